@@ -0,0 +1,407 @@
+#include "../../Public/Core/JobSystem.h"
+
+#include <algorithm>
+#include <iostream>
+
+struct Job
+{
+	std::function<void()> Function;
+	JobCounter* Signal = nullptr;
+	JobAffinity Affinity = JobAffinity::Any;
+};
+
+// Batches per thread for ParallelFor(), a few more than one so stealing can even out uneven batches
+static const uint32_t BatchesPerThread = 4;
+
+// Which pool, and which deque in it, the current thread owns
+static thread_local const JobSystem* CurrentSystem = nullptr;
+static thread_local uint32_t CurrentIndex = 0;
+static thread_local uint32_t StealSeed = 0;
+
+static uint32_t NextRandom(uint32_t& State)
+{
+	// xorshift32, only used to spread steal attempts
+	State ^= State << 13;
+	State ^= State >> 17;
+	State ^= State << 5;
+	return State;
+}
+
+JobSystem::~JobSystem()
+{
+	// Startup can throw before Cleanup() runs, joinable threads must not be destroyed
+	if (!Workers.empty())
+		Shutdown();
+}
+
+void JobSystem::Init(uint32_t WorkerCount)
+{
+	// At least one worker even on a single core: jobs submitted from outside the pool (shader reloads,
+	// background compiles) would otherwise only run while the main thread happens to be inside Wait()
+	if (WorkerCount == 0)
+	{
+		WorkerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+
+	bStopping = false;
+	CurrentSystem = this;
+	CurrentIndex = 0;
+	StealSeed = 0x9E3779B9u;
+
+	for (uint32_t i = 0; i < WorkerCount + 1; ++i)
+	{
+		Queues.push_back(std::make_unique<WorkStealingDeque<Job*>>());
+	}
+	for (uint32_t i = 1; i < WorkerCount + 1; ++i)
+	{
+		Workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> Lock(WakeMutex);
+		bStopping = true;
+	}
+	WakeCondition.notify_all();
+
+	for (std::thread& Worker : Workers)
+	{
+		Worker.join();
+	}
+	Workers.clear();
+
+	Job* Leftover;
+	for (std::unique_ptr<WorkStealingDeque<Job*>>& Queue : Queues)
+	{
+		while (Queue->Steal(Leftover))
+		{
+			delete Leftover;
+		}
+	}
+	Queues.clear();
+
+	std::lock_guard<std::mutex> Lock(SharedMutex);
+	for (Job* Iter : SharedQueue)
+	{
+		delete Iter;
+	}
+	for (Job* Iter : MainThreadQueue)
+	{
+		delete Iter;
+	}
+	for (Job* Iter : BackgroundQueue)
+	{
+		delete Iter;
+	}
+	SharedQueue.clear();
+	MainThreadQueue.clear();
+	BackgroundQueue.clear();
+	SharedCount = 0;
+	BackgroundCount = 0;
+
+	if (CurrentSystem == this)
+		CurrentSystem = nullptr;
+}
+
+void JobSystem::Run(std::function<void()> Function, JobCounter* Signal, JobAffinity Affinity)
+{
+	if (Signal)
+		Signal->Value.fetch_add(1, std::memory_order_relaxed);
+
+	Submit(new Job{ std::move(Function), Signal, Affinity });
+}
+
+void JobSystem::RunAfter(JobCounter& Dependency, std::function<void()> Function, JobCounter* Signal, JobAffinity Affinity)
+{
+	if (Signal)
+		Signal->Value.fetch_add(1, std::memory_order_relaxed);
+
+	Job* NewJob = new Job{ std::move(Function), Signal, Affinity };
+	{
+		// The last job of the dependency takes the list under this lock, so either it sees this job or we see zero
+		std::lock_guard<std::mutex> Lock(Dependency.ContinuationMutex);
+		if (!Dependency.IsDone())
+		{
+			Dependency.Continuations.push_back(NewJob);
+			return;
+		}
+	}
+	Submit(NewJob);
+}
+
+void JobSystem::Wait(JobCounter& Counter)
+{
+	const bool bMainThread = IsMainThread();
+	while (!Counter.IsDone())
+	{
+		if (bMainThread && RunMainThreadJob())
+			continue;
+
+		if (Job* Next = FindJob())
+		{
+			Execute(Next);
+		}
+		else if (Job* Background = FindBackgroundJob(&Counter))
+		{
+			// Waiting on background work, nobody else may be free to run it
+			Execute(Background);
+		}
+		else
+		{
+			// Whatever is left is running on other threads
+			std::this_thread::yield();
+		}
+	}
+
+	// The last job may still be inside the counter's lock, the caller is free to destroy it after this
+	{
+		std::lock_guard<std::mutex> Lock(Counter.ContinuationMutex);
+	}
+
+	if (Counter.bFailed.load(std::memory_order_relaxed))
+	{
+		// Cleared first so the counter can be reused
+		std::exception_ptr Error = Counter.FirstError;
+		Counter.FirstError = nullptr;
+		Counter.bFailed = false;
+		std::rethrow_exception(Error);
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t Count, uint32_t MinBatchSize, const std::function<void(uint32_t Begin, uint32_t End)>& Function)
+{
+	if (Count == 0)
+		return;
+
+	const uint32_t MaxBatches = GetThreadCount() * BatchesPerThread;
+	const uint32_t BatchCount = std::min((Count + std::max(MinBatchSize, 1u) - 1) / std::max(MinBatchSize, 1u), MaxBatches);
+	if (BatchCount <= 1)
+	{
+		Function(0, Count);
+		return;
+	}
+
+	const uint32_t BatchSize = (Count + BatchCount - 1) / BatchCount;
+	JobCounter Counter;
+	for (uint32_t Begin = BatchSize; Begin < Count; Begin += BatchSize)
+	{
+		const uint32_t End = std::min(Begin + BatchSize, Count);
+		Run([&Function, Begin, End]() { Function(Begin, End); }, &Counter);
+	}
+
+	// The batches reference Function and Counter, they have to finish even when ours throws
+	std::exception_ptr Error;
+	try
+	{
+		Function(0, std::min(BatchSize, Count));
+	}
+	catch (...)
+	{
+		Error = std::current_exception();
+	}
+	Wait(Counter);
+
+	if (Error)
+	{
+		std::rethrow_exception(Error);
+	}
+}
+
+void JobSystem::PumpMainThread()
+{
+	while (RunMainThreadJob())
+	{
+	}
+}
+
+bool JobSystem::IsMainThread() const
+{
+	return CurrentSystem == this && CurrentIndex == 0;
+}
+
+uint32_t JobSystem::GetCurrentThreadIndex() const
+{
+	return CurrentSystem == this ? CurrentIndex : UINT32_MAX;
+}
+
+void JobSystem::Submit(Job* NewJob)
+{
+	if (NewJob->Affinity == JobAffinity::MainThread)
+	{
+		// Only the main thread runs these, no worker needs waking
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		MainThreadQueue.push_back(NewJob);
+		return;
+	}
+
+	if (NewJob->Affinity == JobAffinity::Background)
+	{
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		BackgroundQueue.push_back(NewJob);
+		++BackgroundCount;
+	}
+	else if (CurrentSystem == this)
+	{
+		Queues[CurrentIndex]->Push(NewJob);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		SharedQueue.push_back(NewJob);
+		++SharedCount;
+	}
+
+	// Pairs with the epoch check in WorkerLoop(): either a worker about to sleep sees the new epoch,
+	// or we see it counted as sleeping and wake it
+	WakeEpoch.fetch_add(1);
+	if (SleepingWorkers.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(WakeMutex);
+		}
+		WakeCondition.notify_one();
+	}
+}
+
+Job* JobSystem::FindJob()
+{
+	Job* Found = nullptr;
+	const bool bInPool = CurrentSystem == this;
+	if (bInPool && Queues[CurrentIndex]->Pop(Found))
+		return Found;
+
+	if (SharedCount.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		if (!SharedQueue.empty())
+		{
+			Found = SharedQueue.front();
+			SharedQueue.pop_front();
+			--SharedCount;
+			return Found;
+		}
+	}
+
+	// Start at a random victim so thieves don't all hammer the same deque
+	const uint32_t QueueCount = static_cast<uint32_t>(Queues.size());
+	uint32_t LocalSeed = 0x2545F491u;
+	uint32_t& Seed = bInPool ? StealSeed : LocalSeed;
+	const uint32_t Start = NextRandom(Seed) % QueueCount;
+	for (uint32_t i = 0; i < QueueCount; ++i)
+	{
+		const uint32_t Victim = (Start + i) % QueueCount;
+		if (bInPool && Victim == CurrentIndex)
+			continue;
+		if (Queues[Victim]->Steal(Found))
+			return Found;
+	}
+	return nullptr;
+}
+
+Job* JobSystem::FindBackgroundJob(const JobCounter* Signal)
+{
+	if (BackgroundCount.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+
+	std::lock_guard<std::mutex> Lock(SharedMutex);
+	auto Found = std::find_if(BackgroundQueue.begin(), BackgroundQueue.end(), [Signal](const Job* Iter)
+		{
+			return Signal == nullptr || Iter->Signal == Signal;
+		});
+	if (Found == BackgroundQueue.end())
+		return nullptr;
+
+	Job* Next = *Found;
+	BackgroundQueue.erase(Found);
+	--BackgroundCount;
+	return Next;
+}
+
+bool JobSystem::RunMainThreadJob()
+{
+	Job* Next;
+	{
+		std::lock_guard<std::mutex> Lock(SharedMutex);
+		if (MainThreadQueue.empty())
+			return false;
+
+		Next = MainThreadQueue.front();
+		MainThreadQueue.pop_front();
+	}
+	Execute(Next);
+	return true;
+}
+
+void JobSystem::Execute(Job* InJob)
+{
+	JobCounter* Signal = InJob->Signal;
+	try
+	{
+		InJob->Function();
+	}
+	catch (...)
+	{
+		// An exception leaving a worker would terminate the process, Wait() on the counter rethrows it instead
+		if (!Signal)
+			std::cerr << "a job without a counter threw, the exception is dropped\n";
+		else if (!Signal->bFailed.exchange(true))
+			Signal->FirstError = std::current_exception();
+	}
+	delete InJob;
+
+	if (!Signal)
+		return;
+
+	// Only the step to zero takes the lock, it has to be atomic with handing out the continuations
+	int32_t Remaining = Signal->Value.load(std::memory_order_relaxed);
+	while (Remaining > 1)
+	{
+		if (Signal->Value.compare_exchange_weak(Remaining, Remaining - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+			return;
+	}
+
+	std::vector<Job*> Ready;
+	{
+		std::lock_guard<std::mutex> Lock(Signal->ContinuationMutex);
+		if (Signal->Value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Ready.swap(Signal->Continuations);
+	}
+	for (Job* Iter : Ready)
+	{
+		Submit(Iter);
+	}
+}
+
+void JobSystem::WorkerLoop(uint32_t Index)
+{
+	CurrentSystem = this;
+	CurrentIndex = Index;
+	StealSeed = 0x9E3779B9u * (Index + 1);
+
+	while (true)
+	{
+		const uint64_t Epoch = WakeEpoch.load();
+
+		// Short jobs first, a compile can wait for the frame's work to drain
+		if (Job* Next = FindJob())
+		{
+			Execute(Next);
+			continue;
+		}
+		if (Job* Next = FindBackgroundJob(nullptr))
+		{
+			Execute(Next);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> Lock(WakeMutex);
+		if (bStopping)
+			return;
+
+		++SleepingWorkers;
+		WakeCondition.wait(Lock, [this, Epoch]() { return bStopping || WakeEpoch.load() != Epoch; });
+		--SleepingWorkers;
+	}
+}
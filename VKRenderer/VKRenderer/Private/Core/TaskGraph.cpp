@@ -0,0 +1,143 @@
+#include "../../Public/Core/TaskGraph.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+// Width of the bar column in PrintTimeline()
+static const uint32_t TimelineColumns = 48;
+
+static double ToMilliseconds(std::chrono::steady_clock::duration Duration)
+{
+	return std::chrono::duration<double, std::milli>(Duration).count();
+}
+
+TaskId TaskGraph::Add(const std::string& Name, std::function<void()> Function, const std::vector<TaskId>& Dependencies, JobAffinity Affinity)
+{
+	const TaskId Id = static_cast<TaskId>(Tasks.size());
+
+	std::unique_ptr<Task> NewTask = std::make_unique<Task>();
+	NewTask->Name = Name;
+	NewTask->Function = std::move(Function);
+	NewTask->Affinity = Affinity;
+
+	for (TaskId Dependency : Dependencies)
+	{
+		if (Dependency >= Id)
+		{
+			throw std::runtime_error("task " + Name + " depends on a task added after it");
+		}
+		Tasks[Dependency]->Dependents.push_back(Id);
+		++NewTask->DependencyCount;
+	}
+
+	Tasks.push_back(std::move(NewTask));
+	return Id;
+}
+
+void TaskGraph::Run(JobSystem& InJobs)
+{
+	Jobs = &InJobs;
+	bFailed = false;
+	FirstError = nullptr;
+	StartTime = std::chrono::steady_clock::now();
+
+	for (std::unique_ptr<Task>& Iter : Tasks)
+	{
+		Iter->RemainingDependencies = Iter->DependencyCount;
+		Iter->Timing = TaskTiming();
+	}
+
+	for (TaskId Id = 0; Id < Tasks.size(); ++Id)
+	{
+		if (Tasks[Id]->DependencyCount == 0)
+			Launch(Id);
+	}
+	Jobs->Wait(Outstanding);
+
+	TotalTime = std::chrono::steady_clock::now() - StartTime;
+	Jobs = nullptr;
+
+	if (FirstError)
+	{
+		std::rethrow_exception(FirstError);
+	}
+}
+
+void TaskGraph::Launch(TaskId Id)
+{
+	Jobs->Run([this, Id]() { Execute(Id); }, &Outstanding, Tasks[Id]->Affinity);
+}
+
+void TaskGraph::Execute(TaskId Id)
+{
+	Task& Current = *Tasks[Id];
+
+	if (!bFailed)
+	{
+		Current.Timing.Thread = Jobs->GetCurrentThreadIndex();
+		Current.Timing.Start = std::chrono::steady_clock::now() - StartTime;
+		try
+		{
+			Current.Function();
+		}
+		catch (...)
+		{
+			// Only the first error is kept, it is read after Outstanding drained
+			if (!bFailed.exchange(true))
+				FirstError = std::current_exception();
+		}
+		Current.Timing.End = std::chrono::steady_clock::now() - StartTime;
+		Current.Timing.bRan = true;
+	}
+
+	// Dependents are still released after a failure so Outstanding drains, they skip their function
+	for (TaskId Dependent : Current.Dependents)
+	{
+		if (--Tasks[Dependent]->RemainingDependencies == 0)
+			Launch(Dependent);
+	}
+}
+
+void TaskGraph::PrintTimeline(std::ostream& Out) const
+{
+	std::vector<TaskId> Order;
+	size_t NameWidth = 0;
+	for (TaskId Id = 0; Id < Tasks.size(); ++Id)
+	{
+		if (!Tasks[Id]->Timing.bRan)
+			continue;
+
+		Order.push_back(Id);
+		NameWidth = std::max(NameWidth, Tasks[Id]->Name.size());
+	}
+	std::sort(Order.begin(), Order.end(), [this](TaskId A, TaskId B) { return Tasks[A]->Timing.Start < Tasks[B]->Timing.Start; });
+
+	const double Total = std::max(ToMilliseconds(TotalTime), 0.001);
+	Out << std::fixed << std::setprecision(1);
+
+	for (TaskId Id : Order)
+	{
+		const TaskTiming& Timing = Tasks[Id]->Timing;
+		const double Start = ToMilliseconds(Timing.Start);
+		const double End = ToMilliseconds(Timing.End);
+
+		// Bar across the whole run, so overlapping tasks line up
+		std::string Bar(TimelineColumns, ' ');
+		const uint32_t First = std::min(static_cast<uint32_t>(Start / Total * TimelineColumns), TimelineColumns - 1);
+		const uint32_t Last = std::min(static_cast<uint32_t>(End / Total * TimelineColumns), TimelineColumns - 1);
+		std::fill(Bar.begin() + First, Bar.begin() + Last + 1, '#');
+
+		Out << "  " << std::left << std::setw(static_cast<int>(NameWidth)) << Tasks[Id]->Name << std::right
+			<< " |" << Bar << "| "
+			<< std::setw(7) << Start << " +" << std::setw(7) << End - Start << " ms  ";
+		if (Timing.Thread == 0)
+			Out << "main\n";
+		else if (Timing.Thread == UINT32_MAX)
+			Out << "external\n";
+		else
+			Out << "worker " << Timing.Thread << '\n';
+	}
+	Out << "  total " << Total << " ms\n";
+	Out << std::defaultfloat;
+}
@@ -0,0 +1,783 @@
+#include "../../Public/Math/BatchMath.h"
+
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iomanip>
+#include <gtc/matrix_transform.hpp>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BATCHMATH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC accepts AVX2 intrinsics anywhere, the caller makes sure they only run on a capable CPU
+#define BATCHMATH_AVX2_TARGET
+#else
+#define BATCHMATH_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define BATCHMATH_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace BatchMath
+{
+	// Reference
+
+	void Reference::MultiplyMatrices(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			Out[i] = A[i] * B[i];
+		}
+	}
+
+	void Reference::TransformAabbs(const glm::mat4* Matrices, const Aabb* In, Aabb* Out, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			const glm::mat4& M = Matrices[i];
+			const glm::vec3 Center = (In[i].Min + In[i].Max) * 0.5f;
+			const glm::vec3 Extent = (In[i].Max - In[i].Min) * 0.5f;
+
+			// Extent along each world axis is the sum of the rotated/scaled extents projected onto it
+			const glm::vec3 NewCenter = glm::vec3(M * glm::vec4(Center, 1.f));
+			const glm::vec3 NewExtent = glm::abs(glm::vec3(M[0])) * Extent.x + glm::abs(glm::vec3(M[1])) * Extent.y + glm::abs(glm::vec3(M[2])) * Extent.z;
+
+			Out[i].Min = NewCenter - NewExtent;
+			Out[i].Max = NewCenter + NewExtent;
+		}
+	}
+
+	void Reference::CullSpheres(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			uint8_t bVisible = 1;
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				if (glm::dot(glm::vec3(Plane), glm::vec3(Spheres[i])) + Plane.w < -Spheres[i].w)
+					bVisible = 0;
+			}
+			OutVisible[i] = bVisible;
+		}
+	}
+
+	void Reference::CullAabbs(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			const glm::vec3 Center = (Boxes[i].Min + Boxes[i].Max) * 0.5f;
+			const glm::vec3 Extent = (Boxes[i].Max - Boxes[i].Min) * 0.5f;
+
+			uint8_t bVisible = 1;
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				// Distance of the corner furthest along the plane normal
+				const glm::vec3 Normal = glm::vec3(Plane);
+				if (glm::dot(Normal, Center) + Plane.w + glm::dot(glm::abs(Normal), Extent) < 0.f)
+					bVisible = 0;
+			}
+			OutVisible[i] = bVisible;
+		}
+	}
+
+#if defined(BATCHMATH_X86)
+	// SSE
+
+	static inline void MultiplyMatrixSSE(const float* A, const float* B, float* Out)
+	{
+		const __m128 A0 = _mm_loadu_ps(A);
+		const __m128 A1 = _mm_loadu_ps(A + 4);
+		const __m128 A2 = _mm_loadu_ps(A + 8);
+		const __m128 A3 = _mm_loadu_ps(A + 12);
+
+		// Each output column is a linear combination of A's columns weighted by B's column
+		for (int Column = 0; Column < 4; ++Column)
+		{
+			const float* BColumn = B + Column * 4;
+			__m128 Result = _mm_mul_ps(A0, _mm_set1_ps(BColumn[0]));
+			Result = _mm_add_ps(Result, _mm_mul_ps(A1, _mm_set1_ps(BColumn[1])));
+			Result = _mm_add_ps(Result, _mm_mul_ps(A2, _mm_set1_ps(BColumn[2])));
+			Result = _mm_add_ps(Result, _mm_mul_ps(A3, _mm_set1_ps(BColumn[3])));
+			_mm_storeu_ps(Out + Column * 4, Result);
+		}
+	}
+
+	static void MultiplyMatricesSSE(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			MultiplyMatrixSSE(&A[i][0][0], &B[i][0][0], &Out[i][0][0]);
+		}
+	}
+
+	static void TransformAabbsSSE(const glm::mat4* Matrices, const Aabb* In, Aabb* Out, size_t Count)
+	{
+		const __m128 SignMask = _mm_set1_ps(-0.f);
+		const __m128 Half = _mm_set1_ps(0.5f);
+
+		for (size_t i = 0; i < Count; ++i)
+		{
+			const float* M = &Matrices[i][0][0];
+			const __m128 M0 = _mm_loadu_ps(M);
+			const __m128 M1 = _mm_loadu_ps(M + 4);
+			const __m128 M2 = _mm_loadu_ps(M + 8);
+			const __m128 M3 = _mm_loadu_ps(M + 12);
+
+			const __m128 Min = _mm_setr_ps(In[i].Min.x, In[i].Min.y, In[i].Min.z, 0.f);
+			const __m128 Max = _mm_setr_ps(In[i].Max.x, In[i].Max.y, In[i].Max.z, 0.f);
+			const __m128 Center = _mm_mul_ps(_mm_add_ps(Min, Max), Half);
+			const __m128 Extent = _mm_mul_ps(_mm_sub_ps(Max, Min), Half);
+
+			__m128 NewCenter = _mm_add_ps(M3, _mm_mul_ps(M0, _mm_shuffle_ps(Center, Center, _MM_SHUFFLE(0, 0, 0, 0))));
+			NewCenter = _mm_add_ps(NewCenter, _mm_mul_ps(M1, _mm_shuffle_ps(Center, Center, _MM_SHUFFLE(1, 1, 1, 1))));
+			NewCenter = _mm_add_ps(NewCenter, _mm_mul_ps(M2, _mm_shuffle_ps(Center, Center, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			__m128 NewExtent = _mm_mul_ps(_mm_andnot_ps(SignMask, M0), _mm_shuffle_ps(Extent, Extent, _MM_SHUFFLE(0, 0, 0, 0)));
+			NewExtent = _mm_add_ps(NewExtent, _mm_mul_ps(_mm_andnot_ps(SignMask, M1), _mm_shuffle_ps(Extent, Extent, _MM_SHUFFLE(1, 1, 1, 1))));
+			NewExtent = _mm_add_ps(NewExtent, _mm_mul_ps(_mm_andnot_ps(SignMask, M2), _mm_shuffle_ps(Extent, Extent, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			alignas(16) float NewMin[4];
+			alignas(16) float NewMax[4];
+			_mm_store_ps(NewMin, _mm_sub_ps(NewCenter, NewExtent));
+			_mm_store_ps(NewMax, _mm_add_ps(NewCenter, NewExtent));
+			Out[i].Min = glm::vec3(NewMin[0], NewMin[1], NewMin[2]);
+			Out[i].Max = glm::vec3(NewMax[0], NewMax[1], NewMax[2]);
+		}
+	}
+
+	static void CullSpheresSSE(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			// Four spheres, transposed to x/y/z/radius lanes
+			__m128 X = _mm_loadu_ps(&Spheres[i].x);
+			__m128 Y = _mm_loadu_ps(&Spheres[i + 1].x);
+			__m128 Z = _mm_loadu_ps(&Spheres[i + 2].x);
+			__m128 R = _mm_loadu_ps(&Spheres[i + 3].x);
+			_MM_TRANSPOSE4_PS(X, Y, Z, R);
+			const __m128 NegR = _mm_sub_ps(_mm_setzero_ps(), R);
+
+			__m128 Inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				__m128 Distance = _mm_add_ps(_mm_mul_ps(X, _mm_set1_ps(Plane.x)), _mm_set1_ps(Plane.w));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(Y, _mm_set1_ps(Plane.y)));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(Z, _mm_set1_ps(Plane.z)));
+				Inside = _mm_and_ps(Inside, _mm_cmpge_ps(Distance, NegR));
+			}
+
+			const int Mask = _mm_movemask_ps(Inside);
+			for (int Lane = 0; Lane < 4; ++Lane)
+			{
+				OutVisible[i + Lane] = static_cast<uint8_t>((Mask >> Lane) & 1);
+			}
+		}
+		Reference::CullSpheres(InFrustum, Spheres + i, OutVisible + i, Count - i);
+	}
+
+	static void CullAabbsSSE(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count)
+	{
+		const __m128 Half = _mm_set1_ps(0.5f);
+
+		size_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			const Aabb* B = Boxes + i;
+			const __m128 MinX = _mm_setr_ps(B[0].Min.x, B[1].Min.x, B[2].Min.x, B[3].Min.x);
+			const __m128 MinY = _mm_setr_ps(B[0].Min.y, B[1].Min.y, B[2].Min.y, B[3].Min.y);
+			const __m128 MinZ = _mm_setr_ps(B[0].Min.z, B[1].Min.z, B[2].Min.z, B[3].Min.z);
+			const __m128 MaxX = _mm_setr_ps(B[0].Max.x, B[1].Max.x, B[2].Max.x, B[3].Max.x);
+			const __m128 MaxY = _mm_setr_ps(B[0].Max.y, B[1].Max.y, B[2].Max.y, B[3].Max.y);
+			const __m128 MaxZ = _mm_setr_ps(B[0].Max.z, B[1].Max.z, B[2].Max.z, B[3].Max.z);
+
+			const __m128 CX = _mm_mul_ps(_mm_add_ps(MinX, MaxX), Half);
+			const __m128 CY = _mm_mul_ps(_mm_add_ps(MinY, MaxY), Half);
+			const __m128 CZ = _mm_mul_ps(_mm_add_ps(MinZ, MaxZ), Half);
+			const __m128 EX = _mm_mul_ps(_mm_sub_ps(MaxX, MinX), Half);
+			const __m128 EY = _mm_mul_ps(_mm_sub_ps(MaxY, MinY), Half);
+			const __m128 EZ = _mm_mul_ps(_mm_sub_ps(MaxZ, MinZ), Half);
+
+			__m128 Inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				__m128 Distance = _mm_add_ps(_mm_mul_ps(CX, _mm_set1_ps(Plane.x)), _mm_set1_ps(Plane.w));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(CY, _mm_set1_ps(Plane.y)));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(CZ, _mm_set1_ps(Plane.z)));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(EX, _mm_set1_ps(std::abs(Plane.x))));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(EY, _mm_set1_ps(std::abs(Plane.y))));
+				Distance = _mm_add_ps(Distance, _mm_mul_ps(EZ, _mm_set1_ps(std::abs(Plane.z))));
+				Inside = _mm_and_ps(Inside, _mm_cmpge_ps(Distance, _mm_setzero_ps()));
+			}
+
+			const int Mask = _mm_movemask_ps(Inside);
+			for (int Lane = 0; Lane < 4; ++Lane)
+			{
+				OutVisible[i + Lane] = static_cast<uint8_t>((Mask >> Lane) & 1);
+			}
+		}
+		Reference::CullAabbs(InFrustum, Boxes + i, OutVisible + i, Count - i);
+	}
+
+	// AVX2 + FMA
+
+	BATCHMATH_AVX2_TARGET static void MultiplyMatricesAVX2(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			const float* APtr = &A[i][0][0];
+			const float* BPtr = &B[i][0][0];
+			float* OutPtr = &Out[i][0][0];
+
+			// A's columns in both halves, two output columns per iteration
+			const __m256 A0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(APtr));
+			const __m256 A1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(APtr + 4));
+			const __m256 A2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(APtr + 8));
+			const __m256 A3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(APtr + 12));
+
+			for (int Column = 0; Column < 4; Column += 2)
+			{
+				const float* B0 = BPtr + Column * 4;
+				const float* B1 = B0 + 4;
+				__m256 Result = _mm256_mul_ps(A0, _mm256_setr_ps(B0[0], B0[0], B0[0], B0[0], B1[0], B1[0], B1[0], B1[0]));
+				Result = _mm256_fmadd_ps(A1, _mm256_setr_ps(B0[1], B0[1], B0[1], B0[1], B1[1], B1[1], B1[1], B1[1]), Result);
+				Result = _mm256_fmadd_ps(A2, _mm256_setr_ps(B0[2], B0[2], B0[2], B0[2], B1[2], B1[2], B1[2], B1[2]), Result);
+				Result = _mm256_fmadd_ps(A3, _mm256_setr_ps(B0[3], B0[3], B0[3], B0[3], B1[3], B1[3], B1[3], B1[3]), Result);
+				_mm256_storeu_ps(OutPtr + Column * 4, Result);
+			}
+		}
+	}
+
+	BATCHMATH_AVX2_TARGET static void CullSpheresAVX2(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			const glm::vec4* S = Spheres + i;
+			const __m256 X = _mm256_setr_ps(S[0].x, S[1].x, S[2].x, S[3].x, S[4].x, S[5].x, S[6].x, S[7].x);
+			const __m256 Y = _mm256_setr_ps(S[0].y, S[1].y, S[2].y, S[3].y, S[4].y, S[5].y, S[6].y, S[7].y);
+			const __m256 Z = _mm256_setr_ps(S[0].z, S[1].z, S[2].z, S[3].z, S[4].z, S[5].z, S[6].z, S[7].z);
+			const __m256 NegR = _mm256_setr_ps(-S[0].w, -S[1].w, -S[2].w, -S[3].w, -S[4].w, -S[5].w, -S[6].w, -S[7].w);
+
+			__m256 Inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				__m256 Distance = _mm256_fmadd_ps(X, _mm256_set1_ps(Plane.x), _mm256_set1_ps(Plane.w));
+				Distance = _mm256_fmadd_ps(Y, _mm256_set1_ps(Plane.y), Distance);
+				Distance = _mm256_fmadd_ps(Z, _mm256_set1_ps(Plane.z), Distance);
+				Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(Distance, NegR, _CMP_GE_OQ));
+			}
+
+			const int Mask = _mm256_movemask_ps(Inside);
+			for (int Lane = 0; Lane < 8; ++Lane)
+			{
+				OutVisible[i + Lane] = static_cast<uint8_t>((Mask >> Lane) & 1);
+			}
+		}
+		CullSpheresSSE(InFrustum, Spheres + i, OutVisible + i, Count - i);
+	}
+
+	BATCHMATH_AVX2_TARGET static void CullAabbsAVX2(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count)
+	{
+		const __m256 Half = _mm256_set1_ps(0.5f);
+
+		size_t i = 0;
+		for (; i + 8 <= Count; i += 8)
+		{
+			const Aabb* B = Boxes + i;
+			const __m256 MinX = _mm256_setr_ps(B[0].Min.x, B[1].Min.x, B[2].Min.x, B[3].Min.x, B[4].Min.x, B[5].Min.x, B[6].Min.x, B[7].Min.x);
+			const __m256 MinY = _mm256_setr_ps(B[0].Min.y, B[1].Min.y, B[2].Min.y, B[3].Min.y, B[4].Min.y, B[5].Min.y, B[6].Min.y, B[7].Min.y);
+			const __m256 MinZ = _mm256_setr_ps(B[0].Min.z, B[1].Min.z, B[2].Min.z, B[3].Min.z, B[4].Min.z, B[5].Min.z, B[6].Min.z, B[7].Min.z);
+			const __m256 MaxX = _mm256_setr_ps(B[0].Max.x, B[1].Max.x, B[2].Max.x, B[3].Max.x, B[4].Max.x, B[5].Max.x, B[6].Max.x, B[7].Max.x);
+			const __m256 MaxY = _mm256_setr_ps(B[0].Max.y, B[1].Max.y, B[2].Max.y, B[3].Max.y, B[4].Max.y, B[5].Max.y, B[6].Max.y, B[7].Max.y);
+			const __m256 MaxZ = _mm256_setr_ps(B[0].Max.z, B[1].Max.z, B[2].Max.z, B[3].Max.z, B[4].Max.z, B[5].Max.z, B[6].Max.z, B[7].Max.z);
+
+			const __m256 CX = _mm256_mul_ps(_mm256_add_ps(MinX, MaxX), Half);
+			const __m256 CY = _mm256_mul_ps(_mm256_add_ps(MinY, MaxY), Half);
+			const __m256 CZ = _mm256_mul_ps(_mm256_add_ps(MinZ, MaxZ), Half);
+			const __m256 EX = _mm256_mul_ps(_mm256_sub_ps(MaxX, MinX), Half);
+			const __m256 EY = _mm256_mul_ps(_mm256_sub_ps(MaxY, MinY), Half);
+			const __m256 EZ = _mm256_mul_ps(_mm256_sub_ps(MaxZ, MinZ), Half);
+
+			__m256 Inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				__m256 Distance = _mm256_fmadd_ps(CX, _mm256_set1_ps(Plane.x), _mm256_set1_ps(Plane.w));
+				Distance = _mm256_fmadd_ps(CY, _mm256_set1_ps(Plane.y), Distance);
+				Distance = _mm256_fmadd_ps(CZ, _mm256_set1_ps(Plane.z), Distance);
+				Distance = _mm256_fmadd_ps(EX, _mm256_set1_ps(std::abs(Plane.x)), Distance);
+				Distance = _mm256_fmadd_ps(EY, _mm256_set1_ps(std::abs(Plane.y)), Distance);
+				Distance = _mm256_fmadd_ps(EZ, _mm256_set1_ps(std::abs(Plane.z)), Distance);
+				Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(Distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+
+			const int Mask = _mm256_movemask_ps(Inside);
+			for (int Lane = 0; Lane < 8; ++Lane)
+			{
+				OutVisible[i + Lane] = static_cast<uint8_t>((Mask >> Lane) & 1);
+			}
+		}
+		CullAabbsSSE(InFrustum, Boxes + i, OutVisible + i, Count - i);
+	}
+
+	static bool SupportsAVX2()
+	{
+#if defined(_MSC_VER)
+		int Info[4];
+		__cpuid(Info, 0);
+		if (Info[0] < 7)
+			return false;
+
+		__cpuid(Info, 1);
+		const bool bFma = (Info[2] & (1 << 12)) != 0;
+		const bool bOsXsave = (Info[2] & (1 << 27)) != 0;
+		const bool bAvx = (Info[2] & (1 << 28)) != 0;
+		// The OS has to save the YMM registers on context switches too
+		if (!bFma || !bOsXsave || !bAvx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(Info, 7, 0);
+		return (Info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+#endif // BATCHMATH_X86
+
+#if defined(BATCHMATH_NEON)
+	// NEON
+
+	static inline void MultiplyMatrixNEON(const float* A, const float* B, float* Out)
+	{
+		const float32x4_t A0 = vld1q_f32(A);
+		const float32x4_t A1 = vld1q_f32(A + 4);
+		const float32x4_t A2 = vld1q_f32(A + 8);
+		const float32x4_t A3 = vld1q_f32(A + 12);
+
+		for (int Column = 0; Column < 4; ++Column)
+		{
+			const float* BColumn = B + Column * 4;
+			float32x4_t Result = vmulq_n_f32(A0, BColumn[0]);
+			Result = vmlaq_n_f32(Result, A1, BColumn[1]);
+			Result = vmlaq_n_f32(Result, A2, BColumn[2]);
+			Result = vmlaq_n_f32(Result, A3, BColumn[3]);
+			vst1q_f32(Out + Column * 4, Result);
+		}
+	}
+
+	static void MultiplyMatricesNEON(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			MultiplyMatrixNEON(&A[i][0][0], &B[i][0][0], &Out[i][0][0]);
+		}
+	}
+
+	static void TransformAabbsNEON(const glm::mat4* Matrices, const Aabb* In, Aabb* Out, size_t Count)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			const float* M = &Matrices[i][0][0];
+			const float32x4_t M0 = vld1q_f32(M);
+			const float32x4_t M1 = vld1q_f32(M + 4);
+			const float32x4_t M2 = vld1q_f32(M + 8);
+			const float32x4_t M3 = vld1q_f32(M + 12);
+
+			const glm::vec3 Center = (In[i].Min + In[i].Max) * 0.5f;
+			const glm::vec3 Extent = (In[i].Max - In[i].Min) * 0.5f;
+
+			float32x4_t NewCenter = vmlaq_n_f32(M3, M0, Center.x);
+			NewCenter = vmlaq_n_f32(NewCenter, M1, Center.y);
+			NewCenter = vmlaq_n_f32(NewCenter, M2, Center.z);
+
+			float32x4_t NewExtent = vmulq_n_f32(vabsq_f32(M0), Extent.x);
+			NewExtent = vmlaq_n_f32(NewExtent, vabsq_f32(M1), Extent.y);
+			NewExtent = vmlaq_n_f32(NewExtent, vabsq_f32(M2), Extent.z);
+
+			float NewMin[4];
+			float NewMax[4];
+			vst1q_f32(NewMin, vsubq_f32(NewCenter, NewExtent));
+			vst1q_f32(NewMax, vaddq_f32(NewCenter, NewExtent));
+			Out[i].Min = glm::vec3(NewMin[0], NewMin[1], NewMin[2]);
+			Out[i].Max = glm::vec3(NewMax[0], NewMax[1], NewMax[2]);
+		}
+	}
+
+	static void CullSpheresNEON(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			// De-interleaving load, val[0..3] are x/y/z/radius of four spheres
+			const float32x4x4_t S = vld4q_f32(&Spheres[i].x);
+			const float32x4_t NegR = vnegq_f32(S.val[3]);
+
+			uint32x4_t Inside = vdupq_n_u32(~0u);
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				float32x4_t Distance = vmlaq_n_f32(vdupq_n_f32(Plane.w), S.val[0], Plane.x);
+				Distance = vmlaq_n_f32(Distance, S.val[1], Plane.y);
+				Distance = vmlaq_n_f32(Distance, S.val[2], Plane.z);
+				Inside = vandq_u32(Inside, vcgeq_f32(Distance, NegR));
+			}
+
+			uint32_t Lanes[4];
+			vst1q_u32(Lanes, Inside);
+			for (int Lane = 0; Lane < 4; ++Lane)
+			{
+				OutVisible[i + Lane] = Lanes[Lane] != 0 ? 1 : 0;
+			}
+		}
+		Reference::CullSpheres(InFrustum, Spheres + i, OutVisible + i, Count - i);
+	}
+
+	static void CullAabbsNEON(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			float Centers[3][4];
+			float Extents[3][4];
+			for (int Lane = 0; Lane < 4; ++Lane)
+			{
+				const Aabb& Box = Boxes[i + Lane];
+				for (int Axis = 0; Axis < 3; ++Axis)
+				{
+					Centers[Axis][Lane] = (Box.Min[Axis] + Box.Max[Axis]) * 0.5f;
+					Extents[Axis][Lane] = (Box.Max[Axis] - Box.Min[Axis]) * 0.5f;
+				}
+			}
+			const float32x4_t CX = vld1q_f32(Centers[0]), CY = vld1q_f32(Centers[1]), CZ = vld1q_f32(Centers[2]);
+			const float32x4_t EX = vld1q_f32(Extents[0]), EY = vld1q_f32(Extents[1]), EZ = vld1q_f32(Extents[2]);
+
+			uint32x4_t Inside = vdupq_n_u32(~0u);
+			for (const glm::vec4& Plane : InFrustum.Planes)
+			{
+				float32x4_t Distance = vmlaq_n_f32(vdupq_n_f32(Plane.w), CX, Plane.x);
+				Distance = vmlaq_n_f32(Distance, CY, Plane.y);
+				Distance = vmlaq_n_f32(Distance, CZ, Plane.z);
+				Distance = vmlaq_n_f32(Distance, EX, std::abs(Plane.x));
+				Distance = vmlaq_n_f32(Distance, EY, std::abs(Plane.y));
+				Distance = vmlaq_n_f32(Distance, EZ, std::abs(Plane.z));
+				Inside = vandq_u32(Inside, vcgeq_f32(Distance, vdupq_n_f32(0.f)));
+			}
+
+			uint32_t Lanes[4];
+			vst1q_u32(Lanes, Inside);
+			for (int Lane = 0; Lane < 4; ++Lane)
+			{
+				OutVisible[i + Lane] = Lanes[Lane] != 0 ? 1 : 0;
+			}
+		}
+		Reference::CullAabbs(InFrustum, Boxes + i, OutVisible + i, Count - i);
+	}
+#endif // BATCHMATH_NEON
+
+	// Dispatch
+
+	struct KernelTable
+	{
+		SimdLevel Level;
+		void (*MultiplyMatrices)(const glm::mat4*, const glm::mat4*, glm::mat4*, size_t);
+		void (*TransformAabbs)(const glm::mat4*, const Aabb*, Aabb*, size_t);
+		void (*CullSpheres)(const Frustum&, const glm::vec4*, uint8_t*, size_t);
+		void (*CullAabbs)(const Frustum&, const Aabb*, uint8_t*, size_t);
+	};
+
+	static const KernelTable ScalarKernels = { SimdLevel::Scalar, Reference::MultiplyMatrices, Reference::TransformAabbs, Reference::CullSpheres, Reference::CullAabbs };
+#if defined(BATCHMATH_X86)
+	static const KernelTable SSEKernels = { SimdLevel::SSE, MultiplyMatricesSSE, TransformAabbsSSE, CullSpheresSSE, CullAabbsSSE };
+	// The AABB transform is one box per iteration and bound by loads, wider registers do not help it
+	static const KernelTable AVX2Kernels = { SimdLevel::AVX2, MultiplyMatricesAVX2, TransformAabbsSSE, CullSpheresAVX2, CullAabbsAVX2 };
+#endif
+#if defined(BATCHMATH_NEON)
+	static const KernelTable NEONKernels = { SimdLevel::NEON, MultiplyMatricesNEON, TransformAabbsNEON, CullSpheresNEON, CullAabbsNEON };
+#endif
+
+	static const KernelTable* SelectKernels(SimdLevel Requested)
+	{
+#if defined(BATCHMATH_X86)
+		if (Requested == SimdLevel::AVX2 && SupportsAVX2())
+			return &AVX2Kernels;
+		if (Requested == SimdLevel::AVX2 || Requested == SimdLevel::SSE)
+			return &SSEKernels;
+#elif defined(BATCHMATH_NEON)
+		if (Requested == SimdLevel::NEON)
+			return &NEONKernels;
+#endif
+		return &ScalarKernels;
+	}
+
+	static SimdLevel GetWidestLevel()
+	{
+#if defined(BATCHMATH_X86)
+		return SimdLevel::AVX2;
+#elif defined(BATCHMATH_NEON)
+		return SimdLevel::NEON;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	static std::atomic<const KernelTable*>& ActiveKernels()
+	{
+		static std::atomic<const KernelTable*> Kernels{ SelectKernels(GetWidestLevel()) };
+		return Kernels;
+	}
+
+	SimdLevel GetSimdLevel()
+	{
+		return ActiveKernels().load()->Level;
+	}
+
+	const char* GetSimdLevelName(SimdLevel Level)
+	{
+		switch (Level)
+		{
+		case SimdLevel::SSE: return "SSE";
+		case SimdLevel::AVX2: return "AVX2";
+		case SimdLevel::NEON: return "NEON";
+		default: return "scalar";
+		}
+	}
+
+	void ForceSimdLevel(SimdLevel Level)
+	{
+		ActiveKernels() = SelectKernels(Level);
+	}
+
+	void MultiplyMatrix(const glm::mat4& A, const glm::mat4& B, glm::mat4& Out)
+	{
+		// Baseline instruction sets only, too small a call to be worth an indirect jump
+#if defined(BATCHMATH_X86)
+		MultiplyMatrixSSE(&A[0][0], &B[0][0], &Out[0][0]);
+#elif defined(BATCHMATH_NEON)
+		MultiplyMatrixNEON(&A[0][0], &B[0][0], &Out[0][0]);
+#else
+		Out = A * B;
+#endif
+	}
+
+	void MultiplyMatrices(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count)
+	{
+		ActiveKernels().load()->MultiplyMatrices(A, B, Out, Count);
+	}
+
+	void TransformAabbs(const glm::mat4* Matrices, const Aabb* In, Aabb* Out, size_t Count)
+	{
+		ActiveKernels().load()->TransformAabbs(Matrices, In, Out, Count);
+	}
+
+	void CullSpheres(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count)
+	{
+		ActiveKernels().load()->CullSpheres(InFrustum, Spheres, OutVisible, Count);
+	}
+
+	void CullAabbs(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count)
+	{
+		ActiveKernels().load()->CullAabbs(InFrustum, Boxes, OutVisible, Count);
+	}
+
+	Frustum Frustum::FromViewProjection(const glm::mat4& ViewProjection)
+	{
+		// Gribb/Hartmann: clip space bounds as planes built from the rows of the matrix
+		const glm::mat4 T = glm::transpose(ViewProjection);
+		const glm::vec4 Row0 = T[0], Row1 = T[1], Row2 = T[2], Row3 = T[3];
+
+		Frustum Result;
+		Result.Planes[0] = Row3 + Row0;   // left, -w <= x
+		Result.Planes[1] = Row3 - Row0;   // right, x <= w
+		Result.Planes[2] = Row3 + Row1;   // -w <= y
+		Result.Planes[3] = Row3 - Row1;   // y <= w
+		Result.Planes[4] = Row2;          // 0 <= z
+		Result.Planes[5] = Row3 - Row2;   // z <= w
+
+		// Normalized so sphere radii compare in world units. An infinite far plane has no normal and always passes
+		for (glm::vec4& Plane : Result.Planes)
+		{
+			const float Length = glm::length(glm::vec3(Plane));
+			if (Length > 0.f)
+				Plane /= Length;
+		}
+		return Result;
+	}
+
+	// Benchmark
+
+	static bool NearlyEqual(float A, float B)
+	{
+		return std::abs(A - B) <= 1e-4f * std::max(1.f, std::abs(B));
+	}
+
+	static bool NearlyEqual(const glm::vec3& A, const glm::vec3& B)
+	{
+		return NearlyEqual(A.x, B.x) && NearlyEqual(A.y, B.y) && NearlyEqual(A.z, B.z);
+	}
+
+	static bool NearlyEqual(const glm::mat4& A, const glm::mat4& B)
+	{
+		for (int Column = 0; Column < 4; ++Column)
+		{
+			if (!NearlyEqual(glm::vec3(A[Column]), glm::vec3(B[Column])) || !NearlyEqual(A[Column].w, B[Column].w))
+				return false;
+		}
+		return true;
+	}
+
+	// Distance of the sphere/box to the closest plane it could be culled by. Rounding differs between the
+	// kernels (FMA, evaluation order), objects this close to a plane may legitimately come out either way
+	static float GetPlaneMargin(const Frustum& InFrustum, const glm::vec4& Sphere)
+	{
+		float Margin = FLT_MAX;
+		for (const glm::vec4& Plane : InFrustum.Planes)
+		{
+			Margin = std::min(Margin, std::abs(glm::dot(glm::vec3(Plane), glm::vec3(Sphere)) + Plane.w + Sphere.w));
+		}
+		return Margin;
+	}
+
+	static float GetPlaneMargin(const Frustum& InFrustum, const Aabb& Box)
+	{
+		const glm::vec3 Center = (Box.Min + Box.Max) * 0.5f;
+		const glm::vec3 Extent = (Box.Max - Box.Min) * 0.5f;
+
+		float Margin = FLT_MAX;
+		for (const glm::vec4& Plane : InFrustum.Planes)
+		{
+			const glm::vec3 Normal = glm::vec3(Plane);
+			Margin = std::min(Margin, std::abs(glm::dot(Normal, Center) + Plane.w + glm::dot(glm::abs(Normal), Extent)));
+		}
+		return Margin;
+	}
+
+	bool RunBenchmark(size_t Count, std::ostream& Out)
+	{
+		// Affine transforms and objects scattered around a camera, some of them inside its frustum and some outside
+		std::mt19937 Random(1);
+		std::uniform_real_distribution<float> Unit(-1.f, 1.f);
+		std::uniform_real_distribution<float> Size(0.1f, 4.f);
+
+		std::vector<glm::mat4> A(Count), B(Count);
+		std::vector<Aabb> Boxes(Count);
+		std::vector<glm::vec4> Spheres(Count);
+		for (size_t i = 0; i < Count; ++i)
+		{
+			for (glm::mat4* Iter : { &A[i], &B[i] })
+			{
+				for (int Column = 0; Column < 3; ++Column)
+				{
+					(*Iter)[Column] = glm::vec4(Unit(Random) * 2.f, Unit(Random) * 2.f, Unit(Random) * 2.f, 0.f);
+				}
+				(*Iter)[3] = glm::vec4(Unit(Random) * 50.f, Unit(Random) * 50.f, Unit(Random) * 50.f, 1.f);
+			}
+			const glm::vec3 Center(Unit(Random) * 100.f, Unit(Random) * 100.f, Unit(Random) * 100.f);
+			const glm::vec3 Extent(Size(Random), Size(Random), Size(Random));
+			Boxes[i] = Aabb{ Center - Extent, Center + Extent };
+			Spheres[i] = glm::vec4(Center, Size(Random));
+		}
+		const glm::mat4 Projection = glm::perspective(glm::radians(70.f), 16.f / 9.f, 0.1f, 150.f);
+		const Frustum CameraFrustum = Frustum::FromViewProjection(Projection * glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.2f, 0.5f), glm::vec3(0.f, 1.f, 0.f)));
+
+		std::vector<glm::mat4> ReferenceMatrices(Count), Matrices(Count);
+		std::vector<Aabb> ReferenceBoxes(Count), TransformedBoxes(Count);
+		std::vector<uint8_t> ReferenceSpheresVisible(Count), ReferenceBoxesVisible(Count), Visible(Count);
+		Reference::MultiplyMatrices(A.data(), B.data(), ReferenceMatrices.data(), Count);
+		Reference::TransformAabbs(B.data(), Boxes.data(), ReferenceBoxes.data(), Count);
+		Reference::CullSpheres(CameraFrustum, Spheres.data(), ReferenceSpheresVisible.data(), Count);
+		Reference::CullAabbs(CameraFrustum, Boxes.data(), ReferenceBoxesVisible.data(), Count);
+
+		// Best of a few runs, the first one also warms the caches
+		const uint32_t Runs = 5;
+		auto Time = [&](auto&& Kernel)
+		{
+			double Best = DBL_MAX;
+			for (uint32_t Run = 0; Run < Runs; ++Run)
+			{
+				const auto Start = std::chrono::steady_clock::now();
+				Kernel();
+				Best = std::min(Best, std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count());
+			}
+			return static_cast<double>(Count) / Best / 1e6;
+		};
+
+		const SimdLevel Original = GetSimdLevel();
+		bool bPassed = true;
+
+		Out << std::fixed << std::setprecision(1);
+		Out << "math benchmark: " << Count << " elements, Mitems/s\n";
+
+		// MultiplyMatrix is not dispatched, it always uses the baseline instruction set
+		{
+			size_t Mismatches = 0;
+			for (size_t i = 0; i < Count; ++i)
+			{
+				MultiplyMatrix(A[i], B[i], Matrices[i]);
+				Mismatches += NearlyEqual(Matrices[i], ReferenceMatrices[i]) ? 0 : 1;
+			}
+			const double Rate = Time([&]() { for (size_t i = 0; i < Count; ++i) MultiplyMatrix(A[i], B[i], Matrices[i]); });
+			Out << "  single   MultiplyMatrix " << std::setw(8) << Rate << '\n';
+			if (Mismatches > 0)
+			{
+				Out << "  MultiplyMatrix: " << Mismatches << " results differ from the reference\n";
+				bPassed = false;
+			}
+		}
+
+		for (SimdLevel Level : { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2, SimdLevel::NEON })
+		{
+			ForceSimdLevel(Level);
+			if (GetSimdLevel() != Level)
+				continue;
+
+			size_t MatrixMismatches = 0, BoxMismatches = 0, SphereCullMismatches = 0, BoxCullMismatches = 0;
+
+			MultiplyMatrices(A.data(), B.data(), Matrices.data(), Count);
+			TransformAabbs(B.data(), Boxes.data(), TransformedBoxes.data(), Count);
+			for (size_t i = 0; i < Count; ++i)
+			{
+				MatrixMismatches += NearlyEqual(Matrices[i], ReferenceMatrices[i]) ? 0 : 1;
+				BoxMismatches += NearlyEqual(TransformedBoxes[i].Min, ReferenceBoxes[i].Min) && NearlyEqual(TransformedBoxes[i].Max, ReferenceBoxes[i].Max) ? 0 : 1;
+			}
+			CullSpheres(CameraFrustum, Spheres.data(), Visible.data(), Count);
+			for (size_t i = 0; i < Count; ++i)
+			{
+				SphereCullMismatches += Visible[i] == ReferenceSpheresVisible[i] || GetPlaneMargin(CameraFrustum, Spheres[i]) < 1e-3f ? 0 : 1;
+			}
+			CullAabbs(CameraFrustum, Boxes.data(), Visible.data(), Count);
+			for (size_t i = 0; i < Count; ++i)
+			{
+				BoxCullMismatches += Visible[i] == ReferenceBoxesVisible[i] || GetPlaneMargin(CameraFrustum, Boxes[i]) < 1e-3f ? 0 : 1;
+			}
+
+			const double MultiplyRate = Time([&]() { MultiplyMatrices(A.data(), B.data(), Matrices.data(), Count); });
+			const double TransformRate = Time([&]() { TransformAabbs(B.data(), Boxes.data(), TransformedBoxes.data(), Count); });
+			const double SphereRate = Time([&]() { CullSpheres(CameraFrustum, Spheres.data(), Visible.data(), Count); });
+			const double BoxRate = Time([&]() { CullAabbs(CameraFrustum, Boxes.data(), Visible.data(), Count); });
+
+			Out << "  " << std::left << std::setw(8) << GetSimdLevelName(Level) << std::right
+				<< " MultiplyMatrices " << std::setw(8) << MultiplyRate
+				<< "   TransformAabbs " << std::setw(8) << TransformRate
+				<< "   CullSpheres " << std::setw(8) << SphereRate
+				<< "   CullAabbs " << std::setw(8) << BoxRate << '\n';
+
+			if (MatrixMismatches + BoxMismatches + SphereCullMismatches + BoxCullMismatches > 0)
+			{
+				Out << "  " << GetSimdLevelName(Level) << " differs from the reference: " << MatrixMismatches << " matrices, " << BoxMismatches << " boxes, "
+					<< SphereCullMismatches << " sphere and " << BoxCullMismatches << " box culling results\n";
+				bPassed = false;
+			}
+		}
+
+		ForceSimdLevel(Original);
+		Out << std::defaultfloat << (bPassed ? "all levels match the reference\n" : "MISMATCH against the reference\n");
+		return bPassed;
+	}
+}
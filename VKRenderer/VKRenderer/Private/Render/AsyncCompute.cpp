@@ -0,0 +1,180 @@
+#include "../../Public/Render/AsyncCompute.h"
+
+#include <stdexcept>
+
+void AsyncComputeQueue::Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, GpuTimeline* InTimeline, VkQueue InQueue, uint32_t InFamily,
+	uint32_t InGraphicsFamily, uint32_t FramesInFlight)
+{
+	Device = InDevice;
+	Timeline = InTimeline;
+	Queue = InQueue;
+	Family = InFamily;
+	GraphicsFamily = InGraphicsFamily;
+	SharedFamilies[0] = GraphicsFamily;
+	SharedFamilies[1] = Family;
+
+	uint32_t FamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(InPhysicalDevice, &FamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> Families(FamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(InPhysicalDevice, &FamilyCount, Families.data());
+
+	VkPhysicalDeviceProperties Properties;
+	vkGetPhysicalDeviceProperties(InPhysicalDevice, &Properties);
+	TimestampPeriod = Families[Family].timestampValidBits != 0 ? Properties.limits.timestampPeriod : 0.0f;
+
+	Frames.resize(FramesInFlight);
+	for (FrameResources& Frame : Frames)
+	{
+		VkCommandPoolCreateInfo PoolInfo{};
+		PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		PoolInfo.queueFamilyIndex = Family;
+		PoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;   // reset as a whole every frame
+		if (vkCreateCommandPool(Device, &PoolInfo, nullptr, &Frame.Pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create async compute command pool!");
+		}
+
+		if (TimestampPeriod > 0.0f)
+		{
+			VkQueryPoolCreateInfo QueryInfo{};
+			QueryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			QueryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			QueryInfo.queryCount = MaxTimedTasksPerFrame * 2;
+			if (vkCreateQueryPool(Device, &QueryInfo, nullptr, &Frame.Queries) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create async compute query pool!");
+			}
+		}
+	}
+}
+
+void AsyncComputeQueue::Destroy()
+{
+	for (FrameResources& Frame : Frames)
+	{
+		if (Frame.Queries != VK_NULL_HANDLE)
+			vkDestroyQueryPool(Device, Frame.Queries, nullptr);
+		vkDestroyCommandPool(Device, Frame.Pool, nullptr);
+	}
+	Frames.clear();
+	PendingWaits.clear();
+}
+
+void AsyncComputeQueue::BeginFrame(uint32_t FrameIndex)
+{
+	CurrentFrame = FrameIndex;
+	FrameResources& Frame = Frames[CurrentFrame];
+
+	// Usually long complete, unless a task the graphics work did not wait for is still running
+	Timeline->Wait(Frame.LastSubmit);
+
+	LastTimings.clear();
+	if (!Frame.TimedTasks.empty())
+	{
+		const uint32_t QueryCount = static_cast<uint32_t>(Frame.TimedTasks.size()) * 2;
+		std::vector<uint64_t> Ticks(QueryCount);
+		if (vkGetQueryPoolResults(Device, Frame.Queries, 0, QueryCount, Ticks.size() * sizeof(uint64_t), Ticks.data(), sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			for (size_t i = 0; i < Frame.TimedTasks.size(); ++i)
+			{
+				LastTimings.push_back(AsyncComputeTiming{ Frame.TimedTasks[i], (Ticks[i * 2 + 1] - Ticks[i * 2]) * TimestampPeriod / 1e6 });
+			}
+		}
+		Frame.TimedTasks.clear();
+	}
+
+	vkResetCommandPool(Device, Frame.Pool, 0);
+	Frame.UsedCommandBuffers = 0;
+}
+
+GpuSyncPoint AsyncComputeQueue::Submit(const AsyncComputeTask& Task)
+{
+	FrameResources& Frame = Frames[CurrentFrame];
+
+	if (Frame.UsedCommandBuffers == Frame.CommandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo AllocInfo{};
+		AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		AllocInfo.commandPool = Frame.Pool;
+		AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		AllocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer NewBuffer;
+		if (vkAllocateCommandBuffers(Device, &AllocInfo, &NewBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate async compute command buffer!");
+		}
+		Frame.CommandBuffers.push_back(NewBuffer);
+	}
+	VkCommandBuffer Cmd = Frame.CommandBuffers[Frame.UsedCommandBuffers++];
+
+	VkCommandBufferBeginInfo BeginInfo{};
+	BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(Cmd, &BeginInfo);
+
+	// Queries are reset on the GPU right before they are written, the pool is never reset from the host
+	const bool bTimed = Frame.Queries != VK_NULL_HANDLE && Frame.TimedTasks.size() < MaxTimedTasksPerFrame;
+	const uint32_t Query = static_cast<uint32_t>(Frame.TimedTasks.size()) * 2;
+	if (bTimed)
+	{
+		vkCmdResetQueryPool(Cmd, Frame.Queries, Query, 2);
+		vkCmdWriteTimestamp(Cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, Frame.Queries, Query);
+	}
+
+	Task.Record(Cmd);
+
+	if (bTimed)
+	{
+		vkCmdWriteTimestamp(Cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Frame.Queries, Query + 1);
+		Frame.TimedTasks.push_back(Task.Name);
+	}
+
+	if (vkEndCommandBuffer(Cmd) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record async compute task " + Task.Name + "!");
+	}
+
+	TimelineSubmitInfo SubmitInfo;
+	SubmitInfo.CommandBuffers.push_back(Cmd);
+	SubmitInfo.WaitPoints = Task.WaitPoints;
+	SubmitInfo.WaitPointStages = Task.WaitPointStages;
+	SubmitInfo.WaitPointStages.resize(SubmitInfo.WaitPoints.size(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	const GpuSyncPoint Done = Timeline->Submit(Queue, QueueType::Compute, SubmitInfo);
+	Frame.LastSubmit = Done;
+	if (Task.bGraphicsWaits)
+		PendingWaits.push_back(PendingWait{ Done, Task.ConsumerStage });
+	return Done;
+}
+
+void AsyncComputeQueue::AddGraphicsWaits(TimelineSubmitInfo& Info)
+{
+	for (const PendingWait& Iter : PendingWaits)
+	{
+		Info.WaitPoints.push_back(Iter.Point);
+		Info.WaitPointStages.push_back(Iter.Stage);
+	}
+	PendingWaits.clear();
+}
+
+void AsyncComputeQueue::SetSharing(VkBufferCreateInfo& Info) const
+{
+	if (!IsDedicated())
+		return;
+
+	Info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+	Info.queueFamilyIndexCount = 2;
+	Info.pQueueFamilyIndices = SharedFamilies;
+}
+
+void AsyncComputeQueue::SetSharing(VkImageCreateInfo& Info) const
+{
+	if (!IsDedicated())
+		return;
+
+	Info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+	Info.queueFamilyIndexCount = 2;
+	Info.pQueueFamilyIndices = SharedFamilies;
+}
@@ -0,0 +1,455 @@
+#include "../../Public/Render/CascadedShadows.h"
+#include "../../Public/Render/ResidencyManager.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+#include "../../Public/Render/UploadContext.h"
+#include "../../Public/Render/SamplerCache.h"
+#include "../../Public/Render/PipelineLayoutCache.h"
+#include "../../Public/Render/DescriptorAllocator.h"
+#include "../../Public/Math/BatchMath.h"
+
+#include <gtc/matrix_transform.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <filesystem>
+
+void CascadedShadows::Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, ResidencyManager* InResidency, DeferredDeletionQueue* InDeletionQueue,
+	UploadContext* Uploader, SamplerCache* Samplers, PipelineLayoutCache* Layouts, DescriptorSetCache* InDescriptors,
+	const CascadedShadowDesc& InDesc, uint32_t FramesInFlight, const std::string& CasterShader)
+{
+	Device = InDevice;
+	Residency = InResidency;
+	DeletionQueue = InDeletionQueue;
+	Descriptors = InDescriptors;
+	Desc = InDesc;
+
+	if (Desc.CascadeCount == 0 || Desc.CascadeCount > MaxCascades || Desc.Resolution <= 2 || Desc.ShadowDistance <= 0.0f)
+	{
+		throw std::runtime_error("invalid cascaded shadow settings!");
+	}
+
+	bool bLinearFilter = false;
+	DepthFormat = ChooseDepthFormat(InPhysicalDevice, bLinearFilter);
+	CreateImage(Uploader);
+	CreateRenderPass();
+
+	// Hardware compare with reverse-Z: lit where the receiver is at least as close to the light. Outside the
+	// map the border depth 0 (farthest) compares as lit
+	VkSamplerCreateInfo SamplerInfo{};
+	SamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	SamplerInfo.magFilter = bLinearFilter ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	SamplerInfo.minFilter = SamplerInfo.magFilter;
+	SamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	SamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	SamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	SamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+	SamplerInfo.compareEnable = VK_TRUE;
+	SamplerInfo.compareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+	SamplerInfo.maxLod = 0.0f;
+	Sampler = Samplers->Get(SamplerInfo);
+
+	VkPhysicalDeviceProperties Properties;
+	vkGetPhysicalDeviceProperties(InPhysicalDevice, &Properties);
+	const VkDeviceSize Alignment = std::max<VkDeviceSize>(Properties.limits.minUniformBufferOffsetAlignment, 1);
+	CascadeStride = (sizeof(glm::mat4) + Alignment - 1) / Alignment * Alignment;
+
+	Frames.resize(FramesInFlight);
+	for (FrameBuffers& Frame : Frames)
+	{
+		CreateBuffer(GetParamsSize(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, Frame.Params, Frame.ParamsMemory, Frame.MappedParams, Frame.bCoherent);
+		CreateBuffer(CascadeStride * MaxCascades, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, Frame.Cascades, Frame.CascadesMemory, Frame.MappedCascades, Frame.bCoherent);
+
+		// No cascades until the first Update(), receivers skip the lookup
+		std::memset(Frame.MappedParams, 0, GetParamsSize());
+		if (!Frame.bCoherent)
+		{
+			VkMappedMemoryRange Range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Frame.ParamsMemory, 0, VK_WHOLE_SIZE };
+			vkFlushMappedMemoryRanges(Device, 1, &Range);
+		}
+	}
+
+	CreateCasterLayout(Layouts, CasterShader);
+}
+
+void CascadedShadows::Destroy()
+{
+	for (VkFramebuffer Framebuffer : Framebuffers)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_FRAMEBUFFER, Framebuffer);
+	}
+	for (VkImageView View : LayerViews)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, View);
+	}
+	Framebuffers.clear();
+	LayerViews.clear();
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, ArrayView);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE, Image);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_RENDER_PASS, RenderPass);
+	Residency->Free(ImageMemory);
+
+	for (FrameBuffers& Frame : Frames)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, Frame.Params);
+		DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, Frame.Cascades);
+		Residency->Free(Frame.ParamsMemory);
+		Residency->Free(Frame.CascadesMemory);
+	}
+	Frames.clear();
+
+	// The sampler and layouts belong to their caches
+	Image = VK_NULL_HANDLE;
+	ArrayView = VK_NULL_HANDLE;
+	RenderPass = VK_NULL_HANDLE;
+	bEnabled = false;
+}
+
+void CascadedShadows::Update(uint32_t FrameIndex, const glm::mat4& View, float FovY, float Aspect, float NearZ, const glm::vec3& LightDirection,
+	const glm::vec3& LightColor, const glm::vec4* CasterSpheres, const uint8_t* CasterStatic, size_t CasterCount)
+{
+	CurrentFrame = FrameIndex;
+	FrameBuffers& Frame = Frames[CurrentFrame];
+
+	ShadowCascade Fitted[MaxCascades];
+	ComputeCascades(Desc, View, FovY, Aspect, NearZ, LightDirection, Fitted);
+
+	for (uint32_t c = 0; c < Desc.CascadeCount; ++c)
+	{
+		CascadeState& State = Cascades[c];
+		State.Cascade = Fitted[c];
+
+		State.Visible.resize(CasterCount);
+		BatchMath::CullSpheres(BatchMath::Frustum::FromViewProjection(State.Cascade.ViewProj), CasterSpheres, State.Visible.data(), CasterCount);
+
+		bool bDynamicCasters = false;
+		for (size_t i = 0; i < CasterCount && !bDynamicCasters; ++i)
+		{
+			bDynamicCasters = State.Visible[i] && !CasterStatic[i];
+		}
+
+		if (!bEnabled)
+		{
+			State.bDraw = false;
+		}
+		else if (c < Desc.FirstCachedCascade || bDynamicCasters)
+		{
+			State.bDraw = true;
+			State.bCached = false;
+		}
+		else
+		{
+			// Exact compare, snapping keeps the matrix bit identical until the cascade moves by a texel
+			const bool bValid = State.bCached && State.CachedViewProj == State.Cascade.ViewProj && State.CachedGeneration == StaticGeneration;
+			State.bDraw = !bValid;
+			State.bCached = true;
+			State.CachedViewProj = State.Cascade.ViewProj;
+			State.CachedGeneration = StaticGeneration;
+		}
+	}
+
+	ShadowShaderParams Params{};
+	Params.View = View;
+	Params.LightDirection = glm::vec4(glm::normalize(LightDirection), bEnabled ? static_cast<float>(Desc.CascadeCount) : 0.0f);
+	Params.LightColor = glm::vec4(LightColor, 0.0f);
+	Params.Fade = glm::vec4(Desc.ShadowDistance * 0.9f, 1.0f / (Desc.ShadowDistance * 0.1f), 0.0f, 0.0f);
+	for (uint32_t c = 0; c < Desc.CascadeCount; ++c)
+	{
+		const ShadowCascade& Cascade = Cascades[c].Cascade;
+		Params.ViewProj[c] = Cascade.ViewProj;
+		Params.SplitFar[c] = Cascade.SplitFar;
+		Params.NormalOffset[c] = Cascade.TexelWorldSize * Desc.NormalOffsetTexels;
+		std::memcpy(Frame.MappedCascades + c * CascadeStride, &Cascade.ViewProj, sizeof(glm::mat4));
+	}
+	std::memcpy(Frame.MappedParams, &Params, sizeof(Params));
+
+	if (!Frame.bCoherent)
+	{
+		VkMappedMemoryRange Ranges[2] =
+		{
+			{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Frame.ParamsMemory, 0, VK_WHOLE_SIZE },
+			{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Frame.CascadesMemory, 0, VK_WHOLE_SIZE }
+		};
+		vkFlushMappedMemoryRanges(Device, 2, Ranges);
+	}
+}
+
+void CascadedShadows::Record(VkCommandBuffer Cmd, const std::function<void(VkCommandBuffer, uint32_t)>& DrawCascade) const
+{
+	for (uint32_t c = 0; c < Desc.CascadeCount; ++c)
+	{
+		if (!Cascades[c].bDraw)
+			continue;
+
+		VkRenderPassBeginInfo RenderPassInfo{};
+		RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		RenderPassInfo.renderPass = RenderPass;
+		RenderPassInfo.framebuffer = Framebuffers[c];
+		RenderPassInfo.renderArea.offset = { 0, 0 };
+		RenderPassInfo.renderArea.extent = GetExtent();
+
+		VkClearValue ClearDepth{};
+		ClearDepth.depthStencil = { 0.f, 0 };   // reverse-Z far plane
+		RenderPassInfo.clearValueCount = 1;
+		RenderPassInfo.pClearValues = &ClearDepth;
+
+		vkCmdBeginRenderPass(Cmd, &RenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport ViewPort{};
+		ViewPort.width = static_cast<float>(Desc.Resolution);
+		ViewPort.height = static_cast<float>(Desc.Resolution);
+		ViewPort.minDepth = 0.f;
+		ViewPort.maxDepth = 1.f;
+		vkCmdSetViewport(Cmd, 0, 1, &ViewPort);
+
+		VkRect2D Scissor{};
+		Scissor.extent = GetExtent();
+		vkCmdSetScissor(Cmd, 0, 1, &Scissor);
+
+		DrawCascade(Cmd, c);
+		vkCmdEndRenderPass(Cmd);
+	}
+}
+
+void CascadedShadows::ComputeCascades(const CascadedShadowDesc& Desc, const glm::mat4& View, float FovY, float Aspect, float NearZ,
+	const glm::vec3& LightDirection, ShadowCascade* OutCascades)
+{
+	const uint32_t Count = std::min(std::max(Desc.CascadeCount, 1u), MaxCascades);
+	const float FarZ = std::max(Desc.ShadowDistance, NearZ * 2.0f);
+	const float TanY = std::tan(FovY * 0.5f);
+	const float TanX = TanY * Aspect;
+	const float CornerSlopeSq = TanX * TanX + TanY * TanY;   // squared distance of a frustum corner from the view axis per unit of depth
+	const glm::mat4 InvView = glm::inverse(View);
+
+	// Fixed orientation for a given light, the texel grid only depends on the light direction
+	const glm::vec3 Direction = glm::normalize(LightDirection);
+	const glm::vec3 Up = std::abs(Direction.z) > 0.99f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(0.f, 0.f, 1.f);
+	const glm::mat4 LightRotation = glm::lookAt(glm::vec3(0.f), Direction, Up);
+
+	float SplitNear = NearZ;
+	for (uint32_t c = 0; c < Count; ++c)
+	{
+		const float t = static_cast<float>(c + 1) / Count;
+		const float UniformSplit = NearZ + (FarZ - NearZ) * t;
+		const float LogSplit = NearZ * std::pow(FarZ / NearZ, t);
+		const float SplitFar = c + 1 == Count ? FarZ : UniformSplit + (LogSplit - UniformSplit) * Desc.SplitLambda;
+
+		// Smallest sphere around the slice's corners with its center on the view axis. Independent of the
+		// camera's orientation, so the cascade's size never changes while looking around
+		const float CenterDepth = std::min((SplitNear + SplitFar) * (1.0f + CornerSlopeSq) * 0.5f, SplitFar);
+		const float Radius = std::sqrt((SplitFar - CenterDepth) * (SplitFar - CenterDepth) + SplitFar * SplitFar * CornerSlopeSq);
+
+		// One texel of margin on each side absorbs the snapping below
+		const float HalfExtent = Radius * Desc.Resolution / (Desc.Resolution - 2.0f);
+		const float Texel = 2.0f * HalfExtent / Desc.Resolution;
+
+		const glm::vec3 WorldCenter = glm::vec3(InvView * glm::vec4(0.f, 0.f, -CenterDepth, 1.f));
+		const glm::vec3 LightCenter = glm::floor(glm::vec3(LightRotation * glm::vec4(WorldCenter, 1.f)) / Texel) * Texel;
+
+		// Reverse-Z orthographic, depth 1 at the near plane pulled CasterExtension towards the light
+		const float NearDistance = -(LightCenter.z + HalfExtent + Desc.CasterExtension);
+		const float FarDistance = -(LightCenter.z - HalfExtent);
+		glm::mat4 Projection(1.0f);
+		Projection[0][0] = 1.0f / HalfExtent;
+		Projection[1][1] = 1.0f / HalfExtent;
+		Projection[2][2] = 1.0f / (FarDistance - NearDistance);
+		Projection[3][0] = -LightCenter.x / HalfExtent;
+		Projection[3][1] = -LightCenter.y / HalfExtent;
+		Projection[3][2] = FarDistance / (FarDistance - NearDistance);
+
+		ShadowCascade& Cascade = OutCascades[c];
+		Cascade.ViewProj = Projection * LightRotation;
+		Cascade.Sphere = glm::vec4(WorldCenter, Radius);
+		Cascade.SplitNear = SplitNear;
+		Cascade.SplitFar = SplitFar;
+		Cascade.TexelWorldSize = Texel;
+
+		SplitNear = SplitFar;
+	}
+}
+
+uint32_t CascadedShadows::GetDrawnCascadeCount() const
+{
+	uint32_t Result = 0;
+	for (uint32_t c = 0; c < Desc.CascadeCount; ++c)
+	{
+		Result += Cascades[c].bDraw ? 1 : 0;
+	}
+	return Result;
+}
+
+VkDescriptorSet CascadedShadows::GetCascadeDescriptorSet(uint32_t Cascade)
+{
+	DescriptorWrites Writes;
+	Writes.AddBuffer(CasterCascadeBinding.Binding, CasterCascadeBinding.DescriptorType, Frames[CurrentFrame].Cascades, Cascade * CascadeStride, sizeof(glm::mat4));
+	return Descriptors->Get(CasterSetLayout, Writes);
+}
+
+VkFormat CascadedShadows::ChooseDepthFormat(VkPhysicalDevice PhysicalDevice, bool& bOutLinearFilter) const
+{
+	const VkFormatFeatureFlags Required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	for (VkFormat Format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM })
+	{
+		VkFormatProperties Props;
+		vkGetPhysicalDeviceFormatProperties(PhysicalDevice, Format, &Props);
+		if ((Props.optimalTilingFeatures & Required) == Required)
+		{
+			bOutLinearFilter = (Props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+			return Format;
+		}
+	}
+	throw std::runtime_error("no sampled depth format for shadow maps!");
+}
+
+void CascadedShadows::CreateImage(UploadContext* Uploader)
+{
+	VkImageCreateInfo ImageInfo{};
+	ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+	ImageInfo.extent = { Desc.Resolution, Desc.Resolution, 1 };
+	ImageInfo.mipLevels = 1;
+	ImageInfo.arrayLayers = Desc.CascadeCount;
+	ImageInfo.format = DepthFormat;
+	ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	ImageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateImage(Device, &ImageInfo, nullptr, &Image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow map!");
+	}
+
+	VkMemoryRequirements Requirements;
+	vkGetImageMemoryRequirements(Device, Image, &Requirements);
+	ImageMemory = Residency->Allocate(Requirements, MemoryUsage::GpuOnly);
+	vkBindImageMemory(Device, Image, ImageMemory, 0);
+
+	VkImageViewCreateInfo ViewInfo{};
+	ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ViewInfo.image = Image;
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	ViewInfo.format = DepthFormat;
+	ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	ViewInfo.subresourceRange.levelCount = 1;
+	ViewInfo.subresourceRange.layerCount = Desc.CascadeCount;
+	if (vkCreateImageView(Device, &ViewInfo, nullptr, &ArrayView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow map view!");
+	}
+
+	// One attachment view per cascade
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	ViewInfo.subresourceRange.layerCount = 1;
+	LayerViews.resize(Desc.CascadeCount);
+	for (uint32_t c = 0; c < Desc.CascadeCount; ++c)
+	{
+		ViewInfo.subresourceRange.baseArrayLayer = c;
+		if (vkCreateImageView(Device, &ViewInfo, nullptr, &LayerViews[c]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shadow cascade view!");
+		}
+	}
+
+	// Cascades that are not drawn in a frame keep their contents, so the layout is never UNDEFINED after this
+	Uploader->TransitionImage(Image, DepthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void CascadedShadows::CreateRenderPass()
+{
+	// Layout transitions come from the render graph, like the scene passes
+	VkAttachmentDescription DepthAttachment{};
+	DepthAttachment.format = DepthFormat;
+	DepthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	DepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	DepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	DepthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	DepthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	DepthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	DepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference DepthAttachmentRef{};
+	DepthAttachmentRef.attachment = 0;
+	DepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription Subpass{};
+	Subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	Subpass.pDepthStencilAttachment = &DepthAttachmentRef;
+
+	VkRenderPassCreateInfo RenderPassInfo{};
+	RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	RenderPassInfo.attachmentCount = 1;
+	RenderPassInfo.pAttachments = &DepthAttachment;
+	RenderPassInfo.subpassCount = 1;
+	RenderPassInfo.pSubpasses = &Subpass;
+
+	if (vkCreateRenderPass(Device, &RenderPassInfo, nullptr, &RenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow render pass!");
+	}
+
+	Framebuffers.resize(Desc.CascadeCount);
+	for (uint32_t c = 0; c < Desc.CascadeCount; ++c)
+	{
+		VkFramebufferCreateInfo FramebufferInfo{};
+		FramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		FramebufferInfo.renderPass = RenderPass;
+		FramebufferInfo.attachmentCount = 1;
+		FramebufferInfo.pAttachments = &LayerViews[c];
+		FramebufferInfo.width = Desc.Resolution;
+		FramebufferInfo.height = Desc.Resolution;
+		FramebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(Device, &FramebufferInfo, nullptr, &Framebuffers[c]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shadow framebuffer!");
+		}
+	}
+}
+
+void CascadedShadows::CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, VkBuffer& OutBuffer, VkDeviceMemory& OutMemory, uint8_t*& OutMapped, bool& bOutCoherent)
+{
+	VkBufferCreateInfo BufferInfo{};
+	BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	BufferInfo.size = Size;
+	BufferInfo.usage = Usage;
+	BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(Device, &BufferInfo, nullptr, &OutBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow buffer!");
+	}
+
+	VkMemoryRequirements Requirements;
+	vkGetBufferMemoryRequirements(Device, OutBuffer, &Requirements);
+
+	MemoryPlacement Placement;
+	OutMemory = Residency->Allocate(Requirements, MemoryUsage::CpuToGpu, &Placement);
+	vkBindBufferMemory(Device, OutBuffer, OutMemory, 0);
+
+	void* Mapped = nullptr;
+	vkMapMemory(Device, OutMemory, 0, VK_WHOLE_SIZE, 0, &Mapped);
+	OutMapped = static_cast<uint8_t*>(Mapped);
+	bOutCoherent = (Placement.Properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void CascadedShadows::CreateCasterLayout(PipelineLayoutCache* Layouts, const std::string& CasterShader)
+{
+	if (!std::filesystem::exists(CasterShader))
+		return;
+
+	const ReflectedPipelineLayout Layout = Layouts->GetLayout({ CasterShader });
+	const ReflectedBinding* CascadeBinding = Layout.Reflection.FindBinding("ShadowCascade");
+	if (CascadeBinding == nullptr || CascadeBinding->Set != 0 || Layout.Reflection.PushConstants.empty())
+	{
+		throw std::runtime_error(CasterShader + " does not declare ShadowCascade and the object push constants, recompile the shaders!");
+	}
+
+	CasterLayout = Layout.Layout;
+	CasterSetLayout = Layout.SetLayouts[0];
+	CasterCascadeBinding = *CascadeBinding;
+	CasterPushStages = Layout.Reflection.PushConstants[0].stageFlags;
+	bEnabled = true;
+}
@@ -0,0 +1,516 @@
+#include "../../Public/Render/ClusteredLighting.h"
+#include "../../Public/Render/ResidencyManager.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+#include "../../Public/Render/PipelineLayoutCache.h"
+#include "../../Public/Render/DescriptorAllocator.h"
+#include "../../Public/Render/AsyncCompute.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cmath>
+#include <filesystem>
+#include <ostream>
+#include "../../Public/Common/FunctionLibrary.h"
+
+static const char* const BinningBindingNames[5] = { "ClusterParams", "ClusterLights", "ClusterList", "ClusterLightIndices", "ClusterCounter" };
+
+static int GetSlice(const ClusterShaderParams& Params, float Depth)
+{
+	return static_cast<int>(std::floor(std::log2(std::max(Depth, Params.Projection.z)) * Params.SliceScaleBias.x + Params.SliceScaleBias.y));
+}
+
+void ClusteredLighting::Init(VkDevice InDevice, ResidencyManager* InResidency, DeferredDeletionQueue* InDeletionQueue, PipelineLayoutCache* Layouts,
+	DescriptorSetCache* InDescriptors, AsyncComputeQueue* InCompute, const ClusterGridDesc& InDesc, uint32_t FramesInFlight,
+	const std::string& BinningShader)
+{
+	Device = InDevice;
+	Residency = InResidency;
+	DeletionQueue = InDeletionQueue;
+	Descriptors = InDescriptors;
+	Compute = InCompute;
+	Desc = InDesc;
+
+	if (Desc.TilesX == 0 || Desc.TilesY == 0 || Desc.Slices == 0 || Desc.NearZ <= 0.0f || Desc.FarZ <= Desc.NearZ)
+	{
+		throw std::runtime_error("invalid cluster grid!");
+	}
+
+	CreateBinningPipeline(Layouts, BinningShader);
+
+	// The lists are written by the GPU or, without the binning shader, by the CPU every frame
+	const MemoryUsage ListUsage = IsGpuBinning() ? MemoryUsage::GpuOnly : MemoryUsage::CpuToGpu;
+
+	Frames.resize(FramesInFlight);
+	for (FrameBuffers& Frame : Frames)
+	{
+		CreateBuffer(GetParamsSize(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::CpuToGpu, Frame.Params);
+		CreateBuffer(GetLightBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu, Frame.Lights);
+		// Transfer source for VerifyGpuBinning()
+		CreateBuffer(GetClusterBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, ListUsage, Frame.Clusters);
+		CreateBuffer(GetLightIndexBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, ListUsage, Frame.LightIndices);
+		if (IsGpuBinning())
+		{
+			CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, Frame.Counter);
+		}
+
+		// Nothing is lit until the first Update()
+		if (Frame.Clusters.Mapped)
+		{
+			std::memset(Frame.Clusters.Mapped, 0, GetClusterBufferSize());
+			FlushMapped(Frame.Clusters);
+		}
+	}
+}
+
+void ClusteredLighting::Destroy()
+{
+	for (FrameBuffers& Frame : Frames)
+	{
+		DestroyBuffer(Frame.Params);
+		DestroyBuffer(Frame.Lights);
+		DestroyBuffer(Frame.Clusters);
+		DestroyBuffer(Frame.LightIndices);
+		DestroyBuffer(Frame.Counter);
+	}
+	Frames.clear();
+
+	// The layouts belong to the layout cache
+	if (BinningPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(Device, BinningPipeline, nullptr);
+		BinningPipeline = VK_NULL_HANDLE;
+	}
+}
+
+void ClusteredLighting::Update(uint32_t FrameIndex, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params)
+{
+	FrameBuffers& Frame = Frames[FrameIndex];
+
+	const ClusterShaderParams FrameParams = WriteInputs(FrameIndex, Lights, Params);
+	if (IsGpuBinning())
+	{
+		SubmitBinning(FrameIndex);
+		return;
+	}
+
+	const ClusterBinning Binning = BinLights(Desc, Lights, FrameParams);
+	std::memcpy(Frame.Clusters.Mapped, Binning.Clusters.data(), Binning.Clusters.size() * sizeof(glm::uvec2));
+	FlushMapped(Frame.Clusters);
+	if (!Binning.LightIndices.empty())
+	{
+		std::memcpy(Frame.LightIndices.Mapped, Binning.LightIndices.data(), Binning.LightIndices.size() * sizeof(uint32_t));
+		FlushMapped(Frame.LightIndices);
+	}
+}
+
+bool ClusteredLighting::VerifyGpuBinning(VkQueue Queue, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params, std::ostream& Out)
+{
+	if (!IsGpuBinning())
+	{
+		Out << "cluster verification: binned on the CPU, nothing to compare\n";
+		return true;
+	}
+
+	const uint32_t FrameIndex = 0;
+	const FrameBuffers& Frame = Frames[FrameIndex];
+	const ClusterShaderParams FrameParams = WriteInputs(FrameIndex, Lights, Params);
+	const VkDescriptorSet Set = GetBinningSet(FrameIndex);
+
+	MappedBuffer ClusterReadback, IndexReadback;
+	CreateBuffer(GetClusterBufferSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu, ClusterReadback);
+	CreateBuffer(GetLightIndexBufferSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu, IndexReadback);
+
+	VkCommandPoolCreateInfo PoolInfo{};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	PoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	PoolInfo.queueFamilyIndex = Compute->GetFamily();
+	VkCommandPool Pool = VK_NULL_HANDLE;
+	if (vkCreateCommandPool(Device, &PoolInfo, nullptr, &Pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cluster verification command pool!");
+	}
+
+	VkCommandBufferAllocateInfo AllocInfo{};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	AllocInfo.commandPool = Pool;
+	AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	AllocInfo.commandBufferCount = 1;
+	VkCommandBuffer Cmd = VK_NULL_HANDLE;
+	vkAllocateCommandBuffers(Device, &AllocInfo, &Cmd);
+
+	VkCommandBufferBeginInfo BeginInfo{};
+	BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(Cmd, &BeginInfo);
+
+	RecordBinning(Cmd, FrameIndex, Set);
+
+	VkMemoryBarrier Barrier{};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy Copy{ 0, 0, GetClusterBufferSize() };
+	vkCmdCopyBuffer(Cmd, Frame.Clusters.Buffer, ClusterReadback.Buffer, 1, &Copy);
+	Copy.size = GetLightIndexBufferSize();
+	vkCmdCopyBuffer(Cmd, Frame.LightIndices.Buffer, IndexReadback.Buffer, 1, &Copy);
+
+	Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+	vkEndCommandBuffer(Cmd);
+
+	VkSubmitInfo SubmitInfo{};
+	SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	SubmitInfo.commandBufferCount = 1;
+	SubmitInfo.pCommandBuffers = &Cmd;
+	if (vkQueueSubmit(Queue, 1, &SubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit cluster verification!");
+	}
+	vkQueueWaitIdle(Queue);
+	vkDestroyCommandPool(Device, Pool, nullptr);
+
+	for (const MappedBuffer* Iter : { &ClusterReadback, &IndexReadback })
+	{
+		if (!Iter->bCoherent)
+		{
+			VkMappedMemoryRange Range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Iter->Memory, 0, VK_WHOLE_SIZE };
+			vkInvalidateMappedMemoryRanges(Device, 1, &Range);
+		}
+	}
+	const glm::uvec2* GpuClusters = reinterpret_cast<const glm::uvec2*>(ClusterReadback.Mapped);
+	const uint32_t* GpuIndices = reinterpret_cast<const uint32_t*>(IndexReadback.Mapped);
+
+	// Runs are reserved in whatever order the GPU threads get to the counter, compare them as sets. When the
+	// index list overflowed, which runs got cut short depends on that order too, only their lights are checked
+	const ClusterBinning Reference = BinLights(Desc, Lights, FrameParams);
+	uint32_t Mismatches = 0;
+	uint32_t GpuTotal = 0;
+	std::vector<uint32_t> GpuRun, CpuRun;
+	for (uint32_t Cluster = 0; Cluster < GetClusterCount(); ++Cluster)
+	{
+		const glm::uvec2 Range = GpuClusters[Cluster];
+		const glm::uvec2 ReferenceRange = Reference.Clusters[Cluster];
+		GpuTotal += Range.y;
+
+		bool bMatch = Range.x + Range.y <= Desc.MaxLightIndices;
+		if (bMatch)
+		{
+			GpuRun.assign(GpuIndices + Range.x, GpuIndices + Range.x + Range.y);
+			CpuRun.assign(Reference.LightIndices.begin() + ReferenceRange.x, Reference.LightIndices.begin() + ReferenceRange.x + ReferenceRange.y);
+			std::sort(GpuRun.begin(), GpuRun.end());
+			std::sort(CpuRun.begin(), CpuRun.end());
+			bMatch = Reference.Dropped == 0 ? GpuRun == CpuRun : std::includes(CpuRun.begin(), CpuRun.end(), GpuRun.begin(), GpuRun.end());
+		}
+		if (!bMatch && ++Mismatches <= 8)
+		{
+			Out << "  cluster " << Cluster << ": GPU " << Range.y << " lights at " << Range.x << ", CPU " << ReferenceRange.y << " lights\n";
+		}
+	}
+
+	DestroyBuffer(ClusterReadback);
+	DestroyBuffer(IndexReadback);
+
+	Out << "cluster verification: " << Lights.size() << " lights, " << GetClusterCount() << " clusters, " << GpuTotal << " GPU / "
+		<< Reference.LightIndices.size() << " CPU indices" << (Reference.Dropped > 0 ? " (index list full)" : "") << ", "
+		<< Mismatches << " clusters differ\n";
+	return Mismatches == 0;
+}
+
+ClusterShaderParams ClusteredLighting::WriteInputs(uint32_t FrameIndex, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params)
+{
+	FrameBuffers& Frame = Frames[FrameIndex];
+
+	const uint32_t LightCount = static_cast<uint32_t>(std::min<size_t>(Lights.size(), Desc.MaxLights));
+
+	ClusterShaderParams FrameParams = Params;
+	FrameParams.Grid = glm::uvec4(Desc.TilesX, Desc.TilesY, Desc.Slices, LightCount);
+	FrameParams.Limits = glm::uvec4(Desc.MaxLightIndices, 0, 0, 0);
+
+	std::memcpy(Frame.Params.Mapped, &FrameParams, sizeof(FrameParams));
+	FlushMapped(Frame.Params);
+	if (LightCount > 0)
+	{
+		std::memcpy(Frame.Lights.Mapped, Lights.data(), LightCount * sizeof(ClusterLight));
+		FlushMapped(Frame.Lights);
+	}
+	return FrameParams;
+}
+
+ClusterShaderParams ClusteredLighting::MakeParams(const ClusterGridDesc& Desc, float FovY, float Aspect, VkExtent2D Extent, uint32_t LightCount)
+{
+	ClusterShaderParams Params{};
+	Params.View = glm::mat4(1.0f);
+
+	const float Width = static_cast<float>(std::max(Extent.width, 1u));
+	const float Height = static_cast<float>(std::max(Extent.height, 1u));
+	Params.ScreenSize = glm::vec4(Width, Height, 1.0f / Width, 1.0f / Height);
+
+	const float TanY = std::tan(FovY * 0.5f);
+	Params.Projection = glm::vec4(TanY * Aspect, TanY, Desc.NearZ, Desc.FarZ);
+
+	const float LogRange = std::log2(Desc.FarZ / Desc.NearZ);
+	Params.SliceScaleBias = glm::vec4(Desc.Slices / LogRange, -(Desc.Slices * std::log2(Desc.NearZ)) / LogRange, 0.0f, 0.0f);
+
+	Params.Grid = glm::uvec4(Desc.TilesX, Desc.TilesY, Desc.Slices, std::min(LightCount, Desc.MaxLights));
+	Params.Limits = glm::uvec4(Desc.MaxLightIndices, 0, 0, 0);
+	return Params;
+}
+
+ClusterBinning ClusteredLighting::BinLights(const ClusterGridDesc& Desc, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params)
+{
+	const uint32_t TilesPerSlice = Desc.TilesX * Desc.TilesY;
+	const uint32_t ClusterCount = TilesPerSlice * Desc.Slices;
+	const uint32_t LightCount = static_cast<uint32_t>(std::min<size_t>(std::min<size_t>(Lights.size(), Desc.MaxLights), Params.Grid.w));
+	const float NearZ = Params.Projection.z;
+	const float FarZ = Params.Projection.w;
+
+	std::vector<glm::vec3> Mins(ClusterCount);
+	std::vector<glm::vec3> Maxs(ClusterCount);
+	for (uint32_t Slice = 0; Slice < Desc.Slices; ++Slice)
+	{
+		for (uint32_t Y = 0; Y < Desc.TilesY; ++Y)
+		{
+			for (uint32_t X = 0; X < Desc.TilesX; ++X)
+			{
+				const uint32_t Cluster = X + Y * Desc.TilesX + Slice * TilesPerSlice;
+				GetClusterBounds(Params, X, Y, Slice, Mins[Cluster], Maxs[Cluster]);
+			}
+		}
+	}
+
+	// Light order within each cluster, like one GPU thread testing them in turn
+	std::vector<std::vector<uint32_t>> PerCluster(ClusterCount);
+	const glm::mat3 ViewRotation(Params.View);
+	for (uint32_t i = 0; i < LightCount; ++i)
+	{
+		const ClusterLight& Light = Lights[i];
+		const glm::vec3 ViewPosition = glm::vec3(Params.View * glm::vec4(Light.Position, 1.0f));
+		const glm::vec3 ViewDirection = glm::normalize(ViewRotation * Light.Direction);
+
+		// Only the slices the sphere's depth range reaches, widened by one for rounding at the boundaries
+		const float Depth = -ViewPosition.z;
+		if (Depth + Light.Range <= NearZ || Depth - Light.Range >= FarZ)
+			continue;
+		const int FirstSlice = std::max(GetSlice(Params, Depth - Light.Range) - 1, 0);
+		const int LastSlice = std::min(GetSlice(Params, Depth + Light.Range) + 1, static_cast<int>(Desc.Slices) - 1);
+
+		for (int Slice = FirstSlice; Slice <= LastSlice; ++Slice)
+		{
+			for (uint32_t Tile = 0; Tile < TilesPerSlice; ++Tile)
+			{
+				const uint32_t Cluster = Tile + Slice * TilesPerSlice;
+				if (IntersectsCluster(Light, ViewPosition, ViewDirection, Mins[Cluster], Maxs[Cluster]))
+					PerCluster[Cluster].push_back(i);
+			}
+		}
+	}
+
+	ClusterBinning Result;
+	Result.Clusters.resize(ClusterCount);
+	for (uint32_t Cluster = 0; Cluster < ClusterCount; ++Cluster)
+	{
+		const uint32_t Offset = static_cast<uint32_t>(Result.LightIndices.size());
+		const uint32_t Count = static_cast<uint32_t>(PerCluster[Cluster].size());
+		const uint32_t Stored = std::min(Count, Desc.MaxLightIndices - Offset);
+
+		Result.Clusters[Cluster] = glm::uvec2(Offset, Stored);
+		Result.LightIndices.insert(Result.LightIndices.end(), PerCluster[Cluster].begin(), PerCluster[Cluster].begin() + Stored);
+		Result.Dropped += Count - Stored;
+	}
+	return Result;
+}
+
+void ClusteredLighting::GetClusterBounds(const ClusterShaderParams& Params, uint32_t X, uint32_t Y, uint32_t Slice, glm::vec3& OutMin, glm::vec3& OutMax)
+{
+	const float NearZ = Params.Projection.z;
+	const float FarZ = Params.Projection.w;
+	const float Slices = static_cast<float>(Params.Grid.z);
+	const float Depths[2] = { NearZ * std::pow(FarZ / NearZ, Slice / Slices), NearZ * std::pow(FarZ / NearZ, (Slice + 1) / Slices) };
+
+	// NDC of the tile's edges, y points down the screen
+	const float NdcX[2] = { -1.0f + 2.0f * X / Params.Grid.x, -1.0f + 2.0f * (X + 1) / Params.Grid.x };
+	const float NdcY[2] = { -1.0f + 2.0f * Y / Params.Grid.y, -1.0f + 2.0f * (Y + 1) / Params.Grid.y };
+
+	OutMin = glm::vec3(std::numeric_limits<float>::max());
+	OutMax = glm::vec3(-std::numeric_limits<float>::max());
+	for (float Depth : Depths)
+	{
+		for (float Nx : NdcX)
+		{
+			for (float Ny : NdcY)
+			{
+				const glm::vec3 Corner(Nx * Depth * Params.Projection.x, -Ny * Depth * Params.Projection.y, -Depth);
+				OutMin = glm::min(OutMin, Corner);
+				OutMax = glm::max(OutMax, Corner);
+			}
+		}
+	}
+}
+
+bool ClusteredLighting::IntersectsCluster(const ClusterLight& Light, const glm::vec3& ViewPosition, const glm::vec3& ViewDirection, const glm::vec3& Min, const glm::vec3& Max)
+{
+	const glm::vec3 Closest = glm::clamp(ViewPosition, Min, Max) - ViewPosition;
+	if (glm::dot(Closest, Closest) > Light.Range * Light.Range)
+		return false;
+
+	if (Light.Type != ClusterLightType::Spot)
+		return true;
+
+	// Cone against the cluster's bounding sphere
+	const glm::vec3 Center = (Min + Max) * 0.5f;
+	const float Radius = glm::length(Max - Min) * 0.5f;
+	const glm::vec3 ToCenter = Center - ViewPosition;
+	const float AlongAxis = glm::dot(ToCenter, ViewDirection);
+	const float FromAxis = std::sqrt(std::max(glm::dot(ToCenter, ToCenter) - AlongAxis * AlongAxis, 0.0f));
+	const float SinOuterAngle = std::sqrt(std::max(1.0f - Light.CosOuterAngle * Light.CosOuterAngle, 0.0f));
+
+	const bool bOutsideAngle = Light.CosOuterAngle * FromAxis - AlongAxis * SinOuterAngle > Radius;
+	const bool bPastRange = AlongAxis > Radius + Light.Range;
+	const bool bBehind = Light.CosOuterAngle >= 0.0f && AlongAxis < -Radius;
+	return !bOutsideAngle && !bPastRange && !bBehind;
+}
+
+void ClusteredLighting::CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, MemoryUsage Memory, MappedBuffer& Out)
+{
+	VkBufferCreateInfo BufferInfo{};
+	BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	BufferInfo.size = Size;
+	BufferInfo.usage = Usage;
+	BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	Compute->SetSharing(BufferInfo);
+
+	if (vkCreateBuffer(Device, &BufferInfo, nullptr, &Out.Buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cluster lighting buffer!");
+	}
+
+	VkMemoryRequirements Requirements;
+	vkGetBufferMemoryRequirements(Device, Out.Buffer, &Requirements);
+
+	MemoryPlacement Placement;
+	Out.Memory = Residency->Allocate(Requirements, Memory, &Placement);
+	vkBindBufferMemory(Device, Out.Buffer, Out.Memory, 0);
+
+	if (Memory == MemoryUsage::CpuToGpu || Memory == MemoryUsage::GpuToCpu)
+	{
+		void* Mapped = nullptr;
+		vkMapMemory(Device, Out.Memory, 0, VK_WHOLE_SIZE, 0, &Mapped);
+		Out.Mapped = static_cast<uint8_t*>(Mapped);
+		Out.bCoherent = (Placement.Properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	}
+}
+
+void ClusteredLighting::DestroyBuffer(MappedBuffer& Buffer)
+{
+	if (Buffer.Buffer == VK_NULL_HANDLE)
+		return;
+
+	DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, Buffer.Buffer);
+	Residency->Free(Buffer.Memory);
+	Buffer = MappedBuffer();
+}
+
+void ClusteredLighting::FlushMapped(const MappedBuffer& Buffer)
+{
+	if (Buffer.bCoherent)
+		return;
+
+	VkMappedMemoryRange Range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Buffer.Memory, 0, VK_WHOLE_SIZE };
+	vkFlushMappedMemoryRanges(Device, 1, &Range);
+}
+
+void ClusteredLighting::CreateBinningPipeline(PipelineLayoutCache* Layouts, const std::string& BinningShader)
+{
+	if (!std::filesystem::exists(BinningShader))
+		return;
+
+	const ReflectedPipelineLayout Layout = Layouts->GetLayout({ BinningShader });
+	for (uint32_t i = 0; i < 5; ++i)
+	{
+		const ReflectedBinding* Binding = Layout.Reflection.FindBinding(BinningBindingNames[i]);
+		if (Binding == nullptr || Binding->Set != 0)
+		{
+			throw std::runtime_error(BinningShader + " does not declare " + BinningBindingNames[i] + " in set 0!");
+		}
+		BinningBindings[i] = *Binding;
+	}
+	BinningLayout = Layout.Layout;
+	BinningSetLayout = Layout.SetLayouts[0];
+
+	const std::vector<char> Code = ReadFile(BinningShader);
+
+	VkShaderModuleCreateInfo ModuleInfo{};
+	ModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	ModuleInfo.codeSize = Code.size();
+	ModuleInfo.pCode = reinterpret_cast<const uint32_t*>(Code.data());
+
+	VkShaderModule Module;
+	if (vkCreateShaderModule(Device, &ModuleInfo, nullptr, &Module) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module!");
+	}
+
+	VkComputePipelineCreateInfo PipelineInfo{};
+	PipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	PipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	PipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	PipelineInfo.stage.module = Module;
+	PipelineInfo.stage.pName = "main";
+	PipelineInfo.layout = BinningLayout;
+
+	const VkResult Result = vkCreateComputePipelines(Device, VK_NULL_HANDLE, 1, &PipelineInfo, nullptr, &BinningPipeline);
+	vkDestroyShaderModule(Device, Module, nullptr);
+	if (Result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create light binning pipeline!");
+	}
+}
+
+VkDescriptorSet ClusteredLighting::GetBinningSet(uint32_t FrameIndex)
+{
+	const FrameBuffers& Frame = Frames[FrameIndex];
+
+	const MappedBuffer* Buffers[5] = { &Frame.Params, &Frame.Lights, &Frame.Clusters, &Frame.LightIndices, &Frame.Counter };
+	DescriptorWrites Writes;
+	for (uint32_t i = 0; i < 5; ++i)
+	{
+		Writes.AddBuffer(BinningBindings[i].Binding, BinningBindings[i].DescriptorType, Buffers[i]->Buffer, 0, VK_WHOLE_SIZE);
+	}
+	return Descriptors->Get(BinningSetLayout, Writes);
+}
+
+void ClusteredLighting::RecordBinning(VkCommandBuffer Cmd, uint32_t FrameIndex, VkDescriptorSet Set) const
+{
+	const uint32_t GroupCount = (GetClusterCount() + BinningGroupSize - 1) / BinningGroupSize;
+
+	vkCmdFillBuffer(Cmd, Frames[FrameIndex].Counter.Buffer, 0, sizeof(uint32_t), 0);
+
+	VkMemoryBarrier Barrier{};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(Cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, BinningPipeline);
+	vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_COMPUTE, BinningLayout, 0, 1, &Set, 0, nullptr);
+	vkCmdDispatch(Cmd, GroupCount, 1, 1);
+}
+
+void ClusteredLighting::SubmitBinning(uint32_t FrameIndex)
+{
+	const VkDescriptorSet Set = GetBinningSet(FrameIndex);
+
+	AsyncComputeTask Task;
+	Task.Name = "LightBinning";
+	Task.ConsumerStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	Task.Record = [this, FrameIndex, Set](VkCommandBuffer Cmd)
+	{
+		RecordBinning(Cmd, FrameIndex, Set);
+	};
+	Compute->Submit(Task);
+}
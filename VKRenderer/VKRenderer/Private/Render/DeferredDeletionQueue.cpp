@@ -0,0 +1,146 @@
+#include "../../Public/Render/DeferredDeletionQueue.h"
+
+#include <stdexcept>
+
+void DeferredDeletionQueue::Init(VkDevice InDevice, GpuTimeline* InTimeline)
+{
+	Device = InDevice;
+	Timeline = InTimeline;
+}
+
+void DeferredDeletionQueue::RetireCommandBuffer(VkCommandPool Pool, VkCommandBuffer CommandBuffer, const GpuSyncPoint& LastUse)
+{
+	RetireHandle(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)CommandBuffer, (uint64_t)Pool, LastUse, false);
+}
+
+void DeferredDeletionQueue::RetireHandle(VkObjectType Type, uint64_t Handle, uint64_t Owner, const GpuSyncPoint& LastUse, bool bAllQueues)
+{
+	if (Handle == 0)
+		return;
+
+	Entry NewEntry;
+	NewEntry.Type = Type;
+	NewEntry.Handle = Handle;
+	NewEntry.Owner = Owner;
+	NewEntry.WaitValues.fill(0);
+
+	if (bAllQueues)
+	{
+		// Values are only comparable within one queue's semaphore, so snapshot every queue
+		for (size_t i = 0; i < QueueCount; ++i)
+		{
+			NewEntry.WaitValues[i] = Timeline->GetLastSubmitted(static_cast<QueueType>(i)).Value;
+		}
+	}
+	else
+	{
+		NewEntry.WaitValues[static_cast<size_t>(LastUse.Queue)] = LastUse.Value;
+	}
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Entries.push_back(NewEntry);
+}
+
+bool DeferredDeletionQueue::IsComplete(const Entry& InEntry) const
+{
+	for (size_t i = 0; i < QueueCount; ++i)
+	{
+		if (!Timeline->IsComplete(GpuSyncPoint{ static_cast<QueueType>(i), InEntry.WaitValues[i] }))
+			return false;
+	}
+	return true;
+}
+
+void DeferredDeletionQueue::Collect()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	// Stable compaction, keeps the retire order of what is left
+	size_t Kept = 0;
+	for (size_t i = 0; i < Entries.size(); ++i)
+	{
+		if (IsComplete(Entries[i]))
+		{
+			DestroyEntry(Entries[i]);
+		}
+		else
+		{
+			Entries[Kept++] = Entries[i];
+		}
+	}
+	Entries.resize(Kept);
+}
+
+void DeferredDeletionQueue::Flush()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	for (const Entry& Iter : Entries)
+	{
+		DestroyEntry(Iter);
+	}
+	Entries.clear();
+}
+
+size_t DeferredDeletionQueue::GetPendingCount()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Entries.size();
+}
+
+void DeferredDeletionQueue::DestroyEntry(const Entry& InEntry) const
+{
+	switch (InEntry.Type)
+	{
+	case VK_OBJECT_TYPE_BUFFER:
+		vkDestroyBuffer(Device, (VkBuffer)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_IMAGE:
+		vkDestroyImage(Device, (VkImage)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_IMAGE_VIEW:
+		vkDestroyImageView(Device, (VkImageView)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_DEVICE_MEMORY:
+		vkFreeMemory(Device, (VkDeviceMemory)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_SAMPLER:
+		vkDestroySampler(Device, (VkSampler)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_FRAMEBUFFER:
+		vkDestroyFramebuffer(Device, (VkFramebuffer)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_RENDER_PASS:
+		vkDestroyRenderPass(Device, (VkRenderPass)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_PIPELINE:
+		vkDestroyPipeline(Device, (VkPipeline)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+		vkDestroyPipelineLayout(Device, (VkPipelineLayout)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_SHADER_MODULE:
+		vkDestroyShaderModule(Device, (VkShaderModule)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT:
+		vkDestroyDescriptorSetLayout(Device, (VkDescriptorSetLayout)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+		vkDestroyDescriptorPool(Device, (VkDescriptorPool)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_SEMAPHORE:
+		vkDestroySemaphore(Device, (VkSemaphore)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+		vkDestroySwapchainKHR(Device, (VkSwapchainKHR)InEntry.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_COMMAND_BUFFER:
+	{
+		VkCommandBuffer CommandBuffer = (VkCommandBuffer)InEntry.Handle;
+		vkFreeCommandBuffers(Device, (VkCommandPool)InEntry.Owner, 1, &CommandBuffer);
+		break;
+	}
+	default:
+		throw std::runtime_error("deferred deletion of unsupported object type!");
+	}
+}
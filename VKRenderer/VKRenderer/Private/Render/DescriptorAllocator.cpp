@@ -0,0 +1,249 @@
+#include "../../Public/Render/DescriptorAllocator.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+// Pools double until this many sets, beyond that a larger pool only wastes memory
+static const uint32_t MaxSetsPerPool = 4096;
+
+static const uint64_t FnvOffsetBasis = 14695981039346656037ull;
+static const uint64_t FnvPrime = 1099511628211ull;
+
+template<typename T>
+static void HashValue(uint64_t& Hash, const T& Value)
+{
+	const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Value);
+	for (size_t i = 0; i < sizeof(T); ++i)
+	{
+		Hash = (Hash ^ Bytes[i]) * FnvPrime;
+	}
+}
+
+void DescriptorAllocator::Init(VkDevice InDevice, uint32_t InitialSetsPerPool, const std::vector<DescriptorPoolRatio>& InRatios)
+{
+	Device = InDevice;
+	SetsPerPool = std::max(InitialSetsPerPool, 1u);
+	Ratios = InRatios;
+}
+
+void DescriptorAllocator::Destroy()
+{
+	for (VkDescriptorPool Pool : UsedPools)
+	{
+		vkDestroyDescriptorPool(Device, Pool, nullptr);
+	}
+	for (VkDescriptorPool Pool : FreePools)
+	{
+		vkDestroyDescriptorPool(Device, Pool, nullptr);
+	}
+	UsedPools.clear();
+	FreePools.clear();
+	CurrentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout Layout)
+{
+	if (CurrentPool == VK_NULL_HANDLE)
+	{
+		CurrentPool = AcquirePool();
+	}
+
+	VkDescriptorSetAllocateInfo AllocInfo{};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	AllocInfo.descriptorPool = CurrentPool;
+	AllocInfo.descriptorSetCount = 1;
+	AllocInfo.pSetLayouts = &Layout;
+
+	VkDescriptorSet Set;
+	VkResult Result = vkAllocateDescriptorSets(Device, &AllocInfo, &Set);
+	if (Result == VK_ERROR_OUT_OF_POOL_MEMORY || Result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		// This pool is full, the next one is tried once. Failing in a fresh pool means the layout can never fit
+		CurrentPool = AcquirePool();
+		AllocInfo.descriptorPool = CurrentPool;
+		Result = vkAllocateDescriptorSets(Device, &AllocInfo, &Set);
+	}
+
+	if (Result != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate descriptor sets!");
+	}
+	return Set;
+}
+
+void DescriptorAllocator::ResetPools()
+{
+	for (VkDescriptorPool Pool : UsedPools)
+	{
+		vkResetDescriptorPool(Device, Pool, 0);
+	}
+	FreePools.insert(FreePools.end(), UsedPools.begin(), UsedPools.end());
+	UsedPools.clear();
+	CurrentPool = VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::ReleasePools(DeferredDeletionQueue& DeletionQueue)
+{
+	for (VkDescriptorPool Pool : UsedPools)
+	{
+		DeletionQueue.Retire(VK_OBJECT_TYPE_DESCRIPTOR_POOL, Pool);
+	}
+	UsedPools.clear();
+	CurrentPool = VK_NULL_HANDLE;
+}
+
+std::vector<DescriptorPoolRatio> DescriptorAllocator::DefaultRatios()
+{
+	return {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f },
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f }
+	};
+}
+
+VkDescriptorPool DescriptorAllocator::AcquirePool()
+{
+	VkDescriptorPool Pool;
+	if (!FreePools.empty())
+	{
+		Pool = FreePools.back();
+		FreePools.pop_back();
+	}
+	else
+	{
+		std::vector<VkDescriptorPoolSize> PoolSizes;
+		for (const DescriptorPoolRatio& Iter : Ratios)
+		{
+			PoolSizes.push_back(VkDescriptorPoolSize{ Iter.Type, std::max(static_cast<uint32_t>(Iter.Ratio * SetsPerPool), 1u) });
+		}
+
+		// No FREE_DESCRIPTOR_SET_BIT, sets only go away with the whole pool
+		VkDescriptorPoolCreateInfo PoolInfo{};
+		PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		PoolInfo.poolSizeCount = static_cast<uint32_t>(PoolSizes.size());
+		PoolInfo.pPoolSizes = PoolSizes.data();
+		PoolInfo.maxSets = SetsPerPool;
+
+		if (vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &Pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+
+		SetsPerPool = std::min(SetsPerPool * 2, MaxSetsPerPool);
+	}
+
+	UsedPools.push_back(Pool);
+	return Pool;
+}
+
+DescriptorWrites& DescriptorWrites::AddBuffer(uint32_t Binding, VkDescriptorType Type, VkBuffer Buffer, VkDeviceSize Offset, VkDeviceSize Range)
+{
+	Write NewWrite{};
+	NewWrite.Binding = Binding;
+	NewWrite.Type = Type;
+	NewWrite.Buffer = VkDescriptorBufferInfo{ Buffer, Offset, Range };
+	Writes.push_back(NewWrite);
+	return *this;
+}
+
+DescriptorWrites& DescriptorWrites::AddImage(uint32_t Binding, VkDescriptorType Type, VkImageView View, VkSampler Sampler, VkImageLayout Layout)
+{
+	Write NewWrite{};
+	NewWrite.Binding = Binding;
+	NewWrite.Type = Type;
+	NewWrite.Image = VkDescriptorImageInfo{ Sampler, View, Layout };
+	Writes.push_back(NewWrite);
+	return *this;
+}
+
+void DescriptorWrites::Apply(VkDevice Device, VkDescriptorSet Set) const
+{
+	std::vector<VkWriteDescriptorSet> VkWrites(Writes.size());
+	for (size_t i = 0; i < Writes.size(); ++i)
+	{
+		const Write& Iter = Writes[i];
+		const bool bBuffer = Iter.Buffer.buffer != VK_NULL_HANDLE;
+
+		VkWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		VkWrites[i].dstSet = Set;
+		VkWrites[i].dstBinding = Iter.Binding;
+		VkWrites[i].dstArrayElement = 0;
+		VkWrites[i].descriptorType = Iter.Type;
+		VkWrites[i].descriptorCount = 1;
+		VkWrites[i].pBufferInfo = bBuffer ? &Iter.Buffer : nullptr;
+		VkWrites[i].pImageInfo = bBuffer ? nullptr : &Iter.Image;
+	}
+	vkUpdateDescriptorSets(Device, static_cast<uint32_t>(VkWrites.size()), VkWrites.data(), 0, nullptr);
+}
+
+uint64_t DescriptorWrites::Hash(VkDescriptorSetLayout Layout) const
+{
+	uint64_t Result = FnvOffsetBasis;
+	HashValue(Result, Layout);
+
+	// Member by member, the structs may have padding
+	for (const Write& Iter : Writes)
+	{
+		HashValue(Result, Iter.Binding);
+		HashValue(Result, Iter.Type);
+		HashValue(Result, Iter.Buffer.buffer);
+		HashValue(Result, Iter.Buffer.offset);
+		HashValue(Result, Iter.Buffer.range);
+		HashValue(Result, Iter.Image.sampler);
+		HashValue(Result, Iter.Image.imageView);
+		HashValue(Result, Iter.Image.imageLayout);
+	}
+	return Result;
+}
+
+bool DescriptorWrites::operator==(const DescriptorWrites& Other) const
+{
+	return std::equal(Writes.begin(), Writes.end(), Other.Writes.begin(), Other.Writes.end(), [](const Write& A, const Write& B)
+		{
+			return A.Binding == B.Binding && A.Type == B.Type &&
+				A.Buffer.buffer == B.Buffer.buffer && A.Buffer.offset == B.Buffer.offset && A.Buffer.range == B.Buffer.range &&
+				A.Image.sampler == B.Image.sampler && A.Image.imageView == B.Image.imageView && A.Image.imageLayout == B.Image.imageLayout;
+		});
+}
+
+void DescriptorSetCache::Init(VkDevice InDevice)
+{
+	Device = InDevice;
+	Allocator.Init(InDevice);
+}
+
+void DescriptorSetCache::Destroy()
+{
+	Sets.clear();
+	Allocator.Destroy();
+}
+
+VkDescriptorSet DescriptorSetCache::Get(VkDescriptorSetLayout Layout, const DescriptorWrites& Writes)
+{
+	const uint64_t Hash = Writes.Hash(Layout);
+
+	auto Range = Sets.equal_range(Hash);
+	for (auto Iter = Range.first; Iter != Range.second; ++Iter)
+	{
+		if (Iter->second.Layout == Layout && Iter->second.Writes == Writes)
+			return Iter->second.Set;
+	}
+
+	VkDescriptorSet Set = Allocator.Allocate(Layout);
+	Writes.Apply(Device, Set);
+
+	Sets.emplace(Hash, CachedSet{ Layout, Writes, Set });
+	return Set;
+}
+
+void DescriptorSetCache::Clear(DeferredDeletionQueue& DeletionQueue)
+{
+	Sets.clear();
+	Allocator.ReleasePools(DeletionQueue);
+}
@@ -0,0 +1,232 @@
+#include "../../Public/Render/DrawQueue.h"
+#include "../../Public/Core/JobSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+static const uint32_t RadixBits = 8;
+static const uint32_t RadixBuckets = 1u << RadixBits;
+
+// Below this the histogram/scatter passes are too short to be worth splitting across threads
+static const size_t ParallelSortThreshold = 16 * 1024;
+static const uint32_t MaxSortWorkers = 8;
+
+uint32_t DrawSortKey::MakeDepthBucket(float ViewDistance, float MaxDistance, bool bBackToFront)
+{
+	const uint32_t MaxBucket = (1u << DepthBits) - 1;
+
+	const float Normalized = std::min(std::max(ViewDistance / MaxDistance, 0.f), 1.f);
+	const uint32_t Bucket = static_cast<uint32_t>(Normalized * MaxBucket);
+
+	return bBackToFront ? MaxBucket - Bucket : Bucket;
+}
+
+void DrawQueue::Reset()
+{
+	Commands.clear();
+	PushConstants.clear();
+	PushConstantData.clear();
+	Items.clear();
+	bSorted = true;
+	Stats = DrawQueueStats();
+}
+
+void DrawQueue::Add(uint64_t Key, const DrawCommand& Command, const void* PushData, uint32_t PushSize)
+{
+	Items.push_back(SortItem{ Key, static_cast<uint32_t>(Commands.size()) });
+	Commands.push_back(Command);
+
+	PushConstants.push_back(PushConstantRef{ static_cast<uint32_t>(PushConstantData.size()), PushSize });
+	if (PushSize > 0)
+	{
+		const uint8_t* Bytes = static_cast<const uint8_t*>(PushData);
+		PushConstantData.insert(PushConstantData.end(), Bytes, Bytes + PushSize);
+	}
+	bSorted = false;
+}
+
+void DrawQueue::Sort()
+{
+	if (bSorted)
+		return;
+
+	RadixSort(Items, Scratch);
+	bSorted = true;
+}
+
+void DrawQueue::RadixSort(std::vector<SortItem>& InOutItems, std::vector<SortItem>& InScratch)
+{
+	const size_t Count = InOutItems.size();
+	if (Count <= 1)
+		return;
+
+	InScratch.resize(Count);
+
+	uint64_t AnyBits = 0;
+	uint64_t AllBits = ~0ull;
+	for (const SortItem& Item : InOutItems)
+	{
+		AnyBits |= Item.Key;
+		AllBits &= Item.Key;
+	}
+	const uint64_t VaryingBits = AnyBits ^ AllBits;
+
+	uint32_t WorkerCount = 1;
+	if (Jobs && Count >= ParallelSortThreshold)
+	{
+		WorkerCount = std::min(Jobs->GetThreadCount(), MaxSortWorkers);
+	}
+	const size_t ChunkSize = (Count + WorkerCount - 1) / WorkerCount;
+
+	// One histogram per worker, turned into per-worker write offsets so the scatter stays stable
+	std::vector<std::array<uint32_t, RadixBuckets>> Offsets(WorkerCount);
+
+	SortItem* Src = InOutItems.data();
+	SortItem* Dst = InScratch.data();
+
+	for (uint32_t Shift = 0; Shift < 64; Shift += RadixBits)
+	{
+		if (((VaryingBits >> Shift) & (RadixBuckets - 1)) == 0)
+			continue;
+
+		ForEachWorker(WorkerCount, [&](uint32_t Worker)
+			{
+				std::array<uint32_t, RadixBuckets>& Histogram = Offsets[Worker];
+				Histogram.fill(0);
+
+				const size_t Begin = Worker * ChunkSize;
+				const size_t End = std::min(Begin + ChunkSize, Count);
+				for (size_t i = Begin; i < End; ++i)
+				{
+					++Histogram[(Src[i].Key >> Shift) & (RadixBuckets - 1)];
+				}
+			});
+
+		// Digit major, worker minor: worker 0's items of a digit land before worker 1's
+		uint32_t Sum = 0;
+		for (uint32_t Digit = 0; Digit < RadixBuckets; ++Digit)
+		{
+			for (uint32_t Worker = 0; Worker < WorkerCount; ++Worker)
+			{
+				const uint32_t DigitCount = Offsets[Worker][Digit];
+				Offsets[Worker][Digit] = Sum;
+				Sum += DigitCount;
+			}
+		}
+
+		ForEachWorker(WorkerCount, [&](uint32_t Worker)
+			{
+				std::array<uint32_t, RadixBuckets>& WriteOffsets = Offsets[Worker];
+
+				const size_t Begin = Worker * ChunkSize;
+				const size_t End = std::min(Begin + ChunkSize, Count);
+				for (size_t i = Begin; i < End; ++i)
+				{
+					Dst[WriteOffsets[(Src[i].Key >> Shift) & (RadixBuckets - 1)]++] = Src[i];
+				}
+			});
+
+		std::swap(Src, Dst);
+	}
+
+	if (Src != InOutItems.data())
+	{
+		InOutItems.swap(InScratch);
+	}
+}
+
+void DrawQueue::ForEachWorker(uint32_t WorkerCount, const std::function<void(uint32_t)>& Function)
+{
+	if (WorkerCount <= 1)
+	{
+		Function(0);
+		return;
+	}
+
+	// One batch per chunk, the counting passes need a fixed worker -> chunk mapping
+	Jobs->ParallelFor(WorkerCount, 1, [&Function](uint32_t Begin, uint32_t End)
+		{
+			for (uint32_t Worker = Begin; Worker < End; ++Worker)
+			{
+				Function(Worker);
+			}
+		});
+}
+
+void DrawQueue::Execute(VkCommandBuffer CommandBuffer, uint32_t Pass)
+{
+	Sort();
+
+	auto First = std::partition_point(Items.begin(), Items.end(), [Pass](const SortItem& Item) { return DrawSortKey::GetPass(Item.Key) < Pass; });
+	auto Last = std::partition_point(First, Items.end(), [Pass](const SortItem& Item) { return DrawSortKey::GetPass(Item.Key) <= Pass; });
+
+	// Bound state is not carried over between calls, a pass may begin in another command buffer
+	VkPipeline BoundPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout BoundLayout = VK_NULL_HANDLE;
+	VkDescriptorSet BoundSet = VK_NULL_HANDLE;
+	VkBuffer BoundVertexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize BoundVertexOffset = 0;
+	VkBuffer BoundIndexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize BoundIndexOffset = 0;
+	VkIndexType BoundIndexType = VK_INDEX_TYPE_UINT16;
+	// Push constants survive pipeline binds with a compatible layout, identical data is not pushed again
+	const PushConstantRef* PushedConstants = nullptr;
+	VkPipelineLayout PushedLayout = VK_NULL_HANDLE;
+
+	for (auto Iter = First; Iter != Last; ++Iter)
+	{
+		const DrawCommand& Draw = Commands[Iter->Index];
+
+		if (Draw.Pipeline != BoundPipeline)
+		{
+			vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Draw.Pipeline);
+			BoundPipeline = Draw.Pipeline;
+			++Stats.PipelineBinds;
+		}
+
+		// A different layout may not be compatible, rebind the set rather than rely on it
+		if (Draw.DescriptorSet != VK_NULL_HANDLE && (Draw.DescriptorSet != BoundSet || Draw.PipelineLayout != BoundLayout))
+		{
+			vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Draw.PipelineLayout, 0, 1, &Draw.DescriptorSet, 0, nullptr);
+			BoundSet = Draw.DescriptorSet;
+			BoundLayout = Draw.PipelineLayout;
+			++Stats.DescriptorSetBinds;
+		}
+
+		if (Draw.VertexBuffer != BoundVertexBuffer || Draw.VertexBufferOffset != BoundVertexOffset)
+		{
+			vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &Draw.VertexBuffer, &Draw.VertexBufferOffset);
+			BoundVertexBuffer = Draw.VertexBuffer;
+			BoundVertexOffset = Draw.VertexBufferOffset;
+			++Stats.VertexBufferBinds;
+		}
+
+		if (Draw.IndexBuffer != BoundIndexBuffer || Draw.IndexBufferOffset != BoundIndexOffset || Draw.IndexType != BoundIndexType)
+		{
+			vkCmdBindIndexBuffer(CommandBuffer, Draw.IndexBuffer, Draw.IndexBufferOffset, Draw.IndexType);
+			BoundIndexBuffer = Draw.IndexBuffer;
+			BoundIndexOffset = Draw.IndexBufferOffset;
+			BoundIndexType = Draw.IndexType;
+			++Stats.IndexBufferBinds;
+		}
+
+		const PushConstantRef& Push = PushConstants[Iter->Index];
+		if (Push.Size > 0)
+		{
+			const uint8_t* Data = PushConstantData.data() + Push.Offset;
+			const bool bSameData = PushedConstants != nullptr && PushedLayout == Draw.PipelineLayout && PushedConstants->Size == Push.Size &&
+				std::memcmp(PushConstantData.data() + PushedConstants->Offset, Data, Push.Size) == 0;
+			if (!bSameData)
+			{
+				vkCmdPushConstants(CommandBuffer, Draw.PipelineLayout, Draw.PushConstantStages, 0, Push.Size, Data);
+				PushedConstants = &Push;
+				PushedLayout = Draw.PipelineLayout;
+				++Stats.PushConstantUpdates;
+			}
+		}
+
+		vkCmdDrawIndexed(CommandBuffer, Draw.IndexCount, Draw.InstanceCount, Draw.FirstIndex, Draw.VertexOffset, 0);
+		++Stats.Draws;
+	}
+}
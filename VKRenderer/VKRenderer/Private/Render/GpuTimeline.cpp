@@ -0,0 +1,160 @@
+#include "../../Public/Render/GpuTimeline.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+void GpuTimeline::Init(VkDevice InDevice)
+{
+	Device = InDevice;
+
+	VkSemaphoreTypeCreateInfo TypeInfo{};
+	TypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	TypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	TypeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo SemaphoreInfo{};
+	SemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	SemaphoreInfo.pNext = &TypeInfo;
+
+	for (size_t i = 0; i < QueueCount; ++i)
+	{
+		if (vkCreateSemaphore(Device, &SemaphoreInfo, nullptr, &Semaphores[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timeline semaphore!");
+		}
+		LastSubmitted[i] = 0;
+		CompletedCache[i] = 0;
+	}
+}
+
+void GpuTimeline::Destroy()
+{
+	for (size_t i = 0; i < QueueCount; ++i)
+	{
+		if (Semaphores[i] != VK_NULL_HANDLE)
+		{
+			vkDestroySemaphore(Device, Semaphores[i], nullptr);
+			Semaphores[i] = VK_NULL_HANDLE;
+		}
+	}
+}
+
+GpuSyncPoint GpuTimeline::Submit(VkQueue Queue, QueueType Type, const TimelineSubmitInfo& Info)
+{
+	const size_t TypeIndex = static_cast<size_t>(Type);
+
+	std::vector<VkSemaphore> WaitSemaphores;
+	std::vector<uint64_t> WaitValues;
+	std::vector<VkPipelineStageFlags> WaitStages;
+
+	for (size_t i = 0; i < Info.WaitPoints.size(); ++i)
+	{
+		const GpuSyncPoint& Point = Info.WaitPoints[i];
+		if (!Point.IsValid() || (Point.Queue == Type))
+			continue;   // same queue is already ordered by submission
+
+		WaitSemaphores.push_back(GetSemaphore(Point.Queue));
+		WaitValues.push_back(Point.Value);
+		WaitStages.push_back(Info.WaitPointStages[i]);
+	}
+	for (size_t i = 0; i < Info.WaitBinarySemaphores.size(); ++i)
+	{
+		WaitSemaphores.push_back(Info.WaitBinarySemaphores[i]);
+		WaitValues.push_back(0);   // ignored for binary semaphores
+		WaitStages.push_back(Info.WaitBinaryStages[i]);
+	}
+
+	std::vector<VkSemaphore> SignalSemaphores(Info.SignalBinarySemaphores);
+	std::vector<uint64_t> SignalValues(SignalSemaphores.size(), 0);
+	SignalSemaphores.push_back(Semaphores[TypeIndex]);
+	SignalValues.push_back(0);
+
+	std::lock_guard<std::mutex> Lock(SubmitMutex);
+
+	const uint64_t Value = ++Counter;
+	SignalValues.back() = Value;
+
+	VkTimelineSemaphoreSubmitInfo TimelineInfo{};
+	TimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	TimelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(WaitValues.size());
+	TimelineInfo.pWaitSemaphoreValues = WaitValues.data();
+	TimelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(SignalValues.size());
+	TimelineInfo.pSignalSemaphoreValues = SignalValues.data();
+
+	VkSubmitInfo SubmitInfo{};
+	SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	SubmitInfo.pNext = &TimelineInfo;
+	SubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(WaitSemaphores.size());
+	SubmitInfo.pWaitSemaphores = WaitSemaphores.data();
+	SubmitInfo.pWaitDstStageMask = WaitStages.data();
+	SubmitInfo.commandBufferCount = static_cast<uint32_t>(Info.CommandBuffers.size());
+	SubmitInfo.pCommandBuffers = Info.CommandBuffers.data();
+	SubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(SignalSemaphores.size());
+	SubmitInfo.pSignalSemaphores = SignalSemaphores.data();
+
+	if (vkQueueSubmit(Queue, 1, &SubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit command buffer!");
+	}
+
+	LastSubmitted[TypeIndex] = Value;
+
+	return GpuSyncPoint{ Type, Value };
+}
+
+GpuSyncPoint GpuTimeline::GetLastSubmitted(QueueType Type) const
+{
+	return GpuSyncPoint{ Type, LastSubmitted[static_cast<size_t>(Type)].load() };
+}
+
+uint64_t GpuTimeline::GetCompletedValue(QueueType Type)
+{
+	const size_t TypeIndex = static_cast<size_t>(Type);
+
+	uint64_t Value = 0;
+	vkGetSemaphoreCounterValue(Device, Semaphores[TypeIndex], &Value);
+
+	// Only ever moves forward, concurrent callers may race to store
+	uint64_t Cached = CompletedCache[TypeIndex].load();
+	while (Cached < Value && !CompletedCache[TypeIndex].compare_exchange_weak(Cached, Value))
+	{
+	}
+
+	return std::max(Cached, Value);
+}
+
+bool GpuTimeline::IsComplete(const GpuSyncPoint& Point)
+{
+	if (!Point.IsValid() || CompletedCache[static_cast<size_t>(Point.Queue)].load() >= Point.Value)
+		return true;
+
+	return GetCompletedValue(Point.Queue) >= Point.Value;
+}
+
+void GpuTimeline::Wait(const GpuSyncPoint& Point)
+{
+	if (IsComplete(Point))
+		return;
+
+	VkSemaphore Semaphore = GetSemaphore(Point.Queue);
+
+	VkSemaphoreWaitInfo WaitInfo{};
+	WaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	WaitInfo.semaphoreCount = 1;
+	WaitInfo.pSemaphores = &Semaphore;
+	WaitInfo.pValues = &Point.Value;
+
+	if (vkWaitSemaphores(Device, &WaitInfo, UINT64_MAX) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to wait for timeline semaphore!");
+	}
+	GetCompletedValue(Point.Queue);
+}
+
+void GpuTimeline::WaitAll()
+{
+	for (size_t i = 0; i < QueueCount; ++i)
+	{
+		Wait(GetLastSubmitted(static_cast<QueueType>(i)));
+	}
+}
@@ -0,0 +1,97 @@
+#include "../../Public/Render/MemoryPlacement.h"
+
+#include <stdexcept>
+#include <bitset>
+
+// Without resizable BAR the CPU can only reach a 256MB window of VRAM, too small to place geometry in
+static const VkDeviceSize LegacyBarSize = 256ull * 1024 * 1024;
+
+static uint32_t CountBits(VkMemoryPropertyFlags Flags)
+{
+	return static_cast<uint32_t>(std::bitset<32>(Flags).count());
+}
+
+void MemoryPlacementPolicy::Init(VkPhysicalDevice InPhysicalDevice)
+{
+	vkGetPhysicalDeviceMemoryProperties(InPhysicalDevice, &MemProperties);
+
+	bUnifiedMemory = true;
+	for (uint32_t i = 0; i < MemProperties.memoryHeapCount; ++i)
+	{
+		if ((MemProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0)
+			bUnifiedMemory = false;
+	}
+
+	bResizableBar = false;
+	const VkMemoryPropertyFlags Mappable = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	for (uint32_t i = 0; i < MemProperties.memoryTypeCount && !bUnifiedMemory; ++i)
+	{
+		const VkMemoryType& Type = MemProperties.memoryTypes[i];
+		if ((Type.propertyFlags & Mappable) == Mappable && MemProperties.memoryHeaps[Type.heapIndex].size > LegacyBarSize)
+			bResizableBar = true;
+	}
+}
+
+MemoryPlacement MemoryPlacementPolicy::Choose(MemoryUsage Usage, uint32_t TypeFilter) const
+{
+	const VkMemoryPropertyFlags HostMappable = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	int32_t TypeIndex = -1;
+	switch (Usage)
+	{
+	case MemoryUsage::GpuOnly:
+		if (CanWriteDeviceLocalDirectly())
+			TypeIndex = FindType(TypeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | HostMappable, 0, 0);
+		if (TypeIndex < 0)
+			TypeIndex = FindType(TypeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (TypeIndex < 0)
+			TypeIndex = FindType(TypeFilter, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+		break;
+	case MemoryUsage::CpuToGpu:
+		// Small per-frame data is fine in the 256MB BAR window too
+		TypeIndex = FindType(TypeFilter, HostMappable, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		break;
+	case MemoryUsage::GpuToCpu:
+		TypeIndex = FindType(TypeFilter, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0);
+		if (TypeIndex < 0)
+			TypeIndex = FindType(TypeFilter, HostMappable, 0, 0);
+		break;
+	case MemoryUsage::Staging:
+		TypeIndex = FindType(TypeFilter, HostMappable, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		break;
+	}
+
+	if (TypeIndex < 0)
+	{
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	MemoryPlacement Placement;
+	Placement.TypeIndex = static_cast<uint32_t>(TypeIndex);
+	Placement.HeapIndex = MemProperties.memoryTypes[TypeIndex].heapIndex;
+	Placement.Properties = MemProperties.memoryTypes[TypeIndex].propertyFlags;
+	return Placement;
+}
+
+int32_t MemoryPlacementPolicy::FindType(uint32_t TypeFilter, VkMemoryPropertyFlags Required, VkMemoryPropertyFlags Preferred, VkMemoryPropertyFlags Avoided) const
+{
+	int32_t BestIndex = -1;
+	int32_t BestScore = INT32_MIN;
+
+	for (uint32_t i = 0; i < MemProperties.memoryTypeCount; ++i)
+	{
+		const VkMemoryPropertyFlags Flags = MemProperties.memoryTypes[i].propertyFlags;
+		if ((TypeFilter & (1u << i)) == 0 || (Flags & Required) != Required)
+			continue;
+
+		// Earlier types win ties, drivers list the recommended type first
+		const int32_t Score = static_cast<int32_t>(CountBits(Flags & Preferred)) - static_cast<int32_t>(CountBits(Flags & Avoided));
+		if (Score > BestScore)
+		{
+			BestScore = Score;
+			BestIndex = static_cast<int32_t>(i);
+		}
+	}
+
+	return BestIndex;
+}
@@ -0,0 +1,173 @@
+#include "../../Public/Render/PipelineLayoutCache.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+static bool operator==(const VkDescriptorSetLayoutBinding& A, const VkDescriptorSetLayoutBinding& B)
+{
+	// Immutable samplers are compared separately, by value rather than by pointer
+	return A.binding == B.binding && A.descriptorType == B.descriptorType && A.descriptorCount == B.descriptorCount && A.stageFlags == B.stageFlags;
+}
+
+static bool operator==(const VkPushConstantRange& A, const VkPushConstantRange& B)
+{
+	return A.stageFlags == B.stageFlags && A.offset == B.offset && A.size == B.size;
+}
+
+void PipelineLayoutCache::Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice)
+{
+	Device = InDevice;
+
+	VkPhysicalDeviceProperties Properties;
+	vkGetPhysicalDeviceProperties(InPhysicalDevice, &Properties);
+	MaxPushConstantsSize = Properties.limits.maxPushConstantsSize;
+}
+
+void PipelineLayoutCache::Destroy()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	for (PipelineLayoutEntry& Iter : PipelineLayouts)
+	{
+		vkDestroyPipelineLayout(Device, Iter.Layout, nullptr);
+	}
+	for (SetLayoutEntry& Iter : SetLayouts)
+	{
+		vkDestroyDescriptorSetLayout(Device, Iter.Layout, nullptr);
+	}
+	PipelineLayouts.clear();
+	SetLayouts.clear();
+}
+
+ReflectedPipelineLayout PipelineLayoutCache::GetLayout(const std::vector<std::string>& ShaderFiles, const std::unordered_map<std::string, VkSampler>& ImmutableSamplers)
+{
+	ReflectedPipelineLayout Result;
+	for (const std::string& File : ShaderFiles)
+	{
+		Result.Reflection.Merge(ShaderReflection::ReflectFile(File));
+	}
+
+	const ShaderReflection& Reflection = Result.Reflection;
+
+	for (const VkPushConstantRange& Range : Reflection.PushConstants)
+	{
+		if (Range.offset + Range.size > MaxPushConstantsSize)
+		{
+			throw std::runtime_error("push constants use " + std::to_string(Range.offset + Range.size) + " bytes, the device supports " + std::to_string(MaxPushConstantsSize));
+		}
+	}
+
+	const uint32_t SetCount = Reflection.Bindings.empty() ? 0 : Reflection.Bindings.back().Set + 1;
+
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> SetBindings(SetCount);
+	std::vector<std::vector<VkSampler>> BindingSamplers;
+	BindingSamplers.reserve(Reflection.Bindings.size());
+	for (const ReflectedBinding& Iter : Reflection.Bindings)
+	{
+		if (Iter.Count == 0)
+		{
+			throw std::runtime_error("runtime sized descriptor arrays are not supported (" + Iter.Name + ")");
+		}
+
+		VkDescriptorSetLayoutBinding Binding{};
+		Binding.binding = Iter.Binding;
+		Binding.descriptorType = Iter.DescriptorType;
+		Binding.descriptorCount = Iter.Count;
+		Binding.stageFlags = Iter.StageFlags;
+
+		auto Sampler = ImmutableSamplers.find(Iter.Name);
+		if (Sampler != ImmutableSamplers.end())
+		{
+			if (Iter.DescriptorType != VK_DESCRIPTOR_TYPE_SAMPLER && Iter.DescriptorType != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+			{
+				throw std::runtime_error("immutable sampler given for " + Iter.Name + ", which is not a sampler");
+			}
+			BindingSamplers.push_back(std::vector<VkSampler>(Iter.Count, Sampler->second));
+			Binding.pImmutableSamplers = BindingSamplers.back().data();
+		}
+		SetBindings[Iter.Set].push_back(Binding);
+	}
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	for (const std::vector<VkDescriptorSetLayoutBinding>& Bindings : SetBindings)
+	{
+		Result.SetLayouts.push_back(FindOrCreateSetLayout(Bindings));
+	}
+	Result.Layout = FindOrCreatePipelineLayout(Result.SetLayouts, Reflection.PushConstants);
+
+	return Result;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::GetSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& Bindings)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return FindOrCreateSetLayout(Bindings);
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::FindOrCreateSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& Bindings)
+{
+	// Bindings come sorted from reflection, sort anyway so hand-built lists in any order match
+	std::vector<VkDescriptorSetLayoutBinding> Sorted = Bindings;
+	std::sort(Sorted.begin(), Sorted.end(), [](const VkDescriptorSetLayoutBinding& A, const VkDescriptorSetLayoutBinding& B)
+		{
+			return A.binding < B.binding;
+		});
+
+	std::vector<std::vector<VkSampler>> Samplers(Sorted.size());
+	for (size_t i = 0; i < Sorted.size(); ++i)
+	{
+		if (Sorted[i].pImmutableSamplers != nullptr)
+			Samplers[i].assign(Sorted[i].pImmutableSamplers, Sorted[i].pImmutableSamplers + Sorted[i].descriptorCount);
+	}
+
+	for (const SetLayoutEntry& Iter : SetLayouts)
+	{
+		if (Iter.Bindings == Sorted && Iter.Samplers == Samplers)
+			return Iter.Layout;
+	}
+
+	VkDescriptorSetLayoutCreateInfo LayoutInfo{};
+	LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	LayoutInfo.bindingCount = static_cast<uint32_t>(Sorted.size());
+	LayoutInfo.pBindings = Sorted.data();
+
+	VkDescriptorSetLayout Layout;
+	if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &Layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor set layout");
+	}
+
+	// The caller's sampler arrays may be gone by the next lookup
+	for (VkDescriptorSetLayoutBinding& Iter : Sorted)
+	{
+		Iter.pImmutableSamplers = nullptr;
+	}
+	SetLayouts.push_back(SetLayoutEntry{ Sorted, Samplers, Layout });
+	return Layout;
+}
+
+VkPipelineLayout PipelineLayoutCache::FindOrCreatePipelineLayout(const std::vector<VkDescriptorSetLayout>& InSetLayouts, const std::vector<VkPushConstantRange>& PushConstants)
+{
+	for (const PipelineLayoutEntry& Iter : PipelineLayouts)
+	{
+		if (Iter.SetLayouts == InSetLayouts && Iter.PushConstants == PushConstants)
+			return Iter.Layout;
+	}
+
+	VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
+	PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	PipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(InSetLayouts.size());
+	PipelineLayoutInfo.pSetLayouts = InSetLayouts.data();
+	PipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(PushConstants.size());
+	PipelineLayoutInfo.pPushConstantRanges = PushConstants.data();
+
+	VkPipelineLayout Layout;
+	if (vkCreatePipelineLayout(Device, &PipelineLayoutInfo, nullptr, &Layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	PipelineLayouts.push_back(PipelineLayoutEntry{ InSetLayouts, PushConstants, Layout });
+	return Layout;
+}
@@ -0,0 +1,530 @@
+#include "../../Public/Render/PipelineManager.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include "../../Public/Common/FunctionLibrary.h"
+
+static const uint64_t FnvOffsetBasis = 14695981039346656037ull;
+static const uint64_t FnvPrime = 1099511628211ull;
+
+static void HashBytes(uint64_t& Hash, const void* Data, size_t Size)
+{
+	const uint8_t* Bytes = static_cast<const uint8_t*>(Data);
+	for (size_t i = 0; i < Size; ++i)
+	{
+		Hash = (Hash ^ Bytes[i]) * FnvPrime;
+	}
+}
+
+template<typename T>
+static void HashValue(uint64_t& Hash, const T& Value)
+{
+	HashBytes(Hash, &Value, sizeof(T));
+}
+
+static void HashString(uint64_t& Hash, const std::string& Value)
+{
+	HashValue(Hash, Value.size());
+	HashBytes(Hash, Value.data(), Value.size());
+}
+
+uint64_t GraphicsPipelineDesc::Hash() const
+{
+	uint64_t Result = FnvOffsetBasis;
+
+	HashString(Result, VertexShader);
+	HashString(Result, FragmentShader);
+
+	// Member by member, the structs may have padding
+	HashValue(Result, VertexBindings.size());
+	for (const VkVertexInputBindingDescription& Binding : VertexBindings)
+	{
+		HashValue(Result, Binding.binding);
+		HashValue(Result, Binding.stride);
+		HashValue(Result, Binding.inputRate);
+	}
+	HashValue(Result, VertexAttributes.size());
+	for (const VkVertexInputAttributeDescription& Attribute : VertexAttributes)
+	{
+		HashValue(Result, Attribute.location);
+		HashValue(Result, Attribute.binding);
+		HashValue(Result, Attribute.format);
+		HashValue(Result, Attribute.offset);
+	}
+	HashValue(Result, Topology);
+
+	HashValue(Result, PolygonMode);
+	HashValue(Result, CullMode);
+	HashValue(Result, FrontFace);
+
+	HashValue(Result, bDepthTest);
+	HashValue(Result, bDepthWrite);
+	HashValue(Result, DepthCompareOp);
+	HashValue(Result, DepthBiasConstant);
+	HashValue(Result, DepthBiasSlope);
+	HashValue(Result, bAlphaBlend);
+
+	HashValue(Result, Compatibility.ColorFormats.size());
+	for (VkFormat Format : Compatibility.ColorFormats)
+	{
+		HashValue(Result, Format);
+	}
+	HashValue(Result, Compatibility.DepthFormat);
+	HashValue(Result, Compatibility.Samples);
+	HashValue(Result, Compatibility.Subpass);
+
+	HashValue(Result, Layout);
+
+	return Result;
+}
+
+bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc& Other) const
+{
+	auto SameBinding = [](const VkVertexInputBindingDescription& A, const VkVertexInputBindingDescription& B)
+	{
+		return A.binding == B.binding && A.stride == B.stride && A.inputRate == B.inputRate;
+	};
+	auto SameAttribute = [](const VkVertexInputAttributeDescription& A, const VkVertexInputAttributeDescription& B)
+	{
+		return A.location == B.location && A.binding == B.binding && A.format == B.format && A.offset == B.offset;
+	};
+
+	return VertexShader == Other.VertexShader && FragmentShader == Other.FragmentShader &&
+		std::equal(VertexBindings.begin(), VertexBindings.end(), Other.VertexBindings.begin(), Other.VertexBindings.end(), SameBinding) &&
+		std::equal(VertexAttributes.begin(), VertexAttributes.end(), Other.VertexAttributes.begin(), Other.VertexAttributes.end(), SameAttribute) &&
+		Topology == Other.Topology && PolygonMode == Other.PolygonMode && CullMode == Other.CullMode && FrontFace == Other.FrontFace &&
+		bDepthTest == Other.bDepthTest && bDepthWrite == Other.bDepthWrite && DepthCompareOp == Other.DepthCompareOp &&
+		DepthBiasConstant == Other.DepthBiasConstant && DepthBiasSlope == Other.DepthBiasSlope && bAlphaBlend == Other.bAlphaBlend &&
+		Compatibility.ColorFormats == Other.Compatibility.ColorFormats && Compatibility.DepthFormat == Other.Compatibility.DepthFormat &&
+		Compatibility.Samples == Other.Compatibility.Samples && Compatibility.Subpass == Other.Compatibility.Subpass &&
+		Layout == Other.Layout;
+}
+
+void PipelineManager::Init(VkDevice InDevice, const std::string& InCacheFile, JobSystem* InJobs, uint32_t InMaxConcurrentCompiles)
+{
+	Device = InDevice;
+	CacheFile = InCacheFile;
+	Jobs = InJobs;
+	MaxConcurrentCompiles = std::max(InMaxConcurrentCompiles, 1u);
+
+	LoadCache();
+
+	bShuttingDown = false;
+}
+
+void PipelineManager::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> Lock(QueueMutex);
+		bShuttingDown = true;
+		PendingCount -= static_cast<uint32_t>(CompileQueue.size());
+		CompileQueue.clear();
+	}
+	Jobs->Wait(RunningJobs);
+
+	SaveCache();
+
+	for (std::unique_ptr<Entry>& Iter : Entries)
+	{
+		if (Iter->Pipeline.load() != VK_NULL_HANDLE)
+			vkDestroyPipeline(Device, Iter->Pipeline.load(), nullptr);
+		if (Iter->ReloadedPipeline.load() != VK_NULL_HANDLE)
+			vkDestroyPipeline(Device, Iter->ReloadedPipeline.load(), nullptr);
+	}
+	Entries.clear();
+	EntriesByHash.clear();
+
+	vkDestroyPipelineCache(Device, PipelineCache, nullptr);
+	PipelineCache = VK_NULL_HANDLE;
+}
+
+PipelineId PipelineManager::Register(const GraphicsPipelineDesc& Desc, PipelineCompileMode Mode)
+{
+	const uint64_t Hash = Desc.Hash();
+
+	PipelineId Id = InvalidPipelineId;
+	Entry* NewEntry = nullptr;
+	{
+		std::lock_guard<std::mutex> Lock(EntriesMutex);
+
+		auto Range = EntriesByHash.equal_range(Hash);
+		for (auto Iter = Range.first; Iter != Range.second; ++Iter)
+		{
+			if (Entries[Iter->second]->Desc == Desc)
+			{
+				Id = Iter->second;
+				// The render pass it was registered with may be gone by the time a pending compile starts
+				Entries[Id]->Desc.RenderPass = Desc.RenderPass;
+				break;
+			}
+		}
+
+		if (Id == InvalidPipelineId)
+		{
+			Id = static_cast<PipelineId>(Entries.size());
+			Entries.push_back(std::make_unique<Entry>());
+			NewEntry = Entries.back().get();
+			NewEntry->Desc = Desc;
+			NewEntry->Hash = Hash;
+			EntriesByHash.emplace(Hash, Id);
+		}
+	}
+
+	if (NewEntry)
+	{
+		if (Mode == PipelineCompileMode::Blocking)
+		{
+			NewEntry->Pipeline = CreatePipeline(*NewEntry);
+			if (NewEntry->Pipeline.load() == VK_NULL_HANDLE)
+			{
+				throw std::runtime_error("failed to create graphics pipeline");
+			}
+		}
+		else
+		{
+			QueueCompile(Id, false);
+		}
+	}
+
+	return Id;
+}
+
+VkPipeline PipelineManager::Get(PipelineId Id, PipelineId Fallback)
+{
+	std::lock_guard<std::mutex> Lock(EntriesMutex);
+
+	VkPipeline Pipeline = Entries[Id]->Pipeline.load();
+	if (Pipeline == VK_NULL_HANDLE && Fallback != InvalidPipelineId)
+	{
+		Pipeline = Entries[Fallback]->Pipeline.load();
+	}
+	return Pipeline;
+}
+
+bool PipelineManager::IsReady(PipelineId Id)
+{
+	std::lock_guard<std::mutex> Lock(EntriesMutex);
+	return Entries[Id]->Pipeline.load() != VK_NULL_HANDLE;
+}
+
+void PipelineManager::ReloadShader(const std::string& ShaderFile)
+{
+	const std::string Normalized = std::filesystem::path(ShaderFile).lexically_normal().generic_string();
+	auto Matches = [&Normalized](const std::string& File)
+	{
+		return !File.empty() && std::filesystem::path(File).lexically_normal().generic_string() == Normalized;
+	};
+
+	std::vector<PipelineId> Affected;
+	{
+		std::lock_guard<std::mutex> Lock(EntriesMutex);
+		for (size_t i = 0; i < Entries.size(); ++i)
+		{
+			if (Matches(Entries[i]->Desc.VertexShader) || Matches(Entries[i]->Desc.FragmentShader))
+				Affected.push_back(static_cast<PipelineId>(i));
+		}
+	}
+
+	for (PipelineId Id : Affected)
+	{
+		QueueCompile(Id, true);
+	}
+}
+
+void PipelineManager::ApplyReloads(DeferredDeletionQueue& DeletionQueue)
+{
+	if (ReadyReloads.load() == 0)
+		return;
+
+	std::lock_guard<std::mutex> Lock(EntriesMutex);
+	for (std::unique_ptr<Entry>& Iter : Entries)
+	{
+		VkPipeline Reloaded = Iter->ReloadedPipeline.exchange(VK_NULL_HANDLE);
+		if (Reloaded == VK_NULL_HANDLE)
+			continue;
+
+		// Frames still in flight may be using the old pipeline
+		VkPipeline Old = Iter->Pipeline.exchange(Reloaded);
+		if (Old != VK_NULL_HANDLE)
+			DeletionQueue.Retire(VK_OBJECT_TYPE_PIPELINE, Old);
+		--ReadyReloads;
+	}
+}
+
+void PipelineManager::QueueCompile(PipelineId Id, bool bReload)
+{
+	++PendingCount;
+	{
+		std::lock_guard<std::mutex> Lock(QueueMutex);
+		CompileQueue.push_back(CompileJob{ Id, bReload });
+	}
+	StartCompiles();
+}
+
+void PipelineManager::StartCompiles()
+{
+	std::lock_guard<std::mutex> Lock(QueueMutex);
+	while (!bShuttingDown && RunningCompiles < MaxConcurrentCompiles && !CompileQueue.empty())
+	{
+		const CompileJob Job = CompileQueue.front();
+		CompileQueue.pop_front();
+		++RunningCompiles;
+
+		Jobs->Run([this, Job]() { Compile(Job); }, &RunningJobs, JobAffinity::Background);
+	}
+}
+
+void PipelineManager::Compile(const CompileJob& Job)
+{
+	Entry* Target;
+	{
+		std::lock_guard<std::mutex> Lock(EntriesMutex);
+		Target = Entries[Job.Id].get();
+	}
+
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	try
+	{
+		Pipeline = CreatePipeline(*Target);
+	}
+	catch (const std::exception& Error)
+	{
+		// A shader file that can't be read (mid-save during a reload) is a failed compile like any other,
+		// throwing would only surface in Destroy() and leave the compile slot taken
+		std::cerr << "pipeline compile failed (" << Target->Desc.VertexShader << ", " << Target->Desc.FragmentShader << "): " << Error.what() << "\n";
+	}
+
+	if (!Job.bReload)
+	{
+		// A failed compile leaves the entry empty (draws fall back or are skipped) until a reload of its shaders
+		Target->Pipeline = Pipeline;
+	}
+	else if (Pipeline != VK_NULL_HANDLE)
+	{
+		// Swapped in by ApplyReloads() on the render thread. A newer edit may land before that, the
+		// pipeline it replaces here was never used and can be destroyed right away
+		VkPipeline Superseded = Target->ReloadedPipeline.exchange(Pipeline);
+		if (Superseded != VK_NULL_HANDLE)
+			vkDestroyPipeline(Device, Superseded, nullptr);
+		else
+			++ReadyReloads;
+	}
+	// A failed reload keeps the current pipeline, the error has been logged
+
+	--PendingCount;
+	{
+		std::lock_guard<std::mutex> Lock(QueueMutex);
+		--RunningCompiles;
+	}
+	StartCompiles();
+}
+
+VkShaderModule PipelineManager::LoadShaderModule(const std::string& FileName)
+{
+	std::vector<char> Code = ReadFile(FileName);
+
+	VkShaderModuleCreateInfo CreateInfo{};
+	CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	CreateInfo.codeSize = Code.size();
+	CreateInfo.pCode = reinterpret_cast<const uint32_t*>(Code.data());
+
+	VkShaderModule ShaderModule;
+	if (vkCreateShaderModule(Device, &CreateInfo, nullptr, &ShaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module!");
+	}
+	return ShaderModule;
+}
+
+VkPipeline PipelineManager::CreatePipeline(const Entry& InEntry)
+{
+	const GraphicsPipelineDesc& Desc = InEntry.Desc;
+
+	VkRenderPass RenderPass;
+	{
+		std::lock_guard<std::mutex> Lock(EntriesMutex);
+		RenderPass = Desc.RenderPass;
+	}
+
+	std::vector<VkShaderModule> Modules;
+	std::vector<VkPipelineShaderStageCreateInfo> Stages;
+
+	try
+	{
+		Modules.push_back(LoadShaderModule(Desc.VertexShader));
+		if (!Desc.FragmentShader.empty())
+			Modules.push_back(LoadShaderModule(Desc.FragmentShader));
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "pipeline compile failed (" << Desc.VertexShader << ", " << Desc.FragmentShader << "): " << e.what() << '\n';
+		for (VkShaderModule Module : Modules)
+		{
+			vkDestroyShaderModule(Device, Module, nullptr);
+		}
+		return VK_NULL_HANDLE;
+	}
+
+	for (size_t i = 0; i < Modules.size(); ++i)
+	{
+		VkPipelineShaderStageCreateInfo StageInfo{};
+		StageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		StageInfo.stage = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		StageInfo.module = Modules[i];
+		StageInfo.pName = "main";
+		Stages.push_back(StageInfo);
+	}
+
+	VkPipelineVertexInputStateCreateInfo VertexInputInfo{};
+	VertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	VertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(Desc.VertexBindings.size());
+	VertexInputInfo.pVertexBindingDescriptions = Desc.VertexBindings.data();
+	VertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(Desc.VertexAttributes.size());
+	VertexInputInfo.pVertexAttributeDescriptions = Desc.VertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo InputAssembly{};
+	InputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	InputAssembly.topology = Desc.Topology;
+	InputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Viewport and scissor are dynamic, only the counts are baked
+	VkPipelineViewportStateCreateInfo ViewportState{};
+	ViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	ViewportState.viewportCount = 1;
+	ViewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo Rasterizer{};
+	Rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	Rasterizer.depthClampEnable = VK_FALSE;
+	Rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	Rasterizer.polygonMode = Desc.PolygonMode;
+	Rasterizer.lineWidth = 1.0f;
+	Rasterizer.cullMode = Desc.CullMode;
+	Rasterizer.frontFace = Desc.FrontFace;
+	Rasterizer.depthBiasEnable = Desc.DepthBiasConstant != 0.0f || Desc.DepthBiasSlope != 0.0f ? VK_TRUE : VK_FALSE;
+	Rasterizer.depthBiasConstantFactor = Desc.DepthBiasConstant;
+	Rasterizer.depthBiasSlopeFactor = Desc.DepthBiasSlope;
+
+	VkPipelineMultisampleStateCreateInfo Multisampling{};
+	Multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	Multisampling.sampleShadingEnable = VK_FALSE;
+	Multisampling.rasterizationSamples = Desc.Compatibility.Samples;
+	Multisampling.minSampleShading = 1.f;
+
+	VkPipelineDepthStencilStateCreateInfo DepthStencil{};
+	DepthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	DepthStencil.depthTestEnable = Desc.bDepthTest ? VK_TRUE : VK_FALSE;
+	DepthStencil.depthWriteEnable = Desc.bDepthWrite ? VK_TRUE : VK_FALSE;
+	DepthStencil.depthCompareOp = Desc.DepthCompareOp;
+	DepthStencil.depthBoundsTestEnable = VK_FALSE;
+	DepthStencil.minDepthBounds = 0.f;
+	DepthStencil.maxDepthBounds = 1.f;
+	DepthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState ColorBlendAttachment{};
+	ColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	ColorBlendAttachment.blendEnable = Desc.bAlphaBlend ? VK_TRUE : VK_FALSE;
+	ColorBlendAttachment.srcColorBlendFactor = Desc.bAlphaBlend ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+	ColorBlendAttachment.dstColorBlendFactor = Desc.bAlphaBlend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+	ColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	ColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	std::vector<VkPipelineColorBlendAttachmentState> BlendAttachments(Desc.Compatibility.ColorFormats.size(), ColorBlendAttachment);
+
+	VkPipelineColorBlendStateCreateInfo ColorBlending{};
+	ColorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	ColorBlending.logicOpEnable = VK_FALSE;
+	ColorBlending.logicOp = VK_LOGIC_OP_COPY;
+	ColorBlending.attachmentCount = static_cast<uint32_t>(BlendAttachments.size());
+	ColorBlending.pAttachments = BlendAttachments.data();
+
+	VkDynamicState DynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo DynamicState{};
+	DynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	DynamicState.dynamicStateCount = 2;
+	DynamicState.pDynamicStates = DynamicStates;
+
+	VkGraphicsPipelineCreateInfo PipelineInfo{};
+	PipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	PipelineInfo.stageCount = static_cast<uint32_t>(Stages.size());
+	PipelineInfo.pStages = Stages.data();
+	PipelineInfo.pVertexInputState = &VertexInputInfo;
+	PipelineInfo.pInputAssemblyState = &InputAssembly;
+	PipelineInfo.pViewportState = &ViewportState;
+	PipelineInfo.pRasterizationState = &Rasterizer;
+	PipelineInfo.pMultisampleState = &Multisampling;
+	PipelineInfo.pDepthStencilState = &DepthStencil;
+	PipelineInfo.pColorBlendState = &ColorBlending;
+	PipelineInfo.pDynamicState = &DynamicState;
+	PipelineInfo.layout = Desc.Layout;
+	PipelineInfo.renderPass = RenderPass;
+	PipelineInfo.subpass = Desc.Compatibility.Subpass;
+	PipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	// The pipeline cache is internally synchronized, workers share it
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	if (vkCreateGraphicsPipelines(Device, PipelineCache, 1, &PipelineInfo, nullptr, &Pipeline) != VK_SUCCESS)
+	{
+		std::cerr << "pipeline compile failed (" << Desc.VertexShader << ", " << Desc.FragmentShader << ")\n";
+		Pipeline = VK_NULL_HANDLE;
+	}
+
+	for (VkShaderModule Module : Modules)
+	{
+		vkDestroyShaderModule(Device, Module, nullptr);
+	}
+
+	return Pipeline;
+}
+
+void PipelineManager::LoadCache()
+{
+	std::vector<char> InitialData;
+
+	std::ifstream File(CacheFile, std::ios::ate | std::ios::binary);
+	if (!CacheFile.empty() && File.is_open())
+	{
+		InitialData.resize(static_cast<size_t>(File.tellg()));
+		File.seekg(0);
+		File.read(InitialData.data(), InitialData.size());
+	}
+
+	// The driver validates the header (vendor, device, cache UUID) and ignores stale data
+	VkPipelineCacheCreateInfo CacheInfo{};
+	CacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	CacheInfo.initialDataSize = InitialData.size();
+	CacheInfo.pInitialData = InitialData.empty() ? nullptr : InitialData.data();
+
+	if (vkCreatePipelineCache(Device, &CacheInfo, nullptr, &PipelineCache) != VK_SUCCESS)
+	{
+		CacheInfo.initialDataSize = 0;
+		CacheInfo.pInitialData = nullptr;
+		if (vkCreatePipelineCache(Device, &CacheInfo, nullptr, &PipelineCache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+	}
+}
+
+void PipelineManager::SaveCache()
+{
+	if (CacheFile.empty())
+		return;
+
+	size_t DataSize = 0;
+	vkGetPipelineCacheData(Device, PipelineCache, &DataSize, nullptr);
+
+	std::vector<char> Data(DataSize);
+	if (DataSize == 0 || vkGetPipelineCacheData(Device, PipelineCache, &DataSize, Data.data()) != VK_SUCCESS)
+		return;
+
+	std::ofstream File(CacheFile, std::ios::binary | std::ios::trunc);
+	File.write(Data.data(), DataSize);
+}
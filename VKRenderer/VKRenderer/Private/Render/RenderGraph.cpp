@@ -0,0 +1,832 @@
+#include "../../Public/Render/RenderGraph.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <queue>
+#include <set>
+
+ResourceState GetResourceState(ResourceUsage Usage)
+{
+	ResourceState State;
+	switch (Usage)
+	{
+	case ResourceUsage::Undefined:
+		break;
+	case ResourceUsage::ColorAttachment:
+		State.Stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		State.Access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		break;
+	case ResourceUsage::DepthStencilAttachment:
+		State.Stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		State.Access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		break;
+	case ResourceUsage::DepthStencilRead:
+		State.Stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		State.Access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		break;
+	case ResourceUsage::ShaderRead:
+		State.Stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		State.Access = VK_ACCESS_SHADER_READ_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case ResourceUsage::ComputeRead:
+		State.Stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		State.Access = VK_ACCESS_SHADER_READ_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_GENERAL;
+		break;
+	case ResourceUsage::ComputeWrite:
+		State.Stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		State.Access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_GENERAL;
+		break;
+	case ResourceUsage::TransferSrc:
+		State.Stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		State.Access = VK_ACCESS_TRANSFER_READ_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		break;
+	case ResourceUsage::TransferDst:
+		State.Stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		State.Access = VK_ACCESS_TRANSFER_WRITE_BIT;
+		State.Layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		break;
+	case ResourceUsage::Present:
+		State.Stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		State.Access = 0;
+		State.Layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		break;
+	}
+	return State;
+}
+
+bool IsWriteUsage(ResourceUsage Usage)
+{
+	return Usage == ResourceUsage::ColorAttachment ||
+		Usage == ResourceUsage::DepthStencilAttachment ||
+		Usage == ResourceUsage::ComputeWrite ||
+		Usage == ResourceUsage::TransferDst;
+}
+
+ResourceState GetLayoutState(VkImageLayout Layout)
+{
+	switch (Layout)
+	{
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return GetResourceState(ResourceUsage::ColorAttachment);
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return GetResourceState(ResourceUsage::DepthStencilAttachment);
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+		return GetResourceState(ResourceUsage::DepthStencilRead);
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		return GetResourceState(ResourceUsage::ShaderRead);
+	case VK_IMAGE_LAYOUT_GENERAL:
+		return GetResourceState(ResourceUsage::ComputeWrite);
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		return GetResourceState(ResourceUsage::TransferSrc);
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		return GetResourceState(ResourceUsage::TransferDst);
+	case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		return GetResourceState(ResourceUsage::Present);
+	case VK_IMAGE_LAYOUT_UNDEFINED:
+	case VK_IMAGE_LAYOUT_PREINITIALIZED:
+		return ResourceState{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, Layout };
+	default:
+		throw std::invalid_argument("unsupported image layout!");
+	}
+}
+
+VkImageAspectFlags GetImageAspectMask(VkFormat Format)
+{
+	switch (Format)
+	{
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	case VK_FORMAT_S8_UINT:
+		return VK_IMAGE_ASPECT_STENCIL_BIT;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
+static VkImageUsageFlags GetImageUsageFlags(ResourceUsage Usage)
+{
+	switch (Usage)
+	{
+	case ResourceUsage::ColorAttachment:
+		return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case ResourceUsage::DepthStencilAttachment:
+		return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case ResourceUsage::DepthStencilRead:
+		return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	case ResourceUsage::ShaderRead:
+		return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case ResourceUsage::ComputeRead:
+	case ResourceUsage::ComputeWrite:
+		return VK_IMAGE_USAGE_STORAGE_BIT;
+	case ResourceUsage::TransferSrc:
+		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	case ResourceUsage::TransferDst:
+		return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	default:
+		return 0;
+	}
+}
+
+void RenderGraphPassBuilder::Read(RenderGraphHandle Resource, ResourceUsage Usage)
+{
+	if (IsWriteUsage(Usage))
+	{
+		throw std::invalid_argument("render graph read declared with a write usage!");
+	}
+	Accesses.push_back({ Resource, Usage });
+}
+
+void RenderGraphPassBuilder::Write(RenderGraphHandle Resource, ResourceUsage Usage)
+{
+	if (!IsWriteUsage(Usage))
+	{
+		throw std::invalid_argument("render graph write declared with a read usage!");
+	}
+	Accesses.push_back({ Resource, Usage });
+}
+
+void RenderGraph::Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, DeferredDeletionQueue* InDeletionQueue)
+{
+	Device = InDevice;
+	PhysicDevice = InPhysicalDevice;
+	DeletionQueue = InDeletionQueue;
+}
+
+void RenderGraph::Reset()
+{
+	for (Resource& Iter : Resources)
+	{
+		if (Iter.bImported)
+			continue;
+
+		if (DeletionQueue)
+		{
+			DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, Iter.View);
+			DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE, Iter.Image);
+			continue;
+		}
+
+		if (Iter.View != VK_NULL_HANDLE)
+			vkDestroyImageView(Device, Iter.View, nullptr);
+		if (Iter.Image != VK_NULL_HANDLE)
+			vkDestroyImage(Device, Iter.Image, nullptr);
+	}
+
+	// Memory goes last, after every image bound to it
+	for (VkDeviceMemory Memory : TransientMemory)
+	{
+		if (DeletionQueue)
+			DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, Memory);
+		else
+			vkFreeMemory(Device, Memory, nullptr);
+	}
+	TransientMemory.clear();
+	MemoryStats = RenderGraphMemoryStats();
+
+	Resources.clear();
+	Passes.clear();
+	PassOrder.clear();
+	PassBarriers.clear();
+	FinalBarriers = BarrierBatch();
+	bCompiled = false;
+}
+
+RenderGraphHandle RenderGraph::ImportImage(const std::string& Name, const RenderGraphImageDesc& Desc, const ResourceState& InitialState, const ResourceState& FinalState)
+{
+	Resource NewResource;
+	NewResource.Name = Name;
+	NewResource.bImported = true;
+	NewResource.Desc = Desc;
+	NewResource.InitialState = InitialState;
+	NewResource.FinalState = FinalState;
+	Resources.push_back(NewResource);
+
+	return static_cast<RenderGraphHandle>(Resources.size() - 1);
+}
+
+RenderGraphHandle RenderGraph::ImportBuffer(const std::string& Name, VkBuffer Buffer, VkDeviceSize Size, const ResourceState& InitialState)
+{
+	Resource NewResource;
+	NewResource.Name = Name;
+	NewResource.bImage = false;
+	NewResource.bImported = true;
+	NewResource.InitialState = InitialState;
+	NewResource.InitialState.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	NewResource.Buffer = Buffer;
+	NewResource.BufferSize = Size;
+	Resources.push_back(NewResource);
+
+	return static_cast<RenderGraphHandle>(Resources.size() - 1);
+}
+
+RenderGraphHandle RenderGraph::CreateImage(const std::string& Name, const RenderGraphImageDesc& Desc)
+{
+	Resource NewResource;
+	NewResource.Name = Name;
+	NewResource.Desc = Desc;
+	Resources.push_back(NewResource);
+
+	return static_cast<RenderGraphHandle>(Resources.size() - 1);
+}
+
+void RenderGraph::AddPass(const std::string& Name, const SetupFunction& Setup, const ExecuteFunction& Execute)
+{
+	Pass NewPass;
+	NewPass.Name = Name;
+	NewPass.Execute = Execute;
+	Setup(NewPass.Builder);
+
+	for (const auto& Iter : NewPass.Builder.Accesses)
+	{
+		if (Iter.Resource >= Resources.size())
+		{
+			throw std::invalid_argument("render graph pass references an unknown resource!");
+		}
+	}
+
+	Passes.push_back(std::move(NewPass));
+}
+
+void RenderGraph::Compile()
+{
+	CullPasses();
+	SortPasses();
+	ComputeLifetimes();
+	CreateTransientResources();
+	BuildBarriers();
+	bCompiled = true;
+}
+
+bool RenderGraph::IsPassCulled(const std::string& Name) const
+{
+	for (const Pass& Iter : Passes)
+	{
+		if (Iter.Name == Name)
+			return Iter.bCulled;
+	}
+	return true;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walk backwards from the outputs: imported resources are visible outside the graph, so anything
+	// writing them is kept, and everything a kept pass reads becomes live for the passes before it
+	std::vector<bool> Live(Resources.size(), false);
+	for (size_t i = 0; i < Resources.size(); ++i)
+	{
+		Live[i] = Resources[i].bImported;
+	}
+
+	for (size_t i = Passes.size(); i-- > 0;)
+	{
+		Pass& CurPass = Passes[i];
+
+		bool bKeep = CurPass.Builder.bSideEffect;
+		for (const auto& Iter : CurPass.Builder.Accesses)
+		{
+			if (IsWriteUsage(Iter.Usage) && Live[Iter.Resource])
+				bKeep = true;
+		}
+
+		CurPass.bCulled = !bKeep;
+		if (!bKeep)
+			continue;
+
+		for (const auto& Iter : CurPass.Builder.Accesses)
+		{
+			if (!IsWriteUsage(Iter.Usage))
+				Live[Iter.Resource] = true;
+		}
+	}
+}
+
+void RenderGraph::SortPasses()
+{
+	// Declaration order defines which version of a resource a pass sees, so edges always point to an
+	// earlier pass: writer -> later readers/writers, readers -> next writer
+	const size_t PassCount = Passes.size();
+	std::vector<std::set<uint32_t>> Edges(PassCount);
+	std::vector<uint32_t> InDegree(PassCount, 0);
+
+	std::vector<int32_t> LastWriter(Resources.size(), -1);
+	std::vector<std::vector<uint32_t>> ReadersSinceWrite(Resources.size());
+
+	for (uint32_t i = 0; i < PassCount; ++i)
+	{
+		if (Passes[i].bCulled)
+			continue;
+
+		for (const auto& Iter : Passes[i].Builder.Accesses)
+		{
+			int32_t Writer = LastWriter[Iter.Resource];
+			if (Writer >= 0 && Writer != static_cast<int32_t>(i))
+				Edges[Writer].insert(i);
+
+			if (IsWriteUsage(Iter.Usage))
+			{
+				for (uint32_t Reader : ReadersSinceWrite[Iter.Resource])
+				{
+					if (Reader != i)
+						Edges[Reader].insert(i);
+				}
+				ReadersSinceWrite[Iter.Resource].clear();
+				LastWriter[Iter.Resource] = static_cast<int32_t>(i);
+			}
+			else
+			{
+				ReadersSinceWrite[Iter.Resource].push_back(i);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < PassCount; ++i)
+	{
+		for (uint32_t Next : Edges[i])
+			InDegree[Next]++;
+	}
+
+	// Kahn's algorithm, ready passes are taken in declaration order to keep the result deterministic
+	std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> Ready;
+	for (uint32_t i = 0; i < PassCount; ++i)
+	{
+		if (!Passes[i].bCulled && InDegree[i] == 0)
+			Ready.push(i);
+	}
+
+	PassOrder.clear();
+	while (!Ready.empty())
+	{
+		uint32_t Current = Ready.top();
+		Ready.pop();
+		PassOrder.push_back(Current);
+
+		for (uint32_t Next : Edges[Current])
+		{
+			if (--InDegree[Next] == 0)
+				Ready.push(Next);
+		}
+	}
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+	for (Resource& Res : Resources)
+	{
+		Res.ImageUsage = 0;
+		Res.FirstUse = UINT32_MAX;
+		Res.LastUse = 0;
+		Res.UseCount = 0;
+		Res.bAttachmentOnly = true;
+		Res.LastUseStages = 0;
+		Res.LastUseWriteAccess = 0;
+	}
+
+	for (uint32_t OrderIndex = 0; OrderIndex < PassOrder.size(); ++OrderIndex)
+	{
+		const Pass& CurPass = Passes[PassOrder[OrderIndex]];
+		for (const auto& Iter : CurPass.Builder.Accesses)
+		{
+			Resource& Res = Resources[Iter.Resource];
+			const ResourceState State = GetResourceState(Iter.Usage);
+
+			if (Res.LastUse != OrderIndex || Res.UseCount == 0)
+			{
+				Res.UseCount++;
+				Res.LastUseStages = 0;
+				Res.LastUseWriteAccess = 0;
+			}
+			Res.FirstUse = std::min(Res.FirstUse, OrderIndex);
+			Res.LastUse = OrderIndex;
+			Res.LastUseStages |= State.Stage;
+			if (IsWriteUsage(Iter.Usage))
+				Res.LastUseWriteAccess |= State.Access;
+
+			if (Res.bImage)
+			{
+				Res.ImageUsage |= GetImageUsageFlags(Iter.Usage);
+				if (Iter.Usage != ResourceUsage::ColorAttachment && Iter.Usage != ResourceUsage::DepthStencilAttachment)
+					Res.bAttachmentOnly = false;
+			}
+		}
+	}
+}
+
+void RenderGraph::BuildBarriers()
+{
+	struct TrackedState
+	{
+		VkImageLayout Layout;
+		VkPipelineStageFlags WriteStages;
+		VkAccessFlags WriteAccess;
+		VkPipelineStageFlags ReadStages;
+		VkPipelineStageFlags VisibleStages;
+		VkAccessFlags VisibleAccess;
+	};
+
+	std::vector<TrackedState> States(Resources.size());
+	for (size_t i = 0; i < Resources.size(); ++i)
+	{
+		const ResourceState& Initial = Resources[i].InitialState;
+		States[i] = { Initial.Layout, Initial.Stage, Initial.Access, 0, 0, 0 };
+	}
+
+	PassBarriers.assign(PassOrder.size(), BarrierBatch());
+
+	for (size_t OrderIndex = 0; OrderIndex < PassOrder.size(); ++OrderIndex)
+	{
+		const Pass& CurPass = Passes[PassOrder[OrderIndex]];
+		BarrierBatch& Batch = PassBarriers[OrderIndex];
+
+		for (const auto& Iter : CurPass.Builder.Accesses)
+		{
+			Resource& Res = Resources[Iter.Resource];
+			TrackedState& State = States[Iter.Resource];
+
+			ResourceState Target = GetResourceState(Iter.Usage);
+			if (!Res.bImage)
+				Target.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			const bool bWrite = IsWriteUsage(Iter.Usage);
+			const bool bLayoutChange = Res.bImage && Target.Layout != State.Layout;
+
+			bool bNeedBarrier = false;
+			ResourceState Src;
+			if (bLayoutChange || bWrite)
+			{
+				// Layout transitions and writes wait for every earlier access (WAW, WAR)
+				Src.Stage = State.WriteStages | State.ReadStages;
+				Src.Access = State.WriteAccess;
+				bNeedBarrier = bLayoutChange || Src.Stage != 0;
+			}
+			else if ((State.VisibleStages & Target.Stage) != Target.Stage || (State.VisibleAccess & Target.Access) != Target.Access)
+			{
+				// Read after write, earlier reads in the same layout already made the data visible to their stages
+				Src.Stage = State.WriteStages;
+				Src.Access = State.WriteAccess;
+				bNeedBarrier = true;
+			}
+			Src.Layout = State.Layout;
+
+			if (bNeedBarrier)
+			{
+				if (Src.Stage == 0)
+					Src.Stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+				Batch.SrcStages |= Src.Stage;
+				Batch.DstStages |= Target.Stage;
+				Batch.Barriers.push_back({ Iter.Resource, Src, Target });
+			}
+
+			State.Layout = Res.bImage ? Target.Layout : VK_IMAGE_LAYOUT_UNDEFINED;
+			if (bWrite)
+			{
+				State.WriteStages = Target.Stage;
+				State.WriteAccess = Target.Access;
+				State.ReadStages = 0;
+				State.VisibleStages = 0;
+				State.VisibleAccess = 0;
+			}
+			else if (bLayoutChange)
+			{
+				// The transition itself is the latest write, it is only visible to this pass's stages so far
+				State.WriteStages = Target.Stage;
+				State.WriteAccess = 0;
+				State.ReadStages = Target.Stage;
+				State.VisibleStages = Target.Stage;
+				State.VisibleAccess = Target.Access;
+			}
+			else
+			{
+				State.ReadStages |= Target.Stage;
+				if (bNeedBarrier)
+				{
+					State.VisibleStages |= Target.Stage;
+					State.VisibleAccess |= Target.Access;
+				}
+			}
+		}
+	}
+
+	FinalBarriers = BarrierBatch();
+	for (size_t i = 0; i < Resources.size(); ++i)
+	{
+		const Resource& Res = Resources[i];
+		if (!Res.bImported || !Res.bImage || Res.FinalState.Layout == VK_IMAGE_LAYOUT_UNDEFINED)
+			continue;
+
+		const TrackedState& State = States[i];
+		if (State.Layout == Res.FinalState.Layout)
+			continue;
+
+		ResourceState Src;
+		Src.Stage = State.WriteStages | State.ReadStages;
+		if (Src.Stage == 0)
+			Src.Stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		Src.Access = State.WriteAccess;
+		Src.Layout = State.Layout;
+
+		FinalBarriers.SrcStages |= Src.Stage;
+		FinalBarriers.DstStages |= Res.FinalState.Stage;
+		FinalBarriers.Barriers.push_back({ static_cast<RenderGraphHandle>(i), Src, Res.FinalState });
+	}
+}
+
+void RenderGraph::CreateTransientResources()
+{
+	struct MemoryBlock
+	{
+		VkDeviceSize Size = 0;
+		uint32_t TypeBits = ~0u;
+		uint32_t LastUse = 0;
+		RenderGraphHandle LastOccupant = InvalidRenderGraphHandle;
+		std::vector<RenderGraphHandle> Occupants;
+	};
+
+	std::vector<RenderGraphHandle> Aliasable;
+	std::vector<VkMemoryRequirements> Requirements(Resources.size());
+	MemoryStats = RenderGraphMemoryStats();
+
+	for (RenderGraphHandle i = 0; i < Resources.size(); ++i)
+	{
+		Resource& Res = Resources[i];
+		if (Res.bImported || !Res.bImage || Res.ImageUsage == 0)
+			continue;
+
+		// Written and consumed inside one pass: the contents never have to reach memory
+		Res.bLazilyAllocated = Res.bAttachmentOnly && Res.UseCount == 1;
+		if (Res.bLazilyAllocated)
+			Res.ImageUsage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+		VkImageCreateInfo ImageInfo{};
+		ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+		ImageInfo.extent.width = Res.Desc.Extent.width;
+		ImageInfo.extent.height = Res.Desc.Extent.height;
+		ImageInfo.extent.depth = 1;
+		ImageInfo.mipLevels = 1;
+		ImageInfo.arrayLayers = 1;
+		ImageInfo.format = Res.Desc.Format;
+		ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		ImageInfo.usage = Res.ImageUsage;
+		ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		ImageInfo.samples = Res.Desc.Samples;
+
+		if (vkCreateImage(Device, &ImageInfo, nullptr, &Res.Image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render graph image!");
+		}
+
+		vkGetImageMemoryRequirements(Device, Res.Image, &Requirements[i]);
+		MemoryStats.RequestedBytes += Requirements[i].size;
+
+		uint32_t LazyType = 0;
+		if (Res.bLazilyAllocated && FindMemoryType(Requirements[i].memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, LazyType))
+		{
+			// Lazily allocated memory is committed on demand (tile memory), aliasing it would gain nothing
+			VkMemoryAllocateInfo AllocInfo{};
+			AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			AllocInfo.allocationSize = Requirements[i].size;
+			AllocInfo.memoryTypeIndex = LazyType;
+
+			VkDeviceMemory Memory;
+			if (vkAllocateMemory(Device, &AllocInfo, nullptr, &Memory) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate render graph image memory!");
+			}
+			vkBindImageMemory(Device, Res.Image, Memory, 0);
+			TransientMemory.push_back(Memory);
+			MemoryStats.LazilyAllocatedImages++;
+
+			// The same image is used again by the next frame, which must wait for this frame's last use
+			Res.InitialState.Stage = Res.LastUseStages;
+			Res.InitialState.Access = Res.LastUseWriteAccess;
+			Res.InitialState.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			continue;
+		}
+
+		Aliasable.push_back(i);
+	}
+
+	// Greedy interval packing: walk images by first use and drop each into a block whose previous
+	// occupant is already dead, preferring the tightest fit so big blocks stay free for big images
+	std::sort(Aliasable.begin(), Aliasable.end(), [this](RenderGraphHandle A, RenderGraphHandle B)
+		{
+			return Resources[A].FirstUse < Resources[B].FirstUse;
+		});
+
+	std::vector<MemoryBlock> Blocks;
+	for (RenderGraphHandle Handle : Aliasable)
+	{
+		Resource& Res = Resources[Handle];
+		const VkMemoryRequirements& Req = Requirements[Handle];
+
+		int32_t BestBlock = -1;
+		for (int32_t b = 0; b < static_cast<int32_t>(Blocks.size()); ++b)
+		{
+			const MemoryBlock& Block = Blocks[b];
+			if (Block.LastUse >= Res.FirstUse || (Block.TypeBits & Req.memoryTypeBits) == 0)
+				continue;
+
+			if (BestBlock < 0)
+			{
+				BestBlock = b;
+				continue;
+			}
+
+			const MemoryBlock& Best = Blocks[BestBlock];
+			const bool bFits = Block.Size >= Req.size;
+			const bool bBestFits = Best.Size >= Req.size;
+			if ((bFits && (!bBestFits || Block.Size < Best.Size)) || (!bFits && !bBestFits && Block.Size > Best.Size))
+				BestBlock = b;
+		}
+
+		if (BestBlock < 0)
+		{
+			Blocks.push_back(MemoryBlock());
+			BestBlock = static_cast<int32_t>(Blocks.size() - 1);
+		}
+		else
+		{
+			// The new occupant must wait until the previous one is done with the memory, it starts
+			// from an undefined layout so only the execution dependency (and pending writes) matter
+			const Resource& Previous = Resources[Blocks[BestBlock].LastOccupant];
+			Res.InitialState.Stage = Previous.LastUseStages;
+			Res.InitialState.Access = Previous.LastUseWriteAccess;
+			Res.InitialState.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+
+		MemoryBlock& Block = Blocks[BestBlock];
+		Block.Size = std::max(Block.Size, Req.size);
+		Block.TypeBits &= Req.memoryTypeBits;
+		Block.LastUse = Res.LastUse;
+		Block.LastOccupant = Handle;
+		Block.Occupants.push_back(Handle);
+	}
+
+	for (const MemoryBlock& Block : Blocks)
+	{
+		// Frames in flight execute the graph on the same images, so the first occupant of a block waits for
+		// the previous frame's last occupant (e.g. its depth writes) the way later occupants wait for earlier ones
+		Resource& FirstOccupant = Resources[Block.Occupants.front()];
+		const Resource& LastOccupant = Resources[Block.LastOccupant];
+		FirstOccupant.InitialState.Stage = LastOccupant.LastUseStages;
+		FirstOccupant.InitialState.Access = LastOccupant.LastUseWriteAccess;
+		FirstOccupant.InitialState.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		uint32_t TypeIndex = 0;
+		if (!FindMemoryType(Block.TypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, TypeIndex))
+		{
+			throw std::runtime_error("failed to find suitable memory type!");
+		}
+
+		VkMemoryAllocateInfo AllocInfo{};
+		AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		AllocInfo.allocationSize = Block.Size;
+		AllocInfo.memoryTypeIndex = TypeIndex;
+
+		VkDeviceMemory Memory;
+		if (vkAllocateMemory(Device, &AllocInfo, nullptr, &Memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate render graph image memory!");
+		}
+		TransientMemory.push_back(Memory);
+		MemoryStats.AllocatedBytes += Block.Size;
+
+		// Every occupant starts at offset 0, which satisfies any alignment
+		for (RenderGraphHandle Handle : Block.Occupants)
+		{
+			vkBindImageMemory(Device, Resources[Handle].Image, Memory, 0);
+		}
+	}
+
+	for (RenderGraphHandle i = 0; i < Resources.size(); ++i)
+	{
+		Resource& Res = Resources[i];
+		if (Res.bImported || Res.Image == VK_NULL_HANDLE)
+			continue;
+
+		VkImageViewCreateInfo ViewInfo{};
+		ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		ViewInfo.image = Res.Image;
+		ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		ViewInfo.format = Res.Desc.Format;
+		ViewInfo.subresourceRange.aspectMask = GetImageAspectMask(Res.Desc.Format);
+		ViewInfo.subresourceRange.baseMipLevel = 0;
+		ViewInfo.subresourceRange.levelCount = 1;
+		ViewInfo.subresourceRange.baseArrayLayer = 0;
+		ViewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(Device, &ViewInfo, nullptr, &Res.View) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render graph image view!");
+		}
+	}
+}
+
+void RenderGraph::BindImportedImage(RenderGraphHandle Handle, VkImage Image, VkImageView View)
+{
+	Resource& Res = Resources[Handle];
+	if (!Res.bImported || !Res.bImage)
+	{
+		throw std::invalid_argument("only imported images can be rebound!");
+	}
+	Res.Image = Image;
+	Res.View = View;
+}
+
+void RenderGraph::EmitBarriers(VkCommandBuffer CommandBuffer, const BarrierBatch& Batch) const
+{
+	if (Batch.Barriers.empty())
+		return;
+
+	std::vector<VkImageMemoryBarrier> ImageBarriers;
+	std::vector<VkBufferMemoryBarrier> BufferBarriers;
+
+	for (const Barrier& Iter : Batch.Barriers)
+	{
+		const Resource& Res = Resources[Iter.Resource];
+		if (Res.bImage)
+		{
+			VkImageMemoryBarrier ImageBarrier{};
+			ImageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			ImageBarrier.srcAccessMask = Iter.Src.Access;
+			ImageBarrier.dstAccessMask = Iter.Dst.Access;
+			ImageBarrier.oldLayout = Iter.Src.Layout;
+			ImageBarrier.newLayout = Iter.Dst.Layout;
+			ImageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			ImageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			ImageBarrier.image = Res.Image;
+			ImageBarrier.subresourceRange.aspectMask = GetImageAspectMask(Res.Desc.Format);
+			ImageBarrier.subresourceRange.baseMipLevel = 0;
+			ImageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			ImageBarrier.subresourceRange.baseArrayLayer = 0;
+			ImageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+			ImageBarriers.push_back(ImageBarrier);
+		}
+		else
+		{
+			VkBufferMemoryBarrier BufferBarrier{};
+			BufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			BufferBarrier.srcAccessMask = Iter.Src.Access;
+			BufferBarrier.dstAccessMask = Iter.Dst.Access;
+			BufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			BufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			BufferBarrier.buffer = Res.Buffer;
+			BufferBarrier.offset = 0;
+			BufferBarrier.size = VK_WHOLE_SIZE;
+			BufferBarriers.push_back(BufferBarrier);
+		}
+	}
+
+	vkCmdPipelineBarrier(CommandBuffer, Batch.SrcStages, Batch.DstStages, 0, 0, nullptr,
+		static_cast<uint32_t>(BufferBarriers.size()), BufferBarriers.data(),
+		static_cast<uint32_t>(ImageBarriers.size()), ImageBarriers.data());
+}
+
+void RenderGraph::Execute(VkCommandBuffer CommandBuffer)
+{
+	if (!bCompiled)
+	{
+		throw std::runtime_error("render graph executed before compile!");
+	}
+
+	for (size_t OrderIndex = 0; OrderIndex < PassOrder.size(); ++OrderIndex)
+	{
+		EmitBarriers(CommandBuffer, PassBarriers[OrderIndex]);
+		Passes[PassOrder[OrderIndex]].Execute(CommandBuffer);
+	}
+
+	EmitBarriers(CommandBuffer, FinalBarriers);
+}
+
+bool RenderGraph::FindMemoryType(uint32_t TypeFilter, VkMemoryPropertyFlags Properties, uint32_t& OutTypeIndex) const
+{
+	VkPhysicalDeviceMemoryProperties MemProperties;
+	vkGetPhysicalDeviceMemoryProperties(PhysicDevice, &MemProperties);
+
+	for (uint32_t i = 0; i < MemProperties.memoryTypeCount; ++i)
+	{
+		if (TypeFilter & (1 << i) && (MemProperties.memoryTypes[i].propertyFlags & Properties) == Properties)
+		{
+			OutTypeIndex = i;
+			return true;
+		}
+	}
+
+	return false;
+}
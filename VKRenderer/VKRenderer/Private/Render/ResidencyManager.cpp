@@ -0,0 +1,723 @@
+#include "../../Public/Render/ResidencyManager.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+#include "../../Public/Render/TextureDecoder.h"
+
+#include <stdexcept>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+
+static const VkImageLayout SampledLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+static double ToMegabytes(VkDeviceSize Bytes)
+{
+	return static_cast<double>(Bytes) / (1024.0 * 1024.0);
+}
+
+void ResidencyManager::Init(VkPhysicalDevice InPhysicalDevice, VkDevice InDevice, const MemoryPlacementPolicy* InMemoryPolicy, GpuTimeline* InTimeline,
+	UploadContext* InUploader, DeferredDeletionQueue* InDeletionQueue, JobSystem* InJobs, bool bInMemoryBudgetExtension, const ResidencyBudget& InBudget)
+{
+	PhysicalDevice = InPhysicalDevice;
+	Device = InDevice;
+	MemoryPolicy = InMemoryPolicy;
+	Timeline = InTimeline;
+	Uploader = InUploader;
+	DeletionQueue = InDeletionQueue;
+	Jobs = InJobs;
+	bMemoryBudgetExtension = bInMemoryBudgetExtension;
+	Budget = InBudget;
+
+	const VkPhysicalDeviceMemoryProperties& MemProperties = MemoryPolicy->GetMemoryProperties();
+	Heaps.resize(MemProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < MemProperties.memoryHeapCount; ++i)
+	{
+		Heaps[i].Size = MemProperties.memoryHeaps[i].size;
+		Heaps[i].bDeviceLocal = (MemProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	RefreshBudget();
+}
+
+void ResidencyManager::Destroy()
+{
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (Texture && Texture->NextLoadJobs)
+			Jobs->Wait(*Texture->NextLoadJobs);
+	}
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (!Texture)
+			continue;
+
+		CancelLevelChange(*Texture);
+		DestroyImageNow(Texture->Current);
+	}
+	Textures.clear();
+	Allocations.clear();
+	Retiring.clear();
+}
+
+VkDeviceMemory ResidencyManager::Allocate(const VkMemoryRequirements& Requirements, MemoryUsage Usage, MemoryPlacement* OutPlacement)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	VkDeviceMemory Memory = AllocateLocked(Requirements, Usage, false, OutPlacement);
+	if (Memory == VK_NULL_HANDLE)
+	{
+		// The headroom is only spent once streamed textures gave back what they could
+		const uint32_t Heap = MemoryPolicy->Choose(Usage, Requirements.memoryTypeBits).HeapIndex;
+		ReclaimLocked(Heap, Requirements.size);
+		Memory = AllocateLocked(Requirements, Usage, true, OutPlacement);
+	}
+	if (Memory == VK_NULL_HANDLE)
+	{
+		throw std::runtime_error("allocation exceeds the device memory budget!");
+	}
+	return Memory;
+}
+
+void ResidencyManager::Free(VkDeviceMemory Memory)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	FreeLocked(Memory);
+}
+
+StreamedTextureHandle ResidencyManager::CreateTexture(const StreamedTextureDesc& Desc)
+{
+	if (Desc.Width == 0 || Desc.Height == 0 || !Desc.LoadMip)
+	{
+		throw std::runtime_error("invalid streamed texture description!");
+	}
+
+	std::unique_ptr<StreamedTexture> Texture = std::make_unique<StreamedTexture>();
+	Texture->Desc = Desc;
+	Texture->MipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(Desc.Width, Desc.Height)))) + 1;
+	Texture->Current.ResidentMip = Texture->MipCount;
+	Texture->RequestedMip = static_cast<float>(Texture->MipCount);
+	Texture->WantedMip = GetCoarsestResident(*Texture);
+
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		if (!BeginLevelChange(*Texture, GetCoarsestResident(*Texture), true))
+		{
+			throw std::runtime_error("no room in the device memory budget for a streamed texture!");
+		}
+	}
+
+	// Outside the lock, decode jobs this thread helps with may allocate
+	Jobs->Wait(*Texture->NextLoadJobs);
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	RecordLevelChange(*Texture);
+	if (!Texture->bNextRecorded)
+	{
+		throw std::runtime_error("failed to load the pinned mips of a streamed texture!");
+	}
+
+	// Nothing samples it yet, the copies only have to reach the GPU before the first frame that does
+	Texture->Current = Texture->Next;
+	Texture->Next = TextureImage();
+	Texture->bNextRecorded = false;
+
+	for (StreamedTextureHandle Handle = 0; Handle < Textures.size(); ++Handle)
+	{
+		if (!Textures[Handle])
+		{
+			Textures[Handle] = std::move(Texture);
+			return Handle;
+		}
+	}
+	Textures.push_back(std::move(Texture));
+	return static_cast<StreamedTextureHandle>(Textures.size() - 1);
+}
+
+void ResidencyManager::DestroyTexture(StreamedTextureHandle Handle)
+{
+	JobCounter* Loads = nullptr;
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Loads = Textures[Handle]->NextLoadJobs.get();
+	}
+	if (Loads)
+		Jobs->Wait(*Loads);
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	StreamedTexture& Texture = *Textures[Handle];
+	CancelLevelChange(Texture);
+	RetireImage(Texture.Current);
+	Textures[Handle].reset();
+}
+
+void ResidencyManager::RequestMip(StreamedTextureHandle Handle, float Mip)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	StreamedTexture& Texture = *Textures[Handle];
+	Texture.RequestedMip = std::min(Texture.RequestedMip, Mip);
+	Texture.LastRequested = FrameNumber;
+}
+
+float ResidencyManager::GetScreenSpaceMip(uint32_t TexelsAcross, float PixelsAcross)
+{
+	return std::max(std::log2(static_cast<float>(TexelsAcross) / std::max(PixelsAcross, 1.0f)), 0.0f);
+}
+
+TextureMipLoader ResidencyManager::CreateImageSource(std::vector<uint8_t> Pixels, uint32_t Width, uint32_t Height)
+{
+	if (Pixels.size() != static_cast<size_t>(Width) * Height * 4)
+	{
+		throw std::runtime_error("streamed texture source image has the wrong size!");
+	}
+
+	std::shared_ptr<std::vector<std::vector<uint8_t>>> Mips =
+		std::make_shared<std::vector<std::vector<uint8_t>>>(TextureDecoder::BuildMipChain(std::move(Pixels), Width, Height));
+
+	return [Mips](uint32_t Mip, uint8_t* OutTexels)
+		{
+			if (Mip >= Mips->size())
+				return false;
+
+			const std::vector<uint8_t>& Level = (*Mips)[Mip];
+			memcpy(OutTexels, Level.data(), Level.size());
+			return true;
+		};
+}
+
+void ResidencyManager::Update()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	// Init() may run on a startup job, the frame loop is what owns the GPU waits
+	MainThread = std::this_thread::get_id();
+	RefreshBudget();
+	CollectRetired();
+
+	// Swap in images whose copies have completed. The old image may still be sampled by frames in flight
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (!Texture || !Texture->bNextRecorded || !Timeline->IsComplete(Texture->NextReady))
+			continue;
+
+		RetireImage(Texture->Current);
+		Texture->Current = Texture->Next;
+		Texture->Next = TextureImage();
+		Texture->bNextRecorded = false;
+	}
+
+	// Demand: the finest request of the last frame, or the pinned levels once nobody has asked for a while
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (!Texture)
+			continue;
+
+		const uint32_t Coarsest = GetCoarsestResident(*Texture);
+		if (Texture->LastRequested == FrameNumber)
+		{
+			const uint32_t Requested = static_cast<uint32_t>(std::min(std::max(Texture->RequestedMip, 0.0f), static_cast<float>(Coarsest)));
+			Texture->WantedMip = std::max(Requested, std::min(Texture->FinestLoadable, Coarsest));
+			Texture->RequestedMip = static_cast<float>(Texture->MipCount);
+		}
+		else if (FrameNumber - Texture->LastRequested > Budget.TrimDelayFrames)
+		{
+			Texture->WantedMip = Coarsest;
+		}
+
+		if (Texture->WantedMip <= Texture->Current.ResidentMip)
+			Texture->CoarserSince = 0;
+		else if (Texture->CoarserSince == 0)
+			Texture->CoarserSince = FrameNumber;
+	}
+
+	// Pressure: everything above the limit is trimmed away from the least recently requested textures
+	for (uint32_t Heap = 0; Heap < Heaps.size(); ++Heap)
+	{
+		const VkDeviceSize Used = Heaps[Heap].GetUsed();
+		const VkDeviceSize Limit = GetLimit(Heap, false);
+		if (Used > Limit)
+			TrimLeastRecentlyUsed(Heap, Used - Limit);
+	}
+
+	std::vector<StreamedTexture*> StreamIns;
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (!Texture || IsChangingLevel(*Texture))
+			continue;
+
+		if (Texture->CoarserSince != 0 && FrameNumber - Texture->CoarserSince >= Budget.TrimDelayFrames)
+		{
+			BeginLevelChange(*Texture, Texture->WantedMip, true);
+		}
+		else if (Texture->WantedMip < Texture->Current.ResidentMip)
+		{
+			StreamIns.push_back(Texture.get());
+		}
+	}
+
+	// Most recently requested first, then the ones furthest from what the screen wants. One level at a time,
+	// so a texture that just came into view sharpens over a few frames instead of stalling on its top level
+	std::sort(StreamIns.begin(), StreamIns.end(), [](const StreamedTexture* A, const StreamedTexture* B)
+		{
+			if (A->LastRequested != B->LastRequested)
+				return A->LastRequested > B->LastRequested;
+			return A->Current.ResidentMip - A->WantedMip > B->Current.ResidentMip - B->WantedMip;
+		});
+	uint32_t Started = 0;
+	for (StreamedTexture* Texture : StreamIns)
+	{
+		if (Started == Budget.MaxStreamInsPerFrame)
+			break;
+		if (BeginLevelChange(*Texture, Texture->Current.ResidentMip - 1, false))
+			++Started;
+	}
+
+	// Level changes whose loads are done (trims have none) are recorded and go out in one batch
+	std::vector<StreamedTexture*> Recorded;
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (!Texture || !IsChangingLevel(*Texture) || Texture->bNextRecorded)
+			continue;
+		if (Texture->NextLoadJobs && !Texture->NextLoadJobs->IsDone())
+			continue;
+
+		RecordLevelChange(*Texture);
+		if (Texture->bNextRecorded)
+			Recorded.push_back(Texture.get());
+	}
+	FlushLevelChanges(Recorded);
+
+	++FrameNumber;
+}
+
+VkImageView ResidencyManager::GetView(StreamedTextureHandle Handle) const
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Textures[Handle]->Current.View;
+}
+
+uint32_t ResidencyManager::GetResidentMip(StreamedTextureHandle Handle) const
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return Textures[Handle]->Current.ResidentMip;
+}
+
+std::vector<MemoryHeapUsage> ResidencyManager::GetHeapUsage()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	RefreshBudget();
+	return Heaps;
+}
+
+void ResidencyManager::PrintHeapUsage(std::ostream& Out)
+{
+	const std::vector<MemoryHeapUsage> Usage = GetHeapUsage();
+
+	Out << std::fixed << std::setprecision(1);
+	for (size_t i = 0; i < Usage.size(); ++i)
+	{
+		const MemoryHeapUsage& Heap = Usage[i];
+		Out << "  heap " << i << (Heap.bDeviceLocal ? " (device local)" : "") << ": " << ToMegabytes(Heap.GetUsed()) << " / "
+			<< ToMegabytes(Heap.Limit) << " MB used, " << ToMegabytes(Heap.Allocated) << " allocated, " << ToMegabytes(Heap.Retiring)
+			<< " retiring, " << ToMegabytes(Heap.External) << " external, " << ToMegabytes(Heap.Size) << " MB heap\n";
+	}
+	Out << std::defaultfloat;
+}
+
+VkDeviceSize ResidencyManager::GetLimit(uint32_t Heap, bool bMayUseHeadroom) const
+{
+	const VkDeviceSize Limit = Heaps[Heap].Limit;
+	return bMayUseHeadroom ? Limit : Limit - std::min(Budget.TrimHeadroom, Limit);
+}
+
+VkDeviceMemory ResidencyManager::AllocateLocked(const VkMemoryRequirements& Requirements, MemoryUsage Usage, bool bMayUseHeadroom, MemoryPlacement* OutPlacement)
+{
+	const MemoryPlacement Placement = MemoryPolicy->Choose(Usage, Requirements.memoryTypeBits);
+	MemoryHeapUsage& Heap = Heaps[Placement.HeapIndex];
+	if (Heap.GetUsed() + Requirements.size > GetLimit(Placement.HeapIndex, bMayUseHeadroom))
+		return VK_NULL_HANDLE;
+
+	VkMemoryAllocateInfo AllocInfo{};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	AllocInfo.allocationSize = Requirements.size;
+	AllocInfo.memoryTypeIndex = Placement.TypeIndex;
+
+	// Out of memory despite the budget (the driver budget moved, other processes) is handled like over budget
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	if (vkAllocateMemory(Device, &AllocInfo, nullptr, &Memory) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	Allocations[Memory] = Allocation{ Placement.HeapIndex, Requirements.size };
+	Heap.Allocated += Requirements.size;
+	if (OutPlacement)
+		*OutPlacement = Placement;
+	return Memory;
+}
+
+void ResidencyManager::FreeLocked(VkDeviceMemory Memory)
+{
+	if (Memory == VK_NULL_HANDLE)
+		return;
+
+	DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, Memory);
+
+	auto Found = Allocations.find(Memory);
+	if (Found == Allocations.end())
+		return;
+
+	// Same wait the deletion queue applies: everything submitted so far on every queue
+	RetiringAllocation Entry{ Found->second.Heap, Found->second.Size, {} };
+	for (size_t Queue = 0; Queue < Entry.LastUse.size(); ++Queue)
+	{
+		Entry.LastUse[Queue] = Timeline->GetLastSubmitted(static_cast<QueueType>(Queue));
+	}
+	Retiring.push_back(Entry);
+
+	Heaps[Entry.Heap].Allocated -= Entry.Size;
+	Heaps[Entry.Heap].Retiring += Entry.Size;
+	Allocations.erase(Found);
+}
+
+void ResidencyManager::RefreshBudget()
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT BudgetProperties{};
+	BudgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	if (bMemoryBudgetExtension)
+	{
+		VkPhysicalDeviceMemoryProperties2 MemProperties{};
+		MemProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		MemProperties.pNext = &BudgetProperties;
+		vkGetPhysicalDeviceMemoryProperties2(PhysicalDevice, &MemProperties);
+	}
+
+	for (uint32_t i = 0; i < Heaps.size(); ++i)
+	{
+		MemoryHeapUsage& Heap = Heaps[i];
+
+		// The driver budget already leaves out what other processes use
+		const VkDeviceSize DriverLimit = bMemoryBudgetExtension ? BudgetProperties.heapBudget[i] : Heap.Size;
+		Heap.Limit = static_cast<VkDeviceSize>(static_cast<double>(DriverLimit) * Budget.BudgetFraction);
+		if (Heap.bDeviceLocal && Budget.DeviceLocalLimit != 0)
+			Heap.Limit = std::min(Heap.Limit, Budget.DeviceLocalLimit);
+
+		if (bMemoryBudgetExtension)
+		{
+			const VkDeviceSize Tracked = Heap.Allocated + Heap.Retiring;
+			Heap.External = BudgetProperties.heapUsage[i] > Tracked ? BudgetProperties.heapUsage[i] - Tracked : 0;
+		}
+	}
+}
+
+void ResidencyManager::CollectRetired()
+{
+	for (size_t i = 0; i < Retiring.size();)
+	{
+		const RetiringAllocation& Entry = Retiring[i];
+
+		bool bComplete = true;
+		for (const GpuSyncPoint& Point : Entry.LastUse)
+		{
+			bComplete = bComplete && Timeline->IsComplete(Point);
+		}
+		if (!bComplete)
+		{
+			++i;
+			continue;
+		}
+
+		Heaps[Entry.Heap].Retiring -= Entry.Size;
+		Retiring[i] = Retiring.back();
+		Retiring.pop_back();
+	}
+}
+
+VkExtent3D ResidencyManager::GetMipExtent(const StreamedTexture& Texture, uint32_t Mip) const
+{
+	return { std::max(Texture.Desc.Width >> Mip, 1u), std::max(Texture.Desc.Height >> Mip, 1u), 1 };
+}
+
+bool ResidencyManager::CreateImage(const StreamedTexture& Texture, uint32_t ResidentMip, bool bMayUseHeadroom, TextureImage& Out)
+{
+	VkImageCreateInfo ImageInfo{};
+	ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+	ImageInfo.extent = GetMipExtent(Texture, ResidentMip);
+	ImageInfo.mipLevels = Texture.MipCount - ResidentMip;
+	ImageInfo.arrayLayers = 1;
+	ImageInfo.format = Texture.Desc.Format;
+	ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// Transfer source too, the next level change copies the kept levels out of it
+	ImageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+	TextureImage Image;
+	Image.ResidentMip = ResidentMip;
+	if (vkCreateImage(Device, &ImageInfo, nullptr, &Image.Image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create streamed texture image!");
+	}
+
+	VkMemoryRequirements Requirements;
+	vkGetImageMemoryRequirements(Device, Image.Image, &Requirements);
+	Image.Memory = AllocateLocked(Requirements, MemoryUsage::GpuOnly, bMayUseHeadroom, nullptr);
+	if (Image.Memory == VK_NULL_HANDLE)
+	{
+		vkDestroyImage(Device, Image.Image, nullptr);
+		return false;
+	}
+	vkBindImageMemory(Device, Image.Image, Image.Memory, 0);
+
+	VkImageViewCreateInfo ViewInfo{};
+	ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ViewInfo.image = Image.Image;
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	ViewInfo.format = Texture.Desc.Format;
+	ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	ViewInfo.subresourceRange.baseMipLevel = 0;
+	ViewInfo.subresourceRange.levelCount = ImageInfo.mipLevels;
+	ViewInfo.subresourceRange.baseArrayLayer = 0;
+	ViewInfo.subresourceRange.layerCount = 1;
+	if (vkCreateImageView(Device, &ViewInfo, nullptr, &Image.View) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create streamed texture image view!");
+	}
+
+	Out = Image;
+	return true;
+}
+
+void ResidencyManager::DestroyImageNow(TextureImage& Image)
+{
+	if (Image.Image == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyImageView(Device, Image.View, nullptr);
+	vkDestroyImage(Device, Image.Image, nullptr);
+	vkFreeMemory(Device, Image.Memory, nullptr);
+
+	auto Found = Allocations.find(Image.Memory);
+	if (Found != Allocations.end())
+	{
+		Heaps[Found->second.Heap].Allocated -= Found->second.Size;
+		Allocations.erase(Found);
+	}
+	Image = TextureImage();
+}
+
+void ResidencyManager::RetireImage(TextureImage& Image)
+{
+	if (Image.Image == VK_NULL_HANDLE)
+		return;
+
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, Image.View);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE, Image.Image);
+	FreeLocked(Image.Memory);
+	Image = TextureImage();
+}
+
+uint32_t ResidencyManager::GetHeap(VkDeviceMemory Memory) const
+{
+	auto Found = Allocations.find(Memory);
+	return Found != Allocations.end() ? Found->second.Heap : UINT32_MAX;
+}
+
+VkDeviceSize ResidencyManager::GetSize(VkDeviceMemory Memory) const
+{
+	auto Found = Allocations.find(Memory);
+	return Found != Allocations.end() ? Found->second.Size : 0;
+}
+
+bool ResidencyManager::BeginLevelChange(StreamedTexture& Texture, uint32_t NewMip, bool bMayUseHeadroom)
+{
+	if (!CreateImage(Texture, NewMip, bMayUseHeadroom, Texture.Next))
+		return false;
+
+	Texture.bNextRecorded = false;
+	Texture.NextLoads.clear();
+	Texture.NextLoaded.clear();
+	Texture.NextLoadJobs.reset();
+	if (NewMip >= Texture.Current.ResidentMip)
+		return true;
+
+	// Levels the current image lacks are loaded straight into staging memory
+	const uint32_t LoadCount = Texture.Current.ResidentMip - NewMip;
+	Texture.NextLoads.resize(LoadCount);
+	Texture.NextLoaded.assign(LoadCount, 0);
+	Texture.NextLoadJobs = std::make_unique<JobCounter>();
+
+	StreamedTexture* Target = &Texture;
+	for (uint32_t i = 0; i < LoadCount; ++i)
+	{
+		Jobs->Run([this, Target, NewMip, i]()
+			{
+				const VkExtent3D Extent = GetMipExtent(*Target, NewMip + i);
+				StagingReservation Staging = Uploader->ReserveStaging(static_cast<VkDeviceSize>(Extent.width) * Extent.height * 4);
+
+				bool bLoaded = false;
+				try
+				{
+					bLoaded = Target->Desc.LoadMip(NewMip + i, Staging.Data);
+				}
+				catch (const std::exception&)
+				{
+				}
+
+				// Each job owns its own element, read once the counter is done
+				Target->NextLoads[i] = Staging;
+				Target->NextLoaded[i] = bLoaded ? 1 : 0;
+			}, Texture.NextLoadJobs.get(), JobAffinity::Background);
+	}
+	return true;
+}
+
+void ResidencyManager::RecordLevelChange(StreamedTexture& Texture)
+{
+	TextureImage& Next = Texture.Next;
+
+	bool bLoaded = true;
+	for (uint8_t Iter : Texture.NextLoaded)
+	{
+		bLoaded = bLoaded && Iter != 0;
+	}
+	if (!bLoaded)
+	{
+		// Never asked for below the first level that failed
+		for (uint32_t i = 0; i < Texture.NextLoaded.size(); ++i)
+		{
+			if (!Texture.NextLoaded[i])
+				Texture.FinestLoadable = std::max(Texture.FinestLoadable, Next.ResidentMip + i + 1);
+		}
+		CancelLevelChange(Texture);
+		return;
+	}
+
+	for (uint32_t i = 0; i < Texture.NextLoads.size(); ++i)
+	{
+		const uint32_t Mip = Next.ResidentMip + i;
+		Uploader->CommitImage(Texture.NextLoads[i], Next.Image, Texture.Desc.Format, GetMipExtent(Texture, Mip), SampledLayout, Mip - Next.ResidentMip);
+	}
+	Texture.NextLoads.clear();
+	Texture.NextLoaded.clear();
+
+	const uint32_t FirstKept = std::max(Next.ResidentMip, Texture.Current.ResidentMip);
+	if (Texture.Current.Image != VK_NULL_HANDLE && FirstKept < Texture.MipCount)
+	{
+		Uploader->CopyImageMips(Texture.Current.Image, FirstKept - Texture.Current.ResidentMip, SampledLayout, Next.Image, FirstKept - Next.ResidentMip,
+			SampledLayout, Texture.Desc.Format, GetMipExtent(Texture, FirstKept), Texture.MipCount - FirstKept);
+	}
+	Texture.bNextRecorded = true;
+}
+
+void ResidencyManager::CancelLevelChange(StreamedTexture& Texture)
+{
+	// Only called once the loads are done
+	for (const StagingReservation& Staging : Texture.NextLoads)
+	{
+		if (Staging.Buffer != VK_NULL_HANDLE)
+			Uploader->CancelStaging(Staging);
+	}
+	Texture.NextLoads.clear();
+	Texture.NextLoaded.clear();
+	Texture.NextLoadJobs.reset();
+
+	// Once recorded the GPU may be copying into it
+	if (Texture.bNextRecorded)
+		RetireImage(Texture.Next);
+	else
+		DestroyImageNow(Texture.Next);
+	Texture.bNextRecorded = false;
+}
+
+void ResidencyManager::TrimLeastRecentlyUsed(uint32_t Heap, VkDeviceSize Bytes)
+{
+	std::vector<StreamedTexture*> Candidates;
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (Texture && !IsChangingLevel(*Texture) && Texture->Current.ResidentMip < GetCoarsestResident(*Texture) && GetHeap(Texture->Current.Memory) == Heap)
+			Candidates.push_back(Texture.get());
+	}
+	std::sort(Candidates.begin(), Candidates.end(), [](const StreamedTexture* A, const StreamedTexture* B) { return A->LastRequested < B->LastRequested; });
+
+	// Each drops its finest level, about three quarters of its memory. The smaller copy comes out of the headroom
+	VkDeviceSize Freed = 0;
+	for (StreamedTexture* Texture : Candidates)
+	{
+		if (Freed >= Bytes)
+			break;
+
+		const VkDeviceSize OldSize = GetSize(Texture->Current.Memory);
+		if (!BeginLevelChange(*Texture, Texture->Current.ResidentMip + 1, true))
+			break;
+
+		Freed += OldSize - std::min(GetSize(Texture->Next.Memory), OldSize);
+		Texture->WantedMip = std::max(Texture->WantedMip, Texture->Next.ResidentMip);
+	}
+}
+
+void ResidencyManager::ReclaimLocked(uint32_t Heap, VkDeviceSize Bytes)
+{
+	CollectRetired();
+
+	// Stream-ins whose loads are done but that were not recorded yet hold memory the GPU never touched
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (Texture && IsChangingLevel(*Texture) && !Texture->bNextRecorded && Texture->NextLoadJobs && Texture->NextLoadJobs->IsDone() &&
+			Texture->Next.ResidentMip < Texture->Current.ResidentMip && GetHeap(Texture->Next.Memory) == Heap)
+		{
+			CancelLevelChange(*Texture);
+		}
+	}
+
+	const VkDeviceSize Used = Heaps[Heap].GetUsed();
+	const VkDeviceSize Limit = GetLimit(Heap, false);
+	if (Used + Bytes <= Limit)
+		return;
+
+	TrimLeastRecentlyUsed(Heap, Used + Bytes - Limit);
+
+	// A worker must not stall on the GPU while holding the lock, the next Update() records and flushes the trims
+	if (std::this_thread::get_id() != MainThread)
+		return;
+
+	std::vector<StreamedTexture*> Recorded;
+	for (std::unique_ptr<StreamedTexture>& Texture : Textures)
+	{
+		if (Texture && IsChangingLevel(*Texture) && !Texture->bNextRecorded && !Texture->NextLoadJobs)
+		{
+			RecordLevelChange(*Texture);
+			Recorded.push_back(Texture.get());
+		}
+	}
+	if (Recorded.empty())
+		return;
+
+	// The allocation has to succeed now, so this waits for the copies and for every frame that may
+	// still sample the old images
+	FlushLevelChanges(Recorded);
+	for (StreamedTexture* Texture : Recorded)
+	{
+		Timeline->Wait(Texture->NextReady);
+		RetireImage(Texture->Current);
+		Texture->Current = Texture->Next;
+		Texture->Next = TextureImage();
+		Texture->bNextRecorded = false;
+	}
+	Timeline->WaitAll();
+	DeletionQueue->Collect();
+	CollectRetired();
+}
+
+void ResidencyManager::FlushLevelChanges(const std::vector<StreamedTexture*>& Recorded)
+{
+	if (Recorded.empty())
+		return;
+
+	const GpuSyncPoint Ready = Uploader->Flush();
+	for (StreamedTexture* Texture : Recorded)
+	{
+		Texture->NextReady = Ready;
+	}
+}
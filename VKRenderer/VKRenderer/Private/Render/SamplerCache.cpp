@@ -0,0 +1,144 @@
+#include "../../Public/Render/SamplerCache.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+
+static const uint64_t FnvOffsetBasis = 14695981039346656037ull;
+static const uint64_t FnvPrime = 1099511628211ull;
+
+template<typename T>
+static void HashValue(uint64_t& Hash, const T& Value)
+{
+	const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Value);
+	for (size_t i = 0; i < sizeof(T); ++i)
+	{
+		Hash = (Hash ^ Bytes[i]) * FnvPrime;
+	}
+}
+
+// Field by field, the struct has padding
+static uint64_t HashSamplerInfo(const VkSamplerCreateInfo& Info)
+{
+	uint64_t Hash = FnvOffsetBasis;
+	HashValue(Hash, Info.flags);
+	HashValue(Hash, Info.magFilter);
+	HashValue(Hash, Info.minFilter);
+	HashValue(Hash, Info.mipmapMode);
+	HashValue(Hash, Info.addressModeU);
+	HashValue(Hash, Info.addressModeV);
+	HashValue(Hash, Info.addressModeW);
+	HashValue(Hash, Info.mipLodBias);
+	HashValue(Hash, Info.anisotropyEnable);
+	HashValue(Hash, Info.maxAnisotropy);
+	HashValue(Hash, Info.compareEnable);
+	HashValue(Hash, Info.compareOp);
+	HashValue(Hash, Info.minLod);
+	HashValue(Hash, Info.maxLod);
+	HashValue(Hash, Info.borderColor);
+	HashValue(Hash, Info.unnormalizedCoordinates);
+	return Hash;
+}
+
+static bool operator==(const VkSamplerCreateInfo& A, const VkSamplerCreateInfo& B)
+{
+	return A.flags == B.flags && A.magFilter == B.magFilter && A.minFilter == B.minFilter && A.mipmapMode == B.mipmapMode &&
+		A.addressModeU == B.addressModeU && A.addressModeV == B.addressModeV && A.addressModeW == B.addressModeW &&
+		A.mipLodBias == B.mipLodBias && A.anisotropyEnable == B.anisotropyEnable && A.maxAnisotropy == B.maxAnisotropy &&
+		A.compareEnable == B.compareEnable && A.compareOp == B.compareOp && A.minLod == B.minLod && A.maxLod == B.maxLod &&
+		A.borderColor == B.borderColor && A.unnormalizedCoordinates == B.unnormalizedCoordinates;
+}
+
+static bool UsesBorder(VkSamplerAddressMode Mode)
+{
+	return Mode == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+}
+
+void SamplerCache::Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, bool bAnisotropyEnabled)
+{
+	Device = InDevice;
+
+	VkPhysicalDeviceProperties Properties;
+	vkGetPhysicalDeviceProperties(InPhysicalDevice, &Properties);
+	MaxAnisotropy = bAnisotropyEnabled ? Properties.limits.maxSamplerAnisotropy : 1.0f;
+	MaxSamplers = Properties.limits.maxSamplerAllocationCount;
+}
+
+void SamplerCache::Destroy()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	for (auto& Iter : Samplers)
+	{
+		vkDestroySampler(Device, Iter.second.Sampler, nullptr);
+	}
+	Samplers.clear();
+}
+
+VkSampler SamplerCache::Get(const VkSamplerCreateInfo& Info)
+{
+	if (Info.pNext != nullptr)
+	{
+		throw std::runtime_error("sampler create info with a pNext chain can not be cached!");
+	}
+
+	const VkSamplerCreateInfo Normalized = Normalize(Info);
+	const uint64_t Hash = HashSamplerInfo(Normalized);
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	auto Range = Samplers.equal_range(Hash);
+	for (auto Iter = Range.first; Iter != Range.second; ++Iter)
+	{
+		if (Iter->second.Info == Normalized)
+			return Iter->second.Sampler;
+	}
+
+	if (Samplers.size() >= MaxSamplers)
+	{
+		throw std::runtime_error("more than " + std::to_string(MaxSamplers) + " distinct samplers, the device supports no more!");
+	}
+
+	VkSampler Sampler;
+	if (vkCreateSampler(Device, &Normalized, nullptr, &Sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create sampler!");
+	}
+
+	Samplers.emplace(Hash, CachedSampler{ Normalized, Sampler });
+	return Sampler;
+}
+
+uint32_t SamplerCache::GetSamplerCount()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return static_cast<uint32_t>(Samplers.size());
+}
+
+VkSamplerCreateInfo SamplerCache::Normalize(const VkSamplerCreateInfo& Info) const
+{
+	VkSamplerCreateInfo Result = Info;
+	Result.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	Result.pNext = nullptr;
+
+	Result.maxAnisotropy = std::min(Result.maxAnisotropy, MaxAnisotropy);
+	if (Result.anisotropyEnable && Result.maxAnisotropy <= 1.0f)
+	{
+		Result.anisotropyEnable = VK_FALSE;
+	}
+	if (!Result.anisotropyEnable)
+	{
+		Result.maxAnisotropy = 1.0f;
+	}
+
+	if (!Result.compareEnable)
+	{
+		Result.compareOp = VK_COMPARE_OP_NEVER;
+	}
+
+	if (!UsesBorder(Result.addressModeU) && !UsesBorder(Result.addressModeV) && !UsesBorder(Result.addressModeW))
+	{
+		Result.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	}
+	return Result;
+}
@@ -0,0 +1,205 @@
+#include "../../Public/Render/ShaderHotReload.h"
+#include "../../Public/Render/PipelineManager.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <set>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Editors save in several steps (truncate, write, rename), wait for the burst to settle before compiling
+static const std::chrono::milliseconds DebounceTime(50);
+static const std::chrono::milliseconds PollInterval(250);
+
+void ShaderHotReload::Init(PipelineManager* InPipelines, const std::string& InCompilerPath)
+{
+	Pipelines = InPipelines;
+	CompilerPath = InCompilerPath;
+
+	if (CompilerPath.empty())
+	{
+		CompilerPath = "glslc";
+		if (const char* SdkPath = std::getenv("VULKAN_SDK"))
+		{
+#ifdef _WIN32
+			const fs::path SdkCompiler = fs::path(SdkPath) / "Bin" / "glslc.exe";
+#else
+			const fs::path SdkCompiler = fs::path(SdkPath) / "bin" / "glslc";
+#endif
+			std::error_code Error;
+			if (fs::exists(SdkCompiler, Error))
+				CompilerPath = SdkCompiler.string();
+		}
+	}
+}
+
+void ShaderHotReload::AddShader(const std::string& SourceFile, const std::string& OutputFile, const std::vector<std::string>& Defines)
+{
+	std::lock_guard<std::mutex> Lock(ShadersMutex);
+	Shaders.push_back(WatchedShader{ fs::path(SourceFile), fs::path(OutputFile), Defines, GetWriteTime(SourceFile) });
+}
+
+void ShaderHotReload::CompileStale()
+{
+	std::lock_guard<std::mutex> Lock(ShadersMutex);
+	for (WatchedShader& Iter : Shaders)
+	{
+		std::error_code Error;
+		if (!fs::exists(Iter.Source, Error))
+			continue;
+
+		if (!fs::exists(Iter.Output, Error) || GetWriteTime(Iter.Output) < Iter.LastWriteTime)
+		{
+			if (!Compile(Iter))
+				std::cerr << "keeping the existing " << Iter.Output.string() << "\n";
+		}
+	}
+}
+
+void ShaderHotReload::Start()
+{
+	bStopping = false;
+#ifdef __linux__
+	Watcher = std::thread(&ShaderHotReload::WatchLoop, this);
+#else
+	Watcher = std::thread(&ShaderHotReload::PollLoop, this);
+#endif
+}
+
+void ShaderHotReload::Stop()
+{
+	bStopping = true;
+	if (Watcher.joinable())
+		Watcher.join();
+}
+
+void ShaderHotReload::WatchLoop()
+{
+#ifdef __linux__
+	const int Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (Inotify < 0)
+	{
+		std::cerr << "inotify unavailable, polling shader sources\n";
+		PollLoop();
+		return;
+	}
+
+	std::set<std::string> Directories;
+	{
+		std::lock_guard<std::mutex> Lock(ShadersMutex);
+		for (const WatchedShader& Iter : Shaders)
+		{
+			const fs::path Directory = Iter.Source.has_parent_path() ? Iter.Source.parent_path() : fs::path(".");
+			Directories.insert(Directory.string());
+		}
+	}
+	// Watch directories rather than files, saving through a rename replaces the watched inode
+	for (const std::string& Directory : Directories)
+	{
+		if (inotify_add_watch(Inotify, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+			std::cerr << "failed to watch " << Directory << "\n";
+	}
+
+	alignas(inotify_event) char Buffer[4096];
+	while (!bStopping)
+	{
+		pollfd PollFd = { Inotify, POLLIN, 0 };
+		if (poll(&PollFd, 1, 100) <= 0)
+			continue;
+
+		// Drain the burst, the events only tell us to look at the file times
+		do
+		{
+			while (read(Inotify, Buffer, sizeof(Buffer)) > 0)
+			{
+			}
+			std::this_thread::sleep_for(DebounceTime);
+		} while (poll(&PollFd, 1, 0) > 0 && !bStopping);
+
+		std::lock_guard<std::mutex> Lock(ShadersMutex);
+		for (WatchedShader& Iter : Shaders)
+		{
+			OnSourceChanged(Iter);
+		}
+	}
+
+	close(Inotify);
+#endif
+}
+
+void ShaderHotReload::PollLoop()
+{
+	while (!bStopping)
+	{
+		std::this_thread::sleep_for(PollInterval);
+
+		std::lock_guard<std::mutex> Lock(ShadersMutex);
+		for (WatchedShader& Iter : Shaders)
+		{
+			OnSourceChanged(Iter);
+		}
+	}
+}
+
+void ShaderHotReload::OnSourceChanged(WatchedShader& Shader)
+{
+	const fs::file_time_type WriteTime = GetWriteTime(Shader.Source);
+	if (WriteTime == fs::file_time_type::min() || WriteTime == Shader.LastWriteTime)
+		return;
+
+	Shader.LastWriteTime = WriteTime;
+	if (Compile(Shader))
+	{
+		std::cout << "reloading " << Shader.Source.string() << "\n";
+		Pipelines->ReloadShader(Shader.Output.string());
+	}
+}
+
+bool ShaderHotReload::Compile(const WatchedShader& Shader) const
+{
+	// Compile next to the output and move it over only on success, a broken edit keeps the last good SPIR-V
+	fs::path TempOutput = Shader.Output;
+	TempOutput += ".tmp";
+
+	std::string Command = "\"" + CompilerPath + "\"";
+	for (const std::string& Define : Shader.Defines)
+	{
+		Command += " -D" + Define;
+	}
+	Command += " \"" + Shader.Source.string() + "\" -o \"" + TempOutput.string() + "\"";
+#ifdef _WIN32
+	// cmd.exe strips the first and last quote of the line
+	Command = "\"" + Command + "\"";
+#endif
+
+	if (std::system(Command.c_str()) != 0)
+	{
+		std::cerr << "failed to compile " << Shader.Source.string() << "\n";
+		std::error_code Error;
+		fs::remove(TempOutput, Error);
+		return false;
+	}
+
+	std::error_code Error;
+	fs::rename(TempOutput, Shader.Output, Error);
+	if (Error)
+	{
+		std::cerr << "failed to replace " << Shader.Output.string() << ": " << Error.message() << "\n";
+		return false;
+	}
+	return true;
+}
+
+fs::file_time_type ShaderHotReload::GetWriteTime(const fs::path& File)
+{
+	std::error_code Error;
+	const fs::file_time_type WriteTime = fs::last_write_time(File, Error);
+	return Error ? fs::file_time_type::min() : WriteTime;
+}
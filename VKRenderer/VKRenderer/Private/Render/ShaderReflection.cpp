@@ -0,0 +1,522 @@
+#include "../../Public/Render/ShaderReflection.h"
+#include "../../Public/Common/FunctionLibrary.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+
+// The subset of the SPIR-V specification the parser needs
+namespace Spv
+{
+	const uint32_t Magic = 0x07230203;
+	const uint32_t HeaderWords = 5;
+
+	enum Op : uint32_t
+	{
+		OpName = 5,
+		OpEntryPoint = 15,
+		OpTypeBool = 20,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72
+	};
+
+	enum Decoration : uint32_t
+	{
+		Block = 2,
+		BufferBlock = 3,
+		ArrayStride = 6,
+		MatrixStride = 7,
+		BuiltIn = 11,
+		Location = 30,
+		Binding = 33,
+		DescriptorSet = 34,
+		Offset = 35
+	};
+
+	enum StorageClass : uint32_t
+	{
+		UniformConstant = 0,
+		Input = 1,
+		Uniform = 2,
+		PushConstant = 9,
+		StorageBuffer = 12
+	};
+
+	enum Dim : uint32_t
+	{
+		DimBuffer = 5,
+		DimSubpassData = 6
+	};
+
+	enum ExecutionModel : uint32_t
+	{
+		Vertex = 0,
+		TessellationControl = 1,
+		TessellationEvaluation = 2,
+		Geometry = 3,
+		Fragment = 4,
+		GLCompute = 5
+	};
+}
+
+namespace
+{
+	struct IdInfo
+	{
+		uint32_t Opcode = 0;
+		const uint32_t* Operands = nullptr;   // words after the opcode word
+		uint32_t OperandCount = 0;
+
+		std::string Name;
+		uint32_t Set = 0;
+		uint32_t Binding = UINT32_MAX;
+		uint32_t Location = UINT32_MAX;
+		uint32_t ArrayStride = 0;
+		bool bBuiltIn = false;
+		bool bBlock = false;
+		bool bBufferBlock = false;
+
+		std::vector<uint32_t> MemberOffsets;
+		std::vector<uint32_t> MemberMatrixStrides;
+	};
+
+	class SpirvModule
+	{
+	public:
+		SpirvModule(const uint32_t* Code, size_t WordCount)
+		{
+			if (WordCount < Spv::HeaderWords || Code[0] != Spv::Magic)
+			{
+				throw std::runtime_error("not a SPIR-V module");
+			}
+
+			Ids.resize(Code[3]);   // id bound
+
+			size_t Word = Spv::HeaderWords;
+			while (Word < WordCount)
+			{
+				const uint32_t Opcode = Code[Word] & 0xffff;
+				const uint32_t Length = Code[Word] >> 16;
+				if (Length == 0 || Word + Length > WordCount)
+				{
+					throw std::runtime_error("truncated SPIR-V instruction");
+				}
+
+				Parse(Opcode, Code + Word + 1, Length - 1);
+				Word += Length;
+			}
+		}
+
+		const IdInfo& Get(uint32_t Id) const
+		{
+			if (Id >= Ids.size())
+			{
+				throw std::runtime_error("SPIR-V id out of range");
+			}
+			return Ids[Id];
+		}
+
+		VkShaderStageFlags Stages = 0;
+		std::vector<uint32_t> Variables;
+
+	private:
+		IdInfo& At(uint32_t Id)
+		{
+			if (Id >= Ids.size())
+			{
+				throw std::runtime_error("SPIR-V id out of range");
+			}
+			return Ids[Id];
+		}
+
+		void Parse(uint32_t Opcode, const uint32_t* Operands, uint32_t Count)
+		{
+			switch (Opcode)
+			{
+			case Spv::OpName:
+				if (Count >= 2)
+					At(Operands[0]).Name = reinterpret_cast<const char*>(Operands + 1);
+				break;
+			case Spv::OpEntryPoint:
+				if (Count >= 1)
+					Stages |= ToStage(Operands[0]);
+				break;
+			case Spv::OpDecorate:
+				if (Count >= 2)
+					Decorate(At(Operands[0]), Operands[1], Count >= 3 ? Operands[2] : 0);
+				break;
+			case Spv::OpMemberDecorate:
+				if (Count >= 4)
+					DecorateMember(At(Operands[0]), Operands[1], Operands[2], Operands[3]);
+				break;
+			case Spv::OpVariable:
+				if (Count >= 3)
+				{
+					Define(Operands[1], Opcode, Operands, Count);
+					Variables.push_back(Operands[1]);
+				}
+				break;
+			case Spv::OpConstant:
+				if (Count >= 3)
+					Define(Operands[1], Opcode, Operands, Count);
+				break;
+			case Spv::OpTypeBool:
+			case Spv::OpTypeInt:
+			case Spv::OpTypeFloat:
+			case Spv::OpTypeVector:
+			case Spv::OpTypeMatrix:
+			case Spv::OpTypeImage:
+			case Spv::OpTypeSampler:
+			case Spv::OpTypeSampledImage:
+			case Spv::OpTypeArray:
+			case Spv::OpTypeRuntimeArray:
+			case Spv::OpTypeStruct:
+			case Spv::OpTypePointer:
+				if (Count >= 1)
+					Define(Operands[0], Opcode, Operands, Count);
+				break;
+			default:
+				break;
+			}
+		}
+
+		void Define(uint32_t Id, uint32_t Opcode, const uint32_t* Operands, uint32_t Count)
+		{
+			IdInfo& Info = At(Id);
+			Info.Opcode = Opcode;
+			Info.Operands = Operands;
+			Info.OperandCount = Count;
+		}
+
+		static void Decorate(IdInfo& Info, uint32_t Decoration, uint32_t Value)
+		{
+			switch (Decoration)
+			{
+			case Spv::Block: Info.bBlock = true; break;
+			case Spv::BufferBlock: Info.bBufferBlock = true; break;
+			case Spv::ArrayStride: Info.ArrayStride = Value; break;
+			case Spv::BuiltIn: Info.bBuiltIn = true; break;
+			case Spv::Location: Info.Location = Value; break;
+			case Spv::Binding: Info.Binding = Value; break;
+			case Spv::DescriptorSet: Info.Set = Value; break;
+			default: break;
+			}
+		}
+
+		static void DecorateMember(IdInfo& Info, uint32_t Member, uint32_t Decoration, uint32_t Value)
+		{
+			if (Decoration == Spv::BuiltIn)
+			{
+				Info.bBuiltIn = true;
+			}
+			else if (Decoration == Spv::Offset)
+			{
+				if (Info.MemberOffsets.size() <= Member)
+					Info.MemberOffsets.resize(Member + 1, 0);
+				Info.MemberOffsets[Member] = Value;
+			}
+			else if (Decoration == Spv::MatrixStride)
+			{
+				if (Info.MemberMatrixStrides.size() <= Member)
+					Info.MemberMatrixStrides.resize(Member + 1, 0);
+				Info.MemberMatrixStrides[Member] = Value;
+			}
+		}
+
+		static VkShaderStageFlags ToStage(uint32_t ExecutionModel)
+		{
+			switch (ExecutionModel)
+			{
+			case Spv::Vertex: return VK_SHADER_STAGE_VERTEX_BIT;
+			case Spv::TessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+			case Spv::TessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+			case Spv::Geometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+			case Spv::Fragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+			case Spv::GLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+			default: return 0;
+			}
+		}
+
+		std::vector<IdInfo> Ids;
+	};
+
+	// Length operand of an OpTypeArray. Specialization constants and other computed lengths are not known
+	// until the pipeline is created, so they can not be reflected
+	uint32_t GetArrayLength(const SpirvModule& Module, uint32_t LengthId)
+	{
+		const IdInfo& Length = Module.Get(LengthId);
+		if (Length.Opcode != Spv::OpConstant || Length.OperandCount < 3)
+		{
+			throw std::runtime_error("SPIR-V array length is not an OpConstant (specialization constant sized arrays are not supported)");
+		}
+		return Length.Operands[2];
+	}
+
+	// Size of a type in a Block/push constant struct, from the explicit layout decorations
+	uint32_t GetTypeSize(const SpirvModule& Module, uint32_t TypeId, uint32_t MatrixStride = 0)
+	{
+		const IdInfo& Type = Module.Get(TypeId);
+		switch (Type.Opcode)
+		{
+		case Spv::OpTypeBool:
+			return 4;
+		case Spv::OpTypeInt:
+		case Spv::OpTypeFloat:
+			return Type.Operands[1] / 8;
+		case Spv::OpTypeVector:
+			return GetTypeSize(Module, Type.Operands[1]) * Type.Operands[2];
+		case Spv::OpTypeMatrix:
+			// Column major, each column padded to the stride
+			if (MatrixStride != 0)
+				return MatrixStride * Type.Operands[2];
+			return GetTypeSize(Module, Type.Operands[1]) * Type.Operands[2];
+		case Spv::OpTypeArray:
+		{
+			const uint32_t Stride = Type.ArrayStride != 0 ? Type.ArrayStride : GetTypeSize(Module, Type.Operands[1], MatrixStride);
+			return Stride * GetArrayLength(Module, Type.Operands[2]);
+		}
+		case Spv::OpTypeRuntimeArray:
+			return 0;
+		case Spv::OpTypeStruct:
+		{
+			uint32_t Size = 0;
+			for (uint32_t Member = 1; Member < Type.OperandCount; ++Member)
+			{
+				const uint32_t Index = Member - 1;
+				const uint32_t Offset = Index < Type.MemberOffsets.size() ? Type.MemberOffsets[Index] : 0;
+				const uint32_t Stride = Index < Type.MemberMatrixStrides.size() ? Type.MemberMatrixStrides[Index] : 0;
+				Size = std::max(Size, Offset + GetTypeSize(Module, Type.Operands[Member], Stride));
+			}
+			return Size;
+		}
+		default:
+			throw std::runtime_error("unsupported type in SPIR-V block");
+		}
+	}
+
+	VkFormat GetVertexFormat(const SpirvModule& Module, uint32_t TypeId)
+	{
+		const IdInfo& Type = Module.Get(TypeId);
+
+		uint32_t Components = 1;
+		const IdInfo* Scalar = &Type;
+		if (Type.Opcode == Spv::OpTypeVector)
+		{
+			Components = Type.Operands[2];
+			Scalar = &Module.Get(Type.Operands[1]);
+		}
+
+		if (Scalar->Opcode == Spv::OpTypeFloat && Scalar->Operands[1] == 32)
+		{
+			const VkFormat Formats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+			return Formats[Components - 1];
+		}
+		if (Scalar->Opcode == Spv::OpTypeInt && Scalar->Operands[1] == 32)
+		{
+			const bool bSigned = Scalar->Operands[2] != 0;
+			const VkFormat SignedFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+			const VkFormat UnsignedFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+			return bSigned ? SignedFormats[Components - 1] : UnsignedFormats[Components - 1];
+		}
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	VkDescriptorType GetDescriptorType(const SpirvModule& Module, uint32_t StorageClass, const IdInfo& Type)
+	{
+		if (StorageClass == Spv::StorageBuffer)
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		if (StorageClass == Spv::Uniform)
+			return Type.bBufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+		switch (Type.Opcode)
+		{
+		case Spv::OpTypeSampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case Spv::OpTypeSampledImage:
+		{
+			const IdInfo& Image = Module.Get(Type.Operands[1]);
+			return Image.Operands[2] == Spv::DimBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		}
+		case Spv::OpTypeImage:
+		{
+			const uint32_t Dim = Type.Operands[2];
+			const bool bStorage = Type.Operands[6] == 2;
+			if (Dim == Spv::DimSubpassData)
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			if (Dim == Spv::DimBuffer)
+				return bStorage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			return bStorage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		default:
+			throw std::runtime_error("unsupported descriptor type in SPIR-V");
+		}
+	}
+}
+
+ShaderReflection ShaderReflection::Reflect(const uint32_t* Code, size_t WordCount)
+{
+	const SpirvModule Module(Code, WordCount);
+
+	ShaderReflection Result;
+	Result.Stages = Module.Stages;
+
+	for (uint32_t VariableId : Module.Variables)
+	{
+		const IdInfo& Variable = Module.Get(VariableId);
+		const uint32_t StorageClass = Variable.Operands[2];
+
+		const IdInfo& Pointer = Module.Get(Variable.Operands[0]);
+		uint32_t TypeId = Pointer.Operands[2];
+
+		switch (StorageClass)
+		{
+		case Spv::UniformConstant:
+		case Spv::Uniform:
+		case Spv::StorageBuffer:
+		{
+			if (Variable.Binding == UINT32_MAX)
+				break;
+
+			// Arrays of resources are one binding with a descriptor count
+			uint32_t Count = 1;
+			const IdInfo* Type = &Module.Get(TypeId);
+			while (Type->Opcode == Spv::OpTypeArray || Type->Opcode == Spv::OpTypeRuntimeArray)
+			{
+				Count = Type->Opcode == Spv::OpTypeArray ? Count * GetArrayLength(Module, Type->Operands[2]) : 0;
+				Type = &Module.Get(Type->Operands[1]);
+			}
+
+			ReflectedBinding Binding;
+			Binding.Set = Variable.Set;
+			Binding.Binding = Variable.Binding;
+			Binding.DescriptorType = GetDescriptorType(Module, StorageClass, *Type);
+			Binding.Count = Count;
+			Binding.StageFlags = Module.Stages;
+			Binding.Name = Variable.Name.empty() ? Type->Name : Variable.Name;
+			Result.Bindings.push_back(Binding);
+			break;
+		}
+		case Spv::PushConstant:
+		{
+			VkPushConstantRange Range;
+			Range.stageFlags = Module.Stages;
+			Range.offset = 0;
+			Range.size = GetTypeSize(Module, TypeId);
+
+			// Members before the first used offset belong to another stage's range
+			const IdInfo& Block = Module.Get(TypeId);
+			if (!Block.MemberOffsets.empty())
+				Range.offset = *std::min_element(Block.MemberOffsets.begin(), Block.MemberOffsets.end());
+			Range.size -= Range.offset;
+
+			Result.PushConstants.push_back(Range);
+			break;
+		}
+		case Spv::Input:
+		{
+			const IdInfo& Type = Module.Get(TypeId);
+			if ((Module.Stages & VK_SHADER_STAGE_VERTEX_BIT) == 0 || Variable.bBuiltIn || Type.bBuiltIn || Variable.Location == UINT32_MAX)
+				break;
+
+			ReflectedVertexInput Input;
+			Input.Location = Variable.Location;
+			Input.Format = GetVertexFormat(Module, TypeId);
+			Result.VertexInputs.push_back(Input);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	std::sort(Result.Bindings.begin(), Result.Bindings.end(), [](const ReflectedBinding& A, const ReflectedBinding& B)
+		{
+			return A.Set != B.Set ? A.Set < B.Set : A.Binding < B.Binding;
+		});
+	std::sort(Result.VertexInputs.begin(), Result.VertexInputs.end(), [](const ReflectedVertexInput& A, const ReflectedVertexInput& B)
+		{
+			return A.Location < B.Location;
+		});
+
+	return Result;
+}
+
+ShaderReflection ShaderReflection::ReflectFile(const std::string& FileName)
+{
+	const std::vector<char> Code = ReadFile(FileName);
+
+	std::vector<uint32_t> Words(Code.size() / sizeof(uint32_t));
+	std::copy(Code.begin(), Code.begin() + Words.size() * sizeof(uint32_t), reinterpret_cast<char*>(Words.data()));
+
+	return Reflect(Words.data(), Words.size());
+}
+
+void ShaderReflection::Merge(const ShaderReflection& Other)
+{
+	Stages |= Other.Stages;
+
+	for (const ReflectedBinding& Binding : Other.Bindings)
+	{
+		auto Existing = std::find_if(Bindings.begin(), Bindings.end(), [&Binding](const ReflectedBinding& Iter)
+			{
+				return Iter.Set == Binding.Set && Iter.Binding == Binding.Binding;
+			});
+
+		if (Existing == Bindings.end())
+		{
+			Bindings.push_back(Binding);
+			continue;
+		}
+
+		if (Existing->DescriptorType != Binding.DescriptorType || Existing->Count != Binding.Count)
+		{
+			throw std::runtime_error("shader stages disagree on descriptor set " + std::to_string(Binding.Set) + " binding " + std::to_string(Binding.Binding));
+		}
+		Existing->StageFlags |= Binding.StageFlags;
+	}
+
+	// Identical ranges are shared by the stages, anything else stays a separate range
+	for (const VkPushConstantRange& Range : Other.PushConstants)
+	{
+		auto Existing = std::find_if(PushConstants.begin(), PushConstants.end(), [&Range](const VkPushConstantRange& Iter)
+			{
+				return Iter.offset == Range.offset && Iter.size == Range.size;
+			});
+
+		if (Existing != PushConstants.end())
+			Existing->stageFlags |= Range.stageFlags;
+		else
+			PushConstants.push_back(Range);
+	}
+
+	VertexInputs.insert(VertexInputs.end(), Other.VertexInputs.begin(), Other.VertexInputs.end());
+
+	std::sort(Bindings.begin(), Bindings.end(), [](const ReflectedBinding& A, const ReflectedBinding& B)
+		{
+			return A.Set != B.Set ? A.Set < B.Set : A.Binding < B.Binding;
+		});
+}
+
+const ReflectedBinding* ShaderReflection::FindBinding(const std::string& Name) const
+{
+	for (const ReflectedBinding& Iter : Bindings)
+	{
+		if (Iter.Name == Name)
+			return &Iter;
+	}
+	return nullptr;
+}
@@ -0,0 +1,349 @@
+#include "../../Public/Render/TextureDecoder.h"
+#include "../../Public/Core/JobSystem.h"
+#include "../../Public/Common/FunctionLibrary.h"
+
+#include <stb_image.h>
+
+#include <stdexcept>
+#include <filesystem>
+#include <chrono>
+#include <atomic>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+// Faster decoders are picked up when their headers are on the include path. Define
+// TEXTUREDECODER_NO_SPNG / TEXTUREDECODER_NO_TURBOJPEG to leave one out even though it is installed
+#if defined(__has_include)
+#if __has_include(<spng.h>) && !defined(TEXTUREDECODER_NO_SPNG)
+#include <spng.h>
+#define TEXTUREDECODER_SPNG
+#endif
+#if __has_include(<turbojpeg.h>) && !defined(TEXTUREDECODER_NO_TURBOJPEG)
+#include <turbojpeg.h>
+#define TEXTUREDECODER_TURBOJPEG
+#endif
+#endif
+
+#if defined(_MSC_VER) && defined(TEXTUREDECODER_SPNG)
+#pragma comment(lib, "spng.lib")
+#endif
+#if defined(_MSC_VER) && defined(TEXTUREDECODER_TURBOJPEG)
+#pragma comment(lib, "turbojpeg.lib")
+#endif
+
+namespace fs = std::filesystem;
+
+// stb_image: every common format, but it always decodes into its own allocation
+static bool StbAccepts(const uint8_t* /*Data*/, size_t Size)
+{
+	return Size > 0;
+}
+
+static bool StbReadInfo(const uint8_t* Data, size_t Size, uint32_t& OutWidth, uint32_t& OutHeight)
+{
+	int Width, Height, Channels;
+	if (!stbi_info_from_memory(Data, static_cast<int>(Size), &Width, &Height, &Channels))
+		return false;
+
+	OutWidth = static_cast<uint32_t>(Width);
+	OutHeight = static_cast<uint32_t>(Height);
+	return true;
+}
+
+static bool StbDecode(const uint8_t* Data, size_t Size, uint8_t* Out, size_t OutSize)
+{
+	int Width, Height, Channels;
+	stbi_uc* Pixels = stbi_load_from_memory(Data, static_cast<int>(Size), &Width, &Height, &Channels, STBI_rgb_alpha);
+	if (!Pixels)
+		return false;
+
+	const bool bSizeMatches = static_cast<size_t>(Width) * static_cast<size_t>(Height) * 4 == OutSize;
+	if (bSizeMatches)
+		memcpy(Out, Pixels, OutSize);
+
+	stbi_image_free(Pixels);
+	return bSizeMatches;
+}
+
+#if defined(TEXTUREDECODER_SPNG)
+static bool SpngAccepts(const uint8_t* Data, size_t Size)
+{
+	static const uint8_t Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	return Size >= sizeof(Signature) && memcmp(Data, Signature, sizeof(Signature)) == 0;
+}
+
+static bool SpngReadInfo(const uint8_t* Data, size_t Size, uint32_t& OutWidth, uint32_t& OutHeight)
+{
+	spng_ctx* Context = spng_ctx_new(0);
+	if (!Context)
+		return false;
+
+	spng_ihdr Header;
+	const bool bOk = spng_set_png_buffer(Context, Data, Size) == 0 && spng_get_ihdr(Context, &Header) == 0;
+	spng_ctx_free(Context);
+	if (!bOk)
+		return false;
+
+	OutWidth = Header.width;
+	OutHeight = Header.height;
+	return true;
+}
+
+static bool SpngDecode(const uint8_t* Data, size_t Size, uint8_t* Out, size_t OutSize)
+{
+	spng_ctx* Context = spng_ctx_new(0);
+	if (!Context)
+		return false;
+
+	// Rows are written to Out front to back and never read back, fine for write-combined staging memory
+	size_t DecodedSize = 0;
+	const bool bOk = spng_set_png_buffer(Context, Data, Size) == 0 &&
+		spng_decoded_image_size(Context, SPNG_FMT_RGBA8, &DecodedSize) == 0 && DecodedSize == OutSize &&
+		spng_decode_image(Context, Out, OutSize, SPNG_FMT_RGBA8, SPNG_DECODE_TRNS) == 0;
+	spng_ctx_free(Context);
+	return bOk;
+}
+#endif
+
+#if defined(TEXTUREDECODER_TURBOJPEG)
+// One handle per thread, creating one per image costs about as much as decoding a small JPEG
+static tjhandle GetTurboJpegHandle()
+{
+	struct HandleHolder
+	{
+		tjhandle Handle = tjInitDecompress();
+		~HandleHolder()
+		{
+			if (Handle)
+				tjDestroy(Handle);
+		}
+	};
+	static thread_local HandleHolder Holder;
+	return Holder.Handle;
+}
+
+static bool TurboJpegAccepts(const uint8_t* Data, size_t Size)
+{
+	return Size >= 3 && Data[0] == 0xFF && Data[1] == 0xD8 && Data[2] == 0xFF;
+}
+
+static bool TurboJpegReadInfo(const uint8_t* Data, size_t Size, uint32_t& OutWidth, uint32_t& OutHeight)
+{
+	tjhandle Handle = GetTurboJpegHandle();
+	int Width, Height, Subsampling, Colorspace;
+	if (!Handle || tjDecompressHeader3(Handle, Data, static_cast<unsigned long>(Size), &Width, &Height, &Subsampling, &Colorspace) != 0)
+		return false;
+
+	OutWidth = static_cast<uint32_t>(Width);
+	OutHeight = static_cast<uint32_t>(Height);
+	return true;
+}
+
+static bool TurboJpegDecode(const uint8_t* Data, size_t Size, uint8_t* Out, size_t OutSize)
+{
+	uint32_t Width, Height;
+	if (!TurboJpegReadInfo(Data, Size, Width, Height) || static_cast<size_t>(Width) * Height * 4 != OutSize)
+		return false;
+
+	// TJPF_RGBA fills alpha with 255
+	return tjDecompress2(GetTurboJpegHandle(), Data, static_cast<unsigned long>(Size), Out, static_cast<int>(Width), static_cast<int>(Width * 4),
+		static_cast<int>(Height), TJPF_RGBA, 0) == 0;
+}
+#endif
+
+static std::vector<ImageDecoderBackend>& GetBackendList()
+{
+	static std::vector<ImageDecoderBackend> Backends = []()
+	{
+		std::vector<ImageDecoderBackend> BuiltIn;
+#if defined(TEXTUREDECODER_SPNG)
+		BuiltIn.push_back(ImageDecoderBackend{ "spng", SpngAccepts, SpngReadInfo, SpngDecode });
+#endif
+#if defined(TEXTUREDECODER_TURBOJPEG)
+		BuiltIn.push_back(ImageDecoderBackend{ "turbojpeg", TurboJpegAccepts, TurboJpegReadInfo, TurboJpegDecode });
+#endif
+		BuiltIn.push_back(ImageDecoderBackend{ "stb_image", StbAccepts, StbReadInfo, StbDecode });
+		return BuiltIn;
+	}();
+	return Backends;
+}
+
+void TextureDecoder::Init(JobSystem* InJobs, UploadContext* InUploader, TextureImageAllocator InAllocateImage)
+{
+	Jobs = InJobs;
+	Uploader = InUploader;
+	AllocateImage = std::move(InAllocateImage);
+}
+
+void TextureDecoder::Load(const std::string& File, VkFormat Format, DecodedTexture& Out, JobCounter& Done)
+{
+	Jobs->Run([this, File, Format, &Out]() { Decode(File, Format, Out); }, &Done, JobAffinity::Background);
+}
+
+void TextureDecoder::RegisterBackend(const ImageDecoderBackend& Backend)
+{
+	std::vector<ImageDecoderBackend>& Backends = GetBackendList();
+	Backends.insert(Backends.begin(), Backend);
+}
+
+const std::vector<ImageDecoderBackend>& TextureDecoder::GetBackends()
+{
+	return GetBackendList();
+}
+
+const ImageDecoderBackend* TextureDecoder::FindBackend(const uint8_t* Data, size_t Size)
+{
+	for (const ImageDecoderBackend& Backend : GetBackendList())
+	{
+		if (Backend.Accepts(Data, Size))
+			return &Backend;
+	}
+	return nullptr;
+}
+
+void TextureDecoder::Decode(const std::string& File, VkFormat Format, DecodedTexture& Out)
+{
+	// Runs as a job, errors are handed back in Out instead of thrown
+	StagingReservation Staging;
+	try
+	{
+		const std::vector<char> Data = ReadFile(File);
+		const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(Data.data());
+
+		const ImageDecoderBackend* Backend = FindBackend(Bytes, Data.size());
+		if (!Backend || !Backend->ReadInfo(Bytes, Data.size(), Out.Width, Out.Height))
+		{
+			throw std::runtime_error("unsupported image format");
+		}
+		Out.Backend = Backend->Name;
+
+		const VkDeviceSize Size = static_cast<VkDeviceSize>(Out.Width) * Out.Height * 4;
+		Staging = Uploader->ReserveStaging(Size);
+		if (!Backend->Decode(Bytes, Data.size(), Staging.Data, static_cast<size_t>(Size)))
+		{
+			throw std::runtime_error(std::string("failed to decode with ") + Backend->Name);
+		}
+
+		AllocateImage(Out.Width, Out.Height, Format, Out.Image, Out.Memory);
+
+		const VkExtent3D Extent = { Out.Width, Out.Height, 1 };
+		Uploader->CommitImage(Staging, Out.Image, Format, Extent, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	catch (const std::exception& Error)
+	{
+		if (Staging.Buffer != VK_NULL_HANDLE)
+			Uploader->CancelStaging(Staging);
+		Out.Error = File + ": " + Error.what();
+	}
+}
+
+std::vector<std::vector<uint8_t>> TextureDecoder::BuildMipChain(std::vector<uint8_t> Pixels, uint32_t Width, uint32_t Height, uint32_t MaxLevels)
+{
+	std::vector<std::vector<uint8_t>> Mips;
+	Mips.push_back(std::move(Pixels));
+
+	while ((Width > 1 || Height > 1) && Mips.size() < MaxLevels)
+	{
+		const uint32_t DstWidth = std::max(Width / 2, 1u);
+		const uint32_t DstHeight = std::max(Height / 2, 1u);
+		const std::vector<uint8_t>& Src = Mips.back();
+		std::vector<uint8_t> Dst(static_cast<size_t>(DstWidth) * DstHeight * 4);
+
+		// Odd edges repeat their last row / column
+		for (uint32_t Y = 0; Y < DstHeight; ++Y)
+		{
+			const size_t Row0 = static_cast<size_t>(std::min(Y * 2, Height - 1)) * Width;
+			const size_t Row1 = static_cast<size_t>(std::min(Y * 2 + 1, Height - 1)) * Width;
+			for (uint32_t X = 0; X < DstWidth; ++X)
+			{
+				const uint32_t X0 = std::min(X * 2, Width - 1);
+				const uint32_t X1 = std::min(X * 2 + 1, Width - 1);
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					const uint32_t Sum = Src[(Row0 + X0) * 4 + c] + Src[(Row0 + X1) * 4 + c] + Src[(Row1 + X0) * 4 + c] + Src[(Row1 + X1) * 4 + c];
+					Dst[(static_cast<size_t>(Y) * DstWidth + X) * 4 + c] = static_cast<uint8_t>((Sum + 2) / 4);
+				}
+			}
+		}
+
+		Mips.push_back(std::move(Dst));
+		Width = DstWidth;
+		Height = DstHeight;
+	}
+	return Mips;
+}
+
+void TextureDecoder::RunBenchmark(const std::string& Directory, JobSystem& Jobs, std::ostream& Out)
+{
+	struct SourceFile
+	{
+		std::vector<uint8_t> Data;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+	};
+
+	std::vector<SourceFile> Files;
+	size_t TotalBytes = 0;
+	std::error_code Error;
+	for (const fs::directory_entry& Entry : fs::directory_iterator(Directory, Error))
+	{
+		if (!Entry.is_regular_file())
+			continue;
+
+		const std::vector<char> Data = ReadFile(Entry.path().string());
+		Files.push_back(SourceFile{ std::vector<uint8_t>(Data.begin(), Data.end()) });
+		TotalBytes += Data.size();
+	}
+
+	Out << std::fixed << std::setprecision(1);
+	Out << "decode benchmark: " << Files.size() << " files, " << TotalBytes / (1024.0 * 1024.0) << " MB in " << Directory << '\n';
+
+	for (const ImageDecoderBackend& Backend : GetBackends())
+	{
+		std::vector<uint32_t> Accepted;
+		double MegaPixels = 0.0;
+		for (uint32_t i = 0; i < Files.size(); ++i)
+		{
+			SourceFile& Iter = Files[i];
+			if (Backend.Accepts(Iter.Data.data(), Iter.Data.size()) && Backend.ReadInfo(Iter.Data.data(), Iter.Data.size(), Iter.Width, Iter.Height))
+			{
+				Accepted.push_back(i);
+				MegaPixels += static_cast<double>(Iter.Width) * Iter.Height / 1e6;
+			}
+		}
+		if (Accepted.empty())
+			continue;
+
+		std::atomic<uint32_t> Failures{ 0 };
+		auto DecodeRange = [&](uint32_t Begin, uint32_t End)
+		{
+			std::vector<uint8_t> Pixels;
+			for (uint32_t i = Begin; i < End; ++i)
+			{
+				const SourceFile& Iter = Files[Accepted[i]];
+				Pixels.resize(static_cast<size_t>(Iter.Width) * Iter.Height * 4);
+				if (!Backend.Decode(Iter.Data.data(), Iter.Data.size(), Pixels.data(), Pixels.size()))
+					++Failures;
+			}
+		};
+
+		const uint32_t Count = static_cast<uint32_t>(Accepted.size());
+
+		auto Start = std::chrono::steady_clock::now();
+		DecodeRange(0, Count);
+		const double SingleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+		Start = std::chrono::steady_clock::now();
+		Jobs.ParallelFor(Count, 1, DecodeRange);
+		const double PoolSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+		Out << "  " << std::left << std::setw(10) << Backend.Name << std::right << std::setw(5) << Count << " images "
+			<< std::setw(8) << MegaPixels << " MPix   1 thread " << std::setw(8) << MegaPixels / SingleSeconds << " MPix/s   "
+			<< Jobs.GetThreadCount() << " threads " << std::setw(8) << MegaPixels / PoolSeconds << " MPix/s";
+		if (Failures.load() > 0)
+			Out << "   (" << Failures.load() << " failed)";
+		Out << '\n';
+	}
+	Out << std::defaultfloat;
+}
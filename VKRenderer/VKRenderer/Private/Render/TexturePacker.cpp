@@ -0,0 +1,520 @@
+#include "../../Public/Render/TexturePacker.h"
+#include "../../Public/Render/TextureDecoder.h"
+#include "../../Public/Render/ResidencyManager.h"
+#include "../../Public/Render/UploadContext.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+#include "../../Public/Core/JobSystem.h"
+#include "../../Public/Common/FunctionLibrary.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cmath>
+
+namespace fs = std::filesystem;
+
+static const uint32_t TexturePackMagic = 0x50544B56;   // "VKTP"
+static const uint32_t TexturePackVersion = 1;
+
+static bool IsPowerOfTwo(uint32_t Value)
+{
+	return Value != 0 && (Value & (Value - 1)) == 0;
+}
+
+static uint32_t AlignUp(uint32_t Value, uint32_t Alignment)
+{
+	return (Value + Alignment - 1) / Alignment * Alignment;
+}
+
+static uint32_t GetFullMipCount(uint32_t Width, uint32_t Height)
+{
+	return static_cast<uint32_t>(std::floor(std::log2(std::max(Width, Height)))) + 1;
+}
+
+static size_t GetLayerBytes(const PackedTextureSet& Set, uint32_t Mip)
+{
+	return static_cast<size_t>(std::max(Set.Width >> Mip, 1u)) * std::max(Set.Height >> Mip, 1u) * 4;
+}
+
+static void ForEachLayer(JobSystem* Jobs, uint32_t Count, const std::function<void(uint32_t)>& Function)
+{
+	if (!Jobs)
+	{
+		for (uint32_t i = 0; i < Count; ++i)
+			Function(i);
+		return;
+	}
+
+	Jobs->ParallelFor(Count, 1, [&Function](uint32_t Begin, uint32_t End)
+		{
+			for (uint32_t i = Begin; i < End; ++i)
+				Function(i);
+		});
+}
+
+// Writes the chain of one layer into the set, Pixels is level 0 of the layer
+static void StoreLayerMips(PackedTextureSet& Set, uint32_t Layer, std::vector<uint8_t> Pixels)
+{
+	std::vector<std::vector<uint8_t>> Mips = TextureDecoder::BuildMipChain(std::move(Pixels), Set.Width, Set.Height, Set.MipCount);
+	for (uint32_t Mip = 0; Mip < Set.MipCount; ++Mip)
+	{
+		std::memcpy(Set.Levels[Mip].data() + GetLayerBytes(Set, Mip) * Layer, Mips[Mip].data(), GetLayerBytes(Set, Mip));
+	}
+}
+
+static void AllocateLevels(PackedTextureSet& Set)
+{
+	Set.Levels.resize(Set.MipCount);
+	for (uint32_t Mip = 0; Mip < Set.MipCount; ++Mip)
+	{
+		Set.Levels[Mip].assign(GetLayerBytes(Set, Mip) * Set.Layers, 0);
+	}
+}
+
+static void PackArray(const std::vector<TexturePackInput>& Inputs, const std::vector<uint32_t>& Members, JobSystem* Jobs, TexturePack& Result)
+{
+	const TexturePackInput& First = Inputs[Members.front()];
+
+	PackedTextureSet Set;
+	Set.Format = First.Format;
+	Set.Width = First.Width;
+	Set.Height = First.Height;
+	Set.Layers = static_cast<uint32_t>(Members.size());
+	Set.MipCount = GetFullMipCount(Set.Width, Set.Height);
+	Set.bAtlas = false;
+	AllocateLevels(Set);
+
+	const uint32_t SetIndex = static_cast<uint32_t>(Result.Sets.size());
+	for (uint32_t Layer = 0; Layer < Set.Layers; ++Layer)
+	{
+		PackedTextureRegion& Region = Result.Regions[Members[Layer]];
+		Region.ScaleBias = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+		Region.Layer = Layer;
+		Region.Set = SetIndex;
+	}
+
+	ForEachLayer(Jobs, Set.Layers, [&](uint32_t Layer)
+		{
+			StoreLayerMips(Set, Layer, Inputs[Members[Layer]].Pixels);
+		});
+
+	Result.Sets.push_back(std::move(Set));
+}
+
+static void PackAtlas(const std::vector<TexturePackInput>& Inputs, std::vector<uint32_t> Members, const TexturePackSettings& Settings,
+	JobSystem* Jobs, TexturePack& Result)
+{
+	struct Placement
+	{
+		uint32_t Input;
+		uint32_t Page;
+		uint32_t X;
+		uint32_t Y;
+	};
+
+	// Guard texels as wide as the alignment leave one texel of guard at the last level
+	const uint32_t Align = 1u << (std::max(Settings.AtlasMips, 1u) - 1);
+	const uint32_t Guard = Align;
+	const uint32_t PageSize = Settings.AtlasPageSize;
+	auto PaddedWidth = [&](uint32_t Input) { return AlignUp(Inputs[Input].Width, Align) + 2 * Guard; };
+	auto PaddedHeight = [&](uint32_t Input) { return AlignUp(Inputs[Input].Height, Align) + 2 * Guard; };
+
+	Members.erase(std::remove_if(Members.begin(), Members.end(), [&](uint32_t Input) { return PaddedWidth(Input) > PageSize || PaddedHeight(Input) > PageSize; }), Members.end());
+	if (Members.empty())
+		return;
+
+	// Next fit shelves, tallest first so a shelf wastes little above its shorter entries
+	std::stable_sort(Members.begin(), Members.end(), [&](uint32_t A, uint32_t B)
+		{
+			return PaddedHeight(A) != PaddedHeight(B) ? PaddedHeight(A) > PaddedHeight(B) : PaddedWidth(A) > PaddedWidth(B);
+		});
+
+	std::vector<Placement> Placements;
+	uint32_t Page = 0, X = 0, Y = 0, ShelfHeight = 0;
+	uint32_t UsedWidth = 0, UsedHeight = 0;
+	auto FlushSet = [&]()
+		{
+			if (Placements.empty())
+				return;
+
+			// Every page of a set has the size of the largest used extent, so a few icons do not cost a full page
+			PackedTextureSet Set;
+			Set.Format = Inputs[Placements.front().Input].Format;
+			Set.Width = UsedWidth;
+			Set.Height = UsedHeight;
+			Set.Layers = Page + 1;
+			Set.MipCount = std::min(std::max(Settings.AtlasMips, 1u), GetFullMipCount(Set.Width, Set.Height));
+			Set.bAtlas = true;
+			AllocateLevels(Set);
+
+			const uint32_t SetIndex = static_cast<uint32_t>(Result.Sets.size());
+			for (const Placement& Iter : Placements)
+			{
+				const TexturePackInput& Input = Inputs[Iter.Input];
+				PackedTextureRegion& Region = Result.Regions[Iter.Input];
+				Region.ScaleBias = glm::vec4(static_cast<float>(Input.Width) / Set.Width, static_cast<float>(Input.Height) / Set.Height,
+					static_cast<float>(Iter.X + Guard) / Set.Width, static_cast<float>(Iter.Y + Guard) / Set.Height);
+				Region.Layer = Iter.Page;
+				Region.Set = SetIndex;
+			}
+
+			ForEachLayer(Jobs, Set.Layers, [&](uint32_t Layer)
+				{
+					std::vector<uint8_t> Pixels(GetLayerBytes(Set, 0), 0);
+					for (const Placement& Iter : Placements)
+					{
+						if (Iter.Page != Layer)
+							continue;
+
+						// The guard repeats the edge texels, like clamp to edge addressing would
+						const TexturePackInput& Input = Inputs[Iter.Input];
+						const uint32_t Width = AlignUp(Input.Width, Align) + 2 * Guard;
+						const uint32_t Height = AlignUp(Input.Height, Align) + 2 * Guard;
+						for (uint32_t Row = 0; Row < Height; ++Row)
+						{
+							const uint32_t SrcY = static_cast<uint32_t>(std::clamp(static_cast<int32_t>(Row) - static_cast<int32_t>(Guard), 0, static_cast<int32_t>(Input.Height) - 1));
+							uint8_t* Dst = Pixels.data() + (static_cast<size_t>(Iter.Y + Row) * Set.Width + Iter.X) * 4;
+							const uint8_t* Src = Input.Pixels.data() + static_cast<size_t>(SrcY) * Input.Width * 4;
+							for (uint32_t Column = 0; Column < Width; ++Column)
+							{
+								const uint32_t SrcX = static_cast<uint32_t>(std::clamp(static_cast<int32_t>(Column) - static_cast<int32_t>(Guard), 0, static_cast<int32_t>(Input.Width) - 1));
+								std::memcpy(Dst + Column * 4, Src + SrcX * 4, 4);
+							}
+						}
+					}
+					StoreLayerMips(Set, Layer, std::move(Pixels));
+				});
+
+			Result.Sets.push_back(std::move(Set));
+			Placements.clear();
+			Page = X = Y = ShelfHeight = UsedWidth = UsedHeight = 0;
+		};
+
+	for (uint32_t Input : Members)
+	{
+		const uint32_t Width = PaddedWidth(Input);
+		const uint32_t Height = PaddedHeight(Input);
+		if (X + Width > PageSize)
+		{
+			Y += ShelfHeight;
+			X = 0;
+			ShelfHeight = 0;
+		}
+		if (Y + Height > PageSize)
+		{
+			if (Page + 1 == Settings.MaxLayers)
+			{
+				FlushSet();
+			}
+			else
+			{
+				++Page;
+			}
+			X = Y = ShelfHeight = 0;
+		}
+
+		Placements.push_back(Placement{ Input, Page, X, Y });
+		X += Width;
+		ShelfHeight = std::max(ShelfHeight, Height);
+		UsedWidth = std::max(UsedWidth, X);
+		UsedHeight = std::max(UsedHeight, Y + Height);
+	}
+	FlushSet();
+}
+
+uint32_t TexturePack::Find(const std::string& Name) const
+{
+	auto Found = std::find(Names.begin(), Names.end(), Name);
+	return Found != Names.end() ? static_cast<uint32_t>(Found - Names.begin()) : UINT32_MAX;
+}
+
+TexturePack TexturePacker::Pack(const std::vector<TexturePackInput>& Inputs, const TexturePackSettings& Settings, JobSystem* Jobs)
+{
+	TexturePack Result;
+	Result.Names.reserve(Inputs.size());
+	Result.Regions.resize(Inputs.size());
+
+	// Array candidates by format and size, atlas candidates by format
+	std::map<std::tuple<VkFormat, uint32_t, uint32_t>, std::vector<uint32_t>> BySize;
+	for (uint32_t i = 0; i < Inputs.size(); ++i)
+	{
+		const TexturePackInput& Input = Inputs[i];
+		if (Input.Width == 0 || Input.Height == 0 || Input.Pixels.size() != static_cast<size_t>(Input.Width) * Input.Height * 4)
+		{
+			throw std::runtime_error("texture pack input does not match its size!");
+		}
+
+		Result.Names.push_back(Input.Name);
+		Result.Regions[i].Width = Input.Width;
+		Result.Regions[i].Height = Input.Height;
+		if (Input.Width <= Settings.MaxPackedSize && Input.Height <= Settings.MaxPackedSize)
+			BySize[std::make_tuple(Input.Format, Input.Width, Input.Height)].push_back(i);
+	}
+
+	std::map<VkFormat, std::vector<uint32_t>> ByFormat;
+	for (const auto& Iter : BySize)
+	{
+		const uint32_t Width = std::get<1>(Iter.first);
+		const uint32_t Height = std::get<2>(Iter.first);
+		const std::vector<uint32_t>& Members = Iter.second;
+		if (Members.size() < Settings.MinArrayLayers || !IsPowerOfTwo(Width) || !IsPowerOfTwo(Height))
+		{
+			std::vector<uint32_t>& Atlas = ByFormat[std::get<0>(Iter.first)];
+			Atlas.insert(Atlas.end(), Members.begin(), Members.end());
+			continue;
+		}
+
+		for (size_t Begin = 0; Begin < Members.size(); Begin += Settings.MaxLayers)
+		{
+			const size_t End = std::min(Members.size(), Begin + Settings.MaxLayers);
+			PackArray(Inputs, std::vector<uint32_t>(Members.begin() + Begin, Members.begin() + End), Jobs, Result);
+		}
+	}
+
+	for (auto& Iter : ByFormat)
+	{
+		PackAtlas(Inputs, std::move(Iter.second), Settings, Jobs, Result);
+	}
+	return Result;
+}
+
+std::vector<TexturePackInput> TexturePacker::LoadDirectory(const std::string& Directory, VkFormat Format)
+{
+	std::vector<fs::path> Files;
+	std::error_code Error;
+	for (const fs::directory_entry& Entry : fs::directory_iterator(Directory, Error))
+	{
+		if (Entry.is_regular_file())
+			Files.push_back(Entry.path());
+	}
+	if (Error)
+	{
+		throw std::runtime_error("failed to open texture directory!");
+	}
+	// Same order on every file system, so packs built from the same files are identical
+	std::sort(Files.begin(), Files.end());
+
+	std::vector<TexturePackInput> Inputs;
+	for (const fs::path& File : Files)
+	{
+		const std::vector<char> Data = ReadFile(File.string());
+		const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(Data.data());
+
+		TexturePackInput Input;
+		const ImageDecoderBackend* Backend = TextureDecoder::FindBackend(Bytes, Data.size());
+		if (!Backend || !Backend->ReadInfo(Bytes, Data.size(), Input.Width, Input.Height))
+			continue;
+
+		Input.Name = File.filename().string();
+		Input.Format = Format;
+		Input.Pixels.resize(static_cast<size_t>(Input.Width) * Input.Height * 4);
+		if (Backend->Decode(Bytes, Data.size(), Input.Pixels.data(), Input.Pixels.size()))
+			Inputs.push_back(std::move(Input));
+	}
+	return Inputs;
+}
+
+void TexturePacker::Save(const TexturePack& Pack, const std::string& File)
+{
+	std::ofstream Out(File, std::ios::binary);
+	if (!Out.is_open())
+	{
+		throw std::runtime_error("failed to create texture pack file!");
+	}
+
+	auto WriteU32 = [&Out](uint32_t Value) { Out.write(reinterpret_cast<const char*>(&Value), sizeof(Value)); };
+
+	WriteU32(TexturePackMagic);
+	WriteU32(TexturePackVersion);
+	WriteU32(static_cast<uint32_t>(Pack.Sets.size()));
+	for (const PackedTextureSet& Set : Pack.Sets)
+	{
+		WriteU32(static_cast<uint32_t>(Set.Format));
+		WriteU32(Set.Width);
+		WriteU32(Set.Height);
+		WriteU32(Set.Layers);
+		WriteU32(Set.MipCount);
+		WriteU32(Set.bAtlas ? 1 : 0);
+		for (const std::vector<uint8_t>& Level : Set.Levels)
+		{
+			Out.write(reinterpret_cast<const char*>(Level.data()), Level.size());
+		}
+	}
+
+	WriteU32(static_cast<uint32_t>(Pack.Regions.size()));
+	for (size_t i = 0; i < Pack.Regions.size(); ++i)
+	{
+		WriteU32(static_cast<uint32_t>(Pack.Names[i].size()));
+		Out.write(Pack.Names[i].data(), Pack.Names[i].size());
+		Out.write(reinterpret_cast<const char*>(&Pack.Regions[i]), sizeof(PackedTextureRegion));
+	}
+
+	if (!Out)
+	{
+		throw std::runtime_error("failed to write texture pack file!");
+	}
+}
+
+TexturePack TexturePacker::Load(const std::string& File)
+{
+	const std::vector<char> Data = ReadFile(File);
+	size_t Cursor = 0;
+	auto Read = [&](void* Dst, size_t Size)
+		{
+			if (Cursor + Size > Data.size())
+			{
+				throw std::runtime_error("texture pack file is truncated!");
+			}
+			std::memcpy(Dst, Data.data() + Cursor, Size);
+			Cursor += Size;
+		};
+	auto ReadU32 = [&]() { uint32_t Value = 0; Read(&Value, sizeof(Value)); return Value; };
+
+	if (ReadU32() != TexturePackMagic || ReadU32() != TexturePackVersion)
+	{
+		throw std::runtime_error("not a texture pack file!");
+	}
+
+	TexturePack Pack;
+	Pack.Sets.resize(ReadU32());
+	for (PackedTextureSet& Set : Pack.Sets)
+	{
+		Set.Format = static_cast<VkFormat>(ReadU32());
+		Set.Width = ReadU32();
+		Set.Height = ReadU32();
+		Set.Layers = ReadU32();
+		Set.MipCount = ReadU32();
+		Set.bAtlas = ReadU32() != 0;
+		AllocateLevels(Set);
+		for (std::vector<uint8_t>& Level : Set.Levels)
+		{
+			Read(Level.data(), Level.size());
+		}
+	}
+
+	const uint32_t RegionCount = ReadU32();
+	Pack.Names.resize(RegionCount);
+	Pack.Regions.resize(RegionCount);
+	for (uint32_t i = 0; i < RegionCount; ++i)
+	{
+		Pack.Names[i].resize(ReadU32());
+		Read(&Pack.Names[i][0], Pack.Names[i].size());
+		Read(&Pack.Regions[i], sizeof(PackedTextureRegion));
+	}
+	return Pack;
+}
+
+void PackedTextureArray::Init(VkDevice InDevice, ResidencyManager* InResidency, UploadContext* InUploader, DeferredDeletionQueue* InDeletionQueue, const TexturePack& Pack)
+{
+	Device = InDevice;
+	Residency = InResidency;
+	Uploader = InUploader;
+	DeletionQueue = InDeletionQueue;
+
+	for (const PackedTextureSet& Set : Pack.Sets)
+	{
+		SetImage Image;
+
+		VkImageCreateInfo ImageInfo{};
+		ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+		ImageInfo.extent = { Set.Width, Set.Height, 1 };
+		ImageInfo.mipLevels = Set.MipCount;
+		ImageInfo.arrayLayers = Set.Layers;
+		ImageInfo.format = Set.Format;
+		ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		ImageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		if (vkCreateImage(Device, &ImageInfo, nullptr, &Image.Image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create packed texture image!");
+		}
+
+		VkMemoryRequirements Requirements;
+		vkGetImageMemoryRequirements(Device, Image.Image, &Requirements);
+		Image.Memory = Residency->Allocate(Requirements, MemoryUsage::GpuOnly);
+		vkBindImageMemory(Device, Image.Image, Image.Memory, 0);
+
+		VkImageViewCreateInfo ViewInfo{};
+		ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		ViewInfo.image = Image.Image;
+		ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		ViewInfo.format = Set.Format;
+		ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		ViewInfo.subresourceRange.baseMipLevel = 0;
+		ViewInfo.subresourceRange.levelCount = Set.MipCount;
+		ViewInfo.subresourceRange.baseArrayLayer = 0;
+		ViewInfo.subresourceRange.layerCount = Set.Layers;
+		if (vkCreateImageView(Device, &ViewInfo, nullptr, &Image.View) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create packed texture image view!");
+		}
+
+		// One barrier pair for every level and layer of the set
+		std::vector<ImageRegionUpload> Regions;
+		for (uint32_t Mip = 0; Mip < Set.MipCount; ++Mip)
+		{
+			const size_t LayerBytes = GetLayerBytes(Set, Mip);
+			for (uint32_t Layer = 0; Layer < Set.Layers; ++Layer)
+			{
+				ImageRegionUpload Region;
+				Region.Staging = Uploader->ReserveStaging(LayerBytes);
+				std::memcpy(Region.Staging.Data, Set.Levels[Mip].data() + LayerBytes * Layer, LayerBytes);
+				Region.Extent = { std::max(Set.Width >> Mip, 1u), std::max(Set.Height >> Mip, 1u), 1 };
+				Region.MipLevel = Mip;
+				Region.ArrayLayer = Layer;
+				Regions.push_back(Region);
+			}
+		}
+		Uploader->TransitionImage(Image.Image, Set.Format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		Uploader->CommitImageRegions(Image.Image, Set.Format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, Regions);
+
+		Sets.push_back(Image);
+	}
+
+	RemapSize = std::max<VkDeviceSize>(Pack.Regions.size(), 1) * sizeof(PackedTextureRegion);
+
+	VkBufferCreateInfo BufferInfo{};
+	BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	BufferInfo.size = RemapSize;
+	BufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(Device, &BufferInfo, nullptr, &RemapBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create packed texture remap buffer!");
+	}
+
+	VkMemoryRequirements Requirements;
+	vkGetBufferMemoryRequirements(Device, RemapBuffer, &Requirements);
+	RemapMemory = Residency->Allocate(Requirements, MemoryUsage::GpuOnly);
+	vkBindBufferMemory(Device, RemapBuffer, RemapMemory, 0);
+
+	if (!Pack.Regions.empty())
+		Uploader->UploadBuffer(RemapBuffer, 0, Pack.Regions.data(), Pack.Regions.size() * sizeof(PackedTextureRegion));
+}
+
+void PackedTextureArray::Destroy()
+{
+	for (const SetImage& Iter : Sets)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, Iter.View);
+		DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE, Iter.Image);
+		Residency->Free(Iter.Memory);
+	}
+	Sets.clear();
+
+	if (RemapBuffer != VK_NULL_HANDLE)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, RemapBuffer);
+		Residency->Free(RemapMemory);
+		RemapBuffer = VK_NULL_HANDLE;
+		RemapMemory = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,507 @@
+#include "../../Public/Render/UploadContext.h"
+#include "../../Public/Render/RenderGraph.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+void UploadContext::Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, VkQueue InQueue, uint32_t InQueueFamily, QueueType InQueueType,
+	GpuTimeline* InTimeline, DeferredDeletionQueue* InDeletionQueue, const UploadBudget& InBudget)
+{
+	Device = InDevice;
+	PhysicDevice = InPhysicalDevice;
+	Queue = InQueue;
+	Type = InQueueType;
+	Timeline = InTimeline;
+	DeletionQueue = InDeletionQueue;
+	Budget = InBudget;
+
+	VkPhysicalDeviceProperties Properties;
+	vkGetPhysicalDeviceProperties(PhysicDevice, &Properties);
+	// 16 covers the texel size of every uncompressed format and the block size of BC/ASTC
+	CopyAlignment = std::max<VkDeviceSize>(16, Properties.limits.optimalBufferCopyOffsetAlignment);
+
+	VkCommandPoolCreateInfo PoolInfo{};
+	PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	PoolInfo.queueFamilyIndex = InQueueFamily;
+	// Command buffers are reset one by one and reused once their batch has completed
+	PoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if (vkCreateCommandPool(Device, &PoolInfo, nullptr, &CommandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+}
+
+void UploadContext::Destroy()
+{
+	auto DestroyChunk = [this](StagingChunk& Chunk)
+	{
+		vkDestroyBuffer(Device, Chunk.Buffer, nullptr);
+		vkFreeMemory(Device, Chunk.Memory, nullptr);
+	};
+
+	std::for_each(BatchChunks.begin(), BatchChunks.end(), DestroyChunk);
+	std::for_each(FreeChunks.begin(), FreeChunks.end(), DestroyChunk);
+	BatchChunks.clear();
+	FreeChunks.clear();
+
+	// Frees the open and the submitted command buffers as well
+	vkDestroyCommandPool(Device, CommandPool, nullptr);
+	CommandPool = VK_NULL_HANDLE;
+	CommandBuffer = VK_NULL_HANDLE;
+	SubmittedCommandBuffers.clear();
+}
+
+void UploadContext::UploadBuffer(VkBuffer Dst, VkDeviceSize DstOffset, const void* Data, VkDeviceSize Size)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	StagingAllocation Staging = AllocateStaging(Size);
+	memcpy(Staging.Mapped, Data, static_cast<size_t>(Size));
+
+	VkBufferCopy CopyRegion{};
+	CopyRegion.srcOffset = Staging.Offset;
+	CopyRegion.dstOffset = DstOffset;
+	CopyRegion.size = Size;
+	vkCmdCopyBuffer(GetCommandBuffer(), Staging.Buffer, Dst, 1, &CopyRegion);
+
+	FlushIfOverBudget();
+}
+
+void UploadContext::UploadImage(VkImage Dst, VkFormat Format, VkExtent3D Extent, const void* Data, VkDeviceSize Size, VkImageLayout FinalLayout,
+	uint32_t MipLevel, uint32_t ArrayLayer)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	StagingAllocation Staging = AllocateStaging(Size);
+	memcpy(Staging.Mapped, Data, static_cast<size_t>(Size));
+
+	RecordImageCopy(Staging.Buffer, Staging.Offset, Dst, Format, Extent, FinalLayout, MipLevel, ArrayLayer);
+
+	FlushIfOverBudget();
+}
+
+StagingReservation UploadContext::ReserveStaging(VkDeviceSize Size)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	StagingAllocation Staging = AllocateStaging(Size);
+	for (StagingChunk& Chunk : BatchChunks)
+	{
+		if (Chunk.Buffer == Staging.Buffer)
+			++Chunk.Reservations;
+	}
+
+	StagingReservation Reservation;
+	Reservation.Data = Staging.Mapped;
+	Reservation.Size = Size;
+	Reservation.Buffer = Staging.Buffer;
+	Reservation.Offset = Staging.Offset;
+	return Reservation;
+}
+
+void UploadContext::CommitImage(const StagingReservation& Staging, VkImage Dst, VkFormat Format, VkExtent3D Extent, VkImageLayout FinalLayout,
+	uint32_t MipLevel, uint32_t ArrayLayer)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	// Recorded into whichever batch is open now, the chunk was carried into it if an older batch was flushed
+	RecordImageCopy(Staging.Buffer, Staging.Offset, Dst, Format, Extent, FinalLayout, MipLevel, ArrayLayer);
+	ReleaseReservation(Staging.Buffer);
+
+	FlushIfOverBudget();
+}
+
+void UploadContext::CommitImageRegions(VkImage Dst, VkFormat Format, VkImageLayout Layout, const std::vector<ImageRegionUpload>& Regions)
+{
+	if (Regions.empty())
+		return;
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	VkCommandBuffer Cmd = GetCommandBuffer();
+
+	VkImageSubresourceRange Range{};
+	Range.aspectMask = GetImageAspectMask(Format);
+	Range.baseMipLevel = 0;
+	Range.levelCount = VK_REMAINING_MIP_LEVELS;
+	Range.baseArrayLayer = 0;
+	Range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	// Leaving Layout waits for its readers, unlike UploadImage() which starts from UNDEFINED
+	RecordTransition(Cmd, Dst, Layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, Range);
+
+	// Consecutive regions from the same staging buffer go out in one copy
+	std::vector<VkBufferImageCopy> Copies;
+	for (size_t i = 0; i < Regions.size(); ++i)
+	{
+		const ImageRegionUpload& Upload = Regions[i];
+
+		VkBufferImageCopy Region{};
+		Region.bufferOffset = Upload.Staging.Offset;
+		Region.imageSubresource.aspectMask = Range.aspectMask;
+		Region.imageSubresource.mipLevel = Upload.MipLevel;
+		Region.imageSubresource.baseArrayLayer = Upload.ArrayLayer;
+		Region.imageSubresource.layerCount = 1;
+		Region.imageOffset = Upload.Offset;
+		Region.imageExtent = Upload.Extent;
+		Copies.push_back(Region);
+
+		if (i + 1 == Regions.size() || Regions[i + 1].Staging.Buffer != Upload.Staging.Buffer)
+		{
+			vkCmdCopyBufferToImage(Cmd, Upload.Staging.Buffer, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(Copies.size()), Copies.data());
+			Copies.clear();
+		}
+	}
+
+	RecordTransition(Cmd, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, Layout, Range);
+
+	for (const ImageRegionUpload& Iter : Regions)
+	{
+		ReleaseReservation(Iter.Staging.Buffer);
+	}
+
+	FlushIfOverBudget();
+}
+
+void UploadContext::CopyImageMips(VkImage Src, uint32_t SrcMip, VkImageLayout SrcLayout, VkImage Dst, uint32_t DstMip, VkImageLayout FinalLayout,
+	VkFormat Format, VkExtent3D Extent, uint32_t MipCount)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	VkCommandBuffer Cmd = GetCommandBuffer();
+
+	VkImageSubresourceRange SrcRange{};
+	SrcRange.aspectMask = GetImageAspectMask(Format);
+	SrcRange.baseMipLevel = SrcMip;
+	SrcRange.levelCount = MipCount;
+	SrcRange.baseArrayLayer = 0;
+	SrcRange.layerCount = 1;
+
+	VkImageSubresourceRange DstRange = SrcRange;
+	DstRange.baseMipLevel = DstMip;
+
+	RecordTransition(Cmd, Src, SrcLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, SrcRange);
+	RecordTransition(Cmd, Dst, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, DstRange);
+
+	std::vector<VkImageCopy> Regions(MipCount);
+	for (uint32_t i = 0; i < MipCount; ++i)
+	{
+		VkImageCopy& Region = Regions[i];
+		Region.srcSubresource = { SrcRange.aspectMask, SrcMip + i, 0, 1 };
+		Region.srcOffset = { 0, 0, 0 };
+		Region.dstSubresource = { SrcRange.aspectMask, DstMip + i, 0, 1 };
+		Region.dstOffset = { 0, 0, 0 };
+		Region.extent = { std::max(Extent.width >> i, 1u), std::max(Extent.height >> i, 1u), 1 };
+	}
+	vkCmdCopyImage(Cmd, Src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, MipCount, Regions.data());
+
+	RecordTransition(Cmd, Src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, SrcLayout, SrcRange);
+	RecordTransition(Cmd, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, FinalLayout, DstRange);
+}
+
+void UploadContext::CancelStaging(const StagingReservation& Staging)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	ReleaseReservation(Staging.Buffer);
+}
+
+void UploadContext::CopyBuffer(VkBuffer Src, VkBuffer Dst, VkDeviceSize Size)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	VkBufferCopy CopyRegion{};
+	CopyRegion.srcOffset = 0;
+	CopyRegion.dstOffset = 0;
+	CopyRegion.size = Size;
+	vkCmdCopyBuffer(GetCommandBuffer(), Src, Dst, 1, &CopyRegion);
+}
+
+void UploadContext::TransitionImage(VkImage Image, VkFormat Format, VkImageLayout OldLayout, VkImageLayout NewLayout)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	VkImageSubresourceRange Range{};
+	Range.aspectMask = GetImageAspectMask(Format);
+	Range.baseMipLevel = 0;
+	Range.levelCount = VK_REMAINING_MIP_LEVELS;
+	Range.baseArrayLayer = 0;
+	Range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	RecordTransition(GetCommandBuffer(), Image, OldLayout, NewLayout, Range);
+}
+
+GpuSyncPoint UploadContext::Flush()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return FlushLocked();
+}
+
+void UploadContext::Tick()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	if (CommandBuffer != VK_NULL_HANDLE && std::chrono::steady_clock::now() - BatchStart >= Budget.MaxBatchAge)
+	{
+		FlushLocked();
+	}
+}
+
+UploadContext::StagingAllocation UploadContext::AllocateStaging(VkDeviceSize Size)
+{
+	StagingChunk* Target = nullptr;
+
+	if (Size > Budget.ChunkSize)
+	{
+		BatchChunks.push_back(CreateChunk(Size, true));
+		Target = &BatchChunks.back();
+	}
+	else
+	{
+		// Keep filling the chunk this batch is currently writing to
+		for (auto Iter = BatchChunks.rbegin(); Iter != BatchChunks.rend(); ++Iter)
+		{
+			if (!Iter->bDedicated)
+			{
+				VkDeviceSize Offset = (Iter->Used + CopyAlignment - 1) & ~(CopyAlignment - 1);
+				if (Offset + Size <= Iter->Size)
+					Target = &*Iter;
+				break;
+			}
+		}
+
+		if (!Target)
+		{
+			auto Reusable = std::find_if(FreeChunks.begin(), FreeChunks.end(), [this](const StagingChunk& Chunk)
+				{
+					return Timeline->IsComplete(Chunk.LastUse);
+				});
+
+			if (Reusable != FreeChunks.end())
+			{
+				BatchChunks.push_back(*Reusable);
+				FreeChunks.erase(Reusable);
+			}
+			else
+			{
+				BatchChunks.push_back(CreateChunk(Budget.ChunkSize, false));
+			}
+			Target = &BatchChunks.back();
+			Target->Used = 0;
+		}
+	}
+
+	VkDeviceSize Offset = (Target->Used + CopyAlignment - 1) & ~(CopyAlignment - 1);
+	Target->Used = Offset + Size;
+	BatchBytes += Size;
+
+	return StagingAllocation{ Target->Buffer, Offset, Target->Mapped + Offset };
+}
+
+void UploadContext::RecordImageCopy(VkBuffer Src, VkDeviceSize SrcOffset, VkImage Dst, VkFormat Format, VkExtent3D Extent, VkImageLayout FinalLayout,
+	uint32_t MipLevel, uint32_t ArrayLayer)
+{
+	VkCommandBuffer Cmd = GetCommandBuffer();
+
+	VkImageSubresourceRange Range{};
+	Range.aspectMask = GetImageAspectMask(Format);
+	Range.baseMipLevel = MipLevel;
+	Range.levelCount = 1;
+	Range.baseArrayLayer = ArrayLayer;
+	Range.layerCount = 1;
+
+	RecordTransition(Cmd, Dst, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, Range);
+
+	VkBufferImageCopy Region{};
+	Region.bufferOffset = SrcOffset;
+	Region.bufferRowLength = 0;
+	Region.bufferImageHeight = 0;
+	Region.imageSubresource.aspectMask = Range.aspectMask;
+	Region.imageSubresource.mipLevel = MipLevel;
+	Region.imageSubresource.baseArrayLayer = ArrayLayer;
+	Region.imageSubresource.layerCount = 1;
+	Region.imageOffset = { 0, 0, 0 };
+	Region.imageExtent = Extent;
+	vkCmdCopyBufferToImage(Cmd, Src, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &Region);
+
+	RecordTransition(Cmd, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, FinalLayout, Range);
+}
+
+void UploadContext::ReleaseReservation(VkBuffer Buffer)
+{
+	for (StagingChunk& Chunk : BatchChunks)
+	{
+		if (Chunk.Buffer == Buffer && Chunk.Reservations > 0)
+		{
+			--Chunk.Reservations;
+			return;
+		}
+	}
+}
+
+UploadContext::StagingChunk UploadContext::CreateChunk(VkDeviceSize Size, bool bDedicated)
+{
+	StagingChunk Chunk;
+	Chunk.Size = Size;
+	Chunk.bDedicated = bDedicated;
+
+	VkBufferCreateInfo BufferInfo{};
+	BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	BufferInfo.size = Size;
+	BufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(Device, &BufferInfo, nullptr, &Chunk.Buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+
+	VkMemoryRequirements MemRequirements;
+	vkGetBufferMemoryRequirements(Device, Chunk.Buffer, &MemRequirements);
+
+	VkPhysicalDeviceMemoryProperties MemProperties;
+	vkGetPhysicalDeviceMemoryProperties(PhysicDevice, &MemProperties);
+
+	const VkMemoryPropertyFlags Properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	uint32_t TypeIndex = UINT32_MAX;
+	for (uint32_t i = 0; i < MemProperties.memoryTypeCount; ++i)
+	{
+		if ((MemRequirements.memoryTypeBits & (1u << i)) && (MemProperties.memoryTypes[i].propertyFlags & Properties) == Properties)
+		{
+			TypeIndex = i;
+			break;
+		}
+	}
+	if (TypeIndex == UINT32_MAX)
+	{
+		throw std::runtime_error("failed to find staging memory type!");
+	}
+
+	VkMemoryAllocateInfo AllocInfo{};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	AllocInfo.allocationSize = MemRequirements.size;
+	AllocInfo.memoryTypeIndex = TypeIndex;
+
+	if (vkAllocateMemory(Device, &AllocInfo, nullptr, &Chunk.Memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate staging memory!");
+	}
+	vkBindBufferMemory(Device, Chunk.Buffer, Chunk.Memory, 0);
+
+	void* Mapped = nullptr;
+	vkMapMemory(Device, Chunk.Memory, 0, Size, 0, &Mapped);
+	Chunk.Mapped = static_cast<uint8_t*>(Mapped);
+
+	return Chunk;
+}
+
+VkCommandBuffer UploadContext::GetCommandBuffer()
+{
+	if (CommandBuffer != VK_NULL_HANDLE)
+		return CommandBuffer;
+
+	// The pool is only touched under Mutex, so submitted buffers are recycled here rather than freed
+	// by the deletion queue from whichever thread collects it
+	auto Completed = std::find_if(SubmittedCommandBuffers.begin(), SubmittedCommandBuffers.end(), [this](const SubmittedCommandBuffer& Iter)
+		{
+			return Timeline->IsComplete(Iter.LastUse);
+		});
+	if (Completed != SubmittedCommandBuffers.end())
+	{
+		CommandBuffer = Completed->CommandBuffer;
+		SubmittedCommandBuffers.erase(Completed);
+		vkResetCommandBuffer(CommandBuffer, 0);
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo AllocInfo{};
+		AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		AllocInfo.commandPool = CommandPool;
+		AllocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(Device, &AllocInfo, &CommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+	}
+
+	VkCommandBufferBeginInfo BeginInfo{};
+	BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+
+	BatchStart = std::chrono::steady_clock::now();
+
+	return CommandBuffer;
+}
+
+void UploadContext::RecordTransition(VkCommandBuffer Cmd, VkImage Image, VkImageLayout OldLayout, VkImageLayout NewLayout, const VkImageSubresourceRange& Range)
+{
+	VkImageMemoryBarrier Barrier{};
+	Barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	Barrier.oldLayout = OldLayout;
+	Barrier.newLayout = NewLayout;
+	Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	Barrier.image = Image;
+	Barrier.subresourceRange = Range;
+
+	// Same stage/access table the render graph uses, so any pair of known layouts is supported
+	ResourceState SrcState = GetLayoutState(OldLayout);
+	ResourceState DstState = GetLayoutState(NewLayout);
+	Barrier.srcAccessMask = SrcState.Access & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+	Barrier.dstAccessMask = DstState.Access;
+
+	vkCmdPipelineBarrier(Cmd, SrcState.Stage, DstState.Stage, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
+}
+
+GpuSyncPoint UploadContext::FlushLocked()
+{
+	if (CommandBuffer == VK_NULL_HANDLE)
+		return LastFlush;
+
+	vkEndCommandBuffer(CommandBuffer);
+
+	TimelineSubmitInfo SubmitInfo;
+	SubmitInfo.CommandBuffers.push_back(CommandBuffer);
+	LastFlush = Timeline->Submit(Queue, Type, SubmitInfo);
+	++SubmitCount;
+
+	SubmittedCommandBuffers.push_back(SubmittedCommandBuffer{ CommandBuffer, LastFlush });
+	CommandBuffer = VK_NULL_HANDLE;
+
+	std::vector<StagingChunk> Reserved;
+	for (StagingChunk& Chunk : BatchChunks)
+	{
+		Chunk.LastUse = LastFlush;
+
+		// Still being written by a producer, stays with the next batch (and its LastUse moves with it)
+		if (Chunk.Reservations > 0)
+		{
+			Reserved.push_back(Chunk);
+		}
+		else if (Chunk.bDedicated || FreeChunks.size() >= Budget.MaxPooledChunks)
+		{
+			DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, Chunk.Buffer, LastFlush);
+			DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, Chunk.Memory, LastFlush);
+		}
+		else
+		{
+			FreeChunks.push_back(Chunk);
+		}
+	}
+	BatchChunks.swap(Reserved);
+	BatchBytes = 0;
+
+	return LastFlush;
+}
+
+void UploadContext::FlushIfOverBudget()
+{
+	if (BatchBytes >= Budget.MaxBatchBytes)
+	{
+		FlushLocked();
+	}
+}
@@ -0,0 +1,591 @@
+#include "../../Public/Render/VirtualTexture.h"
+#include "../../Public/Render/DeferredDeletionQueue.h"
+#include "../../Public/Render/TextureDecoder.h"
+#include "../../Public/Common/FunctionLibrary.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+
+static const VkFormat PageTableFormat = VK_FORMAT_R8G8B8A8_UINT;
+static const VkDeviceSize PageBytes = static_cast<VkDeviceSize>(PhysicalPageSize) * PhysicalPageSize * 4;
+
+static bool IsPowerOfTwo(uint32_t Value)
+{
+	return Value != 0 && (Value & (Value - 1)) == 0;
+}
+
+static uint32_t Log2(uint32_t Value)
+{
+	uint32_t Result = 0;
+	while (Value >>= 1)
+		++Result;
+	return Result;
+}
+
+// R, G: atlas slot, B: mip of the page in that slot, A: valid
+static uint32_t MakeTableEntry(uint32_t SlotX, uint32_t SlotY, uint32_t Mip)
+{
+	return SlotX | (SlotY << 8) | (Mip << 16) | (1u << 24);
+}
+
+void VirtualTexture::Init(VkDevice InDevice, const MemoryPlacementPolicy* InMemoryPolicy, SamplerCache* InSamplers, JobSystem* InJobs,
+	UploadContext* InUploader, DeferredDeletionQueue* InDeletionQueue, const VirtualTextureDesc& InDesc, uint32_t FramesInFlight)
+{
+	Device = InDevice;
+	MemoryPolicy = InMemoryPolicy;
+	Samplers = InSamplers;
+	Jobs = InJobs;
+	Uploader = InUploader;
+	DeletionQueue = InDeletionQueue;
+	Desc = InDesc;
+
+	if (Desc.Size < VirtualPageSize || Desc.Size % VirtualPageSize != 0 || !IsPowerOfTwo(Desc.Size / VirtualPageSize))
+	{
+		throw std::runtime_error("virtual texture size must be a power of two multiple of the page size!");
+	}
+	if (Desc.AtlasPages < 2 || Desc.AtlasPages > 256)
+	{
+		throw std::runtime_error("virtual texture atlas must be 2 to 256 pages wide!");
+	}
+	if (!Desc.LoadPage)
+	{
+		throw std::runtime_error("virtual texture has no page loader!");
+	}
+
+	PagesAtMip0 = Desc.Size / VirtualPageSize;
+	MipCount = Log2(PagesAtMip0) + 1;
+
+	uint32_t EntryCount = 0;
+	for (uint32_t Mip = 0; Mip < MipCount; ++Mip)
+	{
+		MipOffsets.push_back(EntryCount);
+		EntryCount += GetPagesAtMip(Mip) * GetPagesAtMip(Mip);
+	}
+	Residency.assign(EntryCount, NoSlot);
+	PageTableData.assign(EntryCount, 0);
+
+	CreateImage(PageTableFormat, PagesAtMip0, MipCount, PageTable, PageTableMemory, PageTableView);
+	CreateImage(Desc.Format, Desc.AtlasPages * PhysicalPageSize, 1, Atlas, AtlasMemory, AtlasView);
+
+	// Page table texels are fetched, never filtered
+	VkSamplerCreateInfo SamplerInfo{};
+	SamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	SamplerInfo.magFilter = VK_FILTER_NEAREST;
+	SamplerInfo.minFilter = VK_FILTER_NEAREST;
+	SamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	SamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	SamplerInfo.maxLod = static_cast<float>(MipCount);
+	PageTableSampler = Samplers->Get(SamplerInfo);
+
+	// The atlas has one mip, the borders keep bilinear taps inside their page
+	SamplerInfo.magFilter = VK_FILTER_LINEAR;
+	SamplerInfo.minFilter = VK_FILTER_LINEAR;
+	SamplerInfo.maxLod = 0.0f;
+	AtlasSampler = Samplers->Get(SamplerInfo);
+
+	const VkDeviceSize FeedbackSize = GetFeedbackSize();
+	Feedback.resize(FramesInFlight);
+	for (FeedbackBuffer& Iter : Feedback)
+	{
+		VkBufferCreateInfo BufferInfo{};
+		BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		BufferInfo.size = FeedbackSize;
+		BufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateBuffer(Device, &BufferInfo, nullptr, &Iter.Buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create virtual texture feedback buffer!");
+		}
+
+		VkMemoryRequirements Requirements;
+		vkGetBufferMemoryRequirements(Device, Iter.Buffer, &Requirements);
+		VkMemoryPropertyFlags Properties = 0;
+		Iter.Memory = AllocateMemory(Requirements, MemoryUsage::GpuToCpu, &Properties);
+		Iter.bCoherent = (Properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		vkBindBufferMemory(Device, Iter.Buffer, Iter.Memory, 0);
+
+		void* Mapped = nullptr;
+		vkMapMemory(Device, Iter.Memory, 0, VK_WHOLE_SIZE, 0, &Mapped);
+		Iter.Mapped = static_cast<uint32_t*>(Mapped);
+		std::fill(Iter.Mapped, Iter.Mapped + FeedbackSize / sizeof(uint32_t), VirtualPageId::Invalid);
+		if (!Iter.bCoherent)
+		{
+			VkMappedMemoryRange Range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Iter.Memory, 0, VK_WHOLE_SIZE };
+			vkFlushMappedMemoryRanges(Device, 1, &Range);
+		}
+	}
+
+	VirtualTextureShaderParams Params;
+	const float AtlasTexels = static_cast<float>(Desc.AtlasPages * PhysicalPageSize);
+	Params.VirtualSize = glm::vec4(Desc.Size, Desc.Size, 1.0f / Desc.Size, 1.0f / Desc.Size);
+	Params.Atlas = glm::vec4(VirtualPageSize / AtlasTexels, VirtualPageBorder / AtlasTexels, PhysicalPageSize / AtlasTexels, MipCount);
+	Params.Feedback = glm::uvec4(Desc.FeedbackWidth, Desc.FeedbackHeight, Desc.FeedbackShift, 0);
+	{
+		VkBufferCreateInfo BufferInfo{};
+		BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		BufferInfo.size = sizeof(Params);
+		BufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateBuffer(Device, &BufferInfo, nullptr, &ParamsBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create virtual texture params buffer!");
+		}
+
+		VkMemoryRequirements Requirements;
+		vkGetBufferMemoryRequirements(Device, ParamsBuffer, &Requirements);
+		ParamsMemory = AllocateMemory(Requirements, MemoryUsage::GpuOnly);
+		vkBindBufferMemory(Device, ParamsBuffer, ParamsMemory, 0);
+		Uploader->UploadBuffer(ParamsBuffer, 0, &Params, sizeof(Params));
+	}
+
+	// Slot 0 is reserved for the coarsest page, every other slot starts free at the back of the list
+	Slots.resize(static_cast<size_t>(Desc.AtlasPages) * Desc.AtlasPages);
+	for (uint32_t Slot = 1; Slot < Slots.size(); ++Slot)
+	{
+		Slots[Slot].LruPosition = Lru.insert(Lru.end(), Slot);
+	}
+
+	Uploader->TransitionImage(Atlas, Desc.Format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	Uploader->TransitionImage(PageTable, PageTableFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	// The coarsest page is what everything falls back to, so it is loaded before the first frame
+	const uint32_t Root = VirtualPageId::Make(MipCount - 1, 0, 0);
+	StartLoad(Root);
+	Jobs->Wait(LoadJobs);
+	Loading.clear();
+
+	if (Completed.empty() || !Completed[0].bLoaded)
+	{
+		if (!Completed.empty())
+			Uploader->CancelStaging(Completed[0].Staging);
+		throw std::runtime_error("failed to load the coarsest virtual texture page!");
+	}
+
+	ImageRegionUpload Upload;
+	Upload.Staging = Completed[0].Staging;
+	Upload.Extent = { PhysicalPageSize, PhysicalPageSize, 1 };
+	Uploader->CommitImageRegions(Atlas, Desc.Format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, { Upload });
+	Completed.clear();
+
+	Slots[0].Page = Root;
+	Residency[GetPageIndex(Root)] = 0;
+	Stats.Resident = 1;
+	UploadPageTable(true);
+}
+
+void VirtualTexture::Destroy()
+{
+	Jobs->Wait(LoadJobs);
+	for (const LoadedPage& Iter : Completed)
+	{
+		Uploader->CancelStaging(Iter.Staging);
+	}
+	Completed.clear();
+	Loading.clear();
+
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, PageTableView);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE_VIEW, AtlasView);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE, PageTable);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_IMAGE, Atlas);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, ParamsBuffer);
+	for (const FeedbackBuffer& Iter : Feedback)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_BUFFER, Iter.Buffer);
+	}
+	DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, PageTableMemory);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, AtlasMemory);
+	DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, ParamsMemory);
+	for (const FeedbackBuffer& Iter : Feedback)
+	{
+		DeletionQueue->Retire(VK_OBJECT_TYPE_DEVICE_MEMORY, Iter.Memory);
+	}
+	Feedback.clear();
+}
+
+VkDeviceSize VirtualTexture::GetFeedbackSize() const
+{
+	return static_cast<VkDeviceSize>(Desc.FeedbackWidth) * Desc.FeedbackHeight * sizeof(uint32_t);
+}
+
+void VirtualTexture::Update(uint32_t FrameIndex)
+{
+	++FrameNumber;
+	Stats.Loaded = 0;
+	Stats.Evicted = 0;
+	Stats.PageTableTexels = 0;
+
+	std::vector<uint32_t> Requests;
+	ReadFeedback(FrameIndex, Requests);
+	Stats.Requested = static_cast<uint32_t>(Requests.size());
+
+	// Every requested page and its ancestors are in use: the resident ones move to the front of the LRU,
+	// the missing ones are load candidates. Counts favour pages covering more of the screen
+	std::unordered_map<uint32_t, uint32_t> Missing;
+	for (uint32_t Page : Requests)
+	{
+		uint32_t X = VirtualPageId::GetX(Page);
+		uint32_t Y = VirtualPageId::GetY(Page);
+		for (uint32_t Mip = VirtualPageId::GetMip(Page); Mip < MipCount; ++Mip, X >>= 1, Y >>= 1)
+		{
+			const uint32_t Ancestor = VirtualPageId::Make(Mip, X, Y);
+			const uint32_t Slot = Residency[GetPageIndex(Ancestor)];
+			if (Slot != NoSlot)
+			{
+				Touch(Slot);
+			}
+			else if (Loading.count(Ancestor) == 0 && FailedPages.count(Ancestor) == 0)
+			{
+				++Missing[Ancestor];
+			}
+		}
+	}
+
+	// Coarse pages first: they are cheap, cover more and are what finer pages fall back to
+	std::vector<std::pair<uint32_t, uint32_t>> Candidates(Missing.begin(), Missing.end());
+	std::sort(Candidates.begin(), Candidates.end(), [](const std::pair<uint32_t, uint32_t>& A, const std::pair<uint32_t, uint32_t>& B)
+		{
+			const uint32_t MipA = VirtualPageId::GetMip(A.first);
+			const uint32_t MipB = VirtualPageId::GetMip(B.first);
+			return MipA != MipB ? MipA > MipB : A.second > B.second;
+		});
+	for (const std::pair<uint32_t, uint32_t>& Candidate : Candidates)
+	{
+		if (Loading.size() >= Desc.MaxLoadsInFlight)
+			break;
+		StartLoad(Candidate.first);
+	}
+
+	CommitLoadedPages();
+
+	if (bPageTableDirty)
+	{
+		UploadPageTable(false);
+	}
+
+	Stats.Loading = static_cast<uint32_t>(Loading.size());
+}
+
+void VirtualTexture::RecordFeedbackBarrier(VkCommandBuffer CommandBuffer) const
+{
+	VkMemoryBarrier Barrier{};
+	Barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	Barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	Barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &Barrier, 0, nullptr, 0, nullptr);
+}
+
+uint32_t VirtualTexture::GetPageIndex(uint32_t Page) const
+{
+	const uint32_t Mip = VirtualPageId::GetMip(Page);
+	return MipOffsets[Mip] + VirtualPageId::GetY(Page) * GetPagesAtMip(Mip) + VirtualPageId::GetX(Page);
+}
+
+bool VirtualTexture::IsValidPage(uint32_t Page) const
+{
+	const uint32_t Mip = VirtualPageId::GetMip(Page);
+	return Mip < MipCount && VirtualPageId::GetX(Page) < GetPagesAtMip(Mip) && VirtualPageId::GetY(Page) < GetPagesAtMip(Mip);
+}
+
+void VirtualTexture::CreateImage(VkFormat Format, uint32_t Extent, uint32_t Mips, VkImage& OutImage, VkDeviceMemory& OutMemory, VkImageView& OutView)
+{
+	VkImageCreateInfo ImageInfo{};
+	ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ImageInfo.imageType = VK_IMAGE_TYPE_2D;
+	ImageInfo.extent = { Extent, Extent, 1 };
+	ImageInfo.mipLevels = Mips;
+	ImageInfo.arrayLayers = 1;
+	ImageInfo.format = Format;
+	ImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	ImageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	ImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	if (vkCreateImage(Device, &ImageInfo, nullptr, &OutImage) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create virtual texture image!");
+	}
+
+	VkMemoryRequirements Requirements;
+	vkGetImageMemoryRequirements(Device, OutImage, &Requirements);
+	OutMemory = AllocateMemory(Requirements, MemoryUsage::GpuOnly);
+	vkBindImageMemory(Device, OutImage, OutMemory, 0);
+
+	VkImageViewCreateInfo ViewInfo{};
+	ViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	ViewInfo.image = OutImage;
+	ViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	ViewInfo.format = Format;
+	ViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	ViewInfo.subresourceRange.baseMipLevel = 0;
+	ViewInfo.subresourceRange.levelCount = Mips;
+	ViewInfo.subresourceRange.baseArrayLayer = 0;
+	ViewInfo.subresourceRange.layerCount = 1;
+	if (vkCreateImageView(Device, &ViewInfo, nullptr, &OutView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create virtual texture image view!");
+	}
+}
+
+VkDeviceMemory VirtualTexture::AllocateMemory(const VkMemoryRequirements& Requirements, MemoryUsage Usage, VkMemoryPropertyFlags* OutProperties)
+{
+	const MemoryPlacement Placement = MemoryPolicy->Choose(Usage, Requirements.memoryTypeBits);
+	if (OutProperties)
+		*OutProperties = Placement.Properties;
+
+	VkMemoryAllocateInfo AllocInfo{};
+	AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	AllocInfo.allocationSize = Requirements.size;
+	AllocInfo.memoryTypeIndex = Placement.TypeIndex;
+
+	VkDeviceMemory Memory;
+	if (vkAllocateMemory(Device, &AllocInfo, nullptr, &Memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate virtual texture memory!");
+	}
+	return Memory;
+}
+
+void VirtualTexture::ReadFeedback(uint32_t FrameIndex, std::vector<uint32_t>& OutRequests)
+{
+	FeedbackBuffer& Buffer = Feedback[FrameIndex];
+	const size_t Count = static_cast<size_t>(GetFeedbackSize() / sizeof(uint32_t));
+
+	VkMappedMemoryRange Range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, Buffer.Memory, 0, VK_WHOLE_SIZE };
+	if (!Buffer.bCoherent)
+	{
+		vkInvalidateMappedMemoryRanges(Device, 1, &Range);
+	}
+
+	// Neighbouring blocks mostly ask for the same page, dropping repeats keeps the sort short
+	OutRequests.reserve(Count);
+	uint32_t Previous = VirtualPageId::Invalid;
+	for (size_t i = 0; i < Count; ++i)
+	{
+		const uint32_t Page = Buffer.Mapped[i];
+		if (Page != Previous && Page != VirtualPageId::Invalid && IsValidPage(Page))
+			OutRequests.push_back(Page);
+		Previous = Page;
+	}
+	std::sort(OutRequests.begin(), OutRequests.end());
+	OutRequests.erase(std::unique(OutRequests.begin(), OutRequests.end()), OutRequests.end());
+
+	// Cleared for the next frame that renders with this index
+	std::fill(Buffer.Mapped, Buffer.Mapped + Count, VirtualPageId::Invalid);
+	if (!Buffer.bCoherent)
+	{
+		vkFlushMappedMemoryRanges(Device, 1, &Range);
+	}
+}
+
+void VirtualTexture::StartLoad(uint32_t Page)
+{
+	Loading.insert(Page);
+	Jobs->Run([this, Page]()
+		{
+			LoadedPage Result{ Page, Uploader->ReserveStaging(PageBytes), false };
+			try
+			{
+				Result.bLoaded = Desc.LoadPage(VirtualPageId::GetMip(Page), VirtualPageId::GetX(Page), VirtualPageId::GetY(Page), Result.Staging.Data);
+			}
+			catch (const std::exception&)
+			{
+				Result.bLoaded = false;
+			}
+
+			std::lock_guard<std::mutex> Lock(CompletedMutex);
+			Completed.push_back(Result);
+		}, &LoadJobs, JobAffinity::Background);
+}
+
+void VirtualTexture::CommitLoadedPages()
+{
+	std::vector<LoadedPage> Pages;
+	{
+		std::lock_guard<std::mutex> Lock(CompletedMutex);
+		Pages.swap(Completed);
+	}
+
+	std::vector<ImageRegionUpload> Uploads;
+	for (const LoadedPage& Iter : Pages)
+	{
+		Loading.erase(Iter.Page);
+
+		const uint32_t Slot = Iter.bLoaded ? AcquireSlot() : NoSlot;
+		if (Slot == NoSlot)
+		{
+			// Dropped when every slot was used this frame, it is requested again if still needed
+			if (!Iter.bLoaded)
+			{
+				FailedPages.insert(Iter.Page);
+				++Stats.Failed;
+			}
+			Uploader->CancelStaging(Iter.Staging);
+			continue;
+		}
+
+		Slots[Slot].Page = Iter.Page;
+		Residency[GetPageIndex(Iter.Page)] = Slot;
+		bPageTableDirty = true;
+		++Stats.Loaded;
+
+		ImageRegionUpload Upload;
+		Upload.Staging = Iter.Staging;
+		Upload.Offset = { static_cast<int32_t>(Slot % Desc.AtlasPages * PhysicalPageSize), static_cast<int32_t>(Slot / Desc.AtlasPages * PhysicalPageSize), 0 };
+		Upload.Extent = { PhysicalPageSize, PhysicalPageSize, 1 };
+		Uploads.push_back(Upload);
+	}
+
+	// Any slot reused here was last sampled by frames submitted before this batch, the layout transition
+	// in front of the copies waits for them
+	Uploader->CommitImageRegions(Atlas, Desc.Format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, Uploads);
+}
+
+void VirtualTexture::Touch(uint32_t Slot)
+{
+	PhysicalSlot& Physical = Slots[Slot];
+	if (Slot == 0 || Physical.LastUsed == FrameNumber)
+		return;
+
+	Physical.LastUsed = FrameNumber;
+	Lru.splice(Lru.begin(), Lru, Physical.LruPosition);
+}
+
+uint32_t VirtualTexture::AcquireSlot()
+{
+	const uint32_t Slot = Lru.back();
+	PhysicalSlot& Physical = Slots[Slot];
+	if (Physical.LastUsed == FrameNumber)
+		return NoSlot;
+
+	if (Physical.Page != VirtualPageId::Invalid)
+	{
+		Residency[GetPageIndex(Physical.Page)] = NoSlot;
+		++Stats.Evicted;
+		--Stats.Resident;
+	}
+	++Stats.Resident;
+
+	Physical.LastUsed = FrameNumber;
+	Lru.splice(Lru.begin(), Lru, Physical.LruPosition);
+	return Slot;
+}
+
+void VirtualTexture::UploadPageTable(bool bFull)
+{
+	std::vector<ImageRegionUpload> Uploads;
+	std::vector<uint32_t> Entries;
+
+	// Coarse to fine, so a missing page can copy the entry of its parent
+	for (uint32_t Mip = MipCount; Mip-- > 0;)
+	{
+		const uint32_t Pages = GetPagesAtMip(Mip);
+		const uint32_t Offset = MipOffsets[Mip];
+		Entries.assign(PageTableData.begin() + Offset, PageTableData.begin() + Offset + Pages * Pages);
+
+		uint32_t MinX = Pages, MinY = Pages, MaxX = 0, MaxY = 0;
+		for (uint32_t Y = 0; Y < Pages; ++Y)
+		{
+			for (uint32_t X = 0; X < Pages; ++X)
+			{
+				const uint32_t Slot = Residency[Offset + Y * Pages + X];
+				uint32_t Entry = 0;
+				if (Slot != NoSlot)
+				{
+					Entry = MakeTableEntry(Slot % Desc.AtlasPages, Slot / Desc.AtlasPages, Mip);
+				}
+				else if (Mip + 1 < MipCount)
+				{
+					Entry = PageTableData[MipOffsets[Mip + 1] + (Y >> 1) * GetPagesAtMip(Mip + 1) + (X >> 1)];
+				}
+
+				uint32_t& Current = Entries[Y * Pages + X];
+				if (Current != Entry || bFull)
+				{
+					Current = Entry;
+					MinX = std::min(MinX, X);
+					MinY = std::min(MinY, Y);
+					MaxX = std::max(MaxX, X);
+					MaxY = std::max(MaxY, Y);
+				}
+			}
+		}
+		std::copy(Entries.begin(), Entries.end(), PageTableData.begin() + Offset);
+
+		if (MinX > MaxX)
+			continue;
+
+		// Only the rectangle around the changed entries is uploaded
+		const uint32_t Width = MaxX - MinX + 1;
+		const uint32_t Height = MaxY - MinY + 1;
+		ImageRegionUpload Upload;
+		Upload.Staging = Uploader->ReserveStaging(static_cast<VkDeviceSize>(Width) * Height * sizeof(uint32_t));
+		for (uint32_t Y = 0; Y < Height; ++Y)
+		{
+			memcpy(Upload.Staging.Data + Y * Width * sizeof(uint32_t), &Entries[(MinY + Y) * Pages + MinX], Width * sizeof(uint32_t));
+		}
+		Upload.Offset = { static_cast<int32_t>(MinX), static_cast<int32_t>(MinY), 0 };
+		Upload.Extent = { Width, Height, 1 };
+		Upload.MipLevel = Mip;
+		Uploads.push_back(Upload);
+		Stats.PageTableTexels += Width * Height;
+	}
+
+	Uploader->CommitImageRegions(PageTable, PageTableFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, Uploads);
+	bPageTableDirty = false;
+}
+
+VirtualPageLoader VirtualTexture::CreateImageSource(std::vector<uint8_t> Pixels, uint32_t Size)
+{
+	if (Pixels.size() != static_cast<size_t>(Size) * Size * 4)
+	{
+		throw std::runtime_error("virtual texture source image has the wrong size!");
+	}
+
+	// Built once, shared by every load job. Levels below one page are never asked for
+	std::shared_ptr<std::vector<std::vector<uint8_t>>> Mips =
+		std::make_shared<std::vector<std::vector<uint8_t>>>(TextureDecoder::BuildMipChain(std::move(Pixels), Size, Size));
+
+	return [Mips, Size](uint32_t Mip, uint32_t PageX, uint32_t PageY, uint8_t* OutTexels)
+		{
+			if (Mip >= Mips->size() || (Size >> Mip) < VirtualPageSize)
+				return false;
+
+			const std::vector<uint8_t>& Level = (*Mips)[Mip];
+			const int32_t LevelSize = static_cast<int32_t>(Size >> Mip);
+			const int32_t OriginX = static_cast<int32_t>(PageX * VirtualPageSize) - static_cast<int32_t>(VirtualPageBorder);
+			const int32_t OriginY = static_cast<int32_t>(PageY * VirtualPageSize) - static_cast<int32_t>(VirtualPageBorder);
+
+			for (uint32_t Y = 0; Y < PhysicalPageSize; ++Y)
+			{
+				const int32_t SrcY = (OriginY + static_cast<int32_t>(Y) + LevelSize) % LevelSize;
+				for (uint32_t X = 0; X < PhysicalPageSize; ++X)
+				{
+					const int32_t SrcX = (OriginX + static_cast<int32_t>(X) + LevelSize) % LevelSize;
+					memcpy(OutTexels + (Y * PhysicalPageSize + X) * 4, &Level[(static_cast<size_t>(SrcY) * LevelSize + SrcX) * 4], 4);
+				}
+			}
+			return true;
+		};
+}
+
+VirtualPageLoader VirtualTexture::CreateTileSource(const std::string& Directory, const std::string& Extension)
+{
+	return [Directory, Extension](uint32_t Mip, uint32_t PageX, uint32_t PageY, uint8_t* OutTexels)
+		{
+			const std::string File = Directory + "/" + std::to_string(Mip) + "/" + std::to_string(PageX) + "_" + std::to_string(PageY) + Extension;
+			const std::vector<char> Data = ReadFile(File);
+			const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(Data.data());
+
+			uint32_t Width = 0, Height = 0;
+			const ImageDecoderBackend* Backend = TextureDecoder::FindBackend(Bytes, Data.size());
+			if (!Backend || !Backend->ReadInfo(Bytes, Data.size(), Width, Height) || Width != PhysicalPageSize || Height != PhysicalPageSize)
+				return false;
+
+			return Backend->Decode(Bytes, Data.size(), OutTexels, static_cast<size_t>(PageBytes));
+		};
+}
@@ -0,0 +1,337 @@
+#include "../../Public/Scene/TransformHierarchy.h"
+#include "../../Public/Math/BatchMath.h"
+#include "../../Public/Core/JobSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
+#include <iomanip>
+
+// A level has to be this wide before splitting it across threads beats doing it on one
+static const uint32_t ParallelUpdateThreshold = 16 * 1024;
+
+SceneNodeId TransformHierarchy::AddNode(SceneNodeId Parent, const glm::mat4& Local)
+{
+	uint32_t ParentIndex = NoParent;
+	if (Parent != InvalidSceneNode)
+	{
+		if (Parent >= NodeIndices.size() || NodeIndices[Parent] == UINT32_MAX)
+		{
+			throw std::runtime_error("scene node parent does not exist");
+		}
+		ParentIndex = NodeIndices[Parent];
+	}
+
+	SceneNodeId Id;
+	if (!FreeNodeIds.empty())
+	{
+		Id = FreeNodeIds.back();
+		FreeNodeIds.pop_back();
+	}
+	else
+	{
+		Id = static_cast<SceneNodeId>(NodeIndices.size());
+		NodeIndices.push_back(UINT32_MAX);
+	}
+
+	// Appending keeps parents ahead of children, only the level ranges go stale
+	NodeIndices[Id] = static_cast<uint32_t>(Parents.size());
+	Parents.push_back(ParentIndex);
+	LocalMatrices.push_back(Local);
+	WorldMatrices.push_back(Local);
+	DirtyFlags.push_back(1);
+	NodeIds.push_back(Id);
+	ChildBegins.push_back(0);
+	ChildEnds.push_back(0);
+
+	// Dirty nodes are collected from the flags once the order is rebuilt
+	bOrderDirty = true;
+	return Id;
+}
+
+void TransformHierarchy::RemoveNode(SceneNodeId Node)
+{
+	const uint32_t Index = NodeIndices.at(Node);
+	if (Index == UINT32_MAX)
+		return;
+
+	// Descendants are stored after their ancestors, one forward pass finds the whole subtree
+	std::vector<uint8_t> Removed(Parents.size(), 0);
+	Removed[Index] = 1;
+	for (uint32_t i = Index + 1; i < Parents.size(); ++i)
+	{
+		if (Parents[i] != NoParent && Removed[Parents[i]])
+			Removed[i] = 1;
+	}
+
+	for (uint32_t i = Index; i < Parents.size(); ++i)
+	{
+		if (Removed[i] && NodeIds[i] != InvalidSceneNode)
+		{
+			NodeIndices[NodeIds[i]] = UINT32_MAX;
+			FreeNodeIds.push_back(NodeIds[i]);
+			NodeIds[i] = InvalidSceneNode;   // compacted away by RebuildOrder()
+		}
+	}
+
+	bOrderDirty = true;
+}
+
+void TransformHierarchy::SetLocal(SceneNodeId Node, const glm::mat4& Local)
+{
+	const uint32_t Index = NodeIndices[Node];
+	LocalMatrices[Index] = Local;
+	if (!DirtyFlags[Index])
+	{
+		DirtyFlags[Index] = 1;
+		DirtyNodes.push_back(Index);
+	}
+}
+
+const glm::mat4& TransformHierarchy::GetLocal(SceneNodeId Node) const
+{
+	return LocalMatrices[NodeIndices[Node]];
+}
+
+const glm::mat4& TransformHierarchy::GetWorld(SceneNodeId Node) const
+{
+	return WorldMatrices[NodeIndices[Node]];
+}
+
+void TransformHierarchy::Update()
+{
+	if (bOrderDirty)
+	{
+		RebuildOrder();
+
+		// Storage indices moved, collect the dirty nodes again
+		DirtyNodes.clear();
+		for (uint32_t i = 0; i < DirtyFlags.size(); ++i)
+		{
+			if (DirtyFlags[i])
+				DirtyNodes.push_back(i);
+		}
+	}
+
+	LastUpdatedCount = 0;
+	if (DirtyNodes.empty())
+		return;
+
+	// Every dirty node starts a one node range on its level, ranges of a level expand to the contiguous
+	// children range on the next one, so only the dirty subtrees are ever visited
+	const size_t LevelCount = LevelStarts.size() - 1;
+	LevelRanges.resize(LevelCount);
+	for (uint32_t Index : DirtyNodes)
+	{
+		const size_t Level = std::upper_bound(LevelStarts.begin(), LevelStarts.end(), Index) - LevelStarts.begin() - 1;
+		LevelRanges[Level].push_back({ Index, Index + 1 });
+	}
+
+	// Levels in order, a level only reads world matrices of the level above
+	for (size_t Level = 0; Level < LevelCount; ++Level)
+	{
+		std::vector<NodeRange>& Ranges = LevelRanges[Level];
+		if (Ranges.empty())
+			continue;
+
+		// A dirty node inside a dirty subtree is already covered, merge overlapping and adjacent ranges
+		std::sort(Ranges.begin(), Ranges.end(), [](const NodeRange& A, const NodeRange& B) { return A.Begin < B.Begin; });
+		size_t Merged = 0;
+		for (size_t i = 1; i < Ranges.size(); ++i)
+		{
+			if (Ranges[i].Begin <= Ranges[Merged].End)
+				Ranges[Merged].End = std::max(Ranges[Merged].End, Ranges[i].End);
+			else
+				Ranges[++Merged] = Ranges[i];
+		}
+		Ranges.resize(Merged + 1);
+
+		for (const NodeRange& Range : Ranges)
+		{
+			if (!Jobs || Range.End - Range.Begin < ParallelUpdateThreshold)
+			{
+				UpdateRange(Range.Begin, Range.End);
+			}
+			else
+			{
+				Jobs->ParallelFor(Range.End - Range.Begin, ParallelUpdateThreshold / 4, [this, &Range](uint32_t BatchBegin, uint32_t BatchEnd)
+					{
+						UpdateRange(Range.Begin + BatchBegin, Range.Begin + BatchEnd);
+					});
+			}
+			LastUpdatedCount += Range.End - Range.Begin;
+
+			const uint32_t FirstChild = ChildBegins[Range.Begin];
+			const uint32_t ChildrenEnd = ChildEnds[Range.End - 1];
+			if (FirstChild < ChildrenEnd)
+				LevelRanges[Level + 1].push_back({ FirstChild, ChildrenEnd });
+		}
+		Ranges.clear();
+	}
+
+	for (uint32_t Index : DirtyNodes)
+	{
+		DirtyFlags[Index] = 0;
+	}
+	DirtyNodes.clear();
+}
+
+void TransformHierarchy::UpdateRange(uint32_t Begin, uint32_t End)
+{
+	for (uint32_t i = Begin; i < End; ++i)
+	{
+		const uint32_t Parent = Parents[i];
+		if (Parent == NoParent)
+			WorldMatrices[i] = LocalMatrices[i];
+		else
+			BatchMath::MultiplyMatrix(WorldMatrices[Parent], LocalMatrices[i], WorldMatrices[i]);
+	}
+}
+
+void TransformHierarchy::RebuildOrder()
+{
+	const uint32_t OldCount = static_cast<uint32_t>(Parents.size());
+
+	// Children of every live node in storage order, parents precede children so removed subtrees never
+	// hang off a live node
+	std::vector<uint32_t> ChildOffsets(OldCount + 1, 0);
+	for (uint32_t i = 0; i < OldCount; ++i)
+	{
+		if (NodeIds[i] != InvalidSceneNode && Parents[i] != NoParent)
+			++ChildOffsets[Parents[i] + 1];
+	}
+	for (uint32_t i = 0; i < OldCount; ++i)
+	{
+		ChildOffsets[i + 1] += ChildOffsets[i];
+	}
+	std::vector<uint32_t> Children(ChildOffsets.back());
+	std::vector<uint32_t> WriteOffsets(ChildOffsets.begin(), ChildOffsets.end() - 1);
+	for (uint32_t i = 0; i < OldCount; ++i)
+	{
+		if (NodeIds[i] != InvalidSceneNode && Parents[i] != NoParent)
+			Children[WriteOffsets[Parents[i]]++] = i;
+	}
+
+	// Breadth-first from the roots: each level is contiguous, and so are the children of consecutive
+	// parents. Siblings keep their relative order
+	std::vector<uint32_t> Order;
+	Order.reserve(OldCount);
+	for (uint32_t i = 0; i < OldCount; ++i)
+	{
+		if (NodeIds[i] != InvalidSceneNode && Parents[i] == NoParent)
+			Order.push_back(i);
+	}
+
+	std::vector<uint32_t> NewChildBegins;
+	std::vector<uint32_t> NewChildEnds;
+	NewChildBegins.reserve(Order.capacity());
+	NewChildEnds.reserve(Order.capacity());
+	LevelStarts.assign(1, 0);
+	for (size_t Begin = 0; Begin < Order.size();)
+	{
+		const size_t End = Order.size();
+		LevelStarts.push_back(static_cast<uint32_t>(End));
+		for (size_t i = Begin; i < End; ++i)
+		{
+			NewChildBegins.push_back(static_cast<uint32_t>(Order.size()));
+			Order.insert(Order.end(), Children.begin() + ChildOffsets[Order[i]], Children.begin() + ChildOffsets[Order[i] + 1]);
+			NewChildEnds.push_back(static_cast<uint32_t>(Order.size()));
+		}
+		Begin = End;
+	}
+
+	std::vector<uint32_t> NewIndices(OldCount, UINT32_MAX);
+	for (uint32_t i = 0; i < Order.size(); ++i)
+	{
+		NewIndices[Order[i]] = i;
+	}
+
+	const uint32_t NewCount = LevelStarts.back();
+	std::vector<uint32_t> NewParents(NewCount);
+	std::vector<glm::mat4> NewLocals(NewCount);
+	std::vector<glm::mat4> NewWorlds(NewCount);
+	std::vector<uint8_t> NewDirtyFlags(NewCount);
+	std::vector<SceneNodeId> NewNodeIds(NewCount);
+
+	for (uint32_t i = 0; i < OldCount; ++i)
+	{
+		const uint32_t NewIndex = NewIndices[i];
+		if (NewIndex == UINT32_MAX)
+			continue;
+
+		NewParents[NewIndex] = Parents[i] == NoParent ? NoParent : NewIndices[Parents[i]];
+		NewLocals[NewIndex] = LocalMatrices[i];
+		NewWorlds[NewIndex] = WorldMatrices[i];
+		NewDirtyFlags[NewIndex] = DirtyFlags[i];
+		NewNodeIds[NewIndex] = NodeIds[i];
+		NodeIndices[NodeIds[i]] = NewIndex;
+	}
+
+	Parents.swap(NewParents);
+	LocalMatrices.swap(NewLocals);
+	WorldMatrices.swap(NewWorlds);
+	DirtyFlags.swap(NewDirtyFlags);
+	NodeIds.swap(NewNodeIds);
+	ChildBegins.swap(NewChildBegins);
+	ChildEnds.swap(NewChildEnds);
+
+	bOrderDirty = false;
+}
+
+void TransformHierarchy::RunBenchmark(uint32_t NodeCount, JobSystem& Jobs, std::ostream& Out)
+{
+	// A scene like tree: a few roots, every node has up to eight children, levels fill breadth-first
+	const uint32_t RootCount = std::min(NodeCount, 16u);
+	const uint32_t FanOut = 8;
+
+	TransformHierarchy Hierarchy;
+	std::vector<SceneNodeId> Nodes;
+	Nodes.reserve(NodeCount);
+	for (uint32_t i = 0; i < NodeCount; ++i)
+	{
+		const SceneNodeId Parent = i < RootCount ? InvalidSceneNode : Nodes[(i - RootCount) / FanOut];
+		const glm::vec3 Offset(static_cast<float>(i % 7), static_cast<float>(i % 5), static_cast<float>(i % 3));
+		Nodes.push_back(Hierarchy.AddNode(Parent, glm::mat4(glm::vec4(1, 0, 0, 0), glm::vec4(0, 1, 0, 0), glm::vec4(0, 0, 1, 0), glm::vec4(Offset, 1))));
+	}
+	Hierarchy.Update();
+
+	Out << std::fixed << std::setprecision(3);
+	Out << "transform benchmark: " << Hierarchy.GetNodeCount() << " nodes, " << Hierarchy.GetLevelCount() << " levels\n";
+
+	const uint32_t Iterations = 10;
+	const SceneNodeId Leaf = Nodes.back();
+	for (JobSystem* Iter : { static_cast<JobSystem*>(nullptr), &Jobs })
+	{
+		Hierarchy.SetJobSystem(Iter);
+
+		double FullSeconds = 0.0;
+		uint32_t FullUpdated = 0;
+		for (uint32_t i = 0; i < Iterations; ++i)
+		{
+			for (SceneNodeId Node : Nodes)
+			{
+				Hierarchy.SetLocal(Node, Hierarchy.GetLocal(Node));
+			}
+			const auto Start = std::chrono::steady_clock::now();
+			Hierarchy.Update();
+			FullSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+			FullUpdated = Hierarchy.GetLastUpdatedCount();
+		}
+
+		double LeafSeconds = 0.0;
+		uint32_t LeafUpdated = 0;
+		for (uint32_t i = 0; i < Iterations; ++i)
+		{
+			Hierarchy.SetLocal(Leaf, Hierarchy.GetLocal(Leaf));
+			const auto Start = std::chrono::steady_clock::now();
+			Hierarchy.Update();
+			LeafSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+			LeafUpdated = Hierarchy.GetLastUpdatedCount();
+		}
+
+		Out << "  " << std::setw(2) << (Iter ? Iter->GetThreadCount() : 1) << " threads   full "
+			<< std::setw(9) << FullSeconds * 1000.0 / Iterations << " ms (" << FullUpdated << " nodes)   single leaf "
+			<< std::setw(9) << LeafSeconds * 1e6 / Iterations << " us (" << LeafUpdated << " nodes)\n";
+	}
+	Out << std::defaultfloat;
+}
@@ -18,7 +18,31 @@
 #include <algorithm>
 #include "../Public/Common/FunctionLibrary.h"
 #include "../Public/Common/VertexInput.h"
+#include "../Public/Render/RenderGraph.h"
+#include "../Public/Render/GpuTimeline.h"
+#include "../Public/Render/DeferredDeletionQueue.h"
+#include "../Public/Render/UploadContext.h"
+#include "../Public/Render/MemoryPlacement.h"
+#include "../Public/Render/DrawQueue.h"
+#include "../Public/Render/PipelineManager.h"
+#include "../Public/Render/ShaderHotReload.h"
+#include "../Public/Render/PipelineLayoutCache.h"
+#include "../Public/Render/DescriptorAllocator.h"
+#include "../Public/Render/TextureDecoder.h"
+#include "../Public/Render/ResidencyManager.h"
+#include "../Public/Render/TexturePacker.h"
+#include "../Public/Render/SamplerCache.h"
+#include "../Public/Render/AsyncCompute.h"
+#include "../Public/Render/ClusteredLighting.h"
+#include "../Public/Render/CascadedShadows.h"
+#include "../Public/Render/VirtualTexture.h"
+#include "../Public/Scene/TransformHierarchy.h"
+#include "../Public/Core/JobSystem.h"
+#include "../Public/Core/TaskGraph.h"
+#include "../Public/Math/Projection.h"
+#include "../Public/Math/BatchMath.h"
 #include <chrono>
+#include <random>
 #include <gtc/matrix_transform.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -28,6 +52,9 @@ const uint32_t HEIGHT = 600;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Lay down depth first so the base pass shades each pixel once (depth test EQUAL), worth it for overdraw-heavy scenes
+const bool EnableDepthPrepass = false;
+
 const std::vector<const char*> ValidationLayers = { "VK_LAYER_KHRONOS_validation" };
 const std::vector<const char*> DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
@@ -37,6 +64,13 @@ const std::vector<const char*> DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_N
 	const bool EnableValidationLayers = true;
 #endif // NDEBUG
 
+// Recompile edited shaders while running, development builds only
+#ifdef NDEBUG
+	const bool EnableShaderHotReload = false;
+#else
+	const bool EnableShaderHotReload = true;
+#endif // NDEBUG
+
 	static void FramebufferResizeCallback(GLFWwindow* Window, int Width, int Height);
 
 class HelloTriangleApplication
@@ -44,6 +78,10 @@ class HelloTriangleApplication
 public:
 	void run()
 	{
+		// Before anything else submits work, this thread becomes the job system's main thread
+		Jobs.Init();
+		std::cout << "job system: " << Jobs.GetThreadCount() << " threads\n";
+
 		InitWindow();
 		InitVulkan();
 		MainLoop();
@@ -63,30 +101,64 @@ private:
 		glfwSetFramebufferSizeCallback(Window, FramebufferResizeCallback);
 	}
 
+	// Startup is a dependency graph, stages that don't depend on each other (texture decodes, shader
+	// compiles, buffer uploads, sampler, command pool, ...) overlap on the job system
 	void InitVulkan()
 	{
-		CreateInstance();
-		SetupDebugMessenger();
-		CreateSurface();
-		PickPhysicalDevice();
-		CreateLogicalDevice();
-		CreateSwapChain();
-		CreateImageViews();
-		CreateRenderPass();
-		CreateDescriptorSetLayout();
-		CreateGraphicsPipeline();
-		CreateFramebuffers();
-		CreateCommandPool();
-		CreateTextureImage();
-		CreateTextureImageView();
-		CreateTextureSampler();
-		CreateVertexBuffers();
-		CreateIndexBuffers();
-		CreateUniformBuffers();
-		CreateDescriptorPool();
-		CreateDescriptorSets();
-		CreateCommandBuffers();
-		CreateSyncObjects();
+		TaskGraph Startup;
+
+		const TaskId InstanceStage = Startup.Add("CreateInstance", [this]() { CreateInstance(); });
+		Startup.Add("SetupDebugMessenger", [this]() { SetupDebugMessenger(); }, { InstanceStage });
+		const TaskId SurfaceStage = Startup.Add("CreateSurface", [this]() { CreateSurface(); }, { InstanceStage });
+		const TaskId PhysicalDeviceStage = Startup.Add("PickPhysicalDevice", [this]() { PickPhysicalDevice(); }, { SurfaceStage });
+		const TaskId DeviceStage = Startup.Add("CreateLogicalDevice", [this]() { CreateLogicalDevice(); }, { PhysicalDeviceStage });
+
+		// glfwGetFramebufferSize() is main thread only
+		const TaskId SwapChainStage = Startup.Add("CreateSwapChain", [this]() { CreateSwapChain(); }, { DeviceStage }, JobAffinity::MainThread);
+		const TaskId ImageViewsStage = Startup.Add("CreateImageViews", [this]() { CreateImageViews(); }, { SwapChainStage });
+		const TaskId RenderPassStage = Startup.Add("CreateRenderPass", [this]() { CreateRenderPass(); }, { SwapChainStage });
+
+		// The scene layout bakes the texture sampler in as an immutable sampler
+		const TaskId SamplerStage = Startup.Add("CreateTextureSampler", [this]() { CreateTextureSampler(); }, { DeviceStage });
+		const TaskId HotReloadStage = Startup.Add("SetupShaderHotReload", [this]() { SetupShaderHotReload(); }, { DeviceStage });
+		// The shadow sampler is immutable in the scene layout too, and the render graph imports the shadow map
+		const TaskId ShadowStage = Startup.Add("CreateShadows", [this]() { CreateShadows(); }, { HotReloadStage });
+		const TaskId LayoutStage = Startup.Add("CreatePipelineLayout", [this]() { CreatePipelineLayout(); }, { HotReloadStage, SamplerStage, ShadowStage });
+		const TaskId LightingStage = Startup.Add("CreateClusteredLighting", [this]() { CreateClusteredLighting(); }, { HotReloadStage });
+		Startup.Add("CreateGraphicsPipeline", [this]() { CreateGraphicsPipeline(); }, { RenderPassStage, LayoutStage });
+
+		const TaskId RenderGraphStage = Startup.Add("SetupRenderGraph", [this]() { SetupRenderGraph(); }, { RenderPassStage, ShadowStage });
+		Startup.Add("CreateFramebuffers", [this]() { CreateFramebuffers(); }, { ImageViewsStage, RenderGraphStage });
+
+		const TaskId CommandPoolStage = Startup.Add("CreateCommandPool", [this]() { CreateCommandPool(); }, { DeviceStage });
+		Startup.Add("CreateCommandBuffers", [this]() { CreateCommandBuffers(); }, { CommandPoolStage });
+
+		const TaskId TextureStage = Startup.Add("CreateTextureImage", [this]() { CreateTextureImage(); }, { DeviceStage });
+		Startup.Add("CreateTextureImageView", [this]() { CreateTextureImageView(); }, { TextureStage });
+		const TaskId VertexStage = Startup.Add("CreateVertexBuffers", [this]() { CreateVertexBuffers(); }, { DeviceStage });
+		const TaskId IndexStage = Startup.Add("CreateIndexBuffers", [this]() { CreateIndexBuffers(); }, { DeviceStage });
+		const TaskId VirtualTextureStage = Startup.Add("CreateVirtualTexture", [this]() { CreateVirtualTexture(); }, { DeviceStage });
+
+		// All scene uploads above go out in one submit, frames on the same queue are ordered behind it
+		Startup.Add("FlushUploads", [this]() { Uploader.Flush(); }, { TextureStage, VertexStage, IndexStage, ShadowStage, VirtualTextureStage });
+
+		Startup.Add("CreateUniformBuffers", [this]() { CreateUniformBuffers(); }, { SwapChainStage });
+		// The demo lights are sized by LightingDesc, which CreateClusteredLighting() finishes filling in
+		Startup.Add("CreateScene", [this]() { CreateScene(); }, { LightingStage });
+		Startup.Add("CreateSyncObjects", [this]() { CreateSyncObjects(); }, { SwapChainStage });
+
+		Startup.Run(Jobs);
+
+		std::cout << "startup timeline:\n";
+		Startup.PrintTimeline(std::cout);
+		std::cout << "memory budget" << (Residency.HasMemoryBudgetExtension() ? " (VK_EXT_memory_budget)" : "") << ":\n";
+		Residency.PrintHeapUsage(std::cout);
+
+		if (bVerifyClusters)
+			VerifyClusterBinning();
+
+		if (EnableShaderHotReload)
+			ShaderReloader.Start();
 	}
 
 	void CreateInstance()
@@ -102,7 +174,7 @@ private:
 		AppInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		AppInfo.pEngineName = "No Engine";
 		AppInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		AppInfo.apiVersion = VK_API_VERSION_1_0;
+		AppInfo.apiVersion = VK_API_VERSION_1_2;   // timeline semaphores are core in 1.2
 		AppInfo.pNext = nullptr;
 
 		/// Create vulkan instance
@@ -253,6 +325,21 @@ private:
 		return true;
 	}
 
+	bool IsDeviceExtensionSupported(VkPhysicalDevice DeviceParam, const char* Name)
+	{
+		uint32_t ExtensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(DeviceParam, nullptr, &ExtensionCount, nullptr);
+		std::vector<VkExtensionProperties> AvailableExtensions(ExtensionCount);
+		vkEnumerateDeviceExtensionProperties(DeviceParam, nullptr, &ExtensionCount, AvailableExtensions.data());
+
+		for (const auto& Iter : AvailableExtensions)
+		{
+			if (std::string(Iter.extensionName) == Name)
+				return true;
+		}
+		return false;
+	}
+
 	bool CheckDeviceExtensionsSupport(VkPhysicalDevice DeviceParam)
 	{
 		uint32_t ExtensionCount = 0;
@@ -337,7 +424,20 @@ private:
 		VkPhysicalDeviceFeatures DeviceFeatures;
 		vkGetPhysicalDeviceFeatures(DeviceParam, &DeviceFeatures);
 
-		return Indices.GraphicsFamily.has_value() && ExtensionsSupported && SwapChainAdequate && DeviceFeatures.samplerAnisotropy;
+		VkPhysicalDeviceProperties DeviceProperties;
+		vkGetPhysicalDeviceProperties(DeviceParam, &DeviceProperties);
+		if (DeviceProperties.apiVersion < VK_API_VERSION_1_2)
+			return false;
+
+		VkPhysicalDeviceVulkan12Features Vulkan12Features{};
+		Vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 DeviceFeatures2{};
+		DeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		DeviceFeatures2.pNext = &Vulkan12Features;
+		vkGetPhysicalDeviceFeatures2(DeviceParam, &DeviceFeatures2);
+
+		return Indices.GraphicsFamily.has_value() && ExtensionsSupported && SwapChainAdequate && DeviceFeatures.samplerAnisotropy &&
+			Vulkan12Features.timelineSemaphore;
 
 		/*VkPhysicalDeviceProperties DeviceProperties;
 		vkGetPhysicalDeviceProperties(Device, &DeviceProperties);
@@ -371,6 +471,7 @@ private:
 	{
 		std::optional<uint32_t> GraphicsFamily;
 		std::optional<uint32_t> PresentFamily;
+		std::optional<uint32_t> ComputeFamily;   // without graphics when the device has one, else the graphics family
 
 		bool IsComplete()
 		{
@@ -443,19 +544,26 @@ private:
 		int i = 0;
 		for (const auto& Iter : QueueFamilies)
 		{
-			if (Iter.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-				Indices.GraphicsFamily = i;
+			// A compute only family runs next to graphics instead of behind it in the same queue
+			if ((Iter.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(Iter.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !Indices.ComputeFamily.has_value() && bAsyncCompute)
+				Indices.ComputeFamily = i;
 
-			// check weather this device support current surface
-			vkGetPhysicalDeviceSurfaceSupportKHR(Device, i, Surface, &PresentSupport);
-			if (PresentSupport)
-				Indices.PresentFamily = i;
+			if (!Indices.IsComplete())
+			{
+				if (Iter.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+					Indices.GraphicsFamily = i;
 
-			if (Indices.IsComplete())
-				break;
+				// check weather this device support current surface
+				vkGetPhysicalDeviceSurfaceSupportKHR(Device, i, Surface, &PresentSupport);
+				if (PresentSupport)
+					Indices.PresentFamily = i;
+			}
 			i++;
 		}
 
+		if (!Indices.ComputeFamily.has_value())
+			Indices.ComputeFamily = Indices.GraphicsFamily;
+
 		return Indices;
 	}
 
@@ -504,8 +612,13 @@ private:
 		vkGetPhysicalDeviceFeatures(PhysicDevice, &DeviceFeatures);
 		DeviceFeatures.samplerAnisotropy = VK_TRUE;
 
+		VkPhysicalDeviceVulkan12Features Vulkan12Features{};
+		Vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		Vulkan12Features.timelineSemaphore = VK_TRUE;
+
 		VkDeviceCreateInfo CreateInfo{};
 		CreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		CreateInfo.pNext = &Vulkan12Features;
 		CreateInfo.pQueueCreateInfos = &QueueCreateInfo;
 		CreateInfo.queueCreateInfoCount = 1;
 
@@ -522,12 +635,16 @@ private:
 			CreateInfo.enabledLayerCount = 0;
 		}
 
-		// Open swap extension
-		CreateInfo.enabledExtensionCount = static_cast<uint32_t>(DeviceExtensions.size());
-		CreateInfo.ppEnabledExtensionNames = DeviceExtensions.data();
+		// Open swap extension, plus the driver's memory budget when it reports one
+		std::vector<const char*> EnabledExtensions = DeviceExtensions;
+		const bool bMemoryBudget = IsDeviceExtensionSupported(PhysicDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (bMemoryBudget)
+			EnabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		CreateInfo.enabledExtensionCount = static_cast<uint32_t>(EnabledExtensions.size());
+		CreateInfo.ppEnabledExtensionNames = EnabledExtensions.data();
 
 		std::vector<VkDeviceQueueCreateInfo> QueueCreateInfos;
-		std::set<uint32_t> UniqueQueueFamilies = { Indices.GraphicsFamily.value(), Indices.PresentFamily.value() };
+		std::set<uint32_t> UniqueQueueFamilies = { Indices.GraphicsFamily.value(), Indices.PresentFamily.value(), Indices.ComputeFamily.value() };
 
 		for (uint32_t QueueFamily : UniqueQueueFamilies)
 		{
@@ -548,6 +665,35 @@ private:
 		// Get device queue
 		vkGetDeviceQueue(Device, Indices.GraphicsFamily.value(), 0, &GraphicsQueue);
 		vkGetDeviceQueue(Device, Indices.PresentFamily.value(), 0, &PresentQueue);
+		vkGetDeviceQueue(Device, Indices.ComputeFamily.value(), 0, &ComputeQueue);
+
+		MemoryPolicy.Init(PhysicDevice);
+		Samplers.Init(Device, PhysicDevice, DeviceFeatures.samplerAnisotropy == VK_TRUE);
+		std::cout << "batch math: " << BatchMath::GetSimdLevelName(BatchMath::GetSimdLevel()) << '\n';
+		std::cout << "memory placement: " << (MemoryPolicy.IsUnifiedMemory() ? "unified memory" : MemoryPolicy.HasResizableBar() ? "resizable BAR" : "discrete, staged uploads") << '\n';
+
+		Timeline.Init(Device);
+		DeletionQueue.Init(Device, &Timeline);
+		FrameGraph.Init(Device, PhysicDevice, &DeletionQueue);
+		Uploader.Init(Device, PhysicDevice, GraphicsQueue, Indices.GraphicsFamily.value(), QueueType::Graphics, &Timeline, &DeletionQueue);
+		AsyncCompute.Init(Device, PhysicDevice, &Timeline, ComputeQueue, Indices.ComputeFamily.value(), Indices.GraphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+		std::cout << "async compute: " << (AsyncCompute.IsDedicated() ? "queue family " + std::to_string(AsyncCompute.GetFamily()) : std::string("shares the graphics queue")) << '\n';
+
+		ResidencyBudget MemoryBudget;
+		MemoryBudget.DeviceLocalLimit = DeviceMemoryLimit;
+		Residency.Init(PhysicDevice, Device, &MemoryPolicy, &Timeline, &Uploader, &DeletionQueue, &Jobs, bMemoryBudget, MemoryBudget);
+		TextureLoader.Init(&Jobs, &Uploader, [this](uint32_t Width, uint32_t Height, VkFormat Format, VkImage& Image, VkDeviceMemory& Memory)
+			{
+				CreateImage(Width, Height, Format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+					MemoryUsage::GpuOnly, Image, Memory);
+			});
+		Pipelines.Init(Device, "PipelineCache.bin", &Jobs, std::max(Jobs.GetThreadCount() / 2, 1u));
+		Layouts.Init(Device, PhysicDevice);
+		DescriptorCache.Init(Device);
+		for (DescriptorAllocator& Iter : FrameDescriptors)
+		{
+			Iter.Init(Device);
+		}
 	}
 
 	void CreateSwapChain()
@@ -591,13 +737,18 @@ private:
 		CreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		CreateInfo.presentMode = PresentMode;
 		CreateInfo.clipped = VK_TRUE;
-		CreateInfo.oldSwapchain = VK_NULL_HANDLE;   //used when swap chain recreated(resize viewport...)
+		VkSwapchainKHR OldSwapChain = SwapChain;
+		CreateInfo.oldSwapchain = OldSwapChain;   //used when swap chain recreated(resize viewport...)
 
 		if (vkCreateSwapchainKHR(Device, &CreateInfo, nullptr, &SwapChain) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create swap chain!");
 		}
 
+		// Frames already submitted may still present from the old one
+		if (OldSwapChain != VK_NULL_HANDLE)
+			DeletionQueue.Retire(VK_OBJECT_TYPE_SWAPCHAIN_KHR, OldSwapChain);
+
 		vkGetSwapchainImagesKHR(Device, SwapChain, &ImageCount, nullptr);
 		SwapChainImages.resize(ImageCount);
 		vkGetSwapchainImagesKHR(Device, SwapChain, &ImageCount, SwapChainImages.data());
@@ -627,255 +778,328 @@ private:
 		ColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		ColorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		ColorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // content of framebuffer will be undefined after rendering operation 
-		ColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		ColorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;   // presented in the swap chain
+		// Layout transitions (undefined -> attachment -> present) are scheduled by the render graph
+		ColorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		ColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		//Subpasses: subpasses are subsequent rendering operations that depend on the contents of framebuffers in previous passes
 		VkAttachmentReference ColorAttachmentRef{};
 		ColorAttachmentRef.attachment = 0;
 		ColorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+		DepthFormat = FindDepthFormat();
+
+		// Reverse-Z: cleared to 0 (infinitely far). Nothing reads depth after the base pass, so it is never stored
+		VkAttachmentDescription DepthAttachment{};
+		DepthAttachment.format = DepthFormat;
+		DepthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		DepthAttachment.loadOp = EnableDepthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		DepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		DepthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		DepthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		DepthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		DepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference DepthAttachmentRef{};
+		DepthAttachmentRef.attachment = 1;
+		DepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 		VkSubpassDescription Subpass{};
 		Subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 		Subpass.colorAttachmentCount = 1;
 		Subpass.pColorAttachments = &ColorAttachmentRef;
+		Subpass.pDepthStencilAttachment = &DepthAttachmentRef;
+
+		std::array<VkAttachmentDescription, 2> Attachments = { ColorAttachment, DepthAttachment };
 
 		VkRenderPassCreateInfo RenderPassInfo{};
 		RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		RenderPassInfo.attachmentCount = 1;
-		RenderPassInfo.pAttachments = &ColorAttachment;
+		RenderPassInfo.attachmentCount = static_cast<uint32_t>(Attachments.size());
+		RenderPassInfo.pAttachments = Attachments.data();
 		RenderPassInfo.subpassCount = 1;
 		RenderPassInfo.pSubpasses = &Subpass;
 
-		VkSubpassDependency Dependency{};
-		Dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		Dependency.dstSubpass = 0;
-		Dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		Dependency.srcAccessMask = 0;
-		Dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		Dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-		RenderPassInfo.dependencyCount = 1;
-		RenderPassInfo.pDependencies = &Dependency;
+		// Synchronization with the acquire semaphore and earlier passes comes from the render graph barriers
+		RenderPassInfo.dependencyCount = 0;
+		RenderPassInfo.pDependencies = nullptr;
 
 		if (vkCreateRenderPass(Device, &RenderPassInfo, nullptr, &RenderPass) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("failed to create render pass!");
 		}
-	}
-
-	void CreateDescriptorSetLayout()
-	{
-		VkDescriptorSetLayoutBinding UBOLayoutBindings{};
-		UBOLayoutBindings.binding = 0;
-		UBOLayoutBindings.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		UBOLayoutBindings.descriptorCount = 1;
-		UBOLayoutBindings.stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // Decide the descriptor referenced by which shader stage
-		UBOLayoutBindings.pImmutableSamplers = nullptr;
 
-		VkDescriptorSetLayoutBinding SamplerLayoutBinding{};
-		SamplerLayoutBinding.binding = 1;
-		SamplerLayoutBinding.descriptorCount = 1;
-		SamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		SamplerLayoutBinding.pImmutableSamplers = nullptr;
-		SamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		if (EnableDepthPrepass)
+		{
+			DepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			DepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			DepthAttachmentRef.attachment = 0;
 
-		std::array<VkDescriptorSetLayoutBinding, 2> Bindings = {UBOLayoutBindings, SamplerLayoutBinding};
+			VkSubpassDescription PrepassSubpass{};
+			PrepassSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			PrepassSubpass.colorAttachmentCount = 0;
+			PrepassSubpass.pDepthStencilAttachment = &DepthAttachmentRef;
 
-		VkDescriptorSetLayoutCreateInfo LayoutInfo{};
-		LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		LayoutInfo.bindingCount = static_cast<uint32_t>(Bindings.size());
-		LayoutInfo.pBindings = Bindings.data();
+			RenderPassInfo.attachmentCount = 1;
+			RenderPassInfo.pAttachments = &DepthAttachment;
+			RenderPassInfo.pSubpasses = &PrepassSubpass;
 
-		if (vkCreateDescriptorSetLayout(Device, &LayoutInfo, nullptr, &DescriptorSetLayout) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create descriptor set layout");
+			if (vkCreateRenderPass(Device, &RenderPassInfo, nullptr, &DepthPrepassRenderPass) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create depth prepass render pass!");
+			}
 		}
 	}
 
-	void CreateGraphicsPipeline()
+	VkFormat FindSupportedFormat(const std::vector<VkFormat>& Candidates, VkImageTiling Tiling, VkFormatFeatureFlags Features)
 	{
-		auto VertShaderCode = ReadFile("Shaders/vert.spv");
-		auto FragShaderCode = ReadFile("Shaders/frag.spv");
+		for (VkFormat Format : Candidates)
+		{
+			VkFormatProperties Props;
+			vkGetPhysicalDeviceFormatProperties(PhysicDevice, Format, &Props);
 
-		VkShaderModule VertShaderModule = CreateShaderModule(VertShaderCode);
-		VkShaderModule FragShaderModule = CreateShaderModule(FragShaderCode);
+			if (Tiling == VK_IMAGE_TILING_LINEAR && (Props.linearTilingFeatures & Features) == Features)
+				return Format;
+			if (Tiling == VK_IMAGE_TILING_OPTIMAL && (Props.optimalTilingFeatures & Features) == Features)
+				return Format;
+		}
 
-		VkPipelineShaderStageCreateInfo VertShaderStageInfo{};
-		VertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		VertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		VertShaderStageInfo.module = VertShaderModule;
-		VertShaderStageInfo.pName = "main";
-		VertShaderStageInfo.pSpecializationInfo = nullptr;
+		throw std::runtime_error("failed to find supported format!");
+	}
 
-		VkPipelineShaderStageCreateInfo FragShaderStageInfo{};
-		FragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		FragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		FragShaderStageInfo.module = FragShaderModule;
-		FragShaderStageInfo.pName = "main";
-		FragShaderStageInfo.pSpecializationInfo = nullptr;
+	VkFormat FindDepthFormat()
+	{
+		// 32 bit float first, reverse-Z only pays off with a floating point depth buffer
+		return FindSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	}
 
-		auto BindingDescription = Vertex::GetBindingDescription();
-		auto AttributeDescriptions = Vertex::GetAttributeDescriptions();
+	// shader.frag compiled with -DVIRTUAL_TEXTURE samples the page atlas instead of texSampler
+	const char* GetSceneFragmentShader() const
+	{
+		return bVirtualTexture ? "Shaders/frag_vt.spv" : "Shaders/frag.spv";
+	}
 
-		VkPipelineVertexInputStateCreateInfo VertexInputInfo{};
-		VertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		VertexInputInfo.vertexBindingDescriptionCount = 0;
-		VertexInputInfo.pVertexBindingDescriptions = nullptr;
-		VertexInputInfo.vertexAttributeDescriptionCount = 0;
-		VertexInputInfo.pVertexAttributeDescriptions = 0;
-		VertexInputInfo.vertexBindingDescriptionCount = 1;
-		VertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(AttributeDescriptions.size());
-		VertexInputInfo.pVertexBindingDescriptions = &BindingDescription;
-		VertexInputInfo.pVertexAttributeDescriptions = AttributeDescriptions.data();
-
-		VkPipelineInputAssemblyStateCreateInfo InputAssembly{};
-		InputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		InputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		InputAssembly.primitiveRestartEnable = VK_FALSE;
+	// Set and pipeline layouts come from the shaders' declarations. Independent of the swap chain, survives resizes
+	void CreatePipelineLayout()
+	{
+		SceneLayout = Layouts.GetLayout({ "Shaders/vert.spv", GetSceneFragmentShader() }, { { "texSampler", TextureSampler }, { "ShadowMap", Shadows.GetSampler() } });
+		PipelineLayout = SceneLayout.Layout;
+		DescriptorSetLayout = SceneLayout.SetLayouts.at(0);
 
-		VkViewport ViewPort{};
-		ViewPort.x = 0.0f;
-		ViewPort.y = 0.0f;
-		ViewPort.width = (float)SwapChainExtent.width;
-		ViewPort.height = (float)SwapChainExtent.height;
-		ViewPort.minDepth = 0.f;
-		ViewPort.maxDepth = 1.f;
+		auto ObjectRange = std::find_if(SceneLayout.Reflection.PushConstants.begin(), SceneLayout.Reflection.PushConstants.end(), [](const VkPushConstantRange& Iter)
+			{
+				return (Iter.stageFlags & VK_SHADER_STAGE_VERTEX_BIT) != 0;
+			});
+		if (ObjectRange == SceneLayout.Reflection.PushConstants.end() || ObjectRange->offset != 0 || ObjectRange->size != sizeof(ObjectPushConstants))
+		{
+			throw std::runtime_error("vert.spv does not declare ObjectPushConstants, recompile the shaders");
+		}
+		ObjectPushStages = ObjectRange->stageFlags;
 
-		VkRect2D Scissor{};
-		Scissor.offset = { 0, 0 };
-		Scissor.extent = SwapChainExtent;
+		// Bindings are looked up by the names the shaders give them
+		const ReflectedBinding* UBOBinding = SceneLayout.Reflection.FindBinding("UBO");
+		const ReflectedBinding* SamplerBinding = SceneLayout.Reflection.FindBinding("texSampler");
+		if (UBOBinding == nullptr || SamplerBinding == nullptr)
+		{
+			throw std::runtime_error("scene shaders do not declare UBO and texSampler");
+		}
+		SceneUBOBinding = *UBOBinding;
+		SceneTextureBinding = *SamplerBinding;
 
-		VkPipelineViewportStateCreateInfo ViewportState{};
-		ViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		ViewportState.viewportCount = 1;
-		ViewportState.pViewports = &ViewPort;
-		ViewportState.scissorCount = 1;
-		ViewportState.pScissors = &Scissor;
-
-		VkPipelineRasterizationStateCreateInfo Rasterizer{};
-		Rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		Rasterizer.depthClampEnable = VK_FALSE;
-		Rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		Rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		Rasterizer.lineWidth = 1.0f;
-		Rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		Rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		Rasterizer.depthBiasEnable = VK_FALSE;
-		Rasterizer.depthBiasConstantFactor = 0.0f;
-		Rasterizer.depthBiasClamp = 0.0f;
-		Rasterizer.depthBiasSlopeFactor = 0.0f;
-
-		VkPipelineMultisampleStateCreateInfo Multisampling{};
-		Multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		Multisampling.sampleShadingEnable = VK_FALSE;
-		Multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		Multisampling.minSampleShading = 1.f;
-		Multisampling.pSampleMask = nullptr;
-		Multisampling.alphaToCoverageEnable = VK_FALSE;
-		Multisampling.alphaToOneEnable = VK_FALSE;
-
-		//VkPipelineDepthStencilStateCreateInfo
-		VkPipelineColorBlendAttachmentState ColorBlendAttachment{};
-		ColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | 
-											  VK_COLOR_COMPONENT_G_BIT |
-											  VK_COLOR_COMPONENT_B_BIT |
-											  VK_COLOR_COMPONENT_A_BIT;
-		ColorBlendAttachment.blendEnable = VK_FALSE;
-		ColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-		ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		ColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-		ColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-		// Enable blend
-		/*ColorBlendAttachment.blendEnable = VK_TRUE;
-		ColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-		ColorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-		ColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-		ColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;*/
-
-		VkPipelineColorBlendStateCreateInfo ColorBlending{};
-		ColorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		ColorBlending.logicOpEnable = VK_FALSE;
-		ColorBlending.logicOp = VK_LOGIC_OP_COPY;
-		ColorBlending.attachmentCount = 1;
-		ColorBlending.pAttachments = &ColorBlendAttachment;
-		ColorBlending.blendConstants[0] = 0.f;
-		ColorBlending.blendConstants[1] = 0.f;
-		ColorBlending.blendConstants[2] = 0.f;
-		ColorBlending.blendConstants[3] = 0.f;
-
-		/*VkDynamicState DynamicStates[] = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_LINE_WIDTH
-		};
-
-		VkPipelineDynamicStateCreateInfo DynamicState{};
-		DynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		DynamicState.dynamicStateCount = 2;
-		DynamicState.pDynamicStates = DynamicStates;*/
-
-		VkPipelineLayoutCreateInfo PipelineLayoutInfo{};
-		PipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		PipelineLayoutInfo.setLayoutCount = 1;
-		PipelineLayoutInfo.pSetLayouts = &DescriptorSetLayout;
-		PipelineLayoutInfo.pushConstantRangeCount = 0;
-		PipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-		if (vkCreatePipelineLayout(Device, &PipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create pipeline layout!");
+		// Shaders compiled before clustered lighting have no light bindings, the scene is then unlit
+		const char* const LightingNames[4] = { "ClusterParams", "ClusterLights", "ClusterList", "ClusterLightIndices" };
+		bSceneLighting = true;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			const ReflectedBinding* Binding = SceneLayout.Reflection.FindBinding(LightingNames[i]);
+			bSceneLighting = bSceneLighting && Binding != nullptr;
+			if (Binding)
+				SceneLightingBindings[i] = *Binding;
 		}
-		
-		VkPipelineShaderStageCreateInfo ShaderStages[2] = { VertShaderStageInfo, FragShaderStageInfo };
 
-		VkGraphicsPipelineCreateInfo PipelineInfo{};
-		PipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		PipelineInfo.stageCount = 2;
-		PipelineInfo.pStages = ShaderStages;
+		// Same for shadows, everything is lit by the sun without them
+		const ReflectedBinding* ShadowMapBinding = SceneLayout.Reflection.FindBinding("ShadowMap");
+		const ReflectedBinding* ShadowParamsBinding = SceneLayout.Reflection.FindBinding("ShadowParams");
+		bSceneShadows = ShadowMapBinding != nullptr && ShadowParamsBinding != nullptr;
+		if (bSceneShadows)
+		{
+			SceneShadowMapBinding = *ShadowMapBinding;
+			SceneShadowParamsBinding = *ShadowParamsBinding;
+		}
 
-		PipelineInfo.pVertexInputState = &VertexInputInfo;
-		PipelineInfo.pInputAssemblyState = &InputAssembly;
-		PipelineInfo.pViewportState = &ViewportState;
-		PipelineInfo.pRasterizationState = &Rasterizer;
-		PipelineInfo.pMultisampleState = &Multisampling;
-		PipelineInfo.pDepthStencilState = nullptr;
-		PipelineInfo.pColorBlendState = &ColorBlending;
-		PipelineInfo.pDynamicState = nullptr;
-		PipelineInfo.layout = PipelineLayout;
-		PipelineInfo.renderPass = RenderPass;
-		PipelineInfo.subpass = 0;
-		PipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-		//PipelineInfo.basePipelineIndex = -1;
+		// frag_vt.spv samples the virtual texture instead of texSampler, it has to declare all of it
+		const char* const VirtualTextureNames[4] = { "VirtualPageTable", "VirtualAtlas", "VirtualFeedbackBuffer", "VirtualParams" };
+		bSceneVirtualTexture = bVirtualTexture;
+		for (uint32_t i = 0; i < 4 && bVirtualTexture; ++i)
+		{
+			const ReflectedBinding* Binding = SceneLayout.Reflection.FindBinding(VirtualTextureNames[i]);
+			if (Binding == nullptr)
+			{
+				throw std::runtime_error(std::string(GetSceneFragmentShader()) + " does not declare " + VirtualTextureNames[i] + ", recompile the shaders");
+			}
+			SceneVirtualTextureBindings[i] = *Binding;
+		}
 
-		if (vkCreateGraphicsPipelines(Device, VK_NULL_HANDLE, 1, &PipelineInfo, nullptr, &GraphicsPipeline) != VK_SUCCESS)
+		// The vertex layout is still defined on the C++ side, make sure it feeds every input the shader reads
+		// (an attribute may have more components than the input, Vulkan drops the extra ones)
+		const auto AttributeDescriptions = Vertex::GetAttributeDescriptions();
+		for (const ReflectedVertexInput& Input : SceneLayout.Reflection.VertexInputs)
 		{
-			throw std::runtime_error("failed to create graphics pipeline");
+			auto Attribute = std::find_if(AttributeDescriptions.begin(), AttributeDescriptions.end(), [&Input](const VkVertexInputAttributeDescription& Iter)
+				{
+					return Iter.location == Input.Location;
+				});
+			if (Attribute == AttributeDescriptions.end())
+			{
+				throw std::runtime_error("vertex shader input " + std::to_string(Input.Location) + " has no vertex attribute");
+			}
 		}
+	}
 
-		vkDestroyShaderModule(Device, FragShaderModule, nullptr);
-		vkDestroyShaderModule(Device, VertShaderModule, nullptr);
+	void SetupShaderHotReload()
+	{
+		if (!EnableShaderHotReload)
+			return;
+
+		ShaderReloader.Init(&Pipelines);
+		ShaderReloader.AddShader("Shaders/shader.vert", "Shaders/vert.spv");
+		ShaderReloader.AddShader("Shaders/shader.frag", "Shaders/frag.spv");
+		ShaderReloader.AddShader("Shaders/shader.frag", "Shaders/frag_vt.spv", { "VIRTUAL_TEXTURE" });
+		ShaderReloader.AddShader("Shaders/shadow.vert", "Shaders/shadowvert.spv");
+		ShaderReloader.CompileStale();
+	}
+
+	// Registers the scene pipelines. After a resize the descriptions hash the same (viewport is dynamic,
+	// render passes are compared by compatibility) and the cached pipelines are returned without compiling
+	void CreateGraphicsPipeline()
+	{
+		auto BindingDescription = Vertex::GetBindingDescription();
+		auto AttributeDescriptions = Vertex::GetAttributeDescriptions();
 
+		GraphicsPipelineDesc Desc;
+		Desc.VertexShader = "Shaders/vert.spv";
+		Desc.FragmentShader = GetSceneFragmentShader();
+		Desc.VertexBindings = { BindingDescription };
+		Desc.VertexAttributes.assign(AttributeDescriptions.begin(), AttributeDescriptions.end());
+		Desc.CullMode = VK_CULL_MODE_BACK_BIT;
+		Desc.FrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+		// Reverse-Z, nearer is greater. With a prepass the base pass only shades the surviving (equal) fragment
+		Desc.bDepthTest = true;
+		Desc.bDepthWrite = !EnableDepthPrepass;
+		Desc.DepthCompareOp = EnableDepthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_GREATER_OR_EQUAL;
+
+		Desc.Compatibility.ColorFormats = { SwapChainImageFormat };
+		Desc.Compatibility.DepthFormat = DepthFormat;
+		Desc.RenderPass = RenderPass;
+		Desc.Layout = PipelineLayout;
+
+		// Nothing to fall back to for the base material, it has to exist before the first frame
+		BasePipelineId = Pipelines.Register(Desc, PipelineCompileMode::Blocking);
+
+		if (EnableDepthPrepass)
+		{
+			// Vertex shader only, no color output, so the prepass runs at full depth-only rate
+			Desc.FragmentShader.clear();
+			Desc.bDepthWrite = true;
+			Desc.DepthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+			Desc.Compatibility.ColorFormats.clear();
+			Desc.RenderPass = DepthPrepassRenderPass;
+
+			DepthPrepassPipelineId = Pipelines.Register(Desc, PipelineCompileMode::Blocking);
+		}
+
+		if (Shadows.IsEnabled())
+		{
+			// Position only, both faces cast so open meshes like the quads still shadow. The bias is for the
+			// receivers' acne, it scales with the slope of the caster in the cascade
+			GraphicsPipelineDesc ShadowDesc;
+			ShadowDesc.VertexShader = "Shaders/shadowvert.spv";
+			ShadowDesc.VertexBindings = { BindingDescription };
+			ShadowDesc.VertexAttributes = { AttributeDescriptions[0] };
+			ShadowDesc.CullMode = VK_CULL_MODE_NONE;
+			ShadowDesc.FrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+			ShadowDesc.bDepthTest = true;
+			ShadowDesc.bDepthWrite = true;
+			ShadowDesc.DepthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+			ShadowDesc.DepthBiasConstant = ShadowsDesc.DepthBiasConstant;
+			ShadowDesc.DepthBiasSlope = ShadowsDesc.DepthBiasSlope;
+			ShadowDesc.Compatibility.DepthFormat = Shadows.GetDepthFormat();
+			ShadowDesc.RenderPass = Shadows.GetRenderPass();
+			ShadowDesc.Layout = Shadows.GetPipelineLayout();
+
+			ShadowPipelineId = Pipelines.Register(ShadowDesc, PipelineCompileMode::Blocking);
+		}
 	}
 
-	VkShaderModule CreateShaderModule(const std::vector<char>& Code)
+	void SetupRenderGraph()
 	{
-		VkShaderModuleCreateInfo CreateInfo{};
-		CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		CreateInfo.codeSize = Code.size();
-		CreateInfo.pCode = reinterpret_cast<const uint32_t*>(Code.data());
+		FrameGraph.Reset();
+
+		RenderGraphImageDesc BackBufferDesc;
+		BackBufferDesc.Format = SwapChainImageFormat;
+		BackBufferDesc.Extent = SwapChainExtent;
+
+		// Swap chain contents are discarded every frame, the first barrier waits on the stage the acquire semaphore signals
+		ResourceState AcquiredState{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+		BackBuffer = FrameGraph.ImportImage("BackBuffer", BackBufferDesc, AcquiredState, GetResourceState(ResourceUsage::Present));
 
-		VkShaderModule ShaderModule;
-		if (vkCreateShaderModule(Device, &CreateInfo, nullptr, &ShaderModule) != VK_SUCCESS)
+		RenderGraphImageDesc DepthDesc;
+		DepthDesc.Format = DepthFormat;
+		DepthDesc.Extent = SwapChainExtent;
+		SceneDepth = FrameGraph.CreateImage("SceneDepth", DepthDesc);
+
+		// Lives across frames, cached cascades keep their contents, so it starts and ends readable
+		ShadowMap = InvalidRenderGraphHandle;
+		if (Shadows.IsEnabled())
 		{
-			throw std::runtime_error("failed to create shader module");
+			RenderGraphImageDesc ShadowDesc;
+			ShadowDesc.Format = Shadows.GetDepthFormat();
+			ShadowDesc.Extent = Shadows.GetExtent();
+			ShadowMap = FrameGraph.ImportImage("ShadowMap", ShadowDesc, GetResourceState(ResourceUsage::ShaderRead), GetResourceState(ResourceUsage::ShaderRead));
+			FrameGraph.BindImportedImage(ShadowMap, Shadows.GetImage(), Shadows.GetArrayView());
+
+			FrameGraph.AddPass("ShadowPass",
+				[this](RenderGraphPassBuilder& Builder)
+				{
+					Builder.Write(ShadowMap, ResourceUsage::DepthStencilAttachment);
+				},
+				[this](VkCommandBuffer Cmd)
+				{
+					Shadows.Record(Cmd, [this](VkCommandBuffer CascadeCmd, uint32_t Cascade)
+						{
+							SceneDraws.Execute(CascadeCmd, DrawPassShadow + Cascade);
+						});
+				});
 		}
 
-		return ShaderModule;
+		if (EnableDepthPrepass)
+		{
+			FrameGraph.AddPass("DepthPrepass",
+				[this](RenderGraphPassBuilder& Builder)
+				{
+					Builder.Write(SceneDepth, ResourceUsage::DepthStencilAttachment);
+				},
+				[this](VkCommandBuffer Cmd)
+				{
+					RecordDepthPrepass(Cmd);
+				});
+		}
+
+		FrameGraph.AddPass("BasePass",
+			[this](RenderGraphPassBuilder& Builder)
+			{
+				Builder.Write(BackBuffer, ResourceUsage::ColorAttachment);
+				Builder.Write(SceneDepth, ResourceUsage::DepthStencilAttachment);
+				if (ShadowMap != InvalidRenderGraphHandle)
+					Builder.Read(ShadowMap, ResourceUsage::ShaderRead);
+			},
+			[this](VkCommandBuffer Cmd)
+			{
+				RecordBasePass(Cmd);
+			});
+
+		FrameGraph.Compile();
 	}
 
 	void CreateFramebuffers()
@@ -884,12 +1108,12 @@ private:
 
 		for (size_t i = 0; i < SwapChainImageViews.size(); ++i)
 		{
-			VkImageView Attachments[] = { SwapChainImageViews[i] };
+			VkImageView Attachments[] = { SwapChainImageViews[i], FrameGraph.GetImageView(SceneDepth) };
 
 			VkFramebufferCreateInfo FramebufferInfo{};
 			FramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 			FramebufferInfo.renderPass = RenderPass;
-			FramebufferInfo.attachmentCount = 1;
+			FramebufferInfo.attachmentCount = 2;
 			FramebufferInfo.pAttachments = Attachments;
 			FramebufferInfo.width = SwapChainExtent.width;
 			FramebufferInfo.height = SwapChainExtent.height;
@@ -900,6 +1124,25 @@ private:
 				throw std::runtime_error("failed to create frambuffer");
 			}
 		}
+
+		if (EnableDepthPrepass)
+		{
+			VkImageView DepthView = FrameGraph.GetImageView(SceneDepth);
+
+			VkFramebufferCreateInfo FramebufferInfo{};
+			FramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			FramebufferInfo.renderPass = DepthPrepassRenderPass;
+			FramebufferInfo.attachmentCount = 1;
+			FramebufferInfo.pAttachments = &DepthView;
+			FramebufferInfo.width = SwapChainExtent.width;
+			FramebufferInfo.height = SwapChainExtent.height;
+			FramebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(Device, &FramebufferInfo, nullptr, &DepthPrepassFramebuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create depth prepass frambuffer");
+			}
+		}
 	}
 	/// For pipeline
 
@@ -912,7 +1155,7 @@ private:
 		VkCommandPoolCreateInfo PoolInfo;
 		PoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		PoolInfo.queueFamilyIndex = QueueFamilyIndices.GraphicsFamily.value();
-		PoolInfo.flags = 0;
+		PoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;   // frame command buffers are re-recorded every frame
 
 		PoolInfo.pNext = nullptr;
 
@@ -922,99 +1165,223 @@ private:
 		}
 	}
 	
-	VkCommandBuffer BeginSingleTimeCommands()
+	void CreateCommandBuffers()
 	{
+		// One per frame in flight, recorded every frame so the draw list can change
+		CommandBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+
 		VkCommandBufferAllocateInfo AllocInfo{};
 		AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 		AllocInfo.commandPool = CommandPool;
-		AllocInfo.commandBufferCount = 1;
+		AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;  //this buffer can not be called from other command buffers
+		AllocInfo.commandBufferCount = (uint32_t)CommandBuffer.size();
+		
+		if (vkAllocateCommandBuffers(Device, &AllocInfo, CommandBuffer.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate command buffer");
+		}
+	}
+
+	void BuildDrawQueue()
+	{
+		SceneDraws.Reset();
 
-		VkCommandBuffer CommandBuffer;
-		vkAllocateCommandBuffers(Device, &AllocInfo, &CommandBuffer);
+		// Misses are skipped (VK_NULL_HANDLE) until the background compile is done
+		VkPipeline BasePipeline = Pipelines.Get(BasePipelineId);
+		VkPipeline DepthOnlyPipeline = EnableDepthPrepass ? Pipelines.Get(DepthPrepassPipelineId) : VK_NULL_HANDLE;
+		VkDescriptorSet SceneSet = GetSceneDescriptorSet(RecordingImageIndex);
 
-		VkCommandBufferBeginInfo BeginInfo{};
-		BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		Scene.Update();
+
+		// World space bounding spheres, culled against the view in one batch
+		SectionSpheres.resize(MeshSections.size());
+		SectionVisibility.resize(MeshSections.size());
+		Jobs.ParallelFor(static_cast<uint32_t>(MeshSections.size()), CullBatchSize, [this](uint32_t Begin, uint32_t End)
+			{
+				for (uint32_t i = Begin; i < End; ++i)
+				{
+					const glm::mat4& World = Scene.GetWorld(SectionNodes[i]);
+					const float Scale = std::max(std::max(glm::length(glm::vec3(World[0])), glm::length(glm::vec3(World[1]))), glm::length(glm::vec3(World[2])));
+					SectionSpheres[i] = glm::vec4(glm::vec3(World * glm::vec4(MeshSections[i].Center, 1.f)), MeshSections[i].Radius * Scale);
+				}
+				BatchMath::CullSpheres(ViewFrustum, SectionSpheres.data() + Begin, SectionVisibility.data() + Begin, End - Begin);
+			});
+
+		// Casters are culled per cascade, a section off screen can still shadow what is on screen
+		Shadows.Update(static_cast<uint32_t>(CurrentFrame), CameraView, glm::radians(45.f), SwapChainExtent.width / (float)SwapChainExtent.height, 0.1f,
+			SunDirection, SunColor, SectionSpheres.data(), SectionStatic.data(), SectionSpheres.size());
+		AddShadowDraws();
+
+		for (size_t i = 0; i < MeshSections.size(); ++i)
+		{
+			if (!SectionVisibility[i])
+				continue;
+
+			const MeshSection& Section = MeshSections[i];
+			const glm::mat4& World = Scene.GetWorld(SectionNodes[i]);
 
-		vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+			DrawCommand Draw;
+			Draw.PipelineLayout = PipelineLayout;
+			Draw.DescriptorSet = SceneSet;
+			Draw.VertexBuffer = VertexBuffer;
+			Draw.IndexBuffer = IndexBuffer;
+			Draw.IndexType = VK_INDEX_TYPE_UINT16;
+			Draw.IndexCount = Section.IndexCount;
+			Draw.FirstIndex = Section.FirstIndex;
+			Draw.PushConstantStages = ObjectPushStages;
 
-		return CommandBuffer;
+			ObjectPushConstants Object;
+			Object.Model = World;
+			Object.MaterialIndex = 0;
+
+			// Opaque, front to back
+			const uint32_t DepthBucket = DrawSortKey::MakeDepthBucket(glm::length(glm::vec3(SectionSpheres[i]) - CameraPosition), MaxDrawDistance, false);
+
+			if (DepthOnlyPipeline != VK_NULL_HANDLE)
+			{
+				Draw.Pipeline = DepthOnlyPipeline;
+				SceneDraws.Add(DrawSortKey::Make(DrawPassDepthPrepass, DepthPrepassPipelineId, 0, DepthBucket), Draw, &Object, sizeof(Object));
+			}
+
+			if (BasePipeline != VK_NULL_HANDLE)
+			{
+				Draw.Pipeline = BasePipeline;
+				SceneDraws.Add(DrawSortKey::Make(DrawPassBase, BasePipelineId, Object.MaterialIndex, DepthBucket), Draw, &Object, sizeof(Object));
+			}
+		}
+
+		SceneDraws.Sort();
 	}
 
-	void EndSingleTimeCommands(VkCommandBuffer CommandBuffer)
+	// Only for the cascades that are drawn this frame, cached ones keep last frame's depth
+	void AddShadowDraws()
 	{
-		vkEndCommandBuffer(CommandBuffer);
+		VkPipeline ShadowPipeline = Shadows.IsEnabled() ? Pipelines.Get(ShadowPipelineId) : VK_NULL_HANDLE;
+		if (ShadowPipeline == VK_NULL_HANDLE)
+			return;
+
+		for (uint32_t c = 0; c < Shadows.GetCascadeCount(); ++c)
+		{
+			if (!Shadows.IsCascadeDrawn(c))
+				continue;
 
-		VkSubmitInfo SubmitInfo{};
-		SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		SubmitInfo.commandBufferCount = 1;
-		SubmitInfo.pCommandBuffers = &CommandBuffer;
+			DrawCommand Draw;
+			Draw.Pipeline = ShadowPipeline;
+			Draw.PipelineLayout = Shadows.GetPipelineLayout();
+			Draw.DescriptorSet = Shadows.GetCascadeDescriptorSet(c);
+			Draw.VertexBuffer = VertexBuffer;
+			Draw.IndexBuffer = IndexBuffer;
+			Draw.IndexType = VK_INDEX_TYPE_UINT16;
+			Draw.PushConstantStages = Shadows.GetPushConstantStages();
 
-		vkQueueSubmit(GraphicsQueue, 1, &SubmitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(GraphicsQueue);
+			for (size_t i = 0; i < MeshSections.size(); ++i)
+			{
+				if (!Shadows.IsCasterVisible(c, i))
+					continue;
+
+				Draw.IndexCount = MeshSections[i].IndexCount;
+				Draw.FirstIndex = MeshSections[i].FirstIndex;
+
+				ObjectPushConstants Object;
+				Object.Model = Scene.GetWorld(SectionNodes[i]);
+				Object.MaterialIndex = 0;
 
-		vkFreeCommandBuffers(Device, CommandPool, 1, &CommandBuffer);
+				SceneDraws.Add(DrawSortKey::Make(DrawPassShadow + c, ShadowPipelineId, 0, 0), Draw, &Object, sizeof(Object));
+			}
+		}
 	}
 
-	void CreateCommandBuffers()
+	void RecordFrame(VkCommandBuffer Cmd, uint32_t ImageIndex)
 	{
-		//each swapchainframebuffer need a command buffer
-		CommandBuffer.resize(SwapChainFrambuffers.size());
+		vkResetCommandBuffer(Cmd, 0);
 
-		VkCommandBufferAllocateInfo AllocInfo{};
-		AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		AllocInfo.commandPool = CommandPool;
-		AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;  //this buffer can not be called from other command buffers
-		AllocInfo.commandBufferCount = (uint32_t)CommandBuffer.size();
-		
-		if (vkAllocateCommandBuffers(Device, &AllocInfo, CommandBuffer.data()) != VK_SUCCESS)
+		VkCommandBufferBeginInfo BeginInfo{};
+		BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		BeginInfo.pInheritanceInfo = nullptr;
+
+		if (vkBeginCommandBuffer(Cmd, &BeginInfo) != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to allocate command buffer");
+			throw std::runtime_error("failed to begin recording command buffer!");
 		}
 
-		for (size_t i = 0; i < CommandBuffer.size(); ++i)
-		{
-			VkCommandBufferBeginInfo BeginInfo{};
-			BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			BeginInfo.flags = 0;
-			BeginInfo.pInheritanceInfo = nullptr;
+		RecordingImageIndex = ImageIndex;
+		BuildDrawQueue();
 
-			if (vkBeginCommandBuffer(CommandBuffer[i], &BeginInfo) != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to begin recording command buffer!");
-			}
+		FrameGraph.BindImportedImage(BackBuffer, SwapChainImages[ImageIndex], SwapChainImageViews[ImageIndex]);
+		FrameGraph.Execute(Cmd);
 
-			VkRenderPassBeginInfo RenderPassInfo{};
-			RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			RenderPassInfo.renderPass = RenderPass;
-			RenderPassInfo.framebuffer = SwapChainFrambuffers[i];
-			RenderPassInfo.renderArea.offset = { 0,0 };
-			RenderPassInfo.renderArea.extent = SwapChainExtent;
-
-			VkClearValue ClearColor = { 0.f, 0.f, 0.f, 1.f };
-			RenderPassInfo.clearValueCount = 1;
-			RenderPassInfo.pClearValues = &ClearColor;
-
-			vkCmdBeginRenderPass(CommandBuffer[i], &RenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-			vkCmdBindPipeline(CommandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline); //VK_PIPELINE_BIND_POINT_GRAPHICS means that pipeline is graphics pipeline
-
-			VkDeviceSize Offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(CommandBuffer[i], 0, 1, &VertexBuffer, Offsets);
-			
-			vkCmdBindIndexBuffer(CommandBuffer[i], IndexBuffer, 0, VK_INDEX_TYPE_UINT16);
-			
-			vkCmdBindDescriptorSets(CommandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, PipelineLayout, 0, 1, &DescriptorSets[i], 0, nullptr);
-			vkCmdDrawIndexed(CommandBuffer[i], static_cast<uint32_t>(Indices.size()), 1, 0, 0, 0);
-			//vkCmdDraw(CommandBuffer[i], 3, 1, 0, 0);
-			vkCmdEndRenderPass(CommandBuffer[i]);
-			if (vkEndCommandBuffer(CommandBuffer[i]) != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to record command buffer");
-			}
+		// The feedback of this frame slot is read back by Update() once the frame is done
+		if (bSceneVirtualTexture)
+			SceneVirtualTexture.RecordFeedbackBarrier(Cmd);
+
+		if (vkEndCommandBuffer(Cmd) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record command buffer");
 		}
 	}
 
+	// Pipelines keep viewport and scissor dynamic so they do not depend on the swap chain extent
+	void SetViewportAndScissor(VkCommandBuffer Cmd)
+	{
+		VkViewport ViewPort{};
+		ViewPort.x = 0.0f;
+		ViewPort.y = 0.0f;
+		ViewPort.width = (float)SwapChainExtent.width;
+		ViewPort.height = (float)SwapChainExtent.height;
+		ViewPort.minDepth = 0.f;
+		ViewPort.maxDepth = 1.f;
+		vkCmdSetViewport(Cmd, 0, 1, &ViewPort);
+
+		VkRect2D Scissor{};
+		Scissor.offset = { 0, 0 };
+		Scissor.extent = SwapChainExtent;
+		vkCmdSetScissor(Cmd, 0, 1, &Scissor);
+	}
+
+	void RecordDepthPrepass(VkCommandBuffer Cmd)
+	{
+		VkRenderPassBeginInfo RenderPassInfo{};
+		RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		RenderPassInfo.renderPass = DepthPrepassRenderPass;
+		RenderPassInfo.framebuffer = DepthPrepassFramebuffer;
+		RenderPassInfo.renderArea.offset = { 0,0 };
+		RenderPassInfo.renderArea.extent = SwapChainExtent;
+
+		VkClearValue ClearDepth{};
+		ClearDepth.depthStencil = { 0.f, 0 };
+		RenderPassInfo.clearValueCount = 1;
+		RenderPassInfo.pClearValues = &ClearDepth;
+
+		vkCmdBeginRenderPass(Cmd, &RenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		SetViewportAndScissor(Cmd);
+		SceneDraws.Execute(Cmd, DrawPassDepthPrepass);
+		vkCmdEndRenderPass(Cmd);
+	}
+
+	void RecordBasePass(VkCommandBuffer Cmd)
+	{
+		VkRenderPassBeginInfo RenderPassInfo{};
+		RenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		RenderPassInfo.renderPass = RenderPass;
+		RenderPassInfo.framebuffer = SwapChainFrambuffers[RecordingImageIndex];
+		RenderPassInfo.renderArea.offset = { 0,0 };
+		RenderPassInfo.renderArea.extent = SwapChainExtent;
+
+		std::array<VkClearValue, 2> ClearValues{};
+		ClearValues[0].color = { 0.f, 0.f, 0.f, 1.f };
+		ClearValues[1].depthStencil = { 0.f, 0 };   // reverse-Z far plane
+		RenderPassInfo.clearValueCount = static_cast<uint32_t>(ClearValues.size());
+		RenderPassInfo.pClearValues = ClearValues.data();
+
+		vkCmdBeginRenderPass(Cmd, &RenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		SetViewportAndScissor(Cmd);
+		// Draws come sorted, redundant pipeline/descriptor/buffer binds are skipped
+		SceneDraws.Execute(Cmd, DrawPassBase);
+		//vkCmdDraw(CommandBuffer[i], 3, 1, 0, 0);
+		vkCmdEndRenderPass(Cmd);
+	}
+
 	void CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, VkMemoryPropertyFlags Properties, VkBuffer& Buffer, VkDeviceMemory& BufferMemory)
 	{
 		VkBufferCreateInfo BufferInfo{};
@@ -1043,64 +1410,55 @@ private:
 		vkBindBufferMemory(Device, Buffer, BufferMemory, 0);
 	}
 
-	void CopyBuffer(VkBuffer SrcBuffer, VkBuffer DstBuffer, VkDeviceSize Size)
+	// Memory type comes from the placement policy instead of fixed property flags
+	MemoryPlacement CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, MemoryUsage MemUsage, VkBuffer& Buffer, VkDeviceMemory& BufferMemory)
 	{
-		VkCommandBufferAllocateInfo AllocInfo{};
-		AllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		AllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		AllocInfo.commandPool = CommandPool;
-		AllocInfo.commandBufferCount = 1;
-		
-		VkCommandBuffer CommandBuffer;
-		vkAllocateCommandBuffers(Device, &AllocInfo, &CommandBuffer);
-
-		VkCommandBufferBeginInfo BeginInfo{};
-		BeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		BeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VkBufferCreateInfo BufferInfo{};
+		BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		BufferInfo.size = Size;
+		BufferInfo.usage = Usage;
+		BufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-		vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+		if (vkCreateBuffer(Device, &BufferInfo, nullptr, &Buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create buffer");
+		}
 
-		VkBufferCopy CopyRegion{};
-		CopyRegion.srcOffset = 0;
-		CopyRegion.dstOffset = 0;
-		CopyRegion.size = Size;
-		vkCmdCopyBuffer(CommandBuffer, SrcBuffer, DstBuffer, 1, &CopyRegion);
+		VkMemoryRequirements MemRequirements;
+		vkGetBufferMemoryRequirements(Device, Buffer, &MemRequirements);
 
-		vkEndCommandBuffer(CommandBuffer);
+		// Counted against the memory budget, throws rather than oversubscribing the heap
+		MemoryPlacement Placement;
+		BufferMemory = Residency.Allocate(MemRequirements, MemUsage, &Placement);
+		vkBindBufferMemory(Device, Buffer, BufferMemory, 0);
 
-		VkSubmitInfo SubmitInfo{};
-		SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		SubmitInfo.commandBufferCount = 1;
-		SubmitInfo.pCommandBuffers = &CommandBuffer;
+		return Placement;
+	}
 
-		vkQueueSubmit(GraphicsQueue, 1, &SubmitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(GraphicsQueue); // we can also use vkWaitForFences
+	// Static GPU data: written in place when the device local memory is host visible (ReBAR, UMA), otherwise staged through the uploader
+	void CreateStaticBuffer(const void* Data, VkDeviceSize Size, VkBufferUsageFlags Usage, VkBuffer& Buffer, VkDeviceMemory& BufferMemory)
+	{
+		MemoryPlacement Placement = CreateBuffer(Size, Usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, Buffer, BufferMemory);
 
-		vkFreeCommandBuffers(Device, CommandPool, 1, &CommandBuffer);
+		if (Placement.IsHostVisible())
+		{
+			void* Mapped;
+			vkMapMemory(Device, BufferMemory, 0, Size, 0, &Mapped);
+			memcpy(Mapped, Data, static_cast<size_t>(Size));
+			vkUnmapMemory(Device, BufferMemory);
+		}
+		else
+		{
+			Uploader.UploadBuffer(Buffer, 0, Data, Size);
+		}
 	}
 
 	void CreateVertexBuffers()
 	{
 		VkDeviceSize BufferSize = sizeof(Vertices[0]) * Vertices.size();
-		// The staging buffer was used to copy data to actual vertex buffer
-		VkBuffer StagingBuffer;
-		VkDeviceMemory StagingBufferMemory;
-		CreateBuffer(BufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, StagingBuffer, StagingBufferMemory);
-
-		void* Data;
-		vkMapMemory(Device, StagingBufferMemory, 0, BufferSize, 0, &Data);
-		memcpy(Data, Vertices.data(), (size_t)BufferSize);
-		vkUnmapMemory(Device, StagingBufferMemory);
-
-		CreateBuffer(BufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VertexBuffer, VertexBufferMemory);
-
-		CopyBuffer(StagingBuffer, VertexBuffer, BufferSize);
 
-		// Destroy staging buffer
-		vkDestroyBuffer(Device, StagingBuffer, nullptr);
-		vkFreeMemory(Device, StagingBufferMemory, nullptr);
+		// Device local, the GPU reads vertices from VRAM instead of over PCIe
+		CreateStaticBuffer(Vertices.data(), BufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VertexBuffer, VertexBufferMemory);
 
 		//VkBufferCreateInfo BufferInfo{};
 		//BufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1130,73 +1488,7 @@ private:
 		//vkBindBufferMemory(Device, VertexBuffer, VertexBufferMemory, 0);
 	}
 
-	void TransitionImageLayout(VkImage Image, VkFormat Format, VkImageLayout OldLayout, VkImageLayout NewLayout)
-	{
-		VkCommandBuffer CommandBuffer = BeginSingleTimeCommands();
-
-		VkImageMemoryBarrier Barrier{};
-		Barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		Barrier.oldLayout = OldLayout;
-		Barrier.newLayout = NewLayout;
-
-		Barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		Barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		Barrier.image = Image;
-		Barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		Barrier.subresourceRange.baseMipLevel = 0;
-		Barrier.subresourceRange.levelCount = 1;
-		Barrier.subresourceRange.baseArrayLayer = 0;
-		Barrier.subresourceRange.layerCount = 1;
-
-		VkPipelineStageFlags SourceStage;
-		VkPipelineStageFlags DestinationStage;
-		if (OldLayout == VK_IMAGE_LAYOUT_UNDEFINED && NewLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-		{
-			Barrier.srcAccessMask = 0;
-			Barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			SourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			DestinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		}
-		else if (OldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && NewLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-		{
-			Barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			Barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			
-			SourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			DestinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		}
-		else
-		{
-			throw std::invalid_argument("unsupported layout transition!");
-		}
-		vkCmdPipelineBarrier(CommandBuffer, SourceStage, DestinationStage, 0, 0, nullptr, 0, nullptr, 1, &Barrier);
-
-		EndSingleTimeCommands(CommandBuffer);
-	}
-
-	void CopyBufferToImage(VkBuffer Buffer, VkImage Image, uint32_t Width, uint32_t Height)
-	{
-		VkCommandBuffer CommandBuffer = BeginSingleTimeCommands();
-
-		VkBufferImageCopy Region{};
-		Region.bufferOffset = 0;
-		Region.bufferRowLength = 0;
-		Region.bufferImageHeight = 0;
-
-		Region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		Region.imageSubresource.mipLevel = 0;
-		Region.imageSubresource.baseArrayLayer = 0;
-		Region.imageSubresource.layerCount = 1;
-
-		Region.imageOffset = {0, 0, 0};
-		Region.imageExtent = {Width, Height, 1};
-
-		vkCmdCopyBufferToImage(CommandBuffer, Buffer, Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &Region);
-
-		EndSingleTimeCommands(CommandBuffer);
-	}
-
-	void CreateImage(uint32_t Width, uint32_t Height, VkFormat Format, VkImageTiling Tiling, VkImageUsageFlags Usage, VkMemoryPropertyFlags Properties, VkImage& Image, VkDeviceMemory& ImageMemory)
+	void CreateImage(uint32_t Width, uint32_t Height, VkFormat Format, VkImageTiling Tiling, VkImageUsageFlags Usage, MemoryUsage MemUsage, VkImage& Image, VkDeviceMemory& ImageMemory)
 	{
 		VkImageCreateInfo ImageInfo{};
 		ImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1221,48 +1513,24 @@ private:
 
 		VkMemoryRequirements MemRequirements;
 		vkGetImageMemoryRequirements(Device, Image, &MemRequirements);
-		VkMemoryAllocateInfo AllocInfo{};
-		AllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		AllocInfo.allocationSize = MemRequirements.size;
-		AllocInfo.memoryTypeIndex = FindMemoryType(MemRequirements.memoryTypeBits, Properties);
-
-		if (vkAllocateMemory(Device, &AllocInfo, nullptr, &ImageMemory) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate image memory!");
-		}
+		ImageMemory = Residency.Allocate(MemRequirements, MemUsage);
 		vkBindImageMemory(Device, Image, ImageMemory, 0);
 	}
 
+	// Decoded on the job system straight into staging memory, the copy goes out with the other startup uploads
 	void CreateTextureImage()
 	{
-		int TexWidth, TexHeight, TexChannels;
-		stbi_uc* Pixels = stbi_load("Textures/TestImage0.png", &TexWidth, &TexHeight, &TexChannels, STBI_rgb_alpha);
-		VkDeviceSize ImageSize = static_cast<VkDeviceSize>(TexWidth * TexHeight * 4);
+		DecodedTexture Texture;
+		JobCounter Done;
+		TextureLoader.Load("Textures/TestImage0.png", VK_FORMAT_R8G8B8A8_SRGB, Texture, Done);
+		Jobs.Wait(Done);
 
-		if (!Pixels)
+		if (!Texture.Error.empty())
 		{
-			throw std::runtime_error("failed to load texture image!");
+			throw std::runtime_error("failed to load texture image! " + Texture.Error);
 		}
-
-		VkBuffer StagingBuffer;
-		VkDeviceMemory StagingBufferMemory;
-
-		CreateBuffer(ImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, StagingBuffer, StagingBufferMemory);
-		void* Data;
-		vkMapMemory(Device, StagingBufferMemory, 0, ImageSize, 0, &Data);
-		memcpy(Data, Pixels, static_cast<size_t>(ImageSize));
-		vkUnmapMemory(Device, StagingBufferMemory);
-
-		stbi_image_free(Pixels);
-
-		CreateImage(TexWidth, TexHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, TextureImage, TextureImageMemory);
-		
-		TransitionImageLayout(TextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-		CopyBufferToImage(StagingBuffer, TextureImage, static_cast<uint32_t>(TexWidth), static_cast<uint32_t>(TexHeight));
-
-		vkDestroyBuffer(Device, StagingBuffer, nullptr);
-		vkFreeMemory(Device, StagingBufferMemory, nullptr);
+		TextureImage = Texture.Image;
+		TextureImageMemory = Texture.Memory;
 	}
 
 	void CreateTextureImageView()
@@ -1295,10 +1563,8 @@ private:
 		SamplerInfo.minLod = 0.f;
 		SamplerInfo.maxLod = 0.f;
 
-		if (vkCreateSampler(Device, &SamplerInfo, nullptr, &TextureSampler) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create texture sampler!");
-		}
+		// Shared with every texture using the same state, anisotropy is clamped to the device limit
+		TextureSampler = Samplers.Get(SamplerInfo);
 	}
 
 	VkImageView CreateImageView(VkImage Image, VkFormat Format)
@@ -1327,20 +1593,7 @@ private:
 	{
 		VkDeviceSize BufferSize = sizeof(Indices[0]) * Indices.size();
 
-		VkBuffer StagingBuffer;
-		VkDeviceMemory StagingBufferMemory;
-		CreateBuffer(BufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			StagingBuffer, StagingBufferMemory);
-
-		void* Data;
-		vkMapMemory(Device, StagingBufferMemory, 0, BufferSize, 0, &Data);
-		memcpy(Data, Indices.data(), (size_t)BufferSize);
-		vkUnmapMemory(Device, StagingBufferMemory);
-
-		CreateBuffer(BufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, IndexBuffer, IndexBufferMemory);
-
-		CopyBuffer(StagingBuffer, IndexBuffer, BufferSize);
-		vkFreeMemory(Device, StagingBufferMemory, nullptr);
+		CreateStaticBuffer(Indices.data(), BufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, IndexBuffer, IndexBufferMemory);
 	}
 
 	void CreateUniformBuffers()
@@ -1352,8 +1605,129 @@ private:
 
 		for (size_t i = 0; i < SwapChainImages.size(); ++i)
 		{
-			CreateBuffer(BufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-							UniformBuffers[i], UniformBuffersMemory[i]);
+			CreateBuffer(BufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::CpuToGpu, UniformBuffers[i], UniformBuffersMemory[i]);
+		}
+	}
+
+	// The mesh sections hang off one root that UpdateUniformBuffer() spins
+	void CreateScene()
+	{
+		Scene.SetJobSystem(&Jobs);
+		SceneDraws.SetJobSystem(&Jobs);
+
+		// Static sections stay out of the spinning root
+		SceneRootNode = Scene.AddNode();
+		for (size_t i = 0; i < MeshSections.size(); ++i)
+		{
+			SectionNodes.push_back(MeshSections[i].bStatic ? Scene.AddNode() : Scene.AddNode(SceneRootNode));
+			SectionStatic.push_back(MeshSections[i].bStatic ? 1 : 0);
+		}
+
+		// Small lights scattered over the quads that orbit at their own speed, every fourth one a spot
+		// pointing down. Intensity shrinks with the count so the overall brightness stays about the same
+		std::mt19937 Random(1);
+		std::uniform_real_distribution<float> Unit(0.f, 1.f);
+		const uint32_t Count = std::min(DemoLightCount, LightingDesc.MaxLights);
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			ClusterLight Light;
+			Light.Position = glm::vec3(Unit(Random) * 2.f - 1.f, Unit(Random) * 2.f - 1.f, Unit(Random) * 0.8f - 0.3f);
+			Light.Range = 0.2f + Unit(Random) * 0.4f;
+			Light.Color = glm::vec3(Unit(Random), Unit(Random), Unit(Random)) * 0.8f + 0.2f;
+			Light.Intensity = 8.f * Light.Range * Light.Range / Count;
+			if (i % 4 == 3)
+			{
+				Light.Type = ClusterLightType::Spot;
+				Light.Direction = glm::vec3(0.f, 0.f, -1.f);
+				Light.CosOuterAngle = std::cos(glm::radians(35.f));
+				Light.CosInnerAngle = std::cos(glm::radians(25.f));
+				Light.Range *= 2.f;
+			}
+			DemoLights.push_back(Light);
+			DemoLightSpeeds.push_back((Unit(Random) - 0.5f) * glm::radians(120.f));
+		}
+	}
+
+	// The scene is lit (unshadowed) by the sun when the caster shader is missing
+	void CreateShadows()
+	{
+		Shadows.Init(Device, PhysicDevice, &Residency, &DeletionQueue, &Uploader, &Samplers, &Layouts, &DescriptorCache, ShadowsDesc,
+			MAX_FRAMES_IN_FLIGHT, "Shaders/shadowvert.spv");
+		std::cout << "cascaded shadows: " << Shadows.GetCascadeCount() << " x " << ShadowsDesc.Resolution << "^2" << (Shadows.IsEnabled() ? "" : ", disabled") << '\n';
+	}
+
+	// Cut into pages on the fly from the decoded test image, which has to be a power of two multiple of the page size
+	void CreateVirtualTexture()
+	{
+		if (!bVirtualTexture)
+			return;
+
+		const std::vector<char> Data = ReadFile("Textures/TestImage0.png");
+		const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(Data.data());
+
+		uint32_t Width = 0, Height = 0;
+		const ImageDecoderBackend* Backend = TextureDecoder::FindBackend(Bytes, Data.size());
+		if (!Backend || !Backend->ReadInfo(Bytes, Data.size(), Width, Height) || Width != Height)
+		{
+			throw std::runtime_error("failed to read the virtual texture source image!");
+		}
+		std::vector<uint8_t> Pixels(static_cast<size_t>(Width) * Height * 4);
+		if (!Backend->Decode(Bytes, Data.size(), Pixels.data(), Pixels.size()))
+		{
+			throw std::runtime_error("failed to decode the virtual texture source image!");
+		}
+
+		VirtualTextureDesc Desc;
+		Desc.Size = Width;
+		Desc.AtlasPages = 8;
+		Desc.LoadPage = VirtualTexture::CreateImageSource(std::move(Pixels), Width);
+		SceneVirtualTexture.Init(Device, &MemoryPolicy, &Samplers, &Jobs, &Uploader, &DeletionQueue, Desc, MAX_FRAMES_IN_FLIGHT);
+		std::cout << "virtual texture: " << Desc.Size << "^2, " << SceneVirtualTexture.GetMipCount() << " mips, " << Desc.AtlasPages * Desc.AtlasPages << " atlas pages\n";
+	}
+
+	// Binning for the frame runs on the async compute queue, or on the CPU when the shader is missing
+	void CreateClusteredLighting()
+	{
+		LightingDesc.FarZ = MaxDrawDistance;
+		Lighting.Init(Device, &Residency, &DeletionQueue, &Layouts, &DescriptorCache, &AsyncCompute, LightingDesc, MAX_FRAMES_IN_FLIGHT,
+			"Shaders/clusterlights.spv");
+		std::cout << "clustered lighting: " << Lighting.GetClusterCount() << " clusters, binned on the " << (Lighting.IsGpuBinning() ? "GPU" : "CPU") << '\n';
+	}
+
+	void UpdateLights(const glm::mat4& View, float Time)
+	{
+		const ClusterShaderParams Params = AnimateLights(View, Time);
+		Lighting.Update(static_cast<uint32_t>(CurrentFrame), FrameLights, Params);
+	}
+
+	// Moves the demo lights into FrameLights and returns the binning parameters for the view
+	ClusterShaderParams AnimateLights(const glm::mat4& View, float Time)
+	{
+		FrameLights.resize(DemoLights.size());
+		for (size_t i = 0; i < DemoLights.size(); ++i)
+		{
+			const glm::mat4 Orbit = glm::rotate(glm::mat4(1.f), Time * DemoLightSpeeds[i], glm::vec3(0.f, 0.f, 1.f));
+			FrameLights[i] = DemoLights[i];
+			FrameLights[i].Position = glm::vec3(Orbit * glm::vec4(DemoLights[i].Position, 1.f));
+			FrameLights[i].Direction = glm::vec3(Orbit * glm::vec4(DemoLights[i].Direction, 0.f));
+		}
+
+		ClusterShaderParams Params = ClusteredLighting::MakeParams(LightingDesc, glm::radians(45.f), SwapChainExtent.width / (float)SwapChainExtent.height,
+			SwapChainExtent, static_cast<uint32_t>(FrameLights.size()));
+		Params.View = View;
+		Params.CameraPosition = glm::vec4(CameraPosition, 1.f);
+		Params.Ambient = glm::vec4(0.15f, 0.15f, 0.15f, 0.f);
+		return Params;
+	}
+
+	// Bins the lights of the first frame once on the GPU and checks the result against the CPU reference
+	void VerifyClusterBinning()
+	{
+		const glm::mat4 View = glm::lookAt(CameraPosition, glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+		const ClusterShaderParams Params = AnimateLights(View, 0.f);
+		if (!Lighting.VerifyGpuBinning(ComputeQueue, FrameLights, Params, std::cout))
+		{
+			throw std::runtime_error("GPU light binning does not match the CPU reference!");
 		}
 	}
 
@@ -1363,85 +1737,66 @@ private:
 		auto CurrentTime = std::chrono::high_resolution_clock::now();
 		float Time = std::chrono::duration<float, std::chrono::seconds::period>(CurrentTime - StartTime).count();
 
+		Scene.SetLocal(SceneRootNode, glm::rotate(glm::mat4(1.f), Time * glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f)));
+
 		UniformBufferObject Ubo{};
-		Ubo.Model = glm::rotate(glm::mat4(1.f), Time * glm::radians(90.f), glm::vec3(0.f, 0.f, 1.f));
-		Ubo.View = glm::lookAt(glm::vec3(2.f, 2.f, 2.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
-		Ubo.Proj = glm::perspective(glm::radians(45.f), SwapChainExtent.width / (float)SwapChainExtent.height, 0.1f, 10.f);
-		Ubo.Proj[1][1] *= -1;
-		
+		Ubo.View = glm::lookAt(CameraPosition, glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 0.f, 1.f));
+		Ubo.Proj = MakeReversedZInfinitePerspective(glm::radians(45.f), SwapChainExtent.width / (float)SwapChainExtent.height, 0.1f);
+		ViewFrustum = BatchMath::Frustum::FromViewProjection(Ubo.Proj * Ubo.View);
+		CameraView = Ubo.View;
+
 		void* Data;
 		vkMapMemory(Device, UniformBuffersMemory[CurrentImage], 0, sizeof(Ubo), 0, &Data);
 		memcpy(Data, &Ubo, sizeof(Ubo));
 		vkUnmapMemory(Device, UniformBuffersMemory[CurrentImage]);
-	}
-
-	void CreateDescriptorPool()
-	{
-		std::array<VkDescriptorPoolSize, 2> PoolSizes{};
-		PoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		PoolSizes[0].descriptorCount = static_cast<uint32_t>(SwapChainImages.size());
-
-		PoolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		PoolSizes[1].descriptorCount = static_cast<uint32_t>(SwapChainImages.size());
-
-		VkDescriptorPoolCreateInfo PoolInfo{};
-		PoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		PoolInfo.poolSizeCount = static_cast<uint32_t>(PoolSizes.size());
-		PoolInfo.pPoolSizes = PoolSizes.data();
-		PoolInfo.maxSets = static_cast<uint32_t>(SwapChainImages.size());
 
-		if (vkCreateDescriptorPool(Device, &PoolInfo, nullptr, &DescriptorPool) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create descriptor pool!");
-		}
+		UpdateLights(Ubo.View, Time);
 	}
 
-	void CreateDescriptorSets()
+	// Without per-frame buffers the set only depends on the image, the cache writes it once and hands out the same set
+	// afterwards. With them it is allocated from the frame slot's pool and written while recording, the pool is reset
+	// once the slot's previous frame is done (DrawFrame)
+	VkDescriptorSet GetSceneDescriptorSet(uint32_t ImageIndex)
 	{
-		std::vector<VkDescriptorSetLayout> Layouts(SwapChainImages.size(), DescriptorSetLayout);
-		VkDescriptorSetAllocateInfo AllocInfo{};
-		AllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		AllocInfo.descriptorPool = DescriptorPool;
-		AllocInfo.descriptorSetCount = static_cast<uint32_t>(SwapChainImages.size());
-		AllocInfo.pSetLayouts = Layouts.data();
+		DescriptorWrites Writes;
+		Writes.AddBuffer(SceneUBOBinding.Binding, SceneUBOBinding.DescriptorType, UniformBuffers[ImageIndex], 0, sizeof(UniformBufferObject));
+		// The sampler is immutable in the set layout, the write only carries the view
+		Writes.AddImage(SceneTextureBinding.Binding, SceneTextureBinding.DescriptorType, TextureImageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		// The light lists are per frame slot
+		if (bSceneLighting)
+		{
+			const uint32_t Frame = static_cast<uint32_t>(CurrentFrame);
+			const VkBuffer LightingBuffers[4] = { Lighting.GetParamsBuffer(Frame), Lighting.GetLightBuffer(Frame), Lighting.GetClusterBuffer(Frame), Lighting.GetLightIndexBuffer(Frame) };
+			const VkDeviceSize LightingSizes[4] = { Lighting.GetParamsSize(), Lighting.GetLightBufferSize(), Lighting.GetClusterBufferSize(), Lighting.GetLightIndexBufferSize() };
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				Writes.AddBuffer(SceneLightingBindings[i].Binding, SceneLightingBindings[i].DescriptorType, LightingBuffers[i], 0, LightingSizes[i]);
+			}
+		}
 
-		DescriptorSets.resize(SwapChainImages.size());
-		if (vkAllocateDescriptorSets(Device, &AllocInfo, DescriptorSets.data()) != VK_SUCCESS)
+		if (bSceneShadows)
 		{
-			throw std::runtime_error("failed to allocate descriptor sets!");
+			Writes.AddImage(SceneShadowMapBinding.Binding, SceneShadowMapBinding.DescriptorType, Shadows.GetArrayView(), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			Writes.AddBuffer(SceneShadowParamsBinding.Binding, SceneShadowParamsBinding.DescriptorType, Shadows.GetParamsBuffer(static_cast<uint32_t>(CurrentFrame)), 0, Shadows.GetParamsSize());
 		}
 
-		std::array<VkWriteDescriptorSet, 2> DescriptorWrites{};
-		for (size_t i = 0; i < SwapChainImages.size(); ++i)
+		// The feedback buffer is per frame slot, its samplers are not baked into the layout
+		if (bSceneVirtualTexture)
 		{
-			VkDescriptorBufferInfo BufferInfo{};
-			BufferInfo.buffer = UniformBuffers[i];
-			BufferInfo.offset = 0;
-			BufferInfo.range = sizeof(UniformBufferObject);
-
-			VkDescriptorImageInfo ImageInfo{};
-			ImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			ImageInfo.imageView = TextureImageView;
-			ImageInfo.sampler = TextureSampler;
+			const ReflectedBinding* Bindings = SceneVirtualTextureBindings;
+			Writes.AddImage(Bindings[0].Binding, Bindings[0].DescriptorType, SceneVirtualTexture.GetPageTableView(), SceneVirtualTexture.GetPageTableSampler(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			Writes.AddImage(Bindings[1].Binding, Bindings[1].DescriptorType, SceneVirtualTexture.GetAtlasView(), SceneVirtualTexture.GetAtlasSampler(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			Writes.AddBuffer(Bindings[2].Binding, Bindings[2].DescriptorType, SceneVirtualTexture.GetFeedbackBuffer(static_cast<uint32_t>(CurrentFrame)), 0, SceneVirtualTexture.GetFeedbackSize());
+			Writes.AddBuffer(Bindings[3].Binding, Bindings[3].DescriptorType, SceneVirtualTexture.GetParamsBuffer(), 0, sizeof(VirtualTextureShaderParams));
+		}
 
-			
-			DescriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			DescriptorWrites[0].dstSet = DescriptorSets[i];
-			DescriptorWrites[0].dstBinding = 0;
-			DescriptorWrites[0].dstArrayElement = 0;
-			DescriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			DescriptorWrites[0].descriptorCount = 1;
-			DescriptorWrites[0].pBufferInfo = &BufferInfo;
+		if (!bSceneLighting && !bSceneShadows && !bSceneVirtualTexture)
+			return DescriptorCache.Get(DescriptorSetLayout, Writes);
 
-			DescriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			DescriptorWrites[1].dstSet = DescriptorSets[i];
-			DescriptorWrites[1].dstBinding = 1;
-			DescriptorWrites[1].dstArrayElement = 0;
-			DescriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			DescriptorWrites[1].descriptorCount = 1;
-			DescriptorWrites[1].pImageInfo = &ImageInfo;
-		}
-		vkUpdateDescriptorSets(Device, static_cast<uint32_t>(DescriptorWrites.size()), DescriptorWrites.data(), 0, nullptr);
+		VkDescriptorSet Set = FrameDescriptors[CurrentFrame].Allocate(DescriptorSetLayout);
+		Writes.Apply(Device, Set);
+		return Set;
 	}
 
 	// because graphics offer different types of memory to allocate, we should find the right type of memory to use 
@@ -1465,21 +1820,18 @@ private:
 	{
 		ImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		RenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		ImagesInFlight.resize(SwapChainImages.size(), VK_NULL_HANDLE);
+
+		// Frame pacing uses timeline points instead of fences, binary semaphores are only kept for acquire/present
+		FrameSyncPoints.resize(MAX_FRAMES_IN_FLIGHT);
+		ImageSyncPoints.resize(SwapChainImages.size());
 
 		VkSemaphoreCreateInfo SemphoreInfo{};
 		SemphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo FenceInfo{};
-		FenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		FenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 		{
 			if (vkCreateSemaphore(Device, &SemphoreInfo, nullptr, &ImageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(Device, &SemphoreInfo, nullptr, &RenderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(Device, &FenceInfo, nullptr, &InFlightFences[i]) != VK_SUCCESS)
+				vkCreateSemaphore(Device, &SemphoreInfo, nullptr, &RenderFinishedSemaphores[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("failed to create semaphores!");
 			}
@@ -1489,7 +1841,16 @@ private:
 
 	void DrawFrame()
 	{
-		vkWaitForFences(Device, 1, &InFlightFences[CurrentFrame], VK_TRUE, UINT64_MAX);
+		Timeline.Wait(FrameSyncPoints[CurrentFrame]);
+		AsyncCompute.BeginFrame(CurrentFrame);
+		DeletionQueue.Collect();
+		// Streamed textures follow last frame's requests within the memory budget
+		Residency.Update();
+		// Pages this frame slot asked for last time start loading, finished ones go into the atlas
+		if (bVirtualTexture)
+			SceneVirtualTexture.Update(static_cast<uint32_t>(CurrentFrame));
+		// Transient sets allocated while recording this frame slot last time are done with
+		FrameDescriptors[CurrentFrame].ResetPools();
 
 		uint32_t ImageIndex;
 		VkResult Result = vkAcquireNextImageKHR(Device, SwapChain, UINT64_MAX, ImageAvailableSemaphores[CurrentFrame], VK_NULL_HANDLE, &ImageIndex);
@@ -1504,37 +1865,33 @@ private:
 			throw std::runtime_error("failed to acquire swap chain image");
 		}*/
 
-		if(ImagesInFlight[ImageIndex] != VK_NULL_HANDLE)
-		{
-			vkWaitForFences(Device, 1, &ImagesInFlight[ImageIndex], VK_TRUE, UINT64_MAX);
-		}
-		ImagesInFlight[ImageIndex] = InFlightFences[CurrentFrame];
+		// The image's command buffer and uniform buffer may still be used by an older frame
+		Timeline.Wait(ImageSyncPoints[ImageIndex]);
 
 		UpdateUniformBuffer(ImageIndex);
 
-		VkSubmitInfo SubmitInfo{};
-		SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		// Rebuilt pipelines replace the old ones here, frames still in flight keep theirs until retired
+		Pipelines.ApplyReloads(DeletionQueue);
 
-		VkSemaphore WaitSemaphores[] = { ImageAvailableSemaphores[CurrentFrame] };
-		VkPipelineStageFlags WaitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		SubmitInfo.waitSemaphoreCount = 1;
-		SubmitInfo.pWaitSemaphores = WaitSemaphores;
-		SubmitInfo.pWaitDstStageMask = WaitStages;
+		VkCommandBuffer FrameCommandBuffer = CommandBuffer[CurrentFrame];
+		RecordFrame(FrameCommandBuffer, ImageIndex);
 
-		SubmitInfo.commandBufferCount = 1;
-		SubmitInfo.pCommandBuffers = &CommandBuffer[ImageIndex];
-		//SubmitInfo.pSubmits
+		// Streaming uploads recorded since the last frame are submitted ahead of it once they are old enough
+		Uploader.Tick();
 
-		VkSemaphore SignalSemphores[] = { RenderFinishedSemaphores[CurrentFrame] };
-		SubmitInfo.signalSemaphoreCount = 1;
-		SubmitInfo.pSignalSemaphores = SignalSemphores;     //specify which semaphores to signal once the command buffer(s) have finished execution
+		TimelineSubmitInfo SubmitInfo;
+		SubmitInfo.WaitBinarySemaphores.push_back(ImageAvailableSemaphores[CurrentFrame]);
+		SubmitInfo.WaitBinaryStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		SubmitInfo.CommandBuffers.push_back(FrameCommandBuffer);
+		// Compute submitted for this frame is waited for only at the stages that consume it
+		AsyncCompute.AddGraphicsWaits(SubmitInfo);
 
-		vkResetFences(Device, 1, &InFlightFences[CurrentFrame]);
+		VkSemaphore SignalSemphores[] = { RenderFinishedSemaphores[CurrentFrame] };
+		SubmitInfo.SignalBinarySemaphores.push_back(SignalSemphores[0]);     //specify which semaphores to signal once the command buffer(s) have finished execution
 
-		if (vkQueueSubmit(GraphicsQueue, 1, &SubmitInfo, InFlightFences[CurrentFrame]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to submit draw command buffer!");
-		}
+		GpuSyncPoint FrameDone = Timeline.Submit(GraphicsQueue, QueueType::Graphics, SubmitInfo);
+		FrameSyncPoints[CurrentFrame] = FrameDone;
+		ImageSyncPoints[ImageIndex] = FrameDone;
 
 		VkPresentInfoKHR PresentInfo{};
 		PresentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1576,51 +1933,48 @@ private:
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(Device);
-
+		// No device idle, everything the in-flight frames use is retired and freed once they complete
 		CleanupSwapChain();
 
-		vkDestroyBuffer(Device, IndexBuffer, nullptr);
-		vkFreeMemory(Device, IndexBufferMemory, nullptr);
-		
-		vkDestroyBuffer(Device, VertexBuffer, nullptr);
-		vkFreeMemory(Device, VertexBufferMemory, nullptr);
-
 		CreateSwapChain();
 		CreateImageViews();
 		CreateRenderPass();
 		CreateGraphicsPipeline();
+		SetupRenderGraph();
 		CreateFramebuffers();
 		CreateUniformBuffers();
-		CreateDescriptorPool();
-		CreateDescriptorSets();
-		CreateCommandBuffers();
+
+		ImageSyncPoints.assign(SwapChainImages.size(), GpuSyncPoint());
 	}
 
+	// Retires everything that depends on the swap chain, the swap chain itself is retired when it is replaced
 	void CleanupSwapChain()
 	{
 		for (size_t i = 0; i < SwapChainFrambuffers.size(); ++i)
 		{
-			vkDestroyFramebuffer(Device, SwapChainFrambuffers[i], nullptr);
+			DeletionQueue.Retire(VK_OBJECT_TYPE_FRAMEBUFFER, SwapChainFrambuffers[i]);
+
+			DeletionQueue.Retire(VK_OBJECT_TYPE_BUFFER, UniformBuffers[i]);
+			Residency.Free(UniformBuffersMemory[i]);
+		}
+		// The cached sets reference the uniform buffers
+		DescriptorCache.Clear(DeletionQueue);
 
-			vkDestroyBuffer(Device, UniformBuffers[i], nullptr);
-			vkFreeMemory(Device, UniformBuffersMemory[i], nullptr);
+		if (EnableDepthPrepass)
+		{
+			DeletionQueue.Retire(VK_OBJECT_TYPE_FRAMEBUFFER, DepthPrepassFramebuffer);
+			DeletionQueue.Retire(VK_OBJECT_TYPE_RENDER_PASS, DepthPrepassRenderPass);
 		}
-		vkDestroyDescriptorPool(Device, DescriptorPool, nullptr);
 
-		vkFreeCommandBuffers(Device, CommandPool, static_cast<uint32_t>(CommandBuffer.size()), CommandBuffer.data());
+		DeletionQueue.Retire(VK_OBJECT_TYPE_RENDER_PASS, RenderPass);
 
-		vkDestroyPipeline(Device, GraphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
-		vkDestroyRenderPass(Device, RenderPass, nullptr);
+		// Framebuffers above were retired first, the depth attachment they reference goes after them
+		FrameGraph.Reset();
 
 		for (size_t i = 0; i < SwapChainImageViews.size(); ++i)
 		{
-			vkDestroyImageView(Device, SwapChainImageViews[i], nullptr);
-			//vkFreeMemory(Device, UniformBuffersMemory[i], nullptr);
+			DeletionQueue.Retire(VK_OBJECT_TYPE_IMAGE_VIEW, SwapChainImageViews[i]);
 		}
-
-		vkDestroySwapchainKHR(Device, SwapChain, nullptr);
 	}
 
 	void MainLoop()
@@ -1628,17 +1982,37 @@ private:
 		while (!glfwWindowShouldClose(Window))
 		{
 			glfwPollEvents();
+			Jobs.PumpMainThread();
 			DrawFrame();
 		}
 
-		vkQueueWaitIdle(PresentQueue);
+		// Shutdown is the one place a full idle is fine, presentation may still reference the semaphores
+		vkDeviceWaitIdle(Device);
 	}
 
 	void Cleanup()
 	{
 		CleanupSwapChain();
+		Lighting.Destroy();
+		Shadows.Destroy();
+		if (bVirtualTexture)
+			SceneVirtualTexture.Destroy();
+		Residency.Destroy();
+		DeletionQueue.Flush();
+		Uploader.Destroy();
+		AsyncCompute.Destroy();
+		ShaderReloader.Stop();
+		Pipelines.Destroy();
+		Jobs.Shutdown();
+		DescriptorCache.Destroy();
+		for (DescriptorAllocator& Iter : FrameDescriptors)
+		{
+			Iter.Destroy();
+		}
+		Layouts.Destroy();
+		Samplers.Destroy();
+		vkDestroySwapchainKHR(Device, SwapChain, nullptr);
 		
-		vkDestroySampler(Device, TextureSampler, nullptr);
 		vkDestroyImageView(Device, TextureImageView, nullptr);
 
 		vkDestroyImage(Device, TextureImage, nullptr);
@@ -1648,12 +2022,15 @@ private:
 		vkDestroyBuffer(Device, VertexBuffer, nullptr);
 		vkFreeMemory(Device, VertexBufferMemory, nullptr);
 
+		vkDestroyBuffer(Device, IndexBuffer, nullptr);
+		vkFreeMemory(Device, IndexBufferMemory, nullptr);
+
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 		{
 			vkDestroySemaphore(Device, RenderFinishedSemaphores[i], nullptr);
 			vkDestroySemaphore(Device, ImageAvailableSemaphores[i], nullptr);
-			vkDestroyFence(Device, InFlightFences[i], nullptr);
 		}
+		Timeline.Destroy();
 
 		vkDestroyCommandPool(Device, CommandPool, nullptr);
 		
@@ -1675,6 +2052,21 @@ private:
 public:
 	bool FramebufferResized = false;
 
+	// Hard cap on device local memory for this instance, 0 for none (--device-memory-limit <MB>)
+	VkDeviceSize DeviceMemoryLimit = 0;
+
+	// Use a compute only queue family when there is one, off to compare frame times (--no-async-compute)
+	bool bAsyncCompute = true;
+
+	// Animated lights in the demo scene (--lights <count>)
+	uint32_t DemoLightCount = 256;
+
+	// Check the GPU light binning against ClusteredLighting::BinLights() once at startup (--verify-clusters)
+	bool bVerifyClusters = false;
+
+	// Stream the scene texture through a page atlas (VirtualTexture) and shade with frag_vt.spv (--virtual-texture)
+	bool bVirtualTexture = false;
+
 private:
 	GLFWwindow* Window = nullptr;
 
@@ -1691,8 +2083,9 @@ private:
 	VkSurfaceKHR Surface;
 
 	VkQueue PresentQueue;
+	VkQueue ComputeQueue;
 
-	VkSwapchainKHR SwapChain;
+	VkSwapchainKHR SwapChain = VK_NULL_HANDLE;
 
 	std::vector<VkImage> SwapChainImages;
 
@@ -1703,10 +2096,24 @@ private:
 	VkExtent2D SwapChainExtent;
 
 	VkRenderPass RenderPass;
-	VkDescriptorSetLayout DescriptorSetLayout;
-	VkPipelineLayout PipelineLayout;
+	VkFormat DepthFormat;
+
+	VkRenderPass DepthPrepassRenderPass = VK_NULL_HANDLE;
+	VkFramebuffer DepthPrepassFramebuffer = VK_NULL_HANDLE;
 
-	VkPipeline GraphicsPipeline;
+	// Owned by Layouts
+	PipelineLayoutCache Layouts;
+	SamplerCache Samplers;
+	ReflectedPipelineLayout SceneLayout;
+	VkDescriptorSetLayout DescriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+	VkShaderStageFlags ObjectPushStages = 0;
+
+	PipelineManager Pipelines;
+	PipelineId BasePipelineId = InvalidPipelineId;
+	PipelineId DepthPrepassPipelineId = InvalidPipelineId;
+	PipelineId ShadowPipelineId = InvalidPipelineId;
+	ShaderHotReload ShaderReloader;
 
 	std::vector<VkFramebuffer> SwapChainFrambuffers;
 
@@ -1716,8 +2123,14 @@ private:
 
 	std::vector<VkSemaphore> ImageAvailableSemaphores;
 	std::vector<VkSemaphore> RenderFinishedSemaphores;
-	std::vector<VkFence> InFlightFences;
-	std::vector<VkFence> ImagesInFlight;
+	GpuTimeline Timeline;
+	std::vector<GpuSyncPoint> FrameSyncPoints;
+	std::vector<GpuSyncPoint> ImageSyncPoints;
+	DeferredDeletionQueue DeletionQueue;
+	UploadContext Uploader;
+	AsyncComputeQueue AsyncCompute;
+	MemoryPlacementPolicy MemoryPolicy;
+	ResidencyManager Residency;
 
 	//bool FramebufferResized = false;
 
@@ -1730,8 +2143,20 @@ private:
 	std::vector<VkBuffer> UniformBuffers;
 	std::vector<VkDeviceMemory> UniformBuffersMemory;
 
-	VkDescriptorPool DescriptorPool;
-	std::vector<VkDescriptorSet> DescriptorSets;
+	// Persistent sets by content, and one allocator per frame in flight for sets that only live one frame
+	DescriptorSetCache DescriptorCache;
+	std::array<DescriptorAllocator, MAX_FRAMES_IN_FLIGHT> FrameDescriptors;
+	ReflectedBinding SceneUBOBinding;
+	ReflectedBinding SceneTextureBinding;
+	ReflectedBinding SceneLightingBindings[4];
+	bool bSceneLighting = false;
+	ReflectedBinding SceneShadowMapBinding;
+	ReflectedBinding SceneShadowParamsBinding;
+	bool bSceneShadows = false;
+	ReflectedBinding SceneVirtualTextureBindings[4];
+	bool bSceneVirtualTexture = false;
+
+	TextureDecoder TextureLoader;
 
 	VkImage TextureImage;
 	VkDeviceMemory TextureImageMemory;
@@ -1739,6 +2164,43 @@ private:
 
 	VkImageView TextureImageView;
 
+	// Pass ids that go into the draw sort keys, the pipeline field is the PipelineManager id
+	enum : uint32_t { DrawPassDepthPrepass = 0, DrawPassBase = 1, DrawPassShadow = 2 };   // shadow cascade c is DrawPassShadow + c
+
+	// Shared by every system that runs work in parallel
+	JobSystem Jobs;
+
+	DrawQueue SceneDraws;
+	glm::vec3 CameraPosition = glm::vec3(2.f, 2.f, 2.f);
+	TransformHierarchy Scene;
+	SceneNodeId SceneRootNode = InvalidSceneNode;
+	std::vector<SceneNodeId> SectionNodes;   // parallel to MeshSections
+	std::vector<uint8_t> SectionStatic;
+	std::vector<glm::vec4> SectionSpheres;
+	std::vector<uint8_t> SectionVisibility;
+	BatchMath::Frustum ViewFrustum;
+	static const uint32_t CullBatchSize = 1024;
+	float MaxDrawDistance = 100.f;
+	glm::mat4 CameraView = glm::mat4(1.f);
+
+	ClusterGridDesc LightingDesc;
+	ClusteredLighting Lighting;
+	std::vector<ClusterLight> DemoLights;
+	std::vector<float> DemoLightSpeeds;   // radians per second around the z axis
+	std::vector<ClusterLight> FrameLights;
+
+	CascadedShadowDesc ShadowsDesc;
+	CascadedShadows Shadows;
+	VirtualTexture SceneVirtualTexture;
+	glm::vec3 SunDirection = glm::normalize(glm::vec3(-0.4f, -0.3f, -1.f));   // direction the light travels
+	glm::vec3 SunColor = glm::vec3(1.f, 0.95f, 0.85f) * 1.5f;
+
+	RenderGraph FrameGraph;
+	RenderGraphHandle BackBuffer = InvalidRenderGraphHandle;
+	RenderGraphHandle SceneDepth = InvalidRenderGraphHandle;
+	RenderGraphHandle ShadowMap = InvalidRenderGraphHandle;
+	uint32_t RecordingImageIndex = 0;
+
 	size_t CurrentFrame = 0;
 };
 
@@ -1772,8 +2234,59 @@ static void FramebufferResizeCallback(GLFWwindow* Window, int Width, int Height)
 
 
 
-int main()
+int main(int argc, char** argv)
 {
+	// VKRenderer --decode-benchmark <directory>: CPU only, no window or device
+	if (argc >= 3 && std::string(argv[1]) == "--decode-benchmark")
+	{
+		JobSystem Jobs;
+		Jobs.Init();
+		TextureDecoder::RunBenchmark(argv[2], Jobs, std::cout);
+		Jobs.Shutdown();
+		return EXIT_SUCCESS;
+	}
+
+	// VKRenderer --transform-benchmark <nodes>: CPU only, times TransformHierarchy::Update()
+	if (argc >= 3 && std::string(argv[1]) == "--transform-benchmark")
+	{
+		JobSystem Jobs;
+		Jobs.Init();
+		TransformHierarchy::RunBenchmark(static_cast<uint32_t>(std::stoul(argv[2])), Jobs, std::cout);
+		Jobs.Shutdown();
+		return EXIT_SUCCESS;
+	}
+
+	// VKRenderer --math-benchmark [elements]: CPU only, checks every BatchMath level against the reference and times it
+	if (argc >= 2 && std::string(argv[1]) == "--math-benchmark")
+	{
+		const size_t Count = argc >= 3 ? std::stoul(argv[2]) : 1 << 20;
+		return BatchMath::RunBenchmark(Count, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// VKRenderer --pack-textures <directory> <output>: packs the small images of a directory offline, load
+	// the result with TexturePacker::Load()
+	if (argc >= 4 && std::string(argv[1]) == "--pack-textures")
+	{
+		JobSystem Jobs;
+		Jobs.Init();
+		const std::vector<TexturePackInput> Inputs = TexturePacker::LoadDirectory(argv[2]);
+		const TexturePack Pack = TexturePacker::Pack(Inputs, TexturePackSettings(), &Jobs);
+		TexturePacker::Save(Pack, argv[3]);
+		Jobs.Shutdown();
+
+		uint32_t Packed = 0;
+		for (const PackedTextureRegion& Iter : Pack.Regions)
+		{
+			Packed += Iter.Set != UINT32_MAX ? 1 : 0;
+		}
+		std::cout << "packed " << Packed << " of " << Inputs.size() << " textures into " << Pack.Sets.size() << " images\n";
+		for (const PackedTextureSet& Iter : Pack.Sets)
+		{
+			std::cout << "  " << (Iter.bAtlas ? "atlas " : "array ") << Iter.Width << "x" << Iter.Height << ", " << Iter.Layers << " layers, " << Iter.MipCount << " mips\n";
+		}
+		return EXIT_SUCCESS;
+	}
+
 	/*char str1[] = "adfsafaf";
 	memcpy(str1, str1 + 1, 3);
 
@@ -1781,6 +2294,23 @@ int main()
 
 	HelloTriangleApplication App;
 
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (std::string(argv[i]) == "--device-memory-limit")
+			App.DeviceMemoryLimit = std::stoull(argv[i + 1]) * 1024 * 1024;
+		if (std::string(argv[i]) == "--lights")
+			App.DemoLightCount = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+	}
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::string(argv[i]) == "--no-async-compute")
+			App.bAsyncCompute = false;
+		if (std::string(argv[i]) == "--virtual-texture")
+			App.bVirtualTexture = true;
+		if (std::string(argv[i]) == "--verify-clusters")
+			App.bVerifyClusters = true;
+	}
+
 	try 
 	{
 		App.run();
@@ -7,7 +7,7 @@
 
 struct Vertex
 {
-	glm::vec2 Pos;
+	glm::vec3 Pos;
 	glm::vec3 Color;
 	glm::vec2 TexCoord;
 
@@ -27,7 +27,7 @@ struct Vertex
 
 		AttributeDescriptions[0].binding = 0;
 		AttributeDescriptions[0].location = 0;
-		AttributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+		AttributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
 		AttributeDescriptions[0].offset = offsetof(Vertex, Pos);
 
 		AttributeDescriptions[1].binding = 0;
@@ -46,20 +46,61 @@ struct Vertex
 
 const std::vector<Vertex> Vertices =
 {
-	{{-0.5f, -0.5f}, {1.f, 0.f, 0.f}, {0.f, 0.f}},
-	{{0.5f, -0.5f}, {0.f, 1.f, 0.f}, {1.f, 0.f}},
-	{{0.5f, 0.5f}, {0.f, 0.f, 1.f}, {1.f, 1.f}},
-	{{-0.5f, 0.5f}, {0.f, 1.f, 1.f}, {0.f, 1.f}}
+	{{-0.5f, -0.5f, 0.f}, {1.f, 0.f, 0.f}, {0.f, 0.f}},
+	{{0.5f, -0.5f, 0.f}, {0.f, 1.f, 0.f}, {1.f, 0.f}},
+	{{0.5f, 0.5f, 0.f}, {0.f, 0.f, 1.f}, {1.f, 1.f}},
+	{{-0.5f, 0.5f, 0.f}, {0.f, 1.f, 1.f}, {0.f, 1.f}},
+
+	{{-0.5f, -0.5f, -0.5f}, {1.f, 0.f, 0.f}, {0.f, 0.f}},
+	{{0.5f, -0.5f, -0.5f}, {0.f, 1.f, 0.f}, {1.f, 0.f}},
+	{{0.5f, 0.5f, -0.5f}, {0.f, 0.f, 1.f}, {1.f, 1.f}},
+	{{-0.5f, 0.5f, -0.5f}, {0.f, 1.f, 1.f}, {0.f, 1.f}},
+
+	// Ground below the quads, receives their shadows
+	{{-4.f, -4.f, -1.f}, {1.f, 1.f, 1.f}, {0.f, 0.f}},
+	{{4.f, -4.f, -1.f}, {1.f, 1.f, 1.f}, {1.f, 0.f}},
+	{{4.f, 4.f, -1.f}, {1.f, 1.f, 1.f}, {1.f, 1.f}},
+	{{-4.f, 4.f, -1.f}, {1.f, 1.f, 1.f}, {0.f, 1.f}}
 };
 
 const std::vector<uint16_t> Indices =
 {
-	0, 1, 2, 2, 3, 0
+	0, 1, 2, 2, 3, 0,
+	4, 5, 6, 6, 7, 4,
+	8, 9, 10, 10, 11, 8
+};
+
+// A draw worth of the index buffer, Center/Radius bound it for culling and depth sorting. Static
+// sections never move, which lets the distant shadow cascades cache them
+struct MeshSection
+{
+	uint32_t FirstIndex;
+	uint32_t IndexCount;
+	glm::vec3 Center;
+	float Radius;
+	bool bStatic = false;
+};
+
+const std::vector<MeshSection> MeshSections =
+{
+	{0, 6, {0.f, 0.f, 0.f}, 0.71f},
+	{6, 6, {0.f, 0.f, -0.5f}, 0.71f},
+	{12, 6, {0.f, 0.f, -1.f}, 5.66f, true}
 };
 
+// Per frame, bound once through the descriptor set
 struct UniformBufferObject
 {
-	glm::mat4 Model;
 	glm::mat4 View;
 	glm::mat4 Proj;
-};
\ No newline at end of file
+};
+
+// Per draw, pushed with the draw instead of written to a buffer. Matches ObjectConstants in shader.vert
+struct ObjectPushConstants
+{
+	glm::mat4 Model;
+	uint32_t MaterialIndex;
+};
+
+// Every device supports at least 128 bytes, larger blocks need a check against maxPushConstantsSize
+static_assert(sizeof(ObjectPushConstants) <= 128, "per draw push constants exceed the guaranteed minimum");
\ No newline at end of file
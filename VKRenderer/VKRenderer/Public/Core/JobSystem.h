@@ -0,0 +1,223 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+
+/**
+ * Chase-Lev work-stealing deque. The owning thread pushes and pops at the bottom without locking,
+ * any other thread may steal from the top. The ring grows when full; outgrown rings are kept until
+ * the deque is destroyed because a thief may still be reading one. T has to be trivially copyable.
+ */
+template<typename T>
+class WorkStealingDeque
+{
+public:
+	explicit WorkStealingDeque(int64_t InitialCapacity = 1024)
+	{
+		Rings.push_back(std::make_unique<Ring>(InitialCapacity));
+		Current.store(Rings.back().get(), std::memory_order_relaxed);
+	}
+
+	// Owner only
+	void Push(T Item)
+	{
+		const int64_t B = Bottom.load(std::memory_order_relaxed);
+		const int64_t T0 = Top.load(std::memory_order_acquire);
+		Ring* Array = Current.load(std::memory_order_relaxed);
+		if (B - T0 > Array->Capacity - 1)
+		{
+			Array = Grow(Array, B, T0);
+		}
+		Array->Put(B, Item);
+		std::atomic_thread_fence(std::memory_order_release);
+		Bottom.store(B + 1, std::memory_order_relaxed);
+	}
+
+	// Owner only, newest first
+	bool Pop(T& OutItem)
+	{
+		const int64_t B = Bottom.load(std::memory_order_relaxed) - 1;
+		Ring* Array = Current.load(std::memory_order_relaxed);
+		Bottom.store(B, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t T0 = Top.load(std::memory_order_relaxed);
+
+		if (T0 > B)
+		{
+			Bottom.store(B + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		OutItem = Array->Get(B);
+		if (T0 == B)
+		{
+			// Last item, race the thieves for it
+			const bool bWon = Top.compare_exchange_strong(T0, T0 + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			Bottom.store(B + 1, std::memory_order_relaxed);
+			return bWon;
+		}
+		return true;
+	}
+
+	// Any thread, oldest first. Fails spuriously when it loses a race, which callers treat as empty
+	bool Steal(T& OutItem)
+	{
+		int64_t T0 = Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t B = Bottom.load(std::memory_order_acquire);
+		if (T0 >= B)
+			return false;
+
+		Ring* Array = Current.load(std::memory_order_acquire);
+		OutItem = Array->Get(T0);
+		return Top.compare_exchange_strong(T0, T0 + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	bool IsEmpty() const
+	{
+		return Top.load(std::memory_order_relaxed) >= Bottom.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Ring
+	{
+		explicit Ring(int64_t InCapacity)
+			: Capacity(InCapacity), Items(new std::atomic<T>[static_cast<size_t>(InCapacity)])
+		{
+		}
+
+		T Get(int64_t Index) const { return Items[static_cast<size_t>(Index & (Capacity - 1))].load(std::memory_order_relaxed); }
+		void Put(int64_t Index, T Item) { Items[static_cast<size_t>(Index & (Capacity - 1))].store(Item, std::memory_order_relaxed); }
+
+		int64_t Capacity;   // power of two
+		std::unique_ptr<std::atomic<T>[]> Items;
+	};
+
+	Ring* Grow(Ring* Old, int64_t B, int64_t T0)
+	{
+		Rings.push_back(std::make_unique<Ring>(Old->Capacity * 2));
+		Ring* New = Rings.back().get();
+		for (int64_t i = T0; i < B; ++i)
+		{
+			New->Put(i, Old->Get(i));
+		}
+		Current.store(New, std::memory_order_release);
+		return New;
+	}
+
+	std::atomic<int64_t> Top{ 0 };
+	std::atomic<int64_t> Bottom{ 0 };
+	std::atomic<Ring*> Current{ nullptr };
+	std::vector<std::unique_ptr<Ring>> Rings;   // touched by the owner only
+};
+
+struct Job;
+
+/**
+ * Counts unfinished jobs. Every job started with a counter adds one and removes it when it returns,
+ * so the counter reaching zero means the whole group is done. Jobs started with RunAfter() wait on a
+ * counter as continuations instead of blocking a thread. The first exception thrown by one of its jobs
+ * is kept and rethrown by Wait(), the rest of the group still runs.
+ */
+class JobCounter
+{
+public:
+	bool IsDone() const { return Value.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int32_t> Value{ 0 };
+	std::atomic<bool> bFailed{ false };
+	std::exception_ptr FirstError;   // written before the failing job signals, read once the counter is done
+	std::mutex ContinuationMutex;
+	std::vector<Job*> Continuations;
+};
+
+enum class JobAffinity : uint8_t
+{
+	Any,
+	MainThread,   // GLFW and anything else that must stay on the thread that called Init()
+	Background    // long jobs (pipeline compiles, decodes, streaming loads), kept off threads helping inside Wait()
+};
+
+/**
+ * The one scheduler every system submits parallel work to (culling, transform updates, sorting,
+ * pipeline compiles, asset decoding), so they share a fixed set of threads instead of each spawning
+ * its own. Every worker owns a work-stealing deque: jobs a worker submits go to its own deque and
+ * idle workers steal from the others. Threads outside the pool submit through a shared queue.
+ *
+ * There are no fibers: Wait() keeps the waiting thread busy running other jobs until the counter
+ * is done, and RunAfter() attaches a continuation to a counter without waiting at all. Background
+ * jobs sit in their own queue that idle workers drain; a thread inside Wait() only takes the ones
+ * signalling the counter it waits on, so a frame's ParallelFor never ends up running a compile.
+ */
+class JobSystem
+{
+public:
+	~JobSystem();
+
+	// The calling thread becomes the main thread and takes part in Wait(). 0 workers means one per remaining core, at least one
+	void Init(uint32_t WorkerCount = 0);
+
+	// Joins the workers, queued jobs that have not started are dropped
+	void Shutdown();
+
+	void Run(std::function<void()> Function, JobCounter* Signal = nullptr, JobAffinity Affinity = JobAffinity::Any);
+
+	// Queued once Dependency is done, right away if it already is
+	void RunAfter(JobCounter& Dependency, std::function<void()> Function, JobCounter* Signal = nullptr, JobAffinity Affinity = JobAffinity::Any);
+
+	// Runs other jobs until the counter is done; on the main thread that includes main thread jobs. Background
+	// jobs are only taken when they signal Counter
+	void Wait(JobCounter& Counter);
+
+	// Splits [0, Count) into batches of at least MinBatchSize, the calling thread runs a share and waits for the rest
+	void ParallelFor(uint32_t Count, uint32_t MinBatchSize, const std::function<void(uint32_t Begin, uint32_t End)>& Function);
+
+	// Runs the queued main thread jobs, call once per frame from the main loop
+	void PumpMainThread();
+
+	// Workers plus the main thread
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(Queues.size()); }
+
+	bool IsMainThread() const;
+
+	// 0 for the main thread, 1.. for workers, UINT32_MAX for threads outside the pool
+	uint32_t GetCurrentThreadIndex() const;
+
+private:
+	void Submit(Job* NewJob);
+	Job* FindJob();
+	// nullptr takes the oldest, otherwise only a job signalling Signal
+	Job* FindBackgroundJob(const JobCounter* Signal);
+	bool RunMainThreadJob();
+	void Execute(Job* InJob);
+	void WorkerLoop(uint32_t Index);
+
+	// Index 0 is the main thread
+	std::vector<std::unique_ptr<WorkStealingDeque<Job*>>> Queues;
+	std::vector<std::thread> Workers;
+
+	std::mutex SharedMutex;
+	std::deque<Job*> SharedQueue;       // submitted from threads outside the pool
+	std::deque<Job*> MainThreadQueue;
+	std::deque<Job*> BackgroundQueue;
+	std::atomic<uint32_t> SharedCount{ 0 };
+	std::atomic<uint32_t> BackgroundCount{ 0 };
+
+	// Workers sleep when there is nothing to steal, every submit bumps the epoch
+	std::mutex WakeMutex;
+	std::condition_variable WakeCondition;
+	std::atomic<uint64_t> WakeEpoch{ 0 };
+	std::atomic<uint32_t> SleepingWorkers{ 0 };
+	std::atomic<bool> bStopping{ false };
+};
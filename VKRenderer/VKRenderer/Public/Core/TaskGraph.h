@@ -0,0 +1,74 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <ostream>
+#include <cstdint>
+
+typedef uint32_t TaskId;
+
+/**
+ * One-shot dependency graph of named tasks, run on the job system. A task starts as soon as all of
+ * its dependencies have finished, so independent chains overlap. Dependencies must have been added
+ * earlier, which rules out cycles by construction. Every task is timed, PrintTimeline() shows where
+ * the time went and which thread ran what.
+ *
+ * Once a task throws, tasks that have not started yet are skipped and Run() rethrows the first
+ * exception after the ones already running have finished.
+ */
+class TaskGraph
+{
+public:
+	struct TaskTiming
+	{
+		std::chrono::steady_clock::duration Start{};   // relative to the start of Run()
+		std::chrono::steady_clock::duration End{};
+		uint32_t Thread = 0;   // job system thread index, 0 is the main thread
+		bool bRan = false;
+	};
+
+	TaskId Add(const std::string& Name, std::function<void()> Function, const std::vector<TaskId>& Dependencies = {},
+		JobAffinity Affinity = JobAffinity::Any);
+
+	// Blocks until every task has run, the calling thread helps. Call from the job system's main thread
+	// when any task has main thread affinity
+	void Run(JobSystem& Jobs);
+
+	const TaskTiming& GetTiming(TaskId Id) const { return Tasks[Id]->Timing; }
+	std::chrono::steady_clock::duration GetTotalTime() const { return TotalTime; }
+
+	void PrintTimeline(std::ostream& Out) const;
+
+private:
+	struct Task
+	{
+		std::string Name;
+		std::function<void()> Function;
+		JobAffinity Affinity = JobAffinity::Any;
+		std::vector<TaskId> Dependents;
+		uint32_t DependencyCount = 0;
+		std::atomic<uint32_t> RemainingDependencies{ 0 };
+		TaskTiming Timing;
+	};
+
+	void Launch(TaskId Id);
+	void Execute(TaskId Id);
+
+	std::vector<std::unique_ptr<Task>> Tasks;
+
+	// Valid during Run()
+	JobSystem* Jobs = nullptr;
+	JobCounter Outstanding;
+	std::chrono::steady_clock::time_point StartTime;
+	std::atomic<bool> bFailed{ false };
+	std::exception_ptr FirstError;
+
+	std::chrono::steady_clock::duration TotalTime{};
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm.hpp>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Array kernels for the inner loops of transform updates and culling. Every kernel has a scalar
+ * reference (BatchMath::Reference) plus SSE and NEON versions, and AVX2 versions where the wider
+ * registers pay off. The widest set the CPU supports is picked once at startup, the AVX2 paths only
+ * run when the CPU and OS report AVX2 and FMA.
+ * Matrices are column major, the same memory layout as glm::mat4.
+ */
+namespace BatchMath
+{
+	struct Aabb
+	{
+		glm::vec3 Min;
+		glm::vec3 Max;
+	};
+
+	// Planes point inwards, a point P is inside when dot(Plane.xyz, P) + Plane.w >= 0 for all six
+	struct Frustum
+	{
+		glm::vec4 Planes[6];
+
+		// Vulkan clip space (0 <= z <= w), works for reverse-Z and infinite projections
+		static Frustum FromViewProjection(const glm::mat4& ViewProjection);
+	};
+
+	enum class SimdLevel : uint8_t
+	{
+		Scalar,
+		SSE,
+		AVX2,
+		NEON
+	};
+
+	SimdLevel GetSimdLevel();
+	const char* GetSimdLevelName(SimdLevel Level);
+
+	// Switches to another level's kernels, for comparing against the reference. A level the CPU lacks falls back to a narrower one
+	void ForceSimdLevel(SimdLevel Level);
+
+	// Out = A * B for one matrix, Out may not alias A or B
+	void MultiplyMatrix(const glm::mat4& A, const glm::mat4& B, glm::mat4& Out);
+
+	// Out[i] = A[i] * B[i]
+	void MultiplyMatrices(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count);
+
+	// World space bounds of In[i] transformed by Matrices[i] (affine), still axis aligned so possibly larger
+	void TransformAabbs(const glm::mat4* Matrices, const Aabb* In, Aabb* Out, size_t Count);
+
+	// OutVisible[i] = 1 when the sphere (xyz center, w radius) touches the frustum, 0 otherwise
+	void CullSpheres(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count);
+
+	void CullAabbs(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count);
+
+	// CPU only: runs every kernel at each level the CPU supports on Count random inputs, checks the results
+	// against Reference and prints the throughput. Returns false when a level disagrees with Reference
+	bool RunBenchmark(size_t Count, std::ostream& Out);
+
+	// Straightforward scalar versions, the definition of correct for the SIMD kernels
+	namespace Reference
+	{
+		void MultiplyMatrices(const glm::mat4* A, const glm::mat4* B, glm::mat4* Out, size_t Count);
+		void TransformAabbs(const glm::mat4* Matrices, const Aabb* In, Aabb* Out, size_t Count);
+		void CullSpheres(const Frustum& InFrustum, const glm::vec4* Spheres, uint8_t* OutVisible, size_t Count);
+		void CullAabbs(const Frustum& InFrustum, const Aabb* Boxes, uint8_t* OutVisible, size_t Count);
+	}
+}
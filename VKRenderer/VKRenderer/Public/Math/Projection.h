@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm.hpp>
+#include <cmath>
+
+/**
+ * Reverse-Z perspective with the far plane at infinity, for Vulkan clip space (y down, z in [0, 1]).
+ * The near plane maps to depth 1 and infinity to 0, so float depth precision is spread evenly over
+ * distance; depth is cleared to 0 and tested with GREATER_OR_EQUAL.
+ */
+inline glm::mat4 MakeReversedZInfinitePerspective(float FovY, float Aspect, float ZNear)
+{
+	const float F = 1.f / std::tan(FovY * 0.5f);
+
+	glm::mat4 Proj(0.f);
+	Proj[0][0] = F / Aspect;
+	Proj[1][1] = -F;      // flip y, glm follows the OpenGL convention
+	Proj[2][3] = -1.f;    // w = -z_view
+	Proj[3][2] = ZNear;   // z = near, so depth = near / -z_view
+
+	return Proj;
+}
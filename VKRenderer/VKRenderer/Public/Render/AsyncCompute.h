@@ -0,0 +1,104 @@
+#pragma once
+
+#include "GpuTimeline.h"
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+struct AsyncComputeTask
+{
+	std::string Name;
+
+	// Records the dispatches, the command buffer is begun and ended by the queue
+	std::function<void(VkCommandBuffer)> Record;
+
+	// Work the task depends on (the depth prepass for culling, the scene color for post-processing), with the
+	// compute stage that first needs it
+	std::vector<GpuSyncPoint> WaitPoints;
+	std::vector<VkPipelineStageFlags> WaitPointStages;
+
+	// Whether this frame's graphics submission waits for the task, at ConsumerStage. Off for work that is
+	// consumed later (next frame, readbacks), which then overlaps with graphics for its whole duration
+	bool bGraphicsWaits = true;
+	VkPipelineStageFlags ConsumerStage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+};
+
+struct AsyncComputeTiming
+{
+	std::string Name;
+	double Milliseconds = 0.0;
+};
+
+/**
+ * Submits compute work (culling, light binning, post-processing) on a queue of its own so it runs
+ * alongside graphics. Each task is submitted as soon as it is recorded with its own timeline signal;
+ * the frame's graphics submission waits for it only at the stage that consumes the result, so vertex
+ * work ahead of that stage and the previous frame's tail overlap with it. Without a dedicated compute
+ * family the tasks go to the graphics queue under the same API and simply run in submission order.
+ *
+ * Resources used on both queues are created with CONCURRENT sharing (SetSharing()) when the families
+ * differ, so no queue family ownership transfers are needed. Not thread safe, submit from the thread
+ * that submits the frame.
+ */
+class AsyncComputeQueue
+{
+public:
+	static const uint32_t MaxTimedTasksPerFrame = 16;
+
+	void Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, GpuTimeline* InTimeline, VkQueue InQueue, uint32_t InFamily,
+		uint32_t InGraphicsFamily, uint32_t FramesInFlight);
+
+	// Device must be idle
+	void Destroy();
+
+	// Call once the frame slot's previous submissions have completed: recycles its command buffers and reads
+	// back the timings of that frame
+	void BeginFrame(uint32_t FrameIndex);
+
+	GpuSyncPoint Submit(const AsyncComputeTask& Task);
+
+	// Adds a wait for every task submitted since the last call that the frame's graphics work consumes
+	void AddGraphicsWaits(TimelineSubmitInfo& Info);
+
+	void SetSharing(VkBufferCreateInfo& Info) const;
+	void SetSharing(VkImageCreateInfo& Info) const;
+
+	bool IsDedicated() const { return Family != GraphicsFamily; }
+	uint32_t GetFamily() const { return Family; }
+
+	// GPU time of each task in the frame slot last passed to BeginFrame(), empty without timestamp support
+	const std::vector<AsyncComputeTiming>& GetLastTimings() const { return LastTimings; }
+
+private:
+	struct FrameResources
+	{
+		VkCommandPool Pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> CommandBuffers;
+		uint32_t UsedCommandBuffers = 0;
+		VkQueryPool Queries = VK_NULL_HANDLE;
+		std::vector<std::string> TimedTasks;
+		GpuSyncPoint LastSubmit;
+	};
+
+	struct PendingWait
+	{
+		GpuSyncPoint Point;
+		VkPipelineStageFlags Stage;
+	};
+
+	VkDevice Device = VK_NULL_HANDLE;
+	GpuTimeline* Timeline = nullptr;
+	VkQueue Queue = VK_NULL_HANDLE;
+	uint32_t Family = 0;
+	uint32_t GraphicsFamily = 0;
+	uint32_t SharedFamilies[2] = { 0, 0 };
+	float TimestampPeriod = 0.0f;   // nanoseconds per tick, 0 when the family has no timestamps
+
+	std::vector<FrameResources> Frames;
+	uint32_t CurrentFrame = 0;
+	std::vector<PendingWait> PendingWaits;
+	std::vector<AsyncComputeTiming> LastTimings;
+};
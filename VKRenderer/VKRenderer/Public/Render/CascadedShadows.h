@@ -0,0 +1,179 @@
+#pragma once
+
+#include "ShaderReflection.h"
+
+#include <vulkan/vulkan_core.h>
+#include <glm.hpp>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+class ResidencyManager;
+class DeferredDeletionQueue;
+class UploadContext;
+class SamplerCache;
+class PipelineLayoutCache;
+class DescriptorSetCache;
+
+struct CascadedShadowDesc
+{
+	uint32_t CascadeCount = 4;        // at most CascadedShadows::MaxCascades
+	uint32_t Resolution = 2048;       // per cascade, square
+	float ShadowDistance = 40.0f;     // view depth the last cascade ends at
+	float SplitLambda = 0.75f;        // 0 uniform splits, 1 logarithmic
+	float CasterExtension = 50.0f;    // how far towards the light casters outside a cascade still cast into it
+
+	// Cascades from here on are cached while only static casters touch them
+	uint32_t FirstCachedCascade = 2;
+
+	// Applied to the caster pipeline, negative with reverse-Z
+	float DepthBiasConstant = -1.0f;
+	float DepthBiasSlope = -2.0f;
+	// Receivers are moved along their normal by this many texels of their cascade before the lookup
+	float NormalOffsetTexels = 1.5f;
+};
+
+struct ShadowCascade
+{
+	glm::mat4 ViewProj;        // world to the cascade's clip space, orthographic and reverse-Z
+	glm::vec4 Sphere;          // world space bounds of the covered slice of the view frustum
+	float SplitNear = 0.0f;    // view depth range
+	float SplitFar = 0.0f;
+	float TexelWorldSize = 0.0f;
+};
+
+// ShadowParams uniform block (std140) of Shaders/CascadedShadows.glsl
+struct ShadowShaderParams
+{
+	glm::mat4 ViewProj[4];
+	glm::mat4 View;              // camera, for the view depth that selects the cascade
+	glm::vec4 SplitFar;          // per cascade
+	glm::vec4 NormalOffset;      // per cascade, world units
+	glm::vec4 LightDirection;    // direction the light travels, w is the cascade count (0 without shadows)
+	glm::vec4 LightColor;        // linear, premultiplied by intensity
+	glm::vec4 Fade;              // view depth shadows start fading out at, 1 / fade length
+};
+
+/**
+ * Cascaded shadow maps for one directional light. The view frustum up to ShadowDistance is split into
+ * cascades, each rendered into a layer of one depth array with an orthographic projection fitted to
+ * the bounding sphere of its slice. The sphere only depends on the split depths and the field of view,
+ * and its center is snapped to whole texels in light space, so the shadow edges stay put while the
+ * camera moves and turns. Casters are culled per cascade against the cascade's volume extended towards
+ * the light.
+ *
+ * Distant cascades cover a lot of the scene and change little. From FirstCachedCascade on, a cascade
+ * whose casters are all static keeps last frame's layer and is not redrawn until its projection
+ * snaps to another texel, the light turns or InvalidateStatic() is called. A dynamic caster in the
+ * cascade makes it render every frame until it leaves again.
+ */
+class CascadedShadows
+{
+public:
+	static const uint32_t MaxCascades = 4;
+
+	// Rendering is off (everything lit) when CasterShader (SPIR-V of Shaders/shadow.vert) does not
+	// exist; the image, sampler and parameters exist regardless so the scene can always bind them
+	void Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, ResidencyManager* InResidency, DeferredDeletionQueue* InDeletionQueue,
+		UploadContext* Uploader, SamplerCache* Samplers, PipelineLayoutCache* Layouts, DescriptorSetCache* InDescriptors,
+		const CascadedShadowDesc& InDesc, uint32_t FramesInFlight, const std::string& CasterShader);
+
+	// Device must be idle
+	void Destroy();
+
+	// Fits the cascades to the camera, culls the casters (world space bounding spheres) per cascade and
+	// decides which cascades are drawn this frame. CasterStatic marks casters that never move or change
+	void Update(uint32_t FrameIndex, const glm::mat4& View, float FovY, float Aspect, float NearZ, const glm::vec3& LightDirection,
+		const glm::vec3& LightColor, const glm::vec4* CasterSpheres, const uint8_t* CasterStatic, size_t CasterCount);
+
+	// Static casters were added, removed or moved, every cached cascade is drawn again
+	void InvalidateStatic() { ++StaticGeneration; }
+
+	// Begins the shadow render pass on each cascade drawn this frame and calls DrawCascade inside it
+	void Record(VkCommandBuffer Cmd, const std::function<void(VkCommandBuffer, uint32_t)>& DrawCascade) const;
+
+	static void ComputeCascades(const CascadedShadowDesc& Desc, const glm::mat4& View, float FovY, float Aspect, float NearZ,
+		const glm::vec3& LightDirection, ShadowCascade* OutCascades);
+
+	bool IsEnabled() const { return bEnabled; }
+	uint32_t GetCascadeCount() const { return Desc.CascadeCount; }
+	const ShadowCascade& GetCascade(uint32_t Cascade) const { return Cascades[Cascade].Cascade; }
+	bool IsCascadeDrawn(uint32_t Cascade) const { return Cascades[Cascade].bDraw; }
+	bool IsCasterVisible(uint32_t Cascade, size_t Caster) const { return Cascades[Cascade].Visible[Caster] != 0; }
+	// Cascades drawn by the last Update(), the rest were served from the cache
+	uint32_t GetDrawnCascadeCount() const;
+
+	// For the caster pipeline and draws
+	VkRenderPass GetRenderPass() const { return RenderPass; }
+	VkFormat GetDepthFormat() const { return DepthFormat; }
+	VkPipelineLayout GetPipelineLayout() const { return CasterLayout; }
+	VkShaderStageFlags GetPushConstantStages() const { return CasterPushStages; }
+	VkDescriptorSet GetCascadeDescriptorSet(uint32_t Cascade);
+
+	// For the receivers, the array view is in SHADER_READ_ONLY_OPTIMAL outside the shadow pass
+	VkImage GetImage() const { return Image; }
+	VkImageView GetArrayView() const { return ArrayView; }
+	VkSampler GetSampler() const { return Sampler; }
+	VkExtent2D GetExtent() const { return VkExtent2D{ Desc.Resolution, Desc.Resolution }; }
+	VkBuffer GetParamsBuffer(uint32_t FrameIndex) const { return Frames[FrameIndex].Params; }
+	VkDeviceSize GetParamsSize() const { return sizeof(ShadowShaderParams); }
+
+private:
+	struct CascadeState
+	{
+		ShadowCascade Cascade;
+		std::vector<uint8_t> Visible;
+		bool bDraw = false;
+
+		// What the layer holds when it is a valid cache
+		bool bCached = false;
+		glm::mat4 CachedViewProj = glm::mat4(0.0f);
+		uint64_t CachedGeneration = 0;
+	};
+
+	struct FrameBuffers
+	{
+		VkBuffer Params = VK_NULL_HANDLE;
+		VkDeviceMemory ParamsMemory = VK_NULL_HANDLE;
+		VkBuffer Cascades = VK_NULL_HANDLE;   // one ViewProj per cascade, CascadeStride apart
+		VkDeviceMemory CascadesMemory = VK_NULL_HANDLE;
+		uint8_t* MappedParams = nullptr;
+		uint8_t* MappedCascades = nullptr;
+		bool bCoherent = true;
+	};
+
+	VkFormat ChooseDepthFormat(VkPhysicalDevice PhysicalDevice, bool& bOutLinearFilter) const;
+	void CreateImage(UploadContext* Uploader);
+	void CreateRenderPass();
+	void CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, VkBuffer& OutBuffer, VkDeviceMemory& OutMemory, uint8_t*& OutMapped, bool& bOutCoherent);
+	void CreateCasterLayout(PipelineLayoutCache* Layouts, const std::string& CasterShader);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	ResidencyManager* Residency = nullptr;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+	DescriptorSetCache* Descriptors = nullptr;
+	CascadedShadowDesc Desc;
+	bool bEnabled = false;
+
+	VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+	VkImage Image = VK_NULL_HANDLE;
+	VkDeviceMemory ImageMemory = VK_NULL_HANDLE;
+	VkImageView ArrayView = VK_NULL_HANDLE;
+	std::vector<VkImageView> LayerViews;
+	std::vector<VkFramebuffer> Framebuffers;
+	VkRenderPass RenderPass = VK_NULL_HANDLE;
+	VkSampler Sampler = VK_NULL_HANDLE;
+
+	VkPipelineLayout CasterLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout CasterSetLayout = VK_NULL_HANDLE;
+	ReflectedBinding CasterCascadeBinding;
+	VkShaderStageFlags CasterPushStages = 0;
+
+	VkDeviceSize CascadeStride = 0;
+	std::vector<FrameBuffers> Frames;
+	uint32_t CurrentFrame = 0;
+
+	CascadeState Cascades[MaxCascades];
+	uint64_t StaticGeneration = 1;
+};
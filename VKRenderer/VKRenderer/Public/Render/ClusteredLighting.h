@@ -0,0 +1,175 @@
+#pragma once
+
+#include "MemoryPlacement.h"
+#include "ShaderReflection.h"
+
+#include <vulkan/vulkan_core.h>
+#include <glm.hpp>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+
+class ResidencyManager;
+class DeferredDeletionQueue;
+class PipelineLayoutCache;
+class DescriptorSetCache;
+class AsyncComputeQueue;
+
+enum class ClusterLightType : uint32_t
+{
+	Point = 0,
+	Spot = 1
+};
+
+// One light in the std430 light buffer of Shaders/ClusteredLighting.glsl, world space
+struct ClusterLight
+{
+	glm::vec3 Position = glm::vec3(0.0f);
+	float Range = 1.0f;                  // no contribution beyond
+	glm::vec3 Color = glm::vec3(1.0f);   // linear
+	float Intensity = 1.0f;
+	glm::vec3 Direction = glm::vec3(0.0f, 0.0f, -1.0f);   // spot lights only
+	float CosOuterAngle = 0.0f;
+	float CosInnerAngle = 1.0f;
+	ClusterLightType Type = ClusterLightType::Point;
+	uint32_t Padding[2] = { 0, 0 };
+};
+
+struct ClusterGridDesc
+{
+	// Screen tiles and exponential depth slices between NearZ and FarZ, lights beyond FarZ are not binned
+	uint32_t TilesX = 16;
+	uint32_t TilesY = 9;
+	uint32_t Slices = 24;
+	float NearZ = 0.1f;
+	float FarZ = 100.0f;
+
+	uint32_t MaxLights = 4096;
+	// Entries of the shared light index list, clusters past it are cut short
+	uint32_t MaxLightIndices = 256 * 1024;
+};
+
+// ClusterParams uniform block (std140) of Shaders/ClusteredLighting.glsl
+struct ClusterShaderParams
+{
+	glm::mat4 View;
+	glm::vec4 CameraPosition;   // world space, w unused
+	glm::vec4 ScreenSize;       // width, height, 1 / width, 1 / height in pixels
+	glm::vec4 Projection;       // view x and y per unit of depth at the NDC edge, near, far
+	glm::vec4 SliceScaleBias;   // slice = log2(view depth) * x + y
+	glm::vec4 Ambient;          // linear color, w unused
+	glm::uvec4 Grid;            // tiles x, tiles y, slices, light count
+	glm::uvec4 Limits;          // max light indices, unused
+};
+
+// The cluster list as the shaders read it: per cluster (x + y * TilesX + slice * TilesX * TilesY) the
+// offset and count of its run in LightIndices
+struct ClusterBinning
+{
+	std::vector<glm::uvec2> Clusters;
+	std::vector<uint32_t> LightIndices;
+	uint32_t Dropped = 0;   // indices that did not fit in MaxLightIndices
+};
+
+/**
+ * Clustered forward shading. The view frustum is cut into a grid of froxels (screen tiles x exponential
+ * depth slices); every frame a compute pass tests each light's bounds against each cluster and writes
+ * one compact list of light indices per cluster, and the fragment shader only iterates the list of the
+ * cluster it falls in, so shading cost follows the number of lights nearby rather than in the scene.
+ *
+ * Binning runs on the async compute queue and the frame waits for it at the fragment stage. BinLights()
+ * is the CPU reference of the same tests; it also fills the lists directly when the binning shader is
+ * missing, so the renderer still lights the scene (more slowly) without it. Results only differ in the
+ * order of the runs, the GPU reserves them with an atomic.
+ */
+class ClusteredLighting
+{
+public:
+	// Falls back to CPU binning when BinningShader (SPIR-V of Shaders/ClusterLights.comp) does not exist
+	void Init(VkDevice InDevice, ResidencyManager* InResidency, DeferredDeletionQueue* InDeletionQueue, PipelineLayoutCache* Layouts,
+		DescriptorSetCache* InDescriptors, AsyncComputeQueue* InCompute, const ClusterGridDesc& InDesc, uint32_t FramesInFlight,
+		const std::string& BinningShader);
+
+	// Device must be idle
+	void Destroy();
+
+	// Writes the frame's lights and parameters and bins them, on the GPU (submitted to the async compute
+	// queue) or on the CPU. Call after the async compute queue's BeginFrame(FrameIndex). Lights past
+	// MaxLights are ignored
+	void Update(uint32_t FrameIndex, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params);
+
+	// Fills in everything but View, CameraPosition and Ambient from the grid and a perspective projection
+	static ClusterShaderParams MakeParams(const ClusterGridDesc& Desc, float FovY, float Aspect, VkExtent2D Extent, uint32_t LightCount);
+
+	// CPU reference binning
+	static ClusterBinning BinLights(const ClusterGridDesc& Desc, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params);
+
+	// View space bounds of one cluster (view space looks down -z)
+	static void GetClusterBounds(const ClusterShaderParams& Params, uint32_t X, uint32_t Y, uint32_t Slice, glm::vec3& OutMin, glm::vec3& OutMax);
+
+	static bool IntersectsCluster(const ClusterLight& Light, const glm::vec3& ViewPosition, const glm::vec3& ViewDirection, const glm::vec3& Min, const glm::vec3& Max);
+
+	// Debug: bins Lights on the GPU once in frame slot 0, reads the cluster list and light indices back and
+	// compares each cluster's lights with BinLights(). Call before the first frame, Queue must be of the
+	// async compute family. Prints a summary and returns false when a cluster differs
+	bool VerifyGpuBinning(VkQueue Queue, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params, std::ostream& Out);
+
+	bool IsGpuBinning() const { return BinningPipeline != VK_NULL_HANDLE; }
+	uint32_t GetClusterCount() const { return Desc.TilesX * Desc.TilesY * Desc.Slices; }
+
+	// Bindings for the fragment shader, per frame slot
+	VkBuffer GetParamsBuffer(uint32_t FrameIndex) const { return Frames[FrameIndex].Params.Buffer; }
+	VkBuffer GetLightBuffer(uint32_t FrameIndex) const { return Frames[FrameIndex].Lights.Buffer; }
+	VkBuffer GetClusterBuffer(uint32_t FrameIndex) const { return Frames[FrameIndex].Clusters.Buffer; }
+	VkBuffer GetLightIndexBuffer(uint32_t FrameIndex) const { return Frames[FrameIndex].LightIndices.Buffer; }
+	VkDeviceSize GetParamsSize() const { return sizeof(ClusterShaderParams); }
+	VkDeviceSize GetLightBufferSize() const { return static_cast<VkDeviceSize>(Desc.MaxLights) * sizeof(ClusterLight); }
+	VkDeviceSize GetClusterBufferSize() const { return static_cast<VkDeviceSize>(GetClusterCount()) * sizeof(glm::uvec2); }
+	VkDeviceSize GetLightIndexBufferSize() const { return static_cast<VkDeviceSize>(Desc.MaxLightIndices) * sizeof(uint32_t); }
+
+private:
+	static const uint32_t BinningGroupSize = 64;
+
+	struct MappedBuffer
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		uint8_t* Mapped = nullptr;
+		bool bCoherent = true;
+	};
+
+	struct FrameBuffers
+	{
+		MappedBuffer Params;
+		MappedBuffer Lights;
+		MappedBuffer Clusters;       // mapped only for CPU binning
+		MappedBuffer LightIndices;   // mapped only for CPU binning
+		MappedBuffer Counter;
+	};
+
+	void CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, MemoryUsage Memory, MappedBuffer& Out);
+	void DestroyBuffer(MappedBuffer& Buffer);
+	void FlushMapped(const MappedBuffer& Buffer);
+	void CreateBinningPipeline(PipelineLayoutCache* Layouts, const std::string& BinningShader);
+	// Writes the lights and parameters of the frame slot, returns the parameters as the shaders see them
+	ClusterShaderParams WriteInputs(uint32_t FrameIndex, const std::vector<ClusterLight>& Lights, const ClusterShaderParams& Params);
+	VkDescriptorSet GetBinningSet(uint32_t FrameIndex);
+	void RecordBinning(VkCommandBuffer Cmd, uint32_t FrameIndex, VkDescriptorSet Set) const;
+	void SubmitBinning(uint32_t FrameIndex);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	ResidencyManager* Residency = nullptr;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+	DescriptorSetCache* Descriptors = nullptr;
+	AsyncComputeQueue* Compute = nullptr;
+	ClusterGridDesc Desc;
+
+	VkPipelineLayout BinningLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout BinningSetLayout = VK_NULL_HANDLE;
+	VkPipeline BinningPipeline = VK_NULL_HANDLE;
+	// Params, lights, cluster list, light indices, counter, as declared by the shader
+	ReflectedBinding BinningBindings[5];
+
+	std::vector<FrameBuffers> Frames;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GpuTimeline.h"
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * Resources that may still be referenced by in-flight GPU work are retired here instead of destroyed.
+ * Each entry remembers the timeline values it has to wait for and is destroyed by Collect() once the
+ * GPU has passed them, so resizes, streaming and hot reload never need vkDeviceWaitIdle.
+ * Entries are destroyed in retire order, retire views before their images and memory last.
+ */
+class DeferredDeletionQueue
+{
+public:
+	void Init(VkDevice InDevice, GpuTimeline* InTimeline);
+
+	// Freed once everything submitted so far, on every queue, has completed
+	template<typename T>
+	void Retire(VkObjectType Type, T Handle)
+	{
+		RetireHandle(Type, (uint64_t)Handle, 0, GpuSyncPoint(), true);
+	}
+
+	// Freed once LastUse is reached, for resources whose last user is known exactly
+	template<typename T>
+	void Retire(VkObjectType Type, T Handle, const GpuSyncPoint& LastUse)
+	{
+		RetireHandle(Type, (uint64_t)Handle, 0, LastUse, false);
+	}
+
+	void RetireCommandBuffer(VkCommandPool Pool, VkCommandBuffer CommandBuffer, const GpuSyncPoint& LastUse);
+
+	// Destroys every entry the GPU is done with, cheap enough to call once per frame
+	void Collect();
+
+	// Destroys everything regardless of GPU progress, only after the device is idle (shutdown)
+	void Flush();
+
+	size_t GetPendingCount();
+
+private:
+	static const size_t QueueCount = static_cast<size_t>(QueueType::Count);
+
+	struct Entry
+	{
+		VkObjectType Type;
+		uint64_t Handle;
+		uint64_t Owner;   // pool the object was allocated from (command buffers)
+		std::array<uint64_t, QueueCount> WaitValues;
+	};
+
+	void RetireHandle(VkObjectType Type, uint64_t Handle, uint64_t Owner, const GpuSyncPoint& LastUse, bool bAllQueues);
+	bool IsComplete(const Entry& InEntry) const;
+	void DestroyEntry(const Entry& InEntry) const;
+
+	VkDevice Device = VK_NULL_HANDLE;
+	GpuTimeline* Timeline = nullptr;
+
+	std::mutex Mutex;
+	std::vector<Entry> Entries;
+};
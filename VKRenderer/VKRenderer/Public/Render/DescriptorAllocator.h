@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+class DeferredDeletionQueue;
+
+// Descriptors reserved per set in each pool, by type. Pools hold SetsPerPool sets and Ratio * SetsPerPool descriptors of each type
+struct DescriptorPoolRatio
+{
+	VkDescriptorType Type;
+	float Ratio;
+};
+
+/**
+ * Allocates descriptor sets from a growing list of pools. When a pool runs out another one (larger,
+ * up to a cap) is taken from the free list or created, so allocation never fails for lack of pool
+ * space. Sets are never freed one by one: ResetPools() recycles every set at once, which makes this
+ * suited to transient per-frame sets with one allocator per frame in flight.
+ */
+class DescriptorAllocator
+{
+public:
+	void Init(VkDevice InDevice, uint32_t InitialSetsPerPool = 64, const std::vector<DescriptorPoolRatio>& InRatios = DefaultRatios());
+
+	// Device must be idle, or at least done with every set
+	void Destroy();
+
+	VkDescriptorSet Allocate(VkDescriptorSetLayout Layout);
+
+	// Every set allocated so far becomes invalid, the GPU must be done with them
+	void ResetPools();
+
+	// Like ResetPools() without waiting, the pools are handed to the deletion queue and new ones are created on demand
+	void ReleasePools(DeferredDeletionQueue& DeletionQueue);
+
+	uint32_t GetPoolCount() const { return static_cast<uint32_t>(UsedPools.size() + FreePools.size()); }
+
+	static std::vector<DescriptorPoolRatio> DefaultRatios();
+
+private:
+	VkDescriptorPool AcquirePool();
+
+	VkDevice Device = VK_NULL_HANDLE;
+	std::vector<DescriptorPoolRatio> Ratios;
+	uint32_t SetsPerPool = 0;
+
+	VkDescriptorPool CurrentPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> UsedPools;   // includes CurrentPool
+	std::vector<VkDescriptorPool> FreePools;
+};
+
+// The contents of a descriptor set, also the key sets are cached by
+struct DescriptorWrites
+{
+	struct Write
+	{
+		uint32_t Binding;
+		VkDescriptorType Type;
+		VkDescriptorBufferInfo Buffer;
+		VkDescriptorImageInfo Image;
+	};
+
+	DescriptorWrites& AddBuffer(uint32_t Binding, VkDescriptorType Type, VkBuffer Buffer, VkDeviceSize Offset, VkDeviceSize Range);
+	DescriptorWrites& AddImage(uint32_t Binding, VkDescriptorType Type, VkImageView View, VkSampler Sampler, VkImageLayout Layout);
+
+	void Apply(VkDevice Device, VkDescriptorSet Set) const;
+
+	uint64_t Hash(VkDescriptorSetLayout Layout) const;
+	bool operator==(const DescriptorWrites& Other) const;
+
+	std::vector<Write> Writes;
+};
+
+/**
+ * Sets whose contents never change after they are written (material textures, per-image uniform
+ * buffers) are created once per distinct layout + writes and shared. Lookup is a hash of the writes,
+ * so asking for a set every frame costs no allocation and no vkUpdateDescriptorSets. A cached set
+ * holds on to the handles it was written with: Clear() when a referenced resource is destroyed.
+ */
+class DescriptorSetCache
+{
+public:
+	void Init(VkDevice InDevice);
+
+	void Destroy();
+
+	VkDescriptorSet Get(VkDescriptorSetLayout Layout, const DescriptorWrites& Writes);
+
+	// Forgets every set, their pools are retired once in-flight frames are done with them
+	void Clear(DeferredDeletionQueue& DeletionQueue);
+
+	uint32_t GetSetCount() const { return static_cast<uint32_t>(Sets.size()); }
+
+private:
+	struct CachedSet
+	{
+		VkDescriptorSetLayout Layout;
+		DescriptorWrites Writes;
+		VkDescriptorSet Set;
+	};
+
+	VkDevice Device = VK_NULL_HANDLE;
+	DescriptorAllocator Allocator;
+	std::unordered_multimap<uint64_t, CachedSet> Sets;
+};
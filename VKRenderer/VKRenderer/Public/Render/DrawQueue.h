@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+class JobSystem;
+
+/**
+ * 64-bit draw sort key, most significant field first so sorting groups draws by pass, then pipeline,
+ * then material (descriptor set), then depth:
+ *   [63..60] pass   [59..44] pipeline   [43..24] material   [23..0] depth bucket
+ */
+namespace DrawSortKey
+{
+	const uint32_t PassBits = 4;
+	const uint32_t PipelineBits = 16;
+	const uint32_t MaterialBits = 20;
+	const uint32_t DepthBits = 24;
+
+	const uint32_t DepthShift = 0;
+	const uint32_t MaterialShift = DepthShift + DepthBits;
+	const uint32_t PipelineShift = MaterialShift + MaterialBits;
+	const uint32_t PassShift = PipelineShift + PipelineBits;
+
+	inline uint64_t Make(uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t DepthBucket)
+	{
+		return (uint64_t(Pass & ((1u << PassBits) - 1)) << PassShift) |
+			(uint64_t(Pipeline & ((1u << PipelineBits) - 1)) << PipelineShift) |
+			(uint64_t(Material & ((1u << MaterialBits) - 1)) << MaterialShift) |
+			(uint64_t(DepthBucket & ((1u << DepthBits) - 1)) << DepthShift);
+	}
+
+	inline uint32_t GetPass(uint64_t Key) { return static_cast<uint32_t>(Key >> PassShift); }
+
+	// Front to back for opaque (early depth rejection), back to front for blended draws
+	uint32_t MakeDepthBucket(float ViewDistance, float MaxDistance, bool bBackToFront);
+}
+
+struct DrawCommand
+{
+	VkPipeline Pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+
+	VkBuffer VertexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize VertexBufferOffset = 0;
+	VkBuffer IndexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize IndexBufferOffset = 0;
+	VkIndexType IndexType = VK_INDEX_TYPE_UINT16;
+
+	uint32_t IndexCount = 0;
+	uint32_t InstanceCount = 1;
+	uint32_t FirstIndex = 0;
+	int32_t VertexOffset = 0;
+
+	// Stages of the layout's push constant range, the data itself is passed to DrawQueue::Add()
+	VkShaderStageFlags PushConstantStages = 0;
+};
+
+struct DrawQueueStats
+{
+	uint32_t Draws = 0;
+	uint32_t PipelineBinds = 0;
+	uint32_t DescriptorSetBinds = 0;
+	uint32_t VertexBufferBinds = 0;
+	uint32_t IndexBufferBinds = 0;
+	uint32_t PushConstantUpdates = 0;
+};
+
+/**
+ * Per-frame list of draws. Draws are added in any order with a sort key, Sort() orders them with a
+ * radix sort (parallel for large queues) and Execute() records one pass worth of draws, skipping
+ * pipeline/descriptor/vertex/index binds that match what is already bound. Small per-draw data (model
+ * matrix, material index) travels as push constants, recorded with the draw instead of written to a buffer.
+ */
+class DrawQueue
+{
+public:
+	// Large sorts are split into jobs, without a job system everything runs on the calling thread
+	void SetJobSystem(JobSystem* InJobs) { Jobs = InJobs; }
+
+	void Reset();
+
+	// PushData (at offset 0 of the layout's range) is copied, it does not have to outlive the call
+	void Add(uint64_t Key, const DrawCommand& Command, const void* PushData = nullptr, uint32_t PushSize = 0);
+
+	void Sort();
+
+	// Records every draw whose key has this pass id, the render pass must already be begun
+	void Execute(VkCommandBuffer CommandBuffer, uint32_t Pass);
+
+	size_t GetDrawCount() const { return Commands.size(); }
+
+	// Accumulated over every Execute() since the last Reset()
+	const DrawQueueStats& GetStats() const { return Stats; }
+
+private:
+	struct SortItem
+	{
+		uint64_t Key;
+		uint32_t Index;
+	};
+
+	// Stable LSD radix sort on the key, 8 bits per pass, passes where every key has the same digit are skipped
+	void RadixSort(std::vector<SortItem>& InOutItems, std::vector<SortItem>& InScratch);
+	void ForEachWorker(uint32_t WorkerCount, const std::function<void(uint32_t)>& Function);
+
+	struct PushConstantRef
+	{
+		uint32_t Offset;   // into PushConstantData
+		uint32_t Size;
+	};
+
+	std::vector<DrawCommand> Commands;
+	std::vector<PushConstantRef> PushConstants;   // parallel to Commands
+	std::vector<uint8_t> PushConstantData;
+	std::vector<SortItem> Items;
+	std::vector<SortItem> Scratch;
+
+	JobSystem* Jobs = nullptr;
+	bool bSorted = true;
+	DrawQueueStats Stats;
+};
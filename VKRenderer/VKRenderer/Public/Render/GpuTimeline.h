@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+enum class QueueType : uint8_t
+{
+	Graphics,
+	Transfer,
+	Compute,
+	Count
+};
+
+// A point on the GPU timeline: reached once the queue's timeline semaphore is >= Value
+struct GpuSyncPoint
+{
+	QueueType Queue = QueueType::Graphics;
+	uint64_t Value = 0;   // 0 is always complete
+
+	bool IsValid() const { return Value != 0; }
+};
+
+struct TimelineSubmitInfo
+{
+	std::vector<VkCommandBuffer> CommandBuffers;
+
+	// Other queues' timeline points this submission waits for
+	std::vector<GpuSyncPoint> WaitPoints;
+	std::vector<VkPipelineStageFlags> WaitPointStages;
+
+	// Binary semaphores, still needed for the swap chain (acquire / present)
+	std::vector<VkSemaphore> WaitBinarySemaphores;
+	std::vector<VkPipelineStageFlags> WaitBinaryStages;
+	std::vector<VkSemaphore> SignalBinarySemaphores;
+};
+
+/**
+ * GPU progress tracking with timeline semaphores (Vulkan 1.2 core). Every queue type owns one
+ * timeline semaphore, and signal values come from one monotonically increasing counter shared by
+ * all queues. Anything that has to know "is the GPU done with X" (deferred deletion, staging reuse,
+ * readbacks, frame pacing) keeps the GpuSyncPoint returned by Submit() instead of a fence.
+ */
+class GpuTimeline
+{
+public:
+	void Init(VkDevice InDevice);
+	void Destroy();
+
+	// Submits to Queue and signals the next timeline value of that queue type, thread safe
+	GpuSyncPoint Submit(VkQueue Queue, QueueType Type, const TimelineSubmitInfo& Info);
+
+	VkSemaphore GetSemaphore(QueueType Type) const { return Semaphores[static_cast<size_t>(Type)]; }
+
+	// Last value handed out for this queue, i.e. "everything submitted so far"
+	GpuSyncPoint GetLastSubmitted(QueueType Type) const;
+
+	uint64_t GetCompletedValue(QueueType Type);
+
+	bool IsComplete(const GpuSyncPoint& Point);
+
+	void Wait(const GpuSyncPoint& Point);
+
+	// Waits for everything submitted so far on every queue
+	void WaitAll();
+
+private:
+	static const size_t QueueCount = static_cast<size_t>(QueueType::Count);
+
+	VkDevice Device = VK_NULL_HANDLE;
+
+	std::array<VkSemaphore, QueueCount> Semaphores{};
+	std::array<std::atomic<uint64_t>, QueueCount> LastSubmitted{};
+	std::array<std::atomic<uint64_t>, QueueCount> CompletedCache{};
+
+	// Allocating a value and submitting it must be atomic, or values could reach a queue out of order.
+	// One lock for all queues, several queue types may map to the same VkQueue
+	std::mutex SubmitMutex;
+
+	std::atomic<uint64_t> Counter{ 0 };
+};
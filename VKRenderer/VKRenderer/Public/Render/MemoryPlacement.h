@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+
+// What a resource is used for, the policy maps this to a memory type for the current device
+enum class MemoryUsage : uint8_t
+{
+	GpuOnly,     // written once or rarely (static geometry, textures), read by the GPU every frame
+	CpuToGpu,    // rewritten by the CPU every frame (uniforms, dynamic vertices)
+	GpuToCpu,    // written by the GPU, read back by the CPU
+	Staging      // upload source, only read by transfer
+};
+
+struct MemoryPlacement
+{
+	uint32_t TypeIndex = UINT32_MAX;
+	uint32_t HeapIndex = UINT32_MAX;
+	VkMemoryPropertyFlags Properties = 0;
+
+	bool IsValid() const { return TypeIndex != UINT32_MAX; }
+	bool IsHostVisible() const { return (Properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0; }
+	bool IsDeviceLocal() const { return (Properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0; }
+};
+
+/**
+ * Picks memory types from the device's heaps instead of hard coded property flags.
+ * On integrated GPUs (every heap is device local) and with resizable BAR (a host visible device local
+ * heap larger than the legacy 256MB window) GPU resources are placed in memory the CPU can write directly,
+ * so static data skips the staging copy. Elsewhere they go to plain DEVICE_LOCAL memory and are uploaded.
+ */
+class MemoryPlacementPolicy
+{
+public:
+	void Init(VkPhysicalDevice InPhysicalDevice);
+
+	// TypeFilter is VkMemoryRequirements::memoryTypeBits, throws if no type fits at all
+	MemoryPlacement Choose(MemoryUsage Usage, uint32_t TypeFilter) const;
+
+	const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return MemProperties; }
+
+	bool IsUnifiedMemory() const { return bUnifiedMemory; }
+	bool HasResizableBar() const { return bResizableBar; }
+
+	// Whether GpuOnly resources end up host visible, i.e. can be filled without a staging copy
+	bool CanWriteDeviceLocalDirectly() const { return bUnifiedMemory || bResizableBar; }
+
+private:
+	int32_t FindType(uint32_t TypeFilter, VkMemoryPropertyFlags Required, VkMemoryPropertyFlags Preferred, VkMemoryPropertyFlags Avoided) const;
+
+	VkPhysicalDeviceMemoryProperties MemProperties{};
+	bool bUnifiedMemory = false;
+	bool bResizableBar = false;
+};
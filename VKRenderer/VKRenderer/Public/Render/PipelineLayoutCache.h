@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ShaderReflection.h"
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+// A pipeline layout generated from reflection, with the set layouts it is built from
+struct ReflectedPipelineLayout
+{
+	VkPipelineLayout Layout = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSetLayout> SetLayouts;   // indexed by set number, unused sets get an empty layout
+	ShaderReflection Reflection;                     // merged over every stage
+};
+
+/**
+ * Builds descriptor set layouts and pipeline layouts from the shaders' own declarations instead of
+ * hand-written bindings. Identical set layouts and pipeline layouts are created once and shared, so
+ * pipelines whose shaders declare the same interface get the same VkPipelineLayout and descriptor sets
+ * stay bound across pipeline switches. Samplers can be baked into the set layouts as immutable samplers,
+ * by binding name; descriptor writes to those bindings then only carry the image view. Everything lives
+ * until Destroy().
+ */
+class PipelineLayoutCache
+{
+public:
+	void Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice);
+
+	void Destroy();
+
+	// Reflects the SPIR-V files (one per stage) and returns the shared layout for their combined interface.
+	// ImmutableSamplers maps sampler and combined image sampler bindings, by name, to the sampler every
+	// element of the binding uses. The samplers must outlive the cache (SamplerCache handles do)
+	ReflectedPipelineLayout GetLayout(const std::vector<std::string>& ShaderFiles,
+		const std::unordered_map<std::string, VkSampler>& ImmutableSamplers = std::unordered_map<std::string, VkSampler>());
+
+	// pImmutableSamplers is copied, it only has to stay valid for the call
+	VkDescriptorSetLayout GetSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& Bindings);
+
+	uint32_t GetSetLayoutCount() const { return static_cast<uint32_t>(SetLayouts.size()); }
+	uint32_t GetPipelineLayoutCount() const { return static_cast<uint32_t>(PipelineLayouts.size()); }
+
+private:
+	struct SetLayoutEntry
+	{
+		std::vector<VkDescriptorSetLayoutBinding> Bindings;   // pImmutableSamplers cleared, see Samplers
+		std::vector<std::vector<VkSampler>> Samplers;          // per binding, empty without immutable samplers
+		VkDescriptorSetLayout Layout;
+	};
+
+	struct PipelineLayoutEntry
+	{
+		std::vector<VkDescriptorSetLayout> SetLayouts;
+		std::vector<VkPushConstantRange> PushConstants;
+		VkPipelineLayout Layout;
+	};
+
+	VkDescriptorSetLayout FindOrCreateSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& Bindings);
+	VkPipelineLayout FindOrCreatePipelineLayout(const std::vector<VkDescriptorSetLayout>& InSetLayouts, const std::vector<VkPushConstantRange>& PushConstants);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	uint32_t MaxPushConstantsSize = 128;
+
+	std::mutex Mutex;
+	std::vector<SetLayoutEntry> SetLayouts;
+	std::vector<PipelineLayoutEntry> PipelineLayouts;
+};
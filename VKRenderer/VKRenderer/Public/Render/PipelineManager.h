@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "../Core/JobSystem.h"
+
+// Attachment formats and sample count, pipelines built against one render pass work with any compatible one
+struct RenderPassCompatibility
+{
+	std::vector<VkFormat> ColorFormats;
+	VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+	VkSampleCountFlagBits Samples = VK_SAMPLE_COUNT_1_BIT;
+	uint32_t Subpass = 0;
+};
+
+/**
+ * Everything a graphics pipeline is built from. Viewport and scissor are always dynamic so a resize
+ * never invalidates a pipeline. RenderPass and Layout are what the pipeline is created with, the render
+ * pass is identified by Compatibility (the handle changes every swap chain recreation).
+ */
+struct GraphicsPipelineDesc
+{
+	std::string VertexShader;     // SPIR-V file
+	std::string FragmentShader;   // empty for depth only pipelines
+
+	std::vector<VkVertexInputBindingDescription> VertexBindings;
+	std::vector<VkVertexInputAttributeDescription> VertexAttributes;
+	VkPrimitiveTopology Topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPolygonMode PolygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags CullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace FrontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	bool bDepthTest = true;
+	bool bDepthWrite = true;
+	VkCompareOp DepthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;   // reverse-Z
+
+	// Depth bias is on when either is non-zero (shadow casters), negative pushes away with reverse-Z
+	float DepthBiasConstant = 0.0f;
+	float DepthBiasSlope = 0.0f;
+
+	bool bAlphaBlend = false;
+
+	RenderPassCompatibility Compatibility;
+	VkRenderPass RenderPass = VK_NULL_HANDLE;
+	VkPipelineLayout Layout = VK_NULL_HANDLE;
+
+	uint64_t Hash() const;
+	bool operator==(const GraphicsPipelineDesc& Other) const;
+};
+
+class DeferredDeletionQueue;
+
+typedef uint32_t PipelineId;
+const PipelineId InvalidPipelineId = UINT32_MAX;
+
+enum class PipelineCompileMode : uint8_t
+{
+	Background,   // returns immediately, Get() yields the fallback (or nothing) until it is compiled
+	Blocking      // compiled on the calling thread before Register() returns
+};
+
+/**
+ * Owns every graphics pipeline. Register() deduplicates descriptions by hash and hands out a small,
+ * stable id (also used as the pipeline field of draw sort keys); unseen descriptions are compiled as
+ * jobs through a shared VkPipelineCache that is persisted across runs. Get() never blocks:
+ * while a pipeline is compiling it returns the fallback's pipeline, or VK_NULL_HANDLE meaning skip the draw.
+ */
+class PipelineManager
+{
+public:
+	// At most MaxConcurrentCompiles jobs compile at once, a burst of compiles must not starve the frame's jobs.
+	// Compiles are background jobs, a thread waiting on frame work never picks one up
+	void Init(VkDevice InDevice, const std::string& InCacheFile, JobSystem* InJobs, uint32_t InMaxConcurrentCompiles);
+
+	// Waits for in-flight compiles, saves the pipeline cache and destroys every pipeline
+	void Destroy();
+
+	PipelineId Register(const GraphicsPipelineDesc& Desc, PipelineCompileMode Mode = PipelineCompileMode::Background);
+
+	VkPipeline Get(PipelineId Id, PipelineId Fallback = InvalidPipelineId);
+
+	bool IsReady(PipelineId Id);
+
+	// Rebuilds every pipeline using this SPIR-V file in the background, the current pipelines stay in use meanwhile
+	void ReloadShader(const std::string& ShaderFile);
+
+	// Swaps in rebuilt pipelines and retires the replaced ones, call at a frame boundary before recording
+	void ApplyReloads(DeferredDeletionQueue& DeletionQueue);
+
+	uint32_t GetPendingCount() const { return PendingCount.load(); }
+
+private:
+	struct Entry
+	{
+		GraphicsPipelineDesc Desc;
+		uint64_t Hash = 0;
+		std::atomic<VkPipeline> Pipeline{ VK_NULL_HANDLE };
+		std::atomic<VkPipeline> ReloadedPipeline{ VK_NULL_HANDLE };   // built by a reload, not yet swapped in
+	};
+
+	struct CompileJob
+	{
+		PipelineId Id;
+		bool bReload;
+	};
+
+	void QueueCompile(PipelineId Id, bool bReload);
+	void StartCompiles();
+	void Compile(const CompileJob& Job);
+	VkPipeline CreatePipeline(const Entry& InEntry);
+	VkShaderModule LoadShaderModule(const std::string& FileName);
+	void LoadCache();
+	void SaveCache();
+
+	VkDevice Device = VK_NULL_HANDLE;
+	VkPipelineCache PipelineCache = VK_NULL_HANDLE;
+	std::string CacheFile;
+
+	std::mutex EntriesMutex;
+	std::deque<std::unique_ptr<Entry>> Entries;   // indexed by PipelineId
+	std::unordered_multimap<uint64_t, PipelineId> EntriesByHash;
+
+	JobSystem* Jobs = nullptr;
+	JobCounter RunningJobs;
+	uint32_t MaxConcurrentCompiles = 1;
+
+	std::mutex QueueMutex;
+	std::deque<CompileJob> CompileQueue;   // waiting for a compile slot
+	uint32_t RunningCompiles = 0;
+	std::atomic<uint32_t> PendingCount{ 0 };
+	std::atomic<uint32_t> ReadyReloads{ 0 };
+	bool bShuttingDown = false;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+// How a pass touches a resource, every usage maps to one fixed (stage, access, layout) triple
+enum class ResourceUsage : uint8_t
+{
+	Undefined,
+	ColorAttachment,
+	DepthStencilAttachment,
+	DepthStencilRead,
+	ShaderRead,
+	ComputeRead,
+	ComputeWrite,
+	TransferSrc,
+	TransferDst,
+	Present
+};
+
+struct ResourceState
+{
+	VkPipelineStageFlags Stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkAccessFlags Access = 0;
+	VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+ResourceState GetResourceState(ResourceUsage Usage);
+
+bool IsWriteUsage(ResourceUsage Usage);
+
+// The stage/access an image in this layout is normally consumed by, used for one-off transitions outside the graph
+ResourceState GetLayoutState(VkImageLayout Layout);
+
+VkImageAspectFlags GetImageAspectMask(VkFormat Format);
+
+class DeferredDeletionQueue;
+
+typedef uint32_t RenderGraphHandle;
+const RenderGraphHandle InvalidRenderGraphHandle = UINT32_MAX;
+
+struct RenderGraphImageDesc
+{
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+	VkExtent2D Extent = { 0, 0 };
+	VkSampleCountFlagBits Samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+class RenderGraphPassBuilder
+{
+public:
+	void Read(RenderGraphHandle Resource, ResourceUsage Usage);
+	void Write(RenderGraphHandle Resource, ResourceUsage Usage);
+
+	// Pass is kept even if nothing reads its outputs (e.g. readbacks, queries)
+	void SetSideEffect() { bSideEffect = true; }
+
+private:
+	friend class RenderGraph;
+
+	struct Access
+	{
+		RenderGraphHandle Resource;
+		ResourceUsage Usage;
+	};
+
+	std::vector<Access> Accesses;
+	bool bSideEffect = false;
+};
+
+struct RenderGraphMemoryStats
+{
+	VkDeviceSize RequestedBytes = 0;   // sum of all transient image sizes
+	VkDeviceSize AllocatedBytes = 0;   // what is actually allocated after aliasing
+	uint32_t LazilyAllocatedImages = 0;
+};
+
+/**
+ * Frame render graph. Passes declare the resources they read and write, Compile() culls passes that
+ * do not contribute to an output, orders the rest and precomputes one batched barrier per pass.
+ * Transient images are created by the graph; imported ones (swap chain) are rebound before Execute().
+ *
+ * Transient images whose lifetimes (in execution order) do not overlap share the same memory block.
+ * An attachment touched by a single pass is created with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT and
+ * lazily allocated memory when the device has it, that pass must not store it (storeOp DONT_CARE).
+ */
+class RenderGraph
+{
+public:
+	typedef std::function<void(RenderGraphPassBuilder&)> SetupFunction;
+	typedef std::function<void(VkCommandBuffer)> ExecuteFunction;
+
+	// With a deletion queue, transient resources are retired instead of destroyed so Reset() never has to wait for the GPU
+	void Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, DeferredDeletionQueue* InDeletionQueue = nullptr);
+
+	// Releases transient resources and forgets all passes, call before rebuilding the graph
+	void Reset();
+
+	RenderGraphHandle ImportImage(const std::string& Name, const RenderGraphImageDesc& Desc, const ResourceState& InitialState, const ResourceState& FinalState);
+
+	RenderGraphHandle ImportBuffer(const std::string& Name, VkBuffer Buffer, VkDeviceSize Size, const ResourceState& InitialState);
+
+	// Image owned by the graph, allocated on Compile and only valid while executing passes
+	RenderGraphHandle CreateImage(const std::string& Name, const RenderGraphImageDesc& Desc);
+
+	void AddPass(const std::string& Name, const SetupFunction& Setup, const ExecuteFunction& Execute);
+
+	void Compile();
+
+	void BindImportedImage(RenderGraphHandle Handle, VkImage Image, VkImageView View);
+
+	void Execute(VkCommandBuffer CommandBuffer);
+
+	VkImage GetImage(RenderGraphHandle Handle) const { return Resources[Handle].Image; }
+	VkImageView GetImageView(RenderGraphHandle Handle) const { return Resources[Handle].View; }
+	VkBuffer GetBuffer(RenderGraphHandle Handle) const { return Resources[Handle].Buffer; }
+	const RenderGraphImageDesc& GetImageDesc(RenderGraphHandle Handle) const { return Resources[Handle].Desc; }
+
+	bool IsPassCulled(const std::string& Name) const;
+
+	bool IsLazilyAllocated(RenderGraphHandle Handle) const { return Resources[Handle].bLazilyAllocated; }
+
+	const RenderGraphMemoryStats& GetMemoryStats() const { return MemoryStats; }
+
+private:
+	struct Resource
+	{
+		std::string Name;
+		bool bImage = true;
+		bool bImported = false;
+		RenderGraphImageDesc Desc;
+		ResourceState InitialState;
+		ResourceState FinalState;
+
+		VkImageUsageFlags ImageUsage = 0;
+
+		// Lifetime in execution order, and how the last pass touched it (needed to alias the memory afterwards)
+		uint32_t FirstUse = UINT32_MAX;
+		uint32_t LastUse = 0;
+		uint32_t UseCount = 0;
+		bool bAttachmentOnly = true;
+		VkPipelineStageFlags LastUseStages = 0;
+		VkAccessFlags LastUseWriteAccess = 0;
+		bool bLazilyAllocated = false;
+
+		VkImage Image = VK_NULL_HANDLE;
+		VkImageView View = VK_NULL_HANDLE;
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceSize BufferSize = 0;
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		RenderGraphPassBuilder Builder;
+		ExecuteFunction Execute;
+		bool bCulled = false;
+	};
+
+	// A barrier is stored by resource index so imported images can be rebound without recompiling
+	struct Barrier
+	{
+		RenderGraphHandle Resource;
+		ResourceState Src;
+		ResourceState Dst;
+	};
+
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags SrcStages = 0;
+		VkPipelineStageFlags DstStages = 0;
+		std::vector<Barrier> Barriers;
+	};
+
+	void CullPasses();
+	void SortPasses();
+	void ComputeLifetimes();
+	void CreateTransientResources();
+	void BuildBarriers();
+	void EmitBarriers(VkCommandBuffer CommandBuffer, const BarrierBatch& Batch) const;
+	bool FindMemoryType(uint32_t TypeFilter, VkMemoryPropertyFlags Properties, uint32_t& OutTypeIndex) const;
+
+	VkDevice Device = VK_NULL_HANDLE;
+	VkPhysicalDevice PhysicDevice = VK_NULL_HANDLE;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+
+	std::vector<Resource> Resources;
+	std::vector<Pass> Passes;
+
+	// Execution order after culling, and the barriers issued before each of those passes
+	std::vector<uint32_t> PassOrder;
+	std::vector<BarrierBatch> PassBarriers;
+	BarrierBatch FinalBarriers;
+
+	// Memory blocks backing transient images, several images may be bound to one block
+	std::vector<VkDeviceMemory> TransientMemory;
+	RenderGraphMemoryStats MemoryStats;
+
+	bool bCompiled = false;
+};
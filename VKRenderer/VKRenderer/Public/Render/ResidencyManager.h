@@ -0,0 +1,202 @@
+#pragma once
+
+#include "MemoryPlacement.h"
+#include "GpuTimeline.h"
+#include "UploadContext.h"
+#include "../Core/JobSystem.h"
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <ostream>
+#include <algorithm>
+#include <cstdint>
+
+class DeferredDeletionQueue;
+
+struct ResidencyBudget
+{
+	// Hard cap per device local heap for this instance, 0 leaves only the driver budget. Several renderers
+	// sharing a GPU each get their own
+	VkDeviceSize DeviceLocalLimit = 0;
+	// Share of the driver budget (VK_EXT_memory_budget, else the heap size) this instance plans with
+	float BudgetFraction = 0.9f;
+	// Kept free below the limit for the smaller copies trimmed textures are rebuilt into
+	VkDeviceSize TrimHeadroom = 32ull * 1024 * 1024;
+	// A texture wanted at a coarser mip than resident for this long is trimmed even without pressure
+	uint32_t TrimDelayFrames = 120;
+	// Textures that start streaming in a finer mip per Update()
+	uint32_t MaxStreamInsPerFrame = 4;
+};
+
+struct MemoryHeapUsage
+{
+	VkDeviceSize Size = 0;
+	VkDeviceSize Limit = 0;       // what this instance may use, after the hard cap
+	VkDeviceSize Allocated = 0;   // live allocations made through the manager
+	VkDeviceSize Retiring = 0;    // freed, waiting for the GPU to be done with them
+	VkDeviceSize External = 0;    // reported by the driver beyond the above (swap chain, other allocators), 0 without VK_EXT_memory_budget
+	bool bDeviceLocal = false;
+
+	VkDeviceSize GetUsed() const { return Allocated + Retiring + External; }
+};
+
+// Writes level Mip of a texture, RGBA8 and max(Width >> Mip, 1) x max(Height >> Mip, 1) texels. Runs on the job system
+typedef std::function<bool(uint32_t Mip, uint8_t* OutTexels)> TextureMipLoader;
+
+struct StreamedTextureDesc
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	VkFormat Format = VK_FORMAT_R8G8B8A8_SRGB;
+	// Coarsest levels loaded by CreateTexture() and never evicted
+	uint32_t PinnedMips = 4;
+	TextureMipLoader LoadMip;
+};
+
+typedef uint32_t StreamedTextureHandle;
+
+/**
+ * Owns the memory budget. Allocations made through it are counted per heap against a limit taken from
+ * VK_EXT_memory_budget when the device has it (the driver's share for this process, which accounts for
+ * other processes), the heap size otherwise, and an optional hard cap; an allocation that does not fit
+ * after reclaiming what it can throws instead of oversubscribing video memory.
+ *
+ * Streamed textures keep only the mips the screen needs: RequestMip() reports the finest level wanted
+ * this frame, Update() streams one finer level in at a time while the budget allows and trims textures
+ * nobody looked at for a while. Under pressure the least recently requested textures lose their finest
+ * levels first. A level change builds a new image (copying the kept levels on the GPU, loading the new
+ * ones on the job system) and swaps it in once the copies have completed, so GetView() changes then.
+ */
+class ResidencyManager
+{
+public:
+	void Init(VkPhysicalDevice InPhysicalDevice, VkDevice InDevice, const MemoryPlacementPolicy* InMemoryPolicy, GpuTimeline* InTimeline,
+		UploadContext* InUploader, DeferredDeletionQueue* InDeletionQueue, JobSystem* InJobs, bool bInMemoryBudgetExtension,
+		const ResidencyBudget& InBudget = ResidencyBudget());
+
+	// Destroys the streamed textures right away, the device must be idle
+	void Destroy();
+
+	// Thread safe. Throws when the heap has no room left even after trimming streamed textures. Only the thread
+	// that calls Update() waits for the GPU to give trimmed memory back, other threads leave the trims to Update()
+	VkDeviceMemory Allocate(const VkMemoryRequirements& Requirements, MemoryUsage Usage, MemoryPlacement* OutPlacement = nullptr);
+
+	// Thread safe. Retired through the deletion queue, still counted until the GPU is done with it
+	void Free(VkDeviceMemory Memory);
+
+	// Loads the pinned mips before returning, the copies are recorded on the uploader
+	StreamedTextureHandle CreateTexture(const StreamedTextureDesc& Desc);
+	void DestroyTexture(StreamedTextureHandle Handle);
+
+	// Finest level the texture is seen at this frame, e.g. from GetScreenSpaceMip(). Several calls keep the finest
+	void RequestMip(StreamedTextureHandle Handle, float Mip);
+
+	// Level at which TexelsAcross texels cover PixelsAcross pixels on screen
+	static float GetScreenSpaceMip(uint32_t TexelsAcross, float PixelsAcross);
+
+	// Levels cut from an RGBA8 image held in memory, the chain is built up front
+	static TextureMipLoader CreateImageSource(std::vector<uint8_t> Pixels, uint32_t Width, uint32_t Height);
+
+	// Once per frame: refreshes the budget, swaps in finished images and starts new level changes
+	void Update();
+
+	// Covers mips from GetResidentMip() down, in SHADER_READ_ONLY_OPTIMAL
+	VkImageView GetView(StreamedTextureHandle Handle) const;
+	uint32_t GetResidentMip(StreamedTextureHandle Handle) const;
+
+	bool HasMemoryBudgetExtension() const { return bMemoryBudgetExtension; }
+	std::vector<MemoryHeapUsage> GetHeapUsage();
+	void PrintHeapUsage(std::ostream& Out);
+
+private:
+	struct Allocation
+	{
+		uint32_t Heap;
+		VkDeviceSize Size;
+	};
+
+	struct RetiringAllocation
+	{
+		uint32_t Heap;
+		VkDeviceSize Size;
+		std::array<GpuSyncPoint, static_cast<size_t>(QueueType::Count)> LastUse;
+	};
+
+	// One image with the levels from ResidentMip down
+	struct TextureImage
+	{
+		VkImage Image = VK_NULL_HANDLE;
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VkImageView View = VK_NULL_HANDLE;
+		uint32_t ResidentMip = 0;
+	};
+
+	struct StreamedTexture
+	{
+		StreamedTextureDesc Desc;
+		uint32_t MipCount = 0;
+		TextureImage Current;
+
+		// Level change in progress: loads of the levels Current lacks, then copies, then the swap
+		TextureImage Next;
+		std::vector<StagingReservation> NextLoads;
+		std::vector<uint8_t> NextLoaded;
+		std::unique_ptr<JobCounter> NextLoadJobs;
+		GpuSyncPoint NextReady;
+		bool bNextRecorded = false;
+
+		float RequestedMip = 0.0f;      // finest request since the last Update()
+		uint32_t WantedMip = 0;
+		uint64_t LastRequested = 0;
+		uint64_t CoarserSince = 0;      // first frame WantedMip was coarser than resident
+		uint32_t FinestLoadable = 0;    // raised when the loader fails a level
+	};
+
+	uint32_t GetCoarsestResident(const StreamedTexture& Texture) const { return Texture.MipCount - std::min(Texture.Desc.PinnedMips, Texture.MipCount); }
+	VkDeviceSize GetLimit(uint32_t Heap, bool bMayUseHeadroom) const;
+
+	VkDeviceMemory AllocateLocked(const VkMemoryRequirements& Requirements, MemoryUsage Usage, bool bMayUseHeadroom, MemoryPlacement* OutPlacement);
+	void FreeLocked(VkDeviceMemory Memory);
+	void RefreshBudget();
+	void CollectRetired();
+	VkExtent3D GetMipExtent(const StreamedTexture& Texture, uint32_t Mip) const;
+	bool CreateImage(const StreamedTexture& Texture, uint32_t ResidentMip, bool bMayUseHeadroom, TextureImage& Out);
+	void DestroyImageNow(TextureImage& Image);
+	void RetireImage(TextureImage& Image);
+
+	bool IsChangingLevel(const StreamedTexture& Texture) const { return Texture.Next.Image != VK_NULL_HANDLE; }
+	uint32_t GetHeap(VkDeviceMemory Memory) const;
+	VkDeviceSize GetSize(VkDeviceMemory Memory) const;
+	bool BeginLevelChange(StreamedTexture& Texture, uint32_t NewMip, bool bMayUseHeadroom);
+	void RecordLevelChange(StreamedTexture& Texture);
+	void CancelLevelChange(StreamedTexture& Texture);
+	void TrimLeastRecentlyUsed(uint32_t Heap, VkDeviceSize Bytes);
+	void ReclaimLocked(uint32_t Heap, VkDeviceSize Bytes);
+	void FlushLevelChanges(const std::vector<StreamedTexture*>& Recorded);
+
+	VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
+	VkDevice Device = VK_NULL_HANDLE;
+	const MemoryPlacementPolicy* MemoryPolicy = nullptr;
+	GpuTimeline* Timeline = nullptr;
+	UploadContext* Uploader = nullptr;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+	JobSystem* Jobs = nullptr;
+	std::thread::id MainThread;   // the only thread that may block on the GPU
+	bool bMemoryBudgetExtension = false;
+	ResidencyBudget Budget;
+
+	mutable std::mutex Mutex;
+	std::vector<MemoryHeapUsage> Heaps;
+	std::vector<VkDeviceSize> DriverBudgets;
+	std::unordered_map<VkDeviceMemory, Allocation> Allocations;
+	std::vector<RetiringAllocation> Retiring;
+
+	std::vector<std::unique_ptr<StreamedTexture>> Textures;   // null where a texture was destroyed
+	uint64_t FrameNumber = 1;   // 0 marks "never" in the per texture frame stamps
+};
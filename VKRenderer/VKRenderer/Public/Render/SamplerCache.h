@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * One VkSampler per distinct sampler state, shared by everything that asks for it. Devices may cap
+ * the number of live samplers as low as 4000 (maxSamplerAllocationCount) while a scene easily has more
+ * textures than that; with the state as key they only ever need a handful. Fields that do not affect
+ * sampling (max anisotropy with anisotropy off, compare op with compare off, border color without a
+ * border address mode) are normalized first so they do not split entries, and anisotropy is clamped to
+ * what the device supports. The handles are stable, which makes them fit for immutable samplers in
+ * descriptor set layouts (PipelineLayoutCache::GetLayout()). Everything lives until Destroy().
+ */
+class SamplerCache
+{
+public:
+	// bAnisotropyEnabled: whether samplerAnisotropy was enabled on the device, anisotropy is turned off otherwise
+	void Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, bool bAnisotropyEnabled);
+
+	void Destroy();
+
+	// Thread safe. Info.pNext must be null, extension structures are not part of the key
+	VkSampler Get(const VkSamplerCreateInfo& Info);
+
+	uint32_t GetSamplerCount();
+
+private:
+	struct CachedSampler
+	{
+		VkSamplerCreateInfo Info;
+		VkSampler Sampler;
+	};
+
+	VkSamplerCreateInfo Normalize(const VkSamplerCreateInfo& Info) const;
+
+	VkDevice Device = VK_NULL_HANDLE;
+	float MaxAnisotropy = 1.0f;
+	uint32_t MaxSamplers = 4000;
+
+	std::mutex Mutex;
+	std::unordered_multimap<uint64_t, CachedSampler> Samplers;
+};
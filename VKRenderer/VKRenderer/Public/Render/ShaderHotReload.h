@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+
+class PipelineManager;
+
+/**
+ * Watches GLSL sources and recompiles them to SPIR-V with glslc (run as a child process) when they
+ * change, then asks the pipeline manager to rebuild every pipeline using the output. Rebuilds happen on
+ * the pipeline workers, PipelineManager::ApplyReloads() swaps them in at a frame boundary. A shader that
+ * fails to compile keeps its last good SPIR-V, the compiler output is left on the console.
+ * Linux uses inotify on the source directories, other platforms poll the file times.
+ */
+class ShaderHotReload
+{
+public:
+	// Without a compiler path glslc is taken from $VULKAN_SDK, then from PATH
+	void Init(PipelineManager* InPipelines, const std::string& InCompilerPath = "");
+
+	// Defines are passed to glslc as -D<define>, one source can feed several variants
+	void AddShader(const std::string& SourceFile, const std::string& OutputFile, const std::vector<std::string>& Defines = {});
+
+	// Recompiles every output that is missing or older than its source, call before creating pipelines
+	void CompileStale();
+
+	void Start();
+
+	// Joins the watcher, call before the pipeline manager is destroyed
+	void Stop();
+
+private:
+	struct WatchedShader
+	{
+		std::filesystem::path Source;
+		std::filesystem::path Output;
+		std::vector<std::string> Defines;
+		std::filesystem::file_time_type LastWriteTime;
+	};
+
+	void WatchLoop();
+	void PollLoop();
+	void OnSourceChanged(WatchedShader& Shader);
+	bool Compile(const WatchedShader& Shader) const;
+	static std::filesystem::file_time_type GetWriteTime(const std::filesystem::path& File);
+
+	PipelineManager* Pipelines = nullptr;
+	std::string CompilerPath;
+
+	std::mutex ShadersMutex;
+	std::vector<WatchedShader> Shaders;
+
+	std::thread Watcher;
+	std::atomic<bool> bStopping{ false };
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+struct ReflectedBinding
+{
+	uint32_t Set = 0;
+	uint32_t Binding = 0;
+	VkDescriptorType DescriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uint32_t Count = 1;                 // array size, 0 for runtime sized arrays
+	VkShaderStageFlags StageFlags = 0;
+	std::string Name;                   // variable name, empty when the SPIR-V is stripped
+};
+
+struct ReflectedVertexInput
+{
+	uint32_t Location = 0;
+	VkFormat Format = VK_FORMAT_UNDEFINED;
+};
+
+/**
+ * Resource interface of one or more shader stages, read straight from the SPIR-V: descriptor bindings,
+ * push constant ranges and (for vertex shaders) the input locations. Only what layouts are built from
+ * is extracted, this is not a general purpose SPIR-V reflector.
+ */
+struct ShaderReflection
+{
+	VkShaderStageFlags Stages = 0;
+	std::vector<ReflectedBinding> Bindings;               // sorted by set, then binding
+	std::vector<VkPushConstantRange> PushConstants;
+	std::vector<ReflectedVertexInput> VertexInputs;       // sorted by location
+
+	// Parses one SPIR-V module, throws on malformed input
+	static ShaderReflection Reflect(const uint32_t* Code, size_t WordCount);
+	static ShaderReflection ReflectFile(const std::string& FileName);
+
+	// Adds another stage's interface, bindings used by both stages get both stage flags
+	void Merge(const ShaderReflection& Other);
+
+	const ReflectedBinding* FindBinding(const std::string& Name) const;
+};
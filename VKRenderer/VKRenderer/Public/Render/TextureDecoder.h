@@ -0,0 +1,79 @@
+#pragma once
+
+#include "UploadContext.h"
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <ostream>
+#include <cstdint>
+
+class JobSystem;
+class JobCounter;
+
+// One decoder library behind plain function pointers, tried in registration order
+struct ImageDecoderBackend
+{
+	const char* Name = nullptr;
+
+	// Signature check on the first bytes of the file
+	bool (*Accepts)(const uint8_t* Data, size_t Size) = nullptr;
+
+	// Dimensions only, no decoding
+	bool (*ReadInfo)(const uint8_t* Data, size_t Size, uint32_t& OutWidth, uint32_t& OutHeight) = nullptr;
+
+	// RGBA8 with tightly packed rows, Out holds exactly Width * Height * 4 bytes
+	bool (*Decode)(const uint8_t* Data, size_t Size, uint8_t* Out, size_t OutSize) = nullptr;
+};
+
+struct DecodedTexture
+{
+	VkImage Image = VK_NULL_HANDLE;
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	const char* Backend = nullptr;
+	std::string Error;   // empty on success
+};
+
+// Creates the device local image a decoded texture is copied into, called from decode jobs
+typedef std::function<void(uint32_t Width, uint32_t Height, VkFormat Format, VkImage& OutImage, VkDeviceMemory& OutMemory)> TextureImageAllocator;
+
+/**
+ * Decodes image files on the job system, any number at once. A decode job reads the header, reserves
+ * staging memory for the whole RGBA8 image and decodes straight into it, so there is no intermediate
+ * pixel buffer and no second copy when the backend writes into caller memory (libspng for PNG,
+ * libjpeg-turbo for JPEG, compiled in when their headers are found). stb_image is the fallback for
+ * everything else and still copies.
+ */
+class TextureDecoder
+{
+public:
+	void Init(JobSystem* InJobs, UploadContext* InUploader, TextureImageAllocator InAllocateImage);
+
+	// Out is filled by the job and valid once Done is. The copy is recorded on the uploader, the image is
+	// in SHADER_READ_ONLY_OPTIMAL once that batch has been flushed. Format must be an RGBA8 format
+	void Load(const std::string& File, VkFormat Format, DecodedTexture& Out, JobCounter& Done);
+
+	// Registered backends come before the built in ones. Register before the first decode
+	static void RegisterBackend(const ImageDecoderBackend& Backend);
+	static const std::vector<ImageDecoderBackend>& GetBackends();
+
+	// First backend accepting the data, stb accepts anything it might decode
+	static const ImageDecoderBackend* FindBackend(const uint8_t* Data, size_t Size);
+
+	// Box filtered RGBA8 chain down to 1x1 or MaxLevels levels, level 0 is Pixels itself
+	static std::vector<std::vector<uint8_t>> BuildMipChain(std::vector<uint8_t> Pixels, uint32_t Width, uint32_t Height, uint32_t MaxLevels = UINT32_MAX);
+
+	// CPU only: decodes every file in Directory with each backend that accepts it, on one thread and on
+	// the whole pool, and prints the throughput. Files are read up front so disk speed does not count
+	static void RunBenchmark(const std::string& Directory, JobSystem& Jobs, std::ostream& Out);
+
+private:
+	void Decode(const std::string& File, VkFormat Format, DecodedTexture& Out);
+
+	JobSystem* Jobs = nullptr;
+	UploadContext* Uploader = nullptr;
+	TextureImageAllocator AllocateImage;
+};
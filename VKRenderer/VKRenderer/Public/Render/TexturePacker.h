@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+#include <glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class JobSystem;
+class UploadContext;
+class ResidencyManager;
+class DeferredDeletionQueue;
+
+struct TexturePackSettings
+{
+	// Textures larger than this on either side are left alone and keep their own image
+	uint32_t MaxPackedSize = 256;
+	// Same sized power of two textures of one format go into an array (one layer each, no padding) once
+	// there are this many of them, the rest share atlas pages
+	uint32_t MinArrayLayers = 4;
+	// Side of an atlas page. Pages of one format are the layers of one image
+	uint32_t AtlasPageSize = 2048;
+	// Levels of an atlas page. Rectangles are aligned to 1 << (AtlasMips - 1) and surrounded by as many
+	// guard texels, so the box filter never mixes neighbours and every level keeps a texel of guard
+	uint32_t AtlasMips = 4;
+	uint32_t MaxLayers = 256;
+};
+
+struct TexturePackInput
+{
+	std::string Name;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	VkFormat Format = VK_FORMAT_R8G8B8A8_SRGB;   // any 4 byte per texel format, only equal formats are packed together
+	std::vector<uint8_t> Pixels;
+};
+
+// Remap of one packed texture, laid out for a std430 buffer (Shaders/PackedTexture.glsl): the texture's
+// UV in [0, 1] maps to UV * ScaleBias.xy + ScaleBias.zw on layer Layer of set Set
+struct PackedTextureRegion
+{
+	glm::vec4 ScaleBias = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	uint32_t Layer = 0;
+	uint32_t Set = UINT32_MAX;   // UINT32_MAX when the texture was not packed
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+};
+
+// One 2D array image worth of texels
+struct PackedTextureSet
+{
+	VkFormat Format = VK_FORMAT_R8G8B8A8_SRGB;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t Layers = 0;
+	uint32_t MipCount = 0;
+	bool bAtlas = false;
+	// Per level, every layer of the level back to back
+	std::vector<std::vector<uint8_t>> Levels;
+};
+
+struct TexturePack
+{
+	std::vector<PackedTextureSet> Sets;
+	// Both in input order
+	std::vector<std::string> Names;
+	std::vector<PackedTextureRegion> Regions;
+
+	// Index into Regions, UINT32_MAX if there is no texture of that name
+	uint32_t Find(const std::string& Name) const;
+};
+
+/**
+ * Merges small textures into a few 2D array images so they share one image, one view and one
+ * descriptor instead of one each. Same sized power of two textures become layers of an array, which
+ * keeps repeat addressing and the full mip chain; everything else is shelf packed into atlas pages with
+ * mip safe padding. The result is either uploaded right away with PackedTextureArray or written to a
+ * file offline (VKRenderer --pack-textures) and loaded at startup without decoding anything.
+ */
+class TexturePacker
+{
+public:
+	// Jobs is optional and spreads the padding and mip building over the pool
+	static TexturePack Pack(const std::vector<TexturePackInput>& Inputs, const TexturePackSettings& Settings = TexturePackSettings(), JobSystem* Jobs = nullptr);
+
+	// Decodes every image file in Directory with the TextureDecoder backends, named by file name
+	static std::vector<TexturePackInput> LoadDirectory(const std::string& Directory, VkFormat Format = VK_FORMAT_R8G8B8A8_SRGB);
+
+	static void Save(const TexturePack& Pack, const std::string& File);
+	static TexturePack Load(const std::string& File);
+};
+
+/**
+ * The images of a TexturePack on the GPU, with the remap table in a storage buffer. Bind the view of a
+ * set as a sampler2DArray and the remap buffer once, then draws select their texture by region index.
+ */
+class PackedTextureArray
+{
+public:
+	// Copies are recorded on the uploader, the images are in SHADER_READ_ONLY_OPTIMAL once it has been flushed
+	void Init(VkDevice InDevice, ResidencyManager* InResidency, UploadContext* InUploader, DeferredDeletionQueue* InDeletionQueue, const TexturePack& Pack);
+
+	void Destroy();
+
+	uint32_t GetSetCount() const { return static_cast<uint32_t>(Sets.size()); }
+	VkImageView GetView(uint32_t Set) const { return Sets[Set].View; }
+	VkBuffer GetRemapBuffer() const { return RemapBuffer; }
+	VkDeviceSize GetRemapSize() const { return RemapSize; }
+
+private:
+	struct SetImage
+	{
+		VkImage Image = VK_NULL_HANDLE;
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VkImageView View = VK_NULL_HANDLE;
+	};
+
+	VkDevice Device = VK_NULL_HANDLE;
+	ResidencyManager* Residency = nullptr;
+	UploadContext* Uploader = nullptr;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+
+	std::vector<SetImage> Sets;
+	VkBuffer RemapBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory RemapMemory = VK_NULL_HANDLE;
+	VkDeviceSize RemapSize = 0;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "GpuTimeline.h"
+
+#include <vulkan/vulkan_core.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+class DeferredDeletionQueue;
+
+// Staging space handed to a producer that writes it directly (decoding straight into mapped memory)
+struct StagingReservation
+{
+	uint8_t* Data = nullptr;   // mapped, write only
+	VkDeviceSize Size = 0;
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VkDeviceSize Offset = 0;
+};
+
+struct ImageRegionUpload
+{
+	StagingReservation Staging;   // tightly packed texels of the region
+	VkOffset3D Offset = { 0, 0, 0 };
+	VkExtent3D Extent = { 0, 0, 1 };
+	uint32_t MipLevel = 0;
+	uint32_t ArrayLayer = 0;
+};
+
+struct UploadBudget
+{
+	// A batch is submitted once it references this much staging data...
+	VkDeviceSize MaxBatchBytes = 32ull * 1024 * 1024;
+	// ...or once its first command is this old when Tick() is called
+	std::chrono::microseconds MaxBatchAge = std::chrono::milliseconds(4);
+	// Size of a pooled staging chunk, larger uploads get a dedicated buffer
+	VkDeviceSize ChunkSize = 16ull * 1024 * 1024;
+	// Idle chunks kept for reuse, any more are released
+	uint32_t MaxPooledChunks = 4;
+};
+
+/**
+ * Batches buffer/image uploads and layout transitions into one command buffer per batch and submits
+ * the batch with a single timeline signal, instead of one submit and one queue idle per resource.
+ * Source data is copied into persistently mapped staging chunks that are recycled once the batch that
+ * read them has completed. Work recorded here is only visible to the GPU after Flush(); submissions
+ * to the same queue after the flush are ordered behind it, other queues wait on the returned point.
+ */
+class UploadContext
+{
+public:
+	void Init(VkDevice InDevice, VkPhysicalDevice InPhysicalDevice, VkQueue InQueue, uint32_t InQueueFamily, QueueType InQueueType,
+		GpuTimeline* InTimeline, DeferredDeletionQueue* InDeletionQueue, const UploadBudget& InBudget = UploadBudget());
+
+	// Device must be idle
+	void Destroy();
+
+	void UploadBuffer(VkBuffer Dst, VkDeviceSize DstOffset, const void* Data, VkDeviceSize Size);
+
+	// Uploads one subresource, the image goes UNDEFINED -> TRANSFER_DST -> FinalLayout (previous contents are discarded)
+	void UploadImage(VkImage Dst, VkFormat Format, VkExtent3D Extent, const void* Data, VkDeviceSize Size, VkImageLayout FinalLayout,
+		uint32_t MipLevel = 0, uint32_t ArrayLayer = 0);
+
+	// Reserves staging space to fill without holding the lock. The chunk is kept out of reuse, even across
+	// flushes, until the reservation is committed or cancelled
+	StagingReservation ReserveStaging(VkDeviceSize Size);
+
+	// Records the copy out of a filled reservation, same transitions as UploadImage()
+	void CommitImage(const StagingReservation& Staging, VkImage Dst, VkFormat Format, VkExtent3D Extent, VkImageLayout FinalLayout,
+		uint32_t MipLevel = 0, uint32_t ArrayLayer = 0);
+
+	// Copies filled reservations into parts of an image that is in Layout and stays in it, the rest of the
+	// image keeps its contents. One barrier pair for all regions
+	void CommitImageRegions(VkImage Dst, VkFormat Format, VkImageLayout Layout, const std::vector<ImageRegionUpload>& Regions);
+
+	// Copies MipCount levels starting at SrcMip of Src (in SrcLayout, left there) to the levels starting at DstMip
+	// of Dst, which go UNDEFINED -> TRANSFER_DST -> FinalLayout. Extent is the size of Dst's level DstMip
+	void CopyImageMips(VkImage Src, uint32_t SrcMip, VkImageLayout SrcLayout, VkImage Dst, uint32_t DstMip, VkImageLayout FinalLayout,
+		VkFormat Format, VkExtent3D Extent, uint32_t MipCount);
+
+	// Releases a reservation that will not be committed, its space is reclaimed with the chunk
+	void CancelStaging(const StagingReservation& Staging);
+
+	void CopyBuffer(VkBuffer Src, VkBuffer Dst, VkDeviceSize Size);
+
+	void TransitionImage(VkImage Image, VkFormat Format, VkImageLayout OldLayout, VkImageLayout NewLayout);
+
+	// Submits the open batch (if any), returns the point at which everything recorded so far is complete
+	GpuSyncPoint Flush();
+
+	// Applies the time budget, call once per frame
+	void Tick();
+
+	uint32_t GetSubmitCount() const { return SubmitCount; }
+
+private:
+	struct StagingChunk
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		uint8_t* Mapped = nullptr;
+		VkDeviceSize Size = 0;
+		VkDeviceSize Used = 0;
+		GpuSyncPoint LastUse;
+		uint32_t Reservations = 0;   // outstanding ReserveStaging() regions, the chunk stays in the open batch meanwhile
+		bool bDedicated = false;
+	};
+
+	struct SubmittedCommandBuffer
+	{
+		VkCommandBuffer CommandBuffer;
+		GpuSyncPoint LastUse;
+	};
+
+	struct StagingAllocation
+	{
+		VkBuffer Buffer;
+		VkDeviceSize Offset;
+		uint8_t* Mapped;
+	};
+
+	StagingAllocation AllocateStaging(VkDeviceSize Size);
+	void RecordImageCopy(VkBuffer Src, VkDeviceSize SrcOffset, VkImage Dst, VkFormat Format, VkExtent3D Extent, VkImageLayout FinalLayout,
+		uint32_t MipLevel, uint32_t ArrayLayer);
+	void ReleaseReservation(VkBuffer Buffer);
+	StagingChunk CreateChunk(VkDeviceSize Size, bool bDedicated);
+	VkCommandBuffer GetCommandBuffer();
+	void RecordTransition(VkCommandBuffer CommandBuffer, VkImage Image, VkImageLayout OldLayout, VkImageLayout NewLayout, const VkImageSubresourceRange& Range);
+	GpuSyncPoint FlushLocked();
+	void FlushIfOverBudget();
+
+	VkDevice Device = VK_NULL_HANDLE;
+	VkPhysicalDevice PhysicDevice = VK_NULL_HANDLE;
+	VkQueue Queue = VK_NULL_HANDLE;
+	QueueType Type = QueueType::Graphics;
+	GpuTimeline* Timeline = nullptr;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+	UploadBudget Budget;
+	VkDeviceSize CopyAlignment = 16;
+
+	std::mutex Mutex;
+	VkCommandPool CommandPool = VK_NULL_HANDLE;
+
+	// Open batch
+	VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+	std::vector<StagingChunk> BatchChunks;
+	VkDeviceSize BatchBytes = 0;
+	std::chrono::steady_clock::time_point BatchStart;
+
+	// Chunks owned by submitted batches, reusable once their LastUse is complete
+	std::vector<StagingChunk> FreeChunks;
+	// Same for the command buffers of submitted batches
+	std::vector<SubmittedCommandBuffer> SubmittedCommandBuffers;
+
+	GpuSyncPoint LastFlush;
+	uint32_t SubmitCount = 0;
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "UploadContext.h"
+#include "MemoryPlacement.h"
+#include "SamplerCache.h"
+#include "../Core/JobSystem.h"
+
+#include <vulkan/vulkan_core.h>
+#include <glm.hpp>
+#include <vector>
+#include <list>
+#include <unordered_set>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+class DeferredDeletionQueue;
+
+// Texels of a page at its own mip level, excluding the border
+static const uint32_t VirtualPageSize = 128;
+// Texels copied from the neighbouring pages on each side, so bilinear and anisotropic taps stay inside the page
+static const uint32_t VirtualPageBorder = 4;
+// Side of a page as stored in the atlas
+static const uint32_t PhysicalPageSize = VirtualPageSize + 2 * VirtualPageBorder;
+
+// Feedback entries written by the shader (Shaders/VirtualTexture.glsl): [31..28] mip, [27..14] page y, [13..0] page x
+namespace VirtualPageId
+{
+	static const uint32_t Invalid = 0xFFFFFFFFu;
+
+	inline uint32_t Make(uint32_t Mip, uint32_t X, uint32_t Y) { return (Mip << 28) | (Y << 14) | X; }
+	inline uint32_t GetMip(uint32_t Id) { return Id >> 28; }
+	inline uint32_t GetY(uint32_t Id) { return (Id >> 14) & 0x3FFFu; }
+	inline uint32_t GetX(uint32_t Id) { return Id & 0x3FFFu; }
+}
+
+// Writes PhysicalPageSize x PhysicalPageSize RGBA8 texels of one page, border included, and returns false
+// if the page does not exist. Runs on the job system, OutTexels is write only staging memory
+typedef std::function<bool(uint32_t Mip, uint32_t PageX, uint32_t PageY, uint8_t* OutTexels)> VirtualPageLoader;
+
+struct VirtualTextureDesc
+{
+	// Square, a power of two multiple of VirtualPageSize
+	uint32_t Size = 0;
+	// Any 4 byte per texel format the loader writes
+	VkFormat Format = VK_FORMAT_R8G8B8A8_SRGB;
+	// The physical cache is AtlasPages x AtlasPages pages, at most 256
+	uint32_t AtlasPages = 32;
+	// Page loads running on the job system at once
+	uint32_t MaxLoadsInFlight = 16;
+	// One feedback entry per (1 << FeedbackShift)^2 pixels, FeedbackWidth x FeedbackHeight entries in total
+	uint32_t FeedbackWidth = 240;
+	uint32_t FeedbackHeight = 135;
+	uint32_t FeedbackShift = 3;
+	VirtualPageLoader LoadPage;
+};
+
+// Layout of the VirtualTextureParams uniform block in Shaders/VirtualTexture.glsl
+struct VirtualTextureShaderParams
+{
+	glm::vec4 VirtualSize;    // width, height, 1 / width, 1 / height in texels at mip 0
+	glm::vec4 Atlas;          // page content, border and physical page as fractions of the atlas, mip count
+	glm::uvec4 Feedback;      // width, height, shift, unused
+};
+
+struct VirtualTextureStats
+{
+	uint32_t Requested = 0;        // distinct pages in the last feedback
+	uint32_t Resident = 0;
+	uint32_t Loading = 0;
+	uint32_t Loaded = 0;           // committed by the last Update()
+	uint32_t Evicted = 0;          // by the last Update()
+	uint32_t Failed = 0;           // pages the loader could not produce, never retried
+	uint32_t PageTableTexels = 0;  // page table entries uploaded by the last Update()
+};
+
+/**
+ * Streams a texture far larger than video memory through a fixed atlas of resident pages.
+ * The shader looks up the page table (one RGBA8 texel per virtual page and mip: atlas slot, mip of the
+ * page actually resident there, valid) and samples the atlas; pages that are not resident point at
+ * their finest resident ancestor, and the single page of the coarsest mip is pinned so every lookup
+ * hits something. While sampling the shader writes the page it wanted into a feedback buffer, which
+ * Update() reads back a few frames later, loads the missing pages on the job system straight into
+ * staging memory and copies them into slots freed in least recently used order.
+ *
+ * Sparse residency (binding memory to a real VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT image) would drop the
+ * indirection, but it is optional, slow to bind on several drivers and absent on most mobile parts;
+ * the atlas path works everywhere.
+ */
+class VirtualTexture
+{
+public:
+	// Loads the coarsest page before returning. FramesInFlight feedback buffers are created
+	// The samplers come from InSamplers and stay owned by it
+	void Init(VkDevice InDevice, const MemoryPlacementPolicy* InMemoryPolicy, SamplerCache* InSamplers, JobSystem* InJobs,
+		UploadContext* InUploader, DeferredDeletionQueue* InDeletionQueue, const VirtualTextureDesc& InDesc, uint32_t FramesInFlight);
+
+	void Destroy();
+
+	// Call once per frame after the previous submission of FrameIndex has completed and before recording it
+	// again: reads its feedback, starts loads for missing pages, commits finished ones and uploads the
+	// changed part of the page table. The copies go into the uploader's open batch
+	void Update(uint32_t FrameIndex);
+
+	// Record after the last pass that samples the texture, makes the feedback writes visible to Update()
+	void RecordFeedbackBarrier(VkCommandBuffer CommandBuffer) const;
+
+	// Bindings for Shaders/VirtualTexture.glsl: page table (usampler2D), atlas (sampler2D), feedback (storage
+	// buffer of the frame), params (uniform buffer). The images are in SHADER_READ_ONLY_OPTIMAL
+	VkImageView GetPageTableView() const { return PageTableView; }
+	VkSampler GetPageTableSampler() const { return PageTableSampler; }
+	VkImageView GetAtlasView() const { return AtlasView; }
+	VkSampler GetAtlasSampler() const { return AtlasSampler; }
+	VkBuffer GetFeedbackBuffer(uint32_t FrameIndex) const { return Feedback[FrameIndex].Buffer; }
+	VkDeviceSize GetFeedbackSize() const;
+	VkBuffer GetParamsBuffer() const { return ParamsBuffer; }
+
+	uint32_t GetMipCount() const { return MipCount; }
+	const VirtualTextureStats& GetStats() const { return Stats; }
+
+	// Pages cut on the fly from an RGBA8 image of Size x Size held in memory, mips built up front with a box filter.
+	// Borders wrap, matching the repeat addressing of the shader
+	static VirtualPageLoader CreateImageSource(std::vector<uint8_t> Pixels, uint32_t Size);
+
+	// Pages pre-cut offline with their borders, Directory/<mip>/<x>_<y><Extension>, decoded with the
+	// TextureDecoder backends. This is the streaming path for textures that do not fit in memory
+	static VirtualPageLoader CreateTileSource(const std::string& Directory, const std::string& Extension = ".png");
+
+private:
+	static const uint32_t NoSlot = UINT32_MAX;
+
+	struct PhysicalSlot
+	{
+		uint32_t Page = VirtualPageId::Invalid;
+		uint64_t LastUsed = 0;
+		std::list<uint32_t>::iterator LruPosition;
+	};
+
+	struct LoadedPage
+	{
+		uint32_t Page;
+		StagingReservation Staging;
+		bool bLoaded;
+	};
+
+	struct FeedbackBuffer
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		uint32_t* Mapped = nullptr;
+		bool bCoherent = false;
+	};
+
+	uint32_t GetPagesAtMip(uint32_t Mip) const { return PagesAtMip0 >> Mip; }
+	uint32_t GetPageIndex(uint32_t Page) const;
+	bool IsValidPage(uint32_t Page) const;
+
+	void CreateImage(VkFormat Format, uint32_t Extent, uint32_t Mips, VkImage& OutImage, VkDeviceMemory& OutMemory, VkImageView& OutView);
+	VkDeviceMemory AllocateMemory(const VkMemoryRequirements& Requirements, MemoryUsage Usage, VkMemoryPropertyFlags* OutProperties = nullptr);
+
+	void ReadFeedback(uint32_t FrameIndex, std::vector<uint32_t>& OutRequests);
+	void StartLoad(uint32_t Page);
+	void CommitLoadedPages();
+	void Touch(uint32_t Slot);
+	uint32_t AcquireSlot();
+	void UploadPageTable(bool bFull);
+
+	VkDevice Device = VK_NULL_HANDLE;
+	const MemoryPlacementPolicy* MemoryPolicy = nullptr;
+	SamplerCache* Samplers = nullptr;
+	JobSystem* Jobs = nullptr;
+	UploadContext* Uploader = nullptr;
+	DeferredDeletionQueue* DeletionQueue = nullptr;
+	VirtualTextureDesc Desc;
+
+	uint32_t PagesAtMip0 = 0;
+	uint32_t MipCount = 0;
+	std::vector<uint32_t> MipOffsets;   // first entry of each mip in Residency and PageTableData
+
+	VkImage PageTable = VK_NULL_HANDLE;
+	VkDeviceMemory PageTableMemory = VK_NULL_HANDLE;
+	VkImageView PageTableView = VK_NULL_HANDLE;
+	VkSampler PageTableSampler = VK_NULL_HANDLE;
+
+	VkImage Atlas = VK_NULL_HANDLE;
+	VkDeviceMemory AtlasMemory = VK_NULL_HANDLE;
+	VkImageView AtlasView = VK_NULL_HANDLE;
+	VkSampler AtlasSampler = VK_NULL_HANDLE;
+
+	VkBuffer ParamsBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory ParamsMemory = VK_NULL_HANDLE;
+
+	std::vector<FeedbackBuffer> Feedback;
+
+	// Slot of every virtual page, NoSlot when not resident, and the page table texels as last uploaded
+	std::vector<uint32_t> Residency;
+	std::vector<uint32_t> PageTableData;
+	bool bPageTableDirty = false;
+
+	// Slot 0 holds the pinned coarsest page and is not in the list, the rest are ordered most recently used first
+	std::vector<PhysicalSlot> Slots;
+	std::list<uint32_t> Lru;
+	uint64_t FrameNumber = 0;
+
+	std::unordered_set<uint32_t> Loading;
+	std::unordered_set<uint32_t> FailedPages;
+	JobCounter LoadJobs;
+	std::mutex CompletedMutex;
+	std::vector<LoadedPage> Completed;
+
+	VirtualTextureStats Stats;
+};
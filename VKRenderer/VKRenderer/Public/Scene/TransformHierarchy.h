@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm.hpp>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+class JobSystem;
+
+typedef uint32_t SceneNodeId;
+const SceneNodeId InvalidSceneNode = UINT32_MAX;
+
+/**
+ * Parent/child transforms for the whole scene, stored flattened and breadth-first: every depth level
+ * is one contiguous range, parents always come before their children and the children of consecutive
+ * nodes are contiguous too. A dirty subtree is therefore one range per level, Update() walks only
+ * those ranges over parallel arrays (structure of arrays, no pointer chasing), and all nodes of a range
+ * can be computed independently of each other. Only nodes whose local transform changed, and their
+ * descendants, are visited at all; the cost of an update does not depend on the size of the scene.
+ *
+ * Node ids are stable handles, the storage order is rebuilt lazily after nodes are added or removed.
+ */
+class TransformHierarchy
+{
+public:
+	// Wide levels are split into jobs, without a job system Update() runs on the calling thread
+	void SetJobSystem(JobSystem* InJobs) { Jobs = InJobs; }
+
+	SceneNodeId AddNode(SceneNodeId Parent = InvalidSceneNode, const glm::mat4& Local = glm::mat4(1.f));
+
+	// Removes the node and everything below it
+	void RemoveNode(SceneNodeId Node);
+
+	void SetLocal(SceneNodeId Node, const glm::mat4& Local);
+
+	const glm::mat4& GetLocal(SceneNodeId Node) const;
+
+	// Valid after Update()
+	const glm::mat4& GetWorld(SceneNodeId Node) const;
+
+	// Recomputes the world matrices of dirty subtrees, levels large enough are split across jobs
+	void Update();
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(Parents.size()); }
+	uint32_t GetLevelCount() const { return LevelStarts.empty() ? 0 : static_cast<uint32_t>(LevelStarts.size() - 1); }
+
+	// Nodes whose world matrix was recomputed by the last Update()
+	uint32_t GetLastUpdatedCount() const { return LastUpdatedCount; }
+
+	// CPU only: builds a hierarchy of NodeCount nodes and prints how long a fully dirty Update() and a
+	// single leaf Update() take, on the calling thread and with the job system
+	static void RunBenchmark(uint32_t NodeCount, JobSystem& Jobs, std::ostream& Out);
+
+private:
+	static const uint32_t NoParent = UINT32_MAX;
+
+	void RebuildOrder();
+	void UpdateRange(uint32_t Begin, uint32_t End);
+
+	struct NodeRange
+	{
+		uint32_t Begin;
+		uint32_t End;
+	};
+
+	// Indexed by storage position, breadth-first once RebuildOrder() has run
+	std::vector<uint32_t> Parents;          // storage index of the parent, NoParent for roots
+	std::vector<glm::mat4> LocalMatrices;
+	std::vector<glm::mat4> WorldMatrices;
+	std::vector<uint8_t> DirtyFlags;        // local changed since the last Update()
+	std::vector<SceneNodeId> NodeIds;
+	std::vector<uint32_t> ChildBegins;      // storage range of the children
+	std::vector<uint32_t> ChildEnds;
+
+	// Storage indices with DirtyFlags set, and the ranges Update() visits per level (kept for their capacity)
+	std::vector<uint32_t> DirtyNodes;
+	std::vector<std::vector<NodeRange>> LevelRanges;
+
+	// Storage index for every handle, UINT32_MAX for free handles
+	std::vector<uint32_t> NodeIndices;
+	std::vector<SceneNodeId> FreeNodeIds;
+
+	// First storage index of each depth level, plus the end
+	std::vector<uint32_t> LevelStarts;
+
+	JobSystem* Jobs = nullptr;
+	bool bOrderDirty = false;
+	uint32_t LastUpdatedCount = 0;
+};
@@ -0,0 +1,69 @@
+// Cascaded shadow lookup, see CascadedShadows.h. Include with GL_GOOGLE_include_directive after
+// optionally defining CSM_SET and CSM_BINDING; the shadow map takes binding CSM_BINDING and the
+// parameters CSM_BINDING + 1.
+
+#ifndef CSM_SET
+#define CSM_SET 0
+#endif
+#ifndef CSM_BINDING
+#define CSM_BINDING 6
+#endif
+
+// One layer per cascade, compares with GREATER_OR_EQUAL (reverse-Z), 1 is lit
+layout(set = CSM_SET, binding = CSM_BINDING) uniform sampler2DArrayShadow ShadowMap;
+
+layout(set = CSM_SET, binding = CSM_BINDING + 1) uniform ShadowParamsBlock
+{
+	mat4 ViewProj[4];
+	mat4 View;
+	vec4 SplitFar;         // view depth each cascade ends at
+	vec4 NormalOffset;     // world units per cascade
+	vec4 LightDirection;   // direction the light travels, w is the cascade count (0 without shadows)
+	vec4 LightColor;
+	vec4 Fade;             // view depth the fade starts at, 1 / fade length
+} ShadowParams;
+
+// 0 in shadow, 1 lit
+float SampleCascadedShadow(vec3 WorldPos, vec3 Normal)
+{
+	uint CascadeCount = uint(ShadowParams.LightDirection.w);
+	if (CascadeCount == 0u)
+		return 1.0;
+
+	float ViewDepth = -(ShadowParams.View * vec4(WorldPos, 1.0)).z;
+	uint Cascade = 0u;
+	while (Cascade < CascadeCount && ViewDepth > ShadowParams.SplitFar[Cascade])
+		++Cascade;
+	if (Cascade == CascadeCount)
+		return 1.0;
+
+	// Offsetting along the normal scales with the cascade's texel size, which a constant bias can not
+	vec3 OffsetPos = WorldPos + Normal * ShadowParams.NormalOffset[Cascade];
+	vec4 ShadowPos = ShadowParams.ViewProj[Cascade] * vec4(OffsetPos, 1.0);
+	vec2 ShadowUV = ShadowPos.xy * 0.5 + 0.5;
+
+	// 3x3 PCF, bilinear compares when the format can be filtered
+	vec2 TexelSize = 1.0 / vec2(textureSize(ShadowMap, 0).xy);
+	float Lit = 0.0;
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			Lit += texture(ShadowMap, vec4(ShadowUV + vec2(x, y) * TexelSize, float(Cascade), ShadowPos.z));
+		}
+	}
+	Lit /= 9.0;
+
+	float Fade = clamp((ViewDepth - ShadowParams.Fade.x) * ShadowParams.Fade.y, 0.0, 1.0);
+	return mix(Lit, 1.0, Fade);
+}
+
+vec3 ShadeDirectionalLight(vec3 WorldPos, vec3 Normal, vec3 Albedo)
+{
+	vec3 L = -normalize(ShadowParams.LightDirection.xyz);
+	float NoL = max(dot(Normal, L), 0.0);
+	if (NoL <= 0.0)
+		return vec3(0.0);
+
+	return Albedo * ShadowParams.LightColor.rgb * NoL * SampleCascadedShadow(WorldPos, Normal);
+}
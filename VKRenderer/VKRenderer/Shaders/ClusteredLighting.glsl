@@ -0,0 +1,156 @@
+// Clustered light lists, see ClusteredLighting.h. Include with GL_GOOGLE_include_directive after
+// optionally defining CL_SET and CL_BINDING; the params, lights, cluster list and light indices take
+// bindings CL_BINDING to CL_BINDING + 3. The binning shader defines CL_COMPUTE, which makes the lists
+// writable and adds the counter at CL_BINDING + 4.
+
+#ifndef CL_SET
+#define CL_SET 0
+#endif
+#ifndef CL_BINDING
+#define CL_BINDING 2
+#endif
+
+#ifdef CL_COMPUTE
+#define CL_LIST_ACCESS
+#else
+#define CL_LIST_ACCESS readonly
+#endif
+
+#define CL_LIGHT_POINT 0u
+#define CL_LIGHT_SPOT 1u
+
+struct ClusterLightData
+{
+	vec3 Position;
+	float Range;
+	vec3 Color;
+	float Intensity;
+	vec3 Direction;
+	float CosOuterAngle;
+	float CosInnerAngle;
+	uint Type;
+	uvec2 Padding;
+};
+
+layout(set = CL_SET, binding = CL_BINDING) uniform ClusterParamsBlock
+{
+	mat4 View;
+	vec4 CameraPosition;   // world space
+	vec4 ScreenSize;       // width, height, 1 / width, 1 / height
+	vec4 Projection;       // view x and y per unit of depth at the NDC edge, near, far
+	vec4 SliceScaleBias;   // slice = log2(view depth) * x + y
+	vec4 Ambient;
+	uvec4 Grid;            // tiles x, tiles y, slices, light count
+	uvec4 Limits;          // max light indices
+} ClusterParams;
+
+layout(set = CL_SET, binding = CL_BINDING + 1) readonly buffer ClusterLightBlock
+{
+	ClusterLightData Lights[];
+} ClusterLights;
+
+// Offset and count of each cluster's run in ClusterLightIndices
+layout(set = CL_SET, binding = CL_BINDING + 2) CL_LIST_ACCESS buffer ClusterListBlock
+{
+	uvec2 Ranges[];
+} ClusterList;
+
+layout(set = CL_SET, binding = CL_BINDING + 3) CL_LIST_ACCESS buffer ClusterIndexBlock
+{
+	uint Indices[];
+} ClusterLightIndices;
+
+#ifdef CL_COMPUTE
+
+layout(set = CL_SET, binding = CL_BINDING + 4) buffer ClusterCounterBlock
+{
+	uint Next;
+} ClusterCounter;
+
+// Same as ClusteredLighting::GetClusterBounds()
+void GetClusterBounds(uint Cluster, out vec3 OutMin, out vec3 OutMax)
+{
+	uvec4 Grid = ClusterParams.Grid;
+	uvec3 Id = uvec3(Cluster % Grid.x, (Cluster / Grid.x) % Grid.y, Cluster / (Grid.x * Grid.y));
+
+	float NearZ = ClusterParams.Projection.z;
+	float FarZ = ClusterParams.Projection.w;
+	vec2 Depths = NearZ * pow(vec2(FarZ / NearZ), vec2(Id.z, Id.z + 1u) / float(Grid.z));
+	vec4 Ndc = -1.0 + 2.0 * vec4(Id.xy, Id.xy + 1u) / vec4(Grid.xy, Grid.xy);
+
+	OutMin = vec3(3.402823e38);
+	OutMax = vec3(-3.402823e38);
+	for (int d = 0; d < 2; ++d)
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			vec2 Edge = vec2((c & 1) == 0 ? Ndc.x : Ndc.z, (c & 2) == 0 ? Ndc.y : Ndc.w);
+			vec3 Corner = vec3(Edge * vec2(1.0, -1.0) * Depths[d] * ClusterParams.Projection.xy, -Depths[d]);
+			OutMin = min(OutMin, Corner);
+			OutMax = max(OutMax, Corner);
+		}
+	}
+}
+
+// Same as ClusteredLighting::IntersectsCluster(), CosOuterAngle below -1 marks a point light
+bool IntersectsCluster(vec4 Sphere, vec4 Cone, vec3 Min, vec3 Max)
+{
+	vec3 Closest = clamp(Sphere.xyz, Min, Max) - Sphere.xyz;
+	if (dot(Closest, Closest) > Sphere.w * Sphere.w)
+		return false;
+	if (Cone.w < -1.5)
+		return true;
+
+	vec3 Center = (Min + Max) * 0.5;
+	float Radius = length(Max - Min) * 0.5;
+	vec3 ToCenter = Center - Sphere.xyz;
+	float AlongAxis = dot(ToCenter, Cone.xyz);
+	float FromAxis = sqrt(max(dot(ToCenter, ToCenter) - AlongAxis * AlongAxis, 0.0));
+	float SinOuterAngle = sqrt(max(1.0 - Cone.w * Cone.w, 0.0));
+
+	bool bOutsideAngle = Cone.w * FromAxis - AlongAxis * SinOuterAngle > Radius;
+	bool bPastRange = AlongAxis > Radius + Sphere.w;
+	bool bBehind = Cone.w >= 0.0 && AlongAxis < -Radius;
+	return !bOutsideAngle && !bPastRange && !bBehind;
+}
+
+#else
+
+uint GetClusterIndex(vec3 WorldPos, vec2 FragCoord)
+{
+	uvec4 Grid = ClusterParams.Grid;
+	float Depth = -(ClusterParams.View * vec4(WorldPos, 1.0)).z;
+	float Slice = floor(log2(max(Depth, ClusterParams.Projection.z)) * ClusterParams.SliceScaleBias.x + ClusterParams.SliceScaleBias.y);
+	uvec2 Tile = min(uvec2(FragCoord * vec2(Grid.xy) * ClusterParams.ScreenSize.zw), Grid.xy - 1u);
+	return Tile.x + Tile.y * Grid.x + uint(clamp(Slice, 0.0, float(Grid.z - 1u))) * Grid.x * Grid.y;
+}
+
+// Lambert with a windowed inverse square falloff that reaches zero at the light's range
+vec3 ShadeClusteredLights(vec3 WorldPos, vec3 Normal, vec3 Albedo, vec2 FragCoord)
+{
+	vec3 Result = ClusterParams.Ambient.rgb * Albedo;
+	float Depth = -(ClusterParams.View * vec4(WorldPos, 1.0)).z;
+	if (Depth >= ClusterParams.Projection.w)
+		return Result;
+
+	uvec2 Range = ClusterList.Ranges[GetClusterIndex(WorldPos, FragCoord)];
+	for (uint i = 0u; i < Range.y; ++i)
+	{
+		ClusterLightData Light = ClusterLights.Lights[ClusterLightIndices.Indices[Range.x + i]];
+
+		vec3 ToLight = Light.Position - WorldPos;
+		float DistanceSq = dot(ToLight, ToLight);
+		vec3 L = ToLight * inversesqrt(max(DistanceSq, 1e-8));
+
+		float Ratio = DistanceSq / (Light.Range * Light.Range);
+		float Window = clamp(1.0 - Ratio * Ratio, 0.0, 1.0);
+		float Attenuation = Window * Window / max(DistanceSq, 0.01);
+		if (Light.Type == CL_LIGHT_SPOT)
+			Attenuation *= smoothstep(Light.CosOuterAngle, Light.CosInnerAngle, dot(-L, Light.Direction));
+
+		Result += Albedo * Light.Color * (Light.Intensity * Attenuation * max(dot(Normal, L), 0.0));
+	}
+	return Result;
+}
+
+#endif
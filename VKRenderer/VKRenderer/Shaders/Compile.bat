@@ -1,2 +1,5 @@
 G:/Vulkan/1.2.141.2/Bin32/glslc.exe shader.vert -o vert.spv
 G:/Vulkan/1.2.141.2/Bin32/glslc.exe shader.frag -o frag.spv
+G:/Vulkan/1.2.141.2/Bin32/glslc.exe -DVIRTUAL_TEXTURE shader.frag -o frag_vt.spv
+G:/Vulkan/1.2.141.2/Bin32/glslc.exe ClusterLights.comp -o clusterlights.spv
+G:/Vulkan/1.2.141.2/Bin32/glslc.exe shadow.vert -o shadowvert.spv
\ No newline at end of file
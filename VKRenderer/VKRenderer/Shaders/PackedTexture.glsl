@@ -0,0 +1,36 @@
+// Packed texture lookup for fragment shaders, see TexturePacker.h. Include with
+// GL_GOOGLE_include_directive after optionally defining PT_SET and PT_BINDING; the set's array view and
+// the remap table take bindings PT_BINDING and PT_BINDING + 1.
+
+#ifndef PT_SET
+#define PT_SET 0
+#endif
+#ifndef PT_BINDING
+#define PT_BINDING 2
+#endif
+
+struct PackedTextureRegion
+{
+	vec4 ScaleBias;   // UV * xy + zw
+	uint Layer;
+	uint Set;
+	uint Width;
+	uint Height;
+};
+
+layout(set = PT_SET, binding = PT_BINDING) uniform sampler2DArray PackedTextures;
+
+layout(set = PT_SET, binding = PT_BINDING + 1) readonly buffer PackedTextureRemap
+{
+	PackedTextureRegion Regions[];
+} PackedRemap;
+
+// Array layers cover the whole layer and repeat through the sampler, atlas rectangles clamp at their
+// guard band. Gradients come from the unclamped UV so the mip does not jump at the edges
+vec4 SamplePackedTexture(uint Region, vec2 UV)
+{
+	PackedTextureRegion Entry = PackedRemap.Regions[Region];
+	vec2 Local = Entry.ScaleBias.xy == vec2(1.0) ? UV : clamp(UV, 0.0, 1.0);
+	vec2 PackedUV = Local * Entry.ScaleBias.xy + Entry.ScaleBias.zw;
+	return textureGrad(PackedTextures, vec3(PackedUV, float(Entry.Layer)), dFdx(UV) * Entry.ScaleBias.xy, dFdy(UV) * Entry.ScaleBias.xy);
+}
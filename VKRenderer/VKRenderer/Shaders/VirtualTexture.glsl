@@ -0,0 +1,58 @@
+// Virtual texture lookup for fragment shaders, see VirtualTexture.h. Include with
+// GL_GOOGLE_include_directive after optionally defining VT_SET and VT_BINDING; the four resources
+// take bindings VT_BINDING to VT_BINDING + 3.
+
+#ifndef VT_SET
+#define VT_SET 0
+#endif
+#ifndef VT_BINDING
+#define VT_BINDING 2
+#endif
+
+// R, G: atlas slot, B: mip of the resident page, A: valid
+layout(set = VT_SET, binding = VT_BINDING) uniform usampler2D VirtualPageTable;
+layout(set = VT_SET, binding = VT_BINDING + 1) uniform sampler2D VirtualAtlas;
+
+// One entry per block of pixels, mip << 28 | page y << 14 | page x
+layout(set = VT_SET, binding = VT_BINDING + 2) buffer VirtualFeedback
+{
+	uint Requests[];
+} VirtualFeedbackBuffer;
+
+layout(set = VT_SET, binding = VT_BINDING + 3) uniform VirtualTextureParams
+{
+	vec4 VirtualSize;    // width, height, 1 / width, 1 / height in texels at mip 0
+	vec4 Atlas;          // page content, border and physical page as fractions of the atlas, mip count
+	uvec4 Feedback;      // width, height, shift, unused
+} VirtualParams;
+
+float VirtualTextureLod(vec2 UV)
+{
+	vec2 Texels = UV * VirtualParams.VirtualSize.xy;
+	vec2 Dx = dFdx(Texels);
+	vec2 Dy = dFdy(Texels);
+	return max(0.5 * log2(max(dot(Dx, Dx), dot(Dy, Dy))), 0.0);
+}
+
+// Repeat addressing, bilinear within the finest resident mip
+vec4 SampleVirtualTexture(vec2 UV)
+{
+	int MipCount = int(VirtualParams.Atlas.w);
+	int Mip = min(int(VirtualTextureLod(UV)), MipCount - 1);
+	vec2 Wrapped = fract(UV);
+
+	// Every pixel of a block writes the same entry, whichever lands last is the one read back
+	uvec2 Pages = uvec2(textureSize(VirtualPageTable, Mip));
+	uvec2 Page = min(uvec2(Wrapped * vec2(Pages)), Pages - 1u);
+	uvec2 Block = min(uvec2(gl_FragCoord.xy) >> VirtualParams.Feedback.z, VirtualParams.Feedback.xy - 1u);
+	VirtualFeedbackBuffer.Requests[Block.y * VirtualParams.Feedback.x + Block.x] = (uint(Mip) << 28) | (Page.y << 14) | Page.x;
+
+	// Missing pages point at their finest resident ancestor, only the coarsest page can still be missing
+	uvec4 Entry = texelFetch(VirtualPageTable, ivec2(Page), Mip);
+	if (Entry.a == 0u)
+		return vec4(0.0);
+
+	vec2 InPage = fract(Wrapped * vec2(textureSize(VirtualPageTable, int(Entry.b))));
+	vec2 AtlasUV = vec2(Entry.rg) * VirtualParams.Atlas.z + VirtualParams.Atlas.y + InPage * VirtualParams.Atlas.x;
+	return textureLod(VirtualAtlas, AtlasUV, 0.0);
+}
@@ -1,8 +1,19 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#define CL_BINDING 2
+#include "ClusteredLighting.glsl"
+#define CSM_BINDING 6
+#include "CascadedShadows.glsl"
+#ifdef VIRTUAL_TEXTURE
+#define VT_BINDING 8
+#include "VirtualTexture.glsl"
+#endif
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragWorldPos;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
@@ -10,6 +21,18 @@ layout(location = 0) out vec4 outColor;
 
 void main()
 {
-	outColor = texture(texSampler, fragTexCoord);
+#ifdef VIRTUAL_TEXTURE
+	vec4 Albedo = SampleVirtualTexture(fragTexCoord);
+#else
+	vec4 Albedo = texture(texSampler, fragTexCoord);
+#endif
+
+	// No vertex normals yet, the face normal is turned towards the camera so both sides are lit
+	vec3 Normal = normalize(cross(dFdx(fragWorldPos), dFdy(fragWorldPos)));
+	if (dot(Normal, ClusterParams.CameraPosition.xyz - fragWorldPos) < 0.0)
+		Normal = -Normal;
+
+	vec3 Color = ShadeClusteredLights(fragWorldPos, Normal, Albedo.rgb, gl_FragCoord.xy) + ShadeDirectionalLight(fragWorldPos, Normal, Albedo.rgb);
+	outColor = vec4(Color, Albedo.a);
    //outColor = vec4(fragTexCoord, 0.f, 1.0);
 }
\ No newline at end of file
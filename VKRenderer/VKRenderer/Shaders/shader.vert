@@ -2,17 +2,22 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0)uniform UniformBufferObject{
-    mat4 Model;
     mat4 View;
     mat4 Proj;
 }UBO;
 
-layout(location = 0) in vec2 inPosition;
+layout(push_constant) uniform ObjectConstants{
+    mat4 Model;
+    uint MaterialIndex;
+}Object;
+
+layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPos;
 
 //vec2 positions[3] = vec2[](vec2(0.0, -0.5), vec2(0.5, 0.5), vec2(-0.5, 0.5));
 //
@@ -20,8 +25,10 @@ layout(location = 1) out vec2 fragTexCoord;
 
 void main()
 {
-    gl_Position = UBO.Proj * UBO.View * UBO.Model * vec4(inPosition, 0.0, 1.0);
+    vec4 WorldPos = Object.Model * vec4(inPosition, 1.0);
+    gl_Position = UBO.Proj * UBO.View * WorldPos;
     //gl_Position = vec4(inPosition, 0.0f, 1.0f);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragWorldPos = WorldPos.xyz;
 }
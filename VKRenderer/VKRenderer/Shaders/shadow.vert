@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth only, one cascade of CascadedShadows per draw
+layout(binding = 0) uniform ShadowCascadeBlock{
+    mat4 ViewProj;
+}ShadowCascade;
+
+layout(push_constant) uniform ObjectConstants{
+    mat4 Model;
+    uint MaterialIndex;
+}Object;
+
+layout(location = 0) in vec3 inPosition;
+
+void main()
+{
+    gl_Position = ShadowCascade.ViewProj * Object.Model * vec4(inPosition, 1.0);
+}